@@ -0,0 +1,98 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdarg>
+
+/**
+ * @brief Bump allocator over a fixed buffer.
+ *
+ * Allocations are carved linearly out of the buffer and released all at once
+ * with reset(). Used for request-scoped scratch memory (JSON parsing, response
+ * formatting) so long-running devices do not fragment the shared heap.
+ */
+class Arena
+{
+public:
+    Arena(uint8_t *buffer, size_t capacity);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * @brief Allocate memory from the arena.
+     * @return Pointer to the block, or nullptr if the arena is exhausted.
+     */
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+
+    /**
+     * @brief printf into the arena.
+     * @return Null-terminated string, or nullptr if the arena is exhausted.
+     */
+    char *format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    void reset();
+
+    bool owns(const void *ptr) const
+    {
+        auto p = static_cast<const uint8_t *>(ptr);
+        return p >= m_buffer && p < m_buffer + m_capacity;
+    }
+
+    size_t used() const { return m_used; }
+    size_t capacity() const { return m_capacity; }
+    size_t highWater() const { return m_high_water; }
+    size_t fallbacks() const { return m_fallbacks; }
+
+    /// Arena bound to the calling task by ArenaScope, if any.
+    static Arena *current();
+
+    /// Route cJSON allocations through the current arena, falling back to the heap.
+    static void installJsonHooks();
+
+private:
+    friend class ArenaScope;
+    static void *jsonMalloc(size_t size);
+    static void jsonFree(void *ptr);
+
+    uint8_t *m_buffer;
+    size_t m_capacity;
+    size_t m_used = 0;
+    size_t m_high_water = 0;
+    size_t m_fallbacks = 0;
+};
+
+/// Arena with inline storage, meant for static allocation.
+template <size_t N>
+class StaticArena : public Arena
+{
+public:
+    StaticArena() : Arena(m_storage, N) {}
+
+private:
+    alignas(max_align_t) uint8_t m_storage[N];
+};
+
+/**
+ * @brief Binds an arena to the calling task for the lifetime of the scope.
+ *
+ * The arena is reset when the scope ends, so nothing allocated from it may
+ * outlive the scope.
+ */
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena &arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    Arena &m_arena;
+    Arena *m_previous;
+};
+
+#endif // ARENA_HPP
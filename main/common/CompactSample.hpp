@@ -0,0 +1,144 @@
+#ifndef COMPACT_SAMPLE_HPP
+#define COMPACT_SAMPLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "common/core.hpp"
+
+// Steps per unit of each quantised channel, at least as fine as any decoder reports.
+#define COMPACT_TEMPERATURE_SCALE 128
+#define COMPACT_ACCEL_SCALE 16
+#define COMPACT_BATTERY_SCALE 256
+// 0 °C in kelvin, as the RAPT Pill converts it.
+#define COMPACT_KELVIN_OFFSET 273.15f
+
+/**
+ * @brief Fixed point channel: value = (q + Bias) / Scale.
+ *
+ * decode() is exactly what a decoder of a fixed point field computes, so
+ * encode(decode(q)) == q for every q and such fields survive bit for bit.
+ * Other values land on the nearest step; values outside the range saturate.
+ */
+template <typename Raw, int32_t Scale, int32_t Bias = 0>
+struct QuantisedChannel
+{
+    static constexpr float decode(Raw q)
+    {
+        return static_cast<float>(static_cast<int32_t>(q) + Bias) / Scale;
+    }
+
+    static constexpr Raw encode(float value)
+    {
+        constexpr float low = static_cast<float>(static_cast<int32_t>(std::numeric_limits<Raw>::min()) + Bias);
+        constexpr float high = static_cast<float>(static_cast<int32_t>(std::numeric_limits<Raw>::max()) + Bias);
+        float scaled = value * Scale;
+        if (!(scaled > low))
+        {
+            // NaN saturates low too.
+            return std::numeric_limits<Raw>::min();
+        }
+        if (scaled >= high)
+        {
+            return std::numeric_limits<Raw>::max();
+        }
+        // Round half up; the cast truncates towards zero.
+        int32_t rounded = static_cast<int32_t>(scaled + 0.5f);
+        rounded -= rounded > scaled + 0.5f ? 1 : 0;
+        return static_cast<Raw>(rounded - Bias);
+    }
+};
+
+/// Celsius held as kelvin * 128, as the RAPT Pill v2 sends it: -273.15 to 238.84 °C.
+struct TemperatureChannel
+{
+    using Kelvin = QuantisedChannel<uint16_t, COMPACT_TEMPERATURE_SCALE>;
+
+    static constexpr float decode(uint16_t q) { return Kelvin::decode(q) - COMPACT_KELVIN_OFFSET; }
+    static constexpr uint16_t encode(float celsius) { return Kelvin::encode(celsius + COMPACT_KELVIN_OFFSET); }
+};
+
+// In g / 16, as the pill sends it.
+using AccelChannel = QuantisedChannel<int16_t, COMPACT_ACCEL_SCALE>;
+// 0 to 256 % in 1/256 %, as the pill sends it.
+using BatteryChannel = QuantisedChannel<uint16_t, COMPACT_BATTERY_SCALE>;
+
+/// A sample of the running boot at sensor resolution, 24 bytes instead of the 40 of RaptPillData.
+struct CompactSample
+{
+    // Seconds since boot; the boot id is the one of the running boot.
+    uint32_t timestamp;
+    // Kept as decoded: the RAPT Pill v1 sends raw gravity and 1/256 °C, which no 16-bit channel shares with the
+    // rest, and the v2 sends gravity and gravity velocity as floats.
+    float temperature;
+    float specific_gravity;
+    float gravity_velocity;
+    int16_t accel[3];
+    uint16_t battery;
+};
+
+/**
+ * @brief Converts samples to and from CompactSample for the queues and buffers
+ * that hold them in RAM before they are stored.
+ *
+ * Temperature, gravity and gravity velocity are kept as the decoders report
+ * them. Acceleration and battery are held in the fixed point the RAPT Pill
+ * sends them in, and every decoder reports them on those steps, so a decoded
+ * sample survives bit for bit. Only the 64-bit timestamp and the boot id are
+ * narrowed away.
+ */
+class CompactCodec
+{
+public:
+    /// Whether sample, as stamped by TimeBase, belongs to boot boot_id and a 32-bit time since boot.
+    static constexpr bool fits(const RaptPillData &sample, uint32_t boot_id)
+    {
+        return sample.boot_id == boot_id && sample.timestamp >= 0 &&
+               sample.timestamp <= static_cast<int64_t>(std::numeric_limits<uint32_t>::max());
+    }
+
+    /// Compact a sample for which fits() holds.
+    static constexpr CompactSample encode(const RaptPillData &sample)
+    {
+        return {
+            .timestamp = static_cast<uint32_t>(sample.timestamp),
+            .temperature = sample.temperature_celsius,
+            .specific_gravity = sample.specific_gravity,
+            .gravity_velocity = sample.gravity_velocity,
+            .accel = {AccelChannel::encode(sample.accel_x), AccelChannel::encode(sample.accel_y),
+                      AccelChannel::encode(sample.accel_z)},
+            .battery = BatteryChannel::encode(sample.battery),
+        };
+    }
+
+    static constexpr RaptPillData decode(const CompactSample &sample, uint32_t boot_id)
+    {
+        return {
+            .timestamp = sample.timestamp,
+            .gravity_velocity = sample.gravity_velocity,
+            .temperature_celsius = sample.temperature,
+            .specific_gravity = sample.specific_gravity,
+            .accel_x = AccelChannel::decode(sample.accel[0]),
+            .accel_y = AccelChannel::decode(sample.accel[1]),
+            .accel_z = AccelChannel::decode(sample.accel[2]),
+            .battery = BatteryChannel::decode(sample.battery),
+            .boot_id = boot_id,
+        };
+    }
+
+    /// Whether encode(decode(q)) == q for every raw value of Channel.
+    template <typename Channel, typename Raw>
+    static constexpr bool lossless()
+    {
+        for (int32_t q = std::numeric_limits<Raw>::min(); q <= std::numeric_limits<Raw>::max(); ++q)
+        {
+            if (Channel::encode(Channel::decode(static_cast<Raw>(q))) != static_cast<Raw>(q))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // COMPACT_SAMPLE_HPP
@@ -0,0 +1,147 @@
+#ifndef FORECAST_HPP
+#define FORECAST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "common/core.hpp"
+#include "drivers/PowerManager.hpp"
+
+// Most recent visible samples read for a fit, and the time span they may cover.
+#define FORECAST_MAX_SAMPLES 4096
+#define FORECAST_WINDOW_S (21 * 24 * 3600)
+// Samples are averaged into at most this many time buckets, starting this narrow.
+#define FORECAST_POINTS 64
+#define FORECAST_MIN_BUCKET_S 900
+// A fit needs this many buckets after the gravity peak, spanning at least this long and
+// dropping by this many gravity points; before that the final gravity is anyone's guess.
+#define FORECAST_MIN_POINTS 8
+#define FORECAST_MIN_SPAN_S (6 * 3600)
+#define FORECAST_MIN_DROP_POINTS 3.0f
+// Stored samples that arrive before the cached fit is redone.
+#define FORECAST_REFIT_SAMPLES 16
+#define FORECAST_MAX_ITERATIONS 50
+// Fermentation counts as complete once the model is within this many gravity points (0.001 SG) of its final gravity.
+#define FORECAST_DONE_POINTS 1.0f
+#define FORECAST_READ_CHUNK 16
+// Bucket sums count gravity in 1e-5 SG.
+#define FORECAST_GRAVITY_SCALE 100000
+
+enum class ForecastState : uint8_t
+{
+    InsufficientData, // Too few samples since the gravity peak, or no drop yet.
+    NoFit,            // The samples do not follow a fermentation curve.
+    Fermenting,
+    Complete,
+};
+
+/// Gravity over time and hours t as fitted: final + (original - final) / (1 + e^(rate * (t - midpoint))).
+struct ForecastModel
+{
+    float final_gravity;
+    float original_gravity;
+    // Steepness per hour.
+    float rate;
+    // Hours from the first point to the steepest drop.
+    float midpoint_h;
+    // Root mean square residual in SG.
+    float rmse;
+    uint8_t iterations;
+};
+
+/// A fit point: hours since the first point and the mean gravity around then.
+struct ForecastPoint
+{
+    float hours;
+    float gravity;
+};
+
+struct ForecastResult
+{
+    ForecastState state;
+    ForecastModel model;
+    // Unix seconds when resolved is set, else seconds since the newest boot, which alone was fitted.
+    bool resolved;
+    int64_t start;
+    int64_t midpoint;
+    int64_t completion;
+    int64_t last;
+    // Model gravity at the last sample.
+    float current_gravity;
+    size_t samples;
+    size_t points;
+    // Stored sample count the fit covered, by absolute number.
+    uint32_t epoch;
+    size_t end;
+};
+
+struct ForecastStats
+{
+    // Reading the window and fitting it, per fit.
+    LatencyStat fit;
+    uint32_t cached;
+};
+
+/**
+ * @brief Forecasts final gravity and time to completion from the history.
+ *
+ * The most recent samples are averaged into time buckets that double in width
+ * as needed, so at most FORECAST_POINTS points are fitted however long the
+ * window is. Points before the gravity peak are dropped; the rest are fitted
+ * to a logistic decay by Levenberg-Marquardt in single precision.
+ *
+ * Nothing runs on ingest. The fit is cached and redone on request once
+ * FORECAST_REFIT_SAMPLES new samples were stored or resolved times changed,
+ * so it runs on the caller's task, such as an async HTTP worker.
+ */
+class Forecast
+{
+public:
+    static Forecast &instance();
+
+    /// Copy the forecast, fitting the history first if the cached fit is stale.
+    ForecastResult current();
+
+    ForecastStats stats();
+
+    static const char *stateName(ForecastState state);
+
+    /**
+     * @brief Fit points, oldest first, to a logistic decay.
+     * @return false if the fit did not converge to a decreasing curve
+     */
+    static bool fit(const ForecastPoint *points, size_t count, ForecastModel &model);
+
+private:
+    Forecast();
+
+    void refit(uint32_t epoch, size_t end);
+    /// Average samples into m_buckets; returns the samples read.
+    size_t collect(bool &resolved);
+    /// One pass of collect(): samples of boots with a known wall time, or with unresolved only those of boot_id.
+    size_t scan(bool unresolved, uint32_t boot_id, uint32_t &newest_boot);
+
+    struct Bucket
+    {
+        // Seconds since m_origin, summed over the bucket's samples.
+        int64_t time_sum;
+        // In units of FORECAST_GRAVITY_SCALE, so sums stay exact.
+        int64_t gravity_sum;
+        uint32_t count;
+    };
+
+    SemaphoreHandle_t m_mutex;
+    ForecastResult m_result = {};
+    bool m_valid = false;
+    uint32_t m_generation = 0;
+    ForecastStats m_stats = {};
+
+    RaptPillData m_chunk[FORECAST_READ_CHUNK];
+    Bucket m_buckets[FORECAST_POINTS];
+    ForecastPoint m_points[FORECAST_POINTS];
+    int64_t m_origin = 0;
+    int64_t m_width = FORECAST_MIN_BUCKET_S;
+};
+
+#endif // FORECAST_HPP
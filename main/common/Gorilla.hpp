@@ -0,0 +1,169 @@
+#ifndef GORILLA_HPP
+#define GORILLA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "common/core.hpp"
+
+#define GORILLA_BLOCK_VERSION 1
+// Encoded block size; one block is one storage record.
+#define GORILLA_BLOCK_BYTES 1000
+// Samples per block; also bounds the tail log that protects the open block.
+#define GORILLA_BLOCK_MAX_SAMPLES 256
+// gravity_velocity, temperature, specific gravity, accel x/y/z and battery.
+#define GORILLA_FLOAT_CHANNELS 7
+// Header flag: the block ends with a table of boot offsets.
+#define GORILLA_FLAG_BOOT_OFFSETS 0x01
+// Boots whose wall clock offset a block can carry, and the bytes the table takes at most.
+#define GORILLA_MAX_BOOT_OFFSETS 4
+#define GORILLA_BOOT_OFFSET_BYTES 12
+#define GORILLA_BOOT_TABLE_BYTES (GORILLA_MAX_BOOT_OFFSETS * GORILLA_BOOT_OFFSET_BYTES + 1)
+// Delta record of one sample: its start and end bit in the stream, 2 bytes each (little endian),
+// then the stream bytes holding those bits.
+#define GORILLA_DELTA_HEADER_BYTES 4
+// Longest delta record: a boot change with every channel in the explicit form, not byte aligned.
+#define GORILLA_DELTA_MAX_BYTES 56
+
+/**
+ * @brief Block layout: version, flags and sample count (little endian),
+ * followed by the bit stream.
+ *
+ * With GORILLA_FLAG_BOOT_OFFSETS the block ends with the wall clock offsets of
+ * its boots as known when it was sealed: per boot its id (4 bytes) and offset
+ * (8 bytes, little endian), then the number of entries in the last byte.
+ * Decoders stop after the header count, so they never read the table.
+ *
+ * The first sample is stored raw. After that each sample stores:
+ * - boot id: '0' when unchanged, else '1' and 32 bits; a new boot restarts the timestamp
+ * - timestamp: delta-of-delta in buckets '0', '10'+7, '110'+9, '1110'+12, '1111'+64 bits
+ * - each float channel: XOR with the previous value, '0' when equal, '10' + meaningful
+ *   bits when they fit the previous window, else '11' + 5 bit leading zeros, 5 bit
+ *   length - 1 and the meaningful bits
+ */
+struct GorillaBlockHeader
+{
+    uint8_t version;
+    uint8_t flags;
+    uint16_t count;
+};
+
+/// Unix seconds minus monotonic seconds of one boot.
+struct GorillaBootOffset
+{
+    uint32_t boot_id;
+    int64_t offset;
+};
+
+/// Encodes samples into a caller-provided block buffer.
+class GorillaEncoder
+{
+public:
+    /// @param reserve Bytes at the end of the buffer kept free of samples for a boot offset table
+    GorillaEncoder(uint8_t *buffer, size_t capacity, size_t reserve = 0);
+
+    void reset();
+
+    /// False when the sample does not fit; the block is left as it was.
+    bool append(const RaptPillData &sample);
+
+    /**
+     * @brief End the block with a boot offset table; no samples can follow until removeBootOffsets().
+     * @return false if more than GORILLA_MAX_BOOT_OFFSETS or they do not fit
+     */
+    bool appendBootOffsets(const GorillaBootOffset *offsets, size_t count);
+    void removeBootOffsets();
+
+    /**
+     * @brief The bits the last append() wrote, as a delta record for a write-ahead log.
+     * @return Record length, 0 if nothing was appended since reset() or max is too small
+     */
+    size_t lastDelta(uint8_t *out, size_t max) const;
+
+    /**
+     * @brief Rebuild the block from the delta records of its samples, oldest first.
+     *
+     * Call resume() once all records are replayed, before appending again.
+     * @return false if the record does not continue the stream; the block is left as it was
+     */
+    bool replayDelta(const uint8_t *record, size_t length);
+
+    /**
+     * @brief Restore the encoder state from the replayed samples.
+     * @param last Receives the newest sample
+     * @return false if the replayed stream does not decode to what it claims; reset() before reuse
+     */
+    bool resume(RaptPillData &last);
+
+    bool full() const { return m_state.count >= GORILLA_BLOCK_MAX_SAMPLES; }
+    uint16_t count() const { return m_state.count; }
+    /// Bytes used so far, header and boot offset table included.
+    size_t size() const { return (m_state.bit_pos + 7) / 8 + m_table_bytes; }
+    const uint8_t *data() const { return m_buffer; }
+
+private:
+    void writeBits(uint64_t value, int bits);
+    void writeTimestamp(int64_t timestamp);
+    void writeFloat(int channel, float value);
+
+    // Everything a sample changes, so a sample that overflows can be undone.
+    struct State
+    {
+        size_t bit_pos;
+        uint16_t count;
+        uint32_t boot_id;
+        int64_t timestamp;
+        int64_t delta;
+        uint32_t values[GORILLA_FLOAT_CHANNELS];
+        uint8_t leading[GORILLA_FLOAT_CHANNELS];
+        uint8_t trailing[GORILLA_FLOAT_CHANNELS];
+    };
+
+    uint8_t *m_buffer;
+    size_t m_capacity;
+    size_t m_reserve;
+    size_t m_table_bytes = 0;
+    // Where the last appended sample starts; for lastDelta().
+    size_t m_last_bit_pos = 0;
+    State m_state = {};
+    bool m_overflow = false;
+};
+
+/// Decodes the samples of a block in order.
+class GorillaDecoder
+{
+public:
+    /**
+     * @param count Samples to decode; pass the header count for sealed blocks,
+     *              or the encoder's count for the block still being written.
+     */
+    GorillaDecoder(const uint8_t *data, size_t size, uint16_t count);
+
+    /// Decoder for a sealed block; count comes from the header.
+    static GorillaDecoder sealed(const uint8_t *data, size_t size);
+
+    /// Copy up to max entries of a sealed block's boot offset table; 0 if it has none.
+    static size_t bootOffsets(const uint8_t *data, size_t size, GorillaBootOffset *out, size_t max);
+
+    bool next(RaptPillData &sample);
+    uint16_t remaining() const { return m_remaining; }
+
+private:
+    uint64_t readBits(int bits);
+    float readFloat(int channel);
+
+    const uint8_t *m_data;
+    size_t m_bits;
+    size_t m_bit_pos;
+    uint16_t m_remaining;
+    bool m_first = true;
+    bool m_error = false;
+
+    uint32_t m_boot_id = 0;
+    int64_t m_timestamp = 0;
+    int64_t m_delta = 0;
+    uint32_t m_values[GORILLA_FLOAT_CHANNELS] = {};
+    uint8_t m_leading[GORILLA_FLOAT_CHANNELS] = {};
+    uint8_t m_trailing[GORILLA_FLOAT_CHANNELS] = {};
+};
+
+#endif // GORILLA_HPP
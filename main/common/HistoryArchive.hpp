@@ -0,0 +1,159 @@
+#ifndef HISTORY_ARCHIVE_HPP
+#define HISTORY_ARCHIVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "common/core.hpp"
+#include "common/Gorilla.hpp"
+#include "common/HistoryStore.hpp"
+#include "common/Settings.hpp"
+#include "common/TimeBase.hpp"
+
+#define HISTORY_ARCHIVE_MAGIC "RMBK"
+#define HISTORY_ARCHIVE_VERSION 1
+#define HISTORY_ARCHIVE_CONTENT_TYPE "application/vnd.raptmate.backup"
+// Samples read from the history at a time while a backup is encoded.
+#define HISTORY_ARCHIVE_READ_CHUNK 16
+// Longest CSV row a restore accepts; longer rows are skipped.
+#define HISTORY_RESTORE_LINE_MAX 128
+
+enum class ArchiveFrame : uint8_t
+{
+    Settings = 'S', // The settings blob as stored in NVS, without the Wi-Fi password.
+    Block = 'G',    // A sealed Gorilla block.
+    End = 'E',      // Total samples in the archive, uint32.
+};
+
+struct HistoryArchiveHeader
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+};
+
+struct HistoryArchiveFrameHeader
+{
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t length;
+    uint16_t crc; // CRC-16 of the payload, as for storage frames.
+};
+
+struct HistoryRestoreStats
+{
+    // Whether the upload was an archive or legacy CSV rows.
+    bool archive;
+    bool settings;
+    uint32_t samples;
+    uint32_t blocks;
+    // CSV rows that did not parse, such as a header line.
+    uint32_t skipped_rows;
+};
+
+/**
+ * @brief Writes the stored history and settings as a backup archive.
+ *
+ * The archive is a HistoryArchiveHeader followed by frames: the settings, the
+ * history as Gorilla blocks and an end frame with the sample count. Timestamps
+ * are resolved to unix seconds while writing, so the archive does not depend
+ * on this device's boot ids and restores onto any device.
+ */
+class HistoryBackup
+{
+public:
+    /// Receives the archive piece by piece; return false to abort.
+    using Sink = bool (*)(const void *data, size_t length, void *ctx);
+
+    HistoryBackup();
+
+    /// Write the whole archive; ESP_FAIL once the sink refused a piece.
+    esp_err_t write(Sink sink, void *ctx);
+
+    uint32_t samples() const { return m_samples; }
+    uint32_t blocks() const { return m_blocks; }
+
+private:
+    bool append(TimeResolver &resolver, const RaptPillData &sample);
+    bool writeFrame(ArchiveFrame type, const void *payload, size_t length);
+    bool writeBlock();
+
+    Sink m_sink = nullptr;
+    void *m_ctx = nullptr;
+    uint8_t m_block[GORILLA_BLOCK_BYTES];
+    GorillaEncoder m_encoder;
+    RaptPillData m_chunk[HISTORY_ARCHIVE_READ_CHUNK];
+    uint32_t m_samples = 0;
+    uint32_t m_blocks = 0;
+};
+
+/**
+ * @brief Restores history from an upload as it arrives, in constant memory.
+ *
+ * Accepts a HistoryBackup archive, or the CSV rows earlier firmware kept in
+ * data.csv. Blocks of an archive are stored as they are; CSV rows are parsed
+ * and encoded into blocks, so either is written to storage one block at a
+ * time. The stored history is replaced from the first block or CSV row on, so
+ * an upload that breaks off leaves what was restored until then. The settings
+ * of an archive are applied after its end frame checked out, keeping the
+ * current Wi-Fi credentials.
+ */
+class HistoryRestore
+{
+public:
+    HistoryRestore();
+
+    /// Consume the next piece of the upload; pieces may split frames and rows anywhere.
+    esp_err_t feed(const uint8_t *data, size_t length);
+
+    /// Store what is still buffered, check the archive is complete and apply its settings.
+    esp_err_t finish();
+
+    /// Reason for the first failure, suitable for the HTTP response; restoring stops there.
+    const char *error() const { return m_error; }
+    const HistoryRestoreStats &stats() const { return m_stats; }
+
+private:
+    enum class Format : uint8_t
+    {
+        Unknown,
+        Archive,
+        Csv,
+    };
+
+    esp_err_t detect();
+    esp_err_t begin();
+    esp_err_t feedArchive(const uint8_t *data, size_t length);
+    esp_err_t finishFrame();
+    esp_err_t applySettings();
+    esp_err_t feedCsv(const uint8_t *data, size_t length);
+    esp_err_t finishRow();
+    esp_err_t flushBlock();
+    esp_err_t fail(esp_err_t err, const char *message);
+
+    Format m_format = Format::Unknown;
+    bool m_started = false;
+    bool m_ended = false;
+    const char *m_error = nullptr;
+    esp_err_t m_err = ESP_OK;
+    HistoryRestoreStats m_stats = {};
+
+    // The first bytes decide the format; for an archive they are its header.
+    HistoryArchiveHeader m_header = {};
+    size_t m_header_fill = 0;
+    HistoryArchiveFrameHeader m_frame = {};
+    size_t m_frame_fill = 0;
+    size_t m_payload_fill = 0;
+
+    // Frame payloads land after the tag byte, so a block is stored without a copy.
+    // CSV rows are encoded into the same buffer.
+    uint8_t m_record[1 + GORILLA_BLOCK_BYTES];
+    GorillaEncoder m_encoder;
+    Settings m_settings = {};
+
+    char m_line[HISTORY_RESTORE_LINE_MAX];
+    size_t m_line_length = 0;
+    bool m_line_overflow = false;
+};
+
+#endif // HISTORY_ARCHIVE_HPP
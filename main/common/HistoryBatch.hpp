@@ -0,0 +1,40 @@
+#ifndef HISTORY_BATCH_HPP
+#define HISTORY_BATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "common/core.hpp"
+#include "common/Gorilla.hpp"
+
+// Samples read from the history at a time while a batch is encoded.
+#define HISTORY_BATCH_READ_CHUNK 16
+#define HISTORY_BATCH_CONTENT_TYPE "application/vnd.raptmate.gorilla"
+
+/**
+ * @brief Encodes stored history into one Gorilla block for sending off the device.
+ *
+ * Timestamps are resolved to unix seconds (boot id 0) where the boot's wall
+ * time is known. Samples of earlier boots that never learned it keep their boot
+ * id and seconds since that boot; a sample of this boot ends the batch, since
+ * its wall time becomes known once the clock is set.
+ */
+class HistoryBatch
+{
+public:
+    HistoryBatch(uint8_t *buffer, size_t capacity);
+
+    /// Encode stored samples from absolute number sample up to end; returns how many were encoded.
+    size_t build(size_t sample, size_t end);
+
+    /// Last encoded sample as stored, before its timestamp was resolved; where to resume after.
+    const RaptPillData &last() const { return m_last; }
+    const uint8_t *data() const { return m_encoder.data(); }
+    size_t size() const { return m_encoder.size(); }
+
+private:
+    GorillaEncoder m_encoder;
+    RaptPillData m_last = {};
+    RaptPillData m_chunk[HISTORY_BATCH_READ_CHUNK];
+};
+
+#endif // HISTORY_BATCH_HPP
@@ -0,0 +1,96 @@
+#ifndef HISTORY_EXPORT_HPP
+#define HISTORY_EXPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "common/core.hpp"
+#include "common/Gorilla.hpp"
+#include "common/HistoryStore.hpp"
+
+#define HISTORY_EXPORT_CSV_CONTENT_TYPE "text/csv"
+#define HISTORY_EXPORT_BLOCKS_CONTENT_TYPE "application/vnd.raptmate.blocks"
+// Samples read from the history at a time while CSV rows are written.
+#define HISTORY_EXPORT_READ_CHUNK 16
+// Every CSV row is padded to this length, newline included, so row n starts at a known offset.
+#define HISTORY_EXPORT_ROW_BYTES 87
+
+enum class HistoryExportFormat : uint8_t
+{
+    Csv,    // Fixed-width rows with timestamps resolved where the boot's wall time is known.
+    Blocks, // Sealed Gorilla blocks as stored, each behind a HistoryExportBlockHeader.
+};
+
+// Precedes every block of a block export.
+struct HistoryExportBlockHeader
+{
+    // Absolute number of the block's first sample, as in HistoryRange.
+    uint32_t first_sample;
+    uint16_t samples;
+    // Bytes of the block that follow.
+    uint16_t length;
+};
+
+/**
+ * @brief Serves the sealed history as a byte stream whose layout is known up front.
+ *
+ * Only sealed blocks and legacy rows are exported. They change only when they
+ * rotate out, so a pinned range of samples reads back byte for byte while new
+ * samples arrive, and a download can be resumed or fetched in slices. Offsets
+ * come from the block index without reading or formatting what precedes them:
+ * CSV rows are padded to HISTORY_EXPORT_ROW_BYTES, and a block takes its
+ * header plus the encoded length the index records. Legacy rows have no block
+ * and are left out of a block export.
+ *
+ * CSV timestamps are resolved per row rather than by walking the history, so
+ * any slice formats the same as the whole: unix seconds with boot id 0 where
+ * the boot's wall time is known, else seconds since that boot and its id.
+ */
+class HistoryExport
+{
+public:
+    /// Receives the export piece by piece; return false to abort.
+    using Sink = bool (*)(const void *data, size_t length, void *ctx);
+
+    /**
+     * @brief Select sealed samples [from, from + count), clamped to what is stored.
+     *
+     * A block export widens the selection to whole blocks.
+     */
+    HistoryExport(HistoryExportFormat format, size_t from, size_t count);
+
+    /// The selected samples by absolute number; also what a response has to be validated against.
+    const HistoryRange &range() const { return m_range; }
+
+    /// Bytes of the whole export.
+    size_t length() const { return m_length; }
+
+    /**
+     * @brief Write bytes first to last of the export, both inclusive.
+     * @return ESP_ERR_INVALID_STATE if selected samples rotated out meanwhile, ESP_FAIL once the sink refused a piece
+     */
+    esp_err_t write(size_t first, size_t last, Sink sink, void *ctx);
+
+private:
+    esp_err_t writeCsv(size_t first, size_t last);
+    esp_err_t writeBlocks(size_t first, size_t last);
+    /// Pass on the part of piece, which starts at offset in the export, that falls within first..last.
+    bool emit(const void *piece, size_t length, size_t offset, size_t first, size_t last);
+    int formatRow(const RaptPillData &sample, char *row);
+
+    HistoryExportFormat m_format;
+    HistoryRange m_range = {};
+    size_t m_length = 0;
+
+    Sink m_sink = nullptr;
+    void *m_ctx = nullptr;
+    uint8_t m_block[GORILLA_BLOCK_BYTES];
+    RaptPillData m_chunk[HISTORY_EXPORT_READ_CHUNK];
+
+    // Wall time offset of the boot last looked up.
+    uint32_t m_boot_id = UINT32_MAX;
+    bool m_offset_known = false;
+    int64_t m_offset = 0;
+};
+
+#endif // HISTORY_EXPORT_HPP
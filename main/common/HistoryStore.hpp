@@ -0,0 +1,257 @@
+#ifndef HISTORY_STORE_HPP
+#define HISTORY_STORE_HPP
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "common/core.hpp"
+#include "common/CompactSample.hpp"
+#include "common/Gorilla.hpp"
+#include "common/SwingingDoor.hpp"
+#include "storage/StorageBackend.hpp"
+
+// First byte of a storage record holding a sealed Gorilla block; CSV rows start with a digit.
+#define HISTORY_BLOCK_TAG 'G'
+// Samples received before load() finished, replayed once the history is indexed; held compacted,
+// 53 fit the 1280 bytes that 32 full samples took.
+#define HISTORY_EARLY_SAMPLES 53
+
+struct HistoryStats
+{
+    // Visible samples, after retention.
+    size_t samples;
+    // Samples received and samples the deadband let through to storage.
+    uint32_t offered_samples;
+    uint32_t stored_samples;
+    size_t sealed_blocks;
+    size_t open_samples;
+    // Rows still in the pre-compression CSV format; they rotate out over time.
+    size_t legacy_rows;
+    // Encoded bytes per sample over sealed and open blocks.
+    float bytes_per_sample;
+    uint64_t decoded_samples;
+    int64_t decode_us;
+};
+
+/// Stretch of the history that is stored together, as seen from a query offset.
+struct HistoryBlock
+{
+    size_t offset;
+    size_t samples;
+    // Never reused while the device runs; only meaningful when immutable.
+    size_t id;
+    // A sealed block that is entirely visible, so its samples never change.
+    bool immutable;
+};
+
+/// Stored samples by absolute number, for readers that must follow the history across rotation.
+struct HistoryRange
+{
+    // Bumped by every load(), which restarts the numbering.
+    uint32_t epoch;
+    size_t first;
+    // The sample held back by the deadband is not included; it may still be replaced.
+    size_t end;
+};
+
+/// A sealed block or a run of legacy CSV rows, by absolute sample number.
+struct HistorySegment
+{
+    size_t record;
+    size_t first_sample;
+    size_t samples;
+    // Encoded bytes of a block; 0 for legacy rows.
+    size_t bytes;
+    bool legacy;
+};
+
+/**
+ * @brief Sample history persisted as Gorilla-compressed blocks.
+ *
+ * Samples are encoded into an open block in RAM and the bits each sample adds
+ * are also written to the storage tail log, so the open block can be rebuilt
+ * after a reset. Once the block is full it is sealed: appended to the log as
+ * one immutable record and the tail log is cleared. Only a small index of the
+ * blocks is kept in RAM; range queries decode the blocks they touch on the fly.
+ *
+ * Received samples pass through a swinging door filter first, so flat stretches
+ * are stored as their end points. The sample it holds back is served as the
+ * last sample of the history.
+ *
+ * Samples may arrive while load() is still indexing storage. They are buffered
+ * and replayed after the stored history, so ingest does not wait for the load.
+ *
+ * Sealed blocks carry the wall clock offsets of their boots. They are indexed
+ * on load and serve TimeBase::offsetFor() for boots its table has forgotten,
+ * so old history keeps resolving however often the device restarts.
+ */
+class HistoryStore
+{
+public:
+    static HistoryStore &instance();
+
+    /// Index the records in storage, rebuild the open block from the tail log and replay early samples.
+    esp_err_t load(StorageBackend &storage);
+
+    bool loaded();
+
+    /**
+     * @brief Offer a received sample; it is stored once the deadband policy needs it.
+     * @return ESP_ERR_INVALID_ARG if it arrives before load() and was not stamped in this boot
+     */
+    esp_err_t append(const RaptPillData &sample);
+
+    /**
+     * @brief Copy a window of the history, oldest first.
+     * @param offset Index of the first sample to copy
+     * @param out Destination buffer
+     * @param max Capacity of the destination buffer
+     * @return Number of samples copied, 0 once offset is past the end
+     */
+    size_t copy(size_t offset, RaptPillData *out, size_t max);
+
+    size_t size();
+
+    /// Stored samples, ignoring retention. Numbers only grow between loads.
+    HistoryRange storedRange();
+
+    /// Copy stored samples starting at absolute number sample; the held sample is never copied.
+    size_t copyStored(size_t sample, RaptPillData *out, size_t max);
+
+    /// Stored samples that are sealed; unlike storedRange() the end only moves when a block is sealed.
+    HistoryRange sealedRange();
+
+    /// Copy sealed samples starting at absolute number sample; 0 once it rotated out or is not sealed.
+    size_t copySealed(size_t sample, RaptPillData *out, size_t max);
+
+    /// Describe the sealed segment holding absolute sample number sample; false once it rotated out or is not sealed.
+    bool segment(size_t sample, HistorySegment &out);
+
+    /**
+     * @brief Copy the stored bytes of a sealed block, without its tag.
+     * @return Length of the block, 0 if it rotated out or the segment holds legacy rows
+     */
+    size_t readBlock(const HistorySegment &segment, uint8_t *out, size_t max);
+
+    /// Absolute number of the first stored sample after (boot_id, timestamp), which orders the history.
+    size_t seekAfter(uint32_t boot_id, int64_t timestamp);
+
+    /// Describe the stretch holding the sample at offset; false once offset is past the end.
+    bool block(size_t offset, HistoryBlock &out);
+
+    /// Changes whenever the samples served by copy() change.
+    uint32_t version() const { return m_version.load(std::memory_order_acquire); }
+
+    /// False when the history is empty.
+    bool latest(RaptPillData &out);
+
+    /// Delete the stored history.
+    esp_err_t clear();
+
+    /**
+     * @brief Store a sealed block as the newest block, ahead of the open block.
+     * @param record HISTORY_BLOCK_TAG followed by the block, as sealed blocks are stored
+     * @return ESP_ERR_INVALID_ARG if the block holds no samples
+     */
+    esp_err_t importBlock(const uint8_t *record, size_t length);
+
+    /// Parse a CSV row as written by earlier firmware: timestamp, the seven channels and an optional boot id.
+    static bool parseCsvRow(const uint8_t *record, size_t length, RaptPillData &data);
+
+    /// Only serve the most recent max_samples samples; 0 serves everything kept in storage.
+    void setRetention(uint32_t max_samples);
+
+    void setDeadband(const DeadbandConfig &config);
+
+    HistoryStats stats();
+
+private:
+    HistoryStore();
+
+    // A sealed block or a run of legacy CSV rows. Record and sample numbers count
+    // from the first load and keep growing, so rotation and clearing only drop entries.
+    struct Segment
+    {
+        size_t record;
+        size_t records;
+        size_t first_sample;
+        size_t samples;
+        // Encoded bytes, or CSV bytes for legacy rows.
+        size_t bytes;
+        bool legacy;
+    };
+
+    // Offset of a boot as sealed into the newest block holding it.
+    struct ArchivedOffset
+    {
+        uint32_t boot_id;
+        int64_t offset;
+        size_t record;
+    };
+
+    esp_err_t ingest(const RaptPillData &sample);
+    esp_err_t store(const RaptPillData &sample);
+    esp_err_t seal();
+    /// Add the open block's boot offset table before it is sealed.
+    void sealBootOffsets();
+    /// Index a sealed block's boot offset table; returns its entries.
+    size_t archiveOffsets(const uint8_t *block, size_t size, size_t record);
+    static bool archivedOffset(uint32_t boot_id, int64_t &offset, void *ctx);
+    void dropRotated();
+    size_t firstSample() const;
+    size_t visibleStart() const;
+    size_t end() const;
+    size_t storedEnd() const;
+    size_t copyRange(size_t sample, size_t last, RaptPillData *out, size_t max);
+    size_t copySegment(const Segment &segment, size_t sample, RaptPillData *out, size_t max);
+    size_t copyOpen(size_t sample, RaptPillData *out, size_t max);
+    bool loadBlock(const Segment &segment);
+
+    SemaphoreHandle_t m_mutex;
+    StorageBackend *m_storage = nullptr;
+    std::vector<Segment> m_segments;
+    size_t m_base_record = 0;
+    size_t m_next_record = 0;
+    size_t m_sealed_end = 0;
+    uint32_t m_retention = 0;
+
+    // Tag byte followed by the open block, so sealing appends it without a copy.
+    uint8_t m_open_record[1 + GORILLA_BLOCK_BYTES];
+    GorillaEncoder m_encoder;
+    RaptPillData m_latest = {};
+
+    SwingingDoor m_door;
+    uint32_t m_offered_samples = 0;
+    uint32_t m_stored_samples = 0;
+    std::atomic<uint32_t> m_version{0};
+    uint32_t m_epoch = 0;
+
+    // Ring of samples appended before the first load() completed; guarded by m_early_lock.
+    portMUX_TYPE m_early_lock = portMUX_INITIALIZER_UNLOCKED;
+    bool m_loaded = false;
+    CompactSample m_early[HISTORY_EARLY_SAMPLES];
+    size_t m_early_head = 0;
+    size_t m_early_count = 0;
+    uint32_t m_early_dropped = 0;
+
+    // Last block read from storage and a decoder parked where the previous copy stopped,
+    // so paging through a block decodes it once.
+    uint8_t m_cache[GORILLA_BLOCK_BYTES];
+    size_t m_cache_record = SIZE_MAX;
+    size_t m_cache_size = 0;
+    GorillaDecoder m_cursor;
+    size_t m_cursor_sample = SIZE_MAX;
+
+    uint64_t m_decoded_samples = 0;
+    int64_t m_decode_us = 0;
+
+    // Sorted by boot id; guarded by its own mutex, as TimeBase reads it from any task.
+    SemaphoreHandle_t m_archive_mutex;
+    std::vector<ArchivedOffset> m_archive;
+};
+
+#endif // HISTORY_STORE_HPP
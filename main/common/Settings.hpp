@@ -0,0 +1,103 @@
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_err.h"
+
+#define SETTINGS_NVS_NAMESPACE "settings"
+#define SETTINGS_NVS_KEY "current"
+#define SETTINGS_VERSION 1
+#define SETTINGS_MAX_LISTENERS 8
+
+/// Bits identifying which group of settings changed.
+enum SettingsGroup : uint32_t
+{
+    SETTINGS_WIFI = 1u << 0,
+    SETTINGS_SCAN = 1u << 1,
+    SETTINGS_RETENTION = 1u << 2,
+    SETTINGS_POWER = 1u << 3,
+    SETTINGS_DEADBAND = 1u << 4,
+    SETTINGS_UPLINK = 1u << 5,
+    SETTINGS_COLLECTOR = 1u << 6,
+    SETTINGS_ALL = 0xffffffffu,
+};
+
+struct Settings
+{
+    uint32_t version;
+
+    // Station credentials; an empty SSID keeps the device in soft-AP only mode.
+    char wifi_ssid[33];
+    char wifi_password[65];
+
+    // BLE discovery, in units of 0.625 ms as used by ble_gap_disc_params.
+    uint16_t scan_interval;
+    uint16_t scan_window;
+
+    // Most recent samples served from the history; 0 serves everything kept in storage.
+    uint32_t history_max_records;
+
+    // PowerProfile, see PowerManager.
+    uint8_t power_profile;
+
+    // History deadband per channel, in hundredths of the channel's unit
+    // (specific gravity in ten-thousandths); see SwingingDoor.
+    uint16_t deadband_gravity_velocity;
+    uint16_t deadband_temperature;
+    uint16_t deadband_specific_gravity;
+    uint16_t deadband_accel;
+    uint16_t deadband_battery;
+    // Longest gap between stored samples, in seconds; 0 disables the heartbeat.
+    uint32_t history_heartbeat_s;
+
+    // Upstream publisher, see Uplink: UplinkMode, the broker URI or webhook URL, and the MQTT topic.
+    uint8_t uplink_mode;
+    char uplink_url[129];
+    char uplink_topic[65];
+
+    // Collector mode, see Collector: pull peers found over mDNS plus a comma separated host[:port] list.
+    uint8_t collector_enabled;
+    char collector_peers[161];
+};
+
+// Fields are only ever appended; a shorter blob written by older firmware
+// loads with the newer fields at their defaults.
+#define SETTINGS_MIN_BLOB_SIZE offsetof(Settings, power_profile)
+
+/**
+ * @brief Typed settings persisted in NVS with a cached copy in RAM.
+ *
+ * Reads never touch flash and never block: they copy the cached struct under
+ * a sequence counter and retry if a writer raced them. Writes are validated,
+ * stored as a single NVS blob (so a power cut leaves either the old or the new
+ * settings) and then announced to listeners subscribed to the changed groups.
+ */
+class SettingsStore
+{
+public:
+    using Listener = void (*)(const Settings &settings, uint32_t changed, void *ctx);
+
+    /// Load settings from NVS, falling back to defaults. Requires NVS.
+    static void init();
+
+    static Settings get();
+    static Settings defaults();
+
+    /**
+     * @brief Validate, persist and publish new settings.
+     * @return ESP_ERR_INVALID_ARG if validation fails; nothing is changed then.
+     */
+    static esp_err_t update(const Settings &next);
+
+    static esp_err_t subscribe(uint32_t groups, Listener listener, void *ctx);
+
+    /// Human readable reason for the last ESP_ERR_INVALID_ARG from update().
+    static const char *lastError();
+
+private:
+    static uint32_t diff(const Settings &a, const Settings &b);
+    static bool validate(const Settings &settings);
+};
+
+#endif // SETTINGS_HPP
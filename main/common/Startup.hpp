@@ -0,0 +1,97 @@
+#ifndef STARTUP_HPP
+#define STARTUP_HPP
+
+#include <cstdint>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Each stage runs on its own short-lived task.
+#define STARTUP_STAGE_STACK 4096
+#define STARTUP_STAGE_PRIORITY 5
+
+enum class StartupStage : uint8_t
+{
+    History,   // Mount the data partition and index the stored history.
+    Ble,       // NimBLE host synced with the controller and scanning.
+    Wifi,      // Soft-AP up, station connecting in the background.
+    Power,     // Power profile applied; needs Wi-Fi for the modem sleep level.
+    Web,       // Web UI files available.
+    Http,      // HTTP server accepting requests.
+    Uplink,    // Upstream publisher running; needs the history and Wi-Fi.
+    Collector, // Peer discovery and pulls scheduled; needs Wi-Fi.
+    Rules,     // Alert rules compiled and the alert task running.
+};
+#define STARTUP_STAGE_COUNT 9
+
+enum class StageState : uint8_t
+{
+    Pending,
+    Running,
+    Ready,
+    Failed,
+    Skipped, // A dependency failed.
+};
+
+/// Boot-relative timings from esp_timer_get_time(); -1 until reached.
+struct StageReport
+{
+    const char *name;
+    StageState state;
+    int64_t start_us;
+    int64_t end_us;
+    esp_err_t err;
+};
+
+enum class StartupMilestone : uint8_t
+{
+    FirstSample,   // First sample received over BLE.
+    FirstResponse, // First HTTP request answered.
+};
+#define STARTUP_MILESTONE_COUNT 2
+
+/**
+ * @brief Runs the boot stages as a dependency graph instead of one after another.
+ *
+ * A stage starts as soon as all stages it depends on are ready, so independent
+ * stages such as loading the history, bringing up Wi-Fi and syncing the BLE host
+ * overlap. A stage whose dependency failed is skipped; ordering-only
+ * dependencies run a stage after another one whatever its outcome. Readiness,
+ * per-stage timings and the first sample and first HTTP response after reset
+ * are kept for /health.
+ */
+class Startup
+{
+public:
+    using StageFn = esp_err_t (*)(void *ctx);
+
+    static constexpr uint32_t bit(StartupStage stage) { return 1u << static_cast<uint32_t>(stage); }
+
+    /**
+     * @brief Register a stage before run().
+     * @param depends Mask of bit() values that must be ready; the stage is skipped if one fails
+     * @param after Mask of stages that only have to finish first, whatever their outcome
+     */
+    static void define(StartupStage stage, const char *name, uint32_t depends, StageFn fn, void *ctx,
+                       uint32_t after = 0);
+
+    /// Start every defined stage; returns immediately.
+    static void run();
+
+    /// True once every stage in the mask is ready.
+    static bool ready(uint32_t stages);
+
+    /// True when all defined stages are ready.
+    static bool complete();
+
+    static StageReport report(StartupStage stage);
+    static const char *stateName(StageState state);
+
+    /// Record a milestone; only the first call counts.
+    static void reach(StartupMilestone milestone);
+    static int64_t milestone(StartupMilestone milestone);
+
+private:
+    static void stageTask(void *param);
+};
+
+#endif // STARTUP_HPP
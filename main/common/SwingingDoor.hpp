@@ -0,0 +1,72 @@
+#ifndef SWINGING_DOOR_HPP
+#define SWINGING_DOOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "common/core.hpp"
+
+// gravity_velocity, temperature, specific gravity, accel x/y/z and battery.
+#define SWINGING_DOOR_CHANNELS 7
+
+/// Deadband per channel, in the channel's own unit; 0 only drops samples on a straight line.
+struct DeadbandConfig
+{
+    float gravity_velocity;
+    float temperature;
+    float specific_gravity;
+    float accel;
+    float battery;
+    // Longest gap between stored samples in seconds; 0 disables the heartbeat.
+    uint32_t heartbeat_s;
+};
+
+/**
+ * @brief Swinging door compression of the sample stream.
+ *
+ * Each stored sample opens a door per channel: the range of slopes for which a
+ * line from the stored sample stays within the deadband of every sample since.
+ * A new sample can end that line only if its own slope is inside every door;
+ * otherwise the previous sample is stored and starts the next line. Samples are
+ * also stored once the heartbeat interval has passed or when the boot changes.
+ * Interpolating linearly between the stored samples therefore reproduces every
+ * dropped sample to within its deadband.
+ *
+ * The last sample received is held back until it is known whether it is needed;
+ * it ends the series until then.
+ */
+class SwingingDoor
+{
+public:
+    void configure(const DeadbandConfig &config) { m_config = config; }
+
+    /**
+     * @brief Offer a received sample.
+     * @param out Samples to store, oldest first
+     * @return Number of samples written to out, at most 2
+     */
+    size_t offer(const RaptPillData &sample, RaptPillData out[2]);
+
+    /// The sample held back, if any.
+    bool pending(RaptPillData &sample) const;
+
+    /// Continue from a sample that is already stored, e.g. after loading the history.
+    void restart(const RaptPillData &stored);
+    void reset();
+
+private:
+    void open(const RaptPillData &origin);
+    /// True when the line from the origin to sample passes through every door.
+    bool fits(const RaptPillData &sample) const;
+    /// Narrow the doors to the deadband around sample.
+    void narrow(const RaptPillData &sample);
+
+    DeadbandConfig m_config = {};
+    bool m_has_origin = false;
+    bool m_has_held = false;
+    RaptPillData m_origin = {};
+    RaptPillData m_held = {};
+    float m_upper[SWINGING_DOOR_CHANNELS] = {};
+    float m_lower[SWINGING_DOOR_CHANNELS] = {};
+};
+
+#endif // SWINGING_DOOR_HPP
@@ -0,0 +1,111 @@
+#ifndef TIME_BASE_HPP
+#define TIME_BASE_HPP
+
+#include <cstdint>
+#include "esp_err.h"
+#include "common/core.hpp"
+
+#define TIMEBASE_NVS_NAMESPACE "timebase"
+// Number of past boots whose wall-clock offset is remembered.
+#define TIMEBASE_MAX_BOOTS 32
+
+enum class TimeSource : uint8_t
+{
+    None,
+    Browser, // Set through POST /api/v1/time.
+    Sntp,
+};
+
+/**
+ * @brief Maps monotonic sample time onto wall time.
+ *
+ * Samples are stamped with seconds since boot plus a boot id that increments
+ * on every reset. Once wall time becomes known for a boot, its offset is
+ * stored; stored records are never rewritten, the offset is applied when
+ * history is read. Boot id 0 is reserved for records that already carry
+ * unix seconds (history written before boot ids existed).
+ *
+ * The NVS table only holds the last TIMEBASE_MAX_BOOTS boots. Older offsets
+ * come from an archive, which the history fills from the offset tables it
+ * seals into its blocks.
+ */
+class TimeBase
+{
+public:
+    /// Offset of a boot the table no longer holds; false if unknown.
+    using OffsetArchive = bool (*)(uint32_t boot_id, int64_t &offset, void *ctx);
+
+    /// Load the offset table and allocate this boot's id. Requires NVS.
+    static void init();
+
+    static void setArchive(OffsetArchive archive, void *ctx);
+    /// Bump generation() after the archive learned offsets.
+    static void archiveChanged();
+
+    /**
+     * @brief Move this boot's id past boots the history already holds.
+     *
+     * Erasing NVS restarts boot ids while storage survives; history is ordered
+     * by boot id, so new samples must not reuse one.
+     */
+    static void raiseBootId(uint32_t at_least);
+
+    static uint32_t bootId();
+    static int64_t monotonicSeconds();
+
+    /// Stamp a sample with the current boot id and monotonic time.
+    static void stamp(RaptPillData &data);
+
+    /**
+     * @brief Record that the wall clock is now unix_seconds.
+     *
+     * Browser time is applied to the system clock, but never overrides SNTP.
+     * @return ESP_ERR_INVALID_STATE if ignored because SNTP already set the clock.
+     */
+    static esp_err_t setWallClock(int64_t unix_seconds, TimeSource source);
+
+    static TimeSource source();
+    static bool offsetFor(uint32_t boot_id, int64_t &offset);
+
+    /// Bumped whenever a boot offset changes, i.e. whenever resolved history may change.
+    static uint32_t generation();
+};
+
+/**
+ * @brief Resolves stored samples to unix seconds while walking history in order.
+ *
+ * Boots whose offset was never learned are placed right after the previous
+ * resolved sample, keeping their internal spacing, so history stays ordered
+ * and nothing is dropped.
+ */
+class TimeResolver
+{
+public:
+    /// Where a walk stands, so a later request can resume it and resolve as if it never stopped.
+    struct Checkpoint
+    {
+        uint32_t boot_id;
+        int64_t last_wall;
+        int64_t last_mono;
+    };
+
+    int64_t resolve(const RaptPillData &data);
+
+    Checkpoint checkpoint() const { return {m_boot_id, m_last_wall, m_last_mono}; }
+    static TimeResolver resume(const Checkpoint &checkpoint);
+
+    bool operator==(const TimeResolver &other) const
+    {
+        return m_boot_id == other.m_boot_id && m_offset_known == other.m_offset_known && m_offset == other.m_offset &&
+               m_last_wall == other.m_last_wall && m_last_mono == other.m_last_mono;
+    }
+
+private:
+    uint32_t m_boot_id = UINT32_MAX;
+    bool m_offset_known = false;
+    int64_t m_offset = 0;
+    int64_t m_last_wall = INT64_MIN;
+    int64_t m_last_mono = 0;
+};
+
+#endif // TIME_BASE_HPP
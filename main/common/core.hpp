@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+
 struct RaptPillData {
+    // Seconds since boot `boot_id`, or unix seconds when boot_id is 0. See TimeBase.
     int64_t timestamp;
     float gravity_velocity;
     float temperature_celsius;
@@ -9,4 +12,5 @@ struct RaptPillData {
     float accel_y;
     float accel_z;
     float battery;
+    uint32_t boot_id;
 };
@@ -0,0 +1,218 @@
+#ifndef COLLECTOR_HPP
+#define COLLECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_http_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "common/core.hpp"
+#include "common/Gorilla.hpp"
+#include "common/Settings.hpp"
+
+#define COLLECTOR_MAX_PEERS 16
+#define COLLECTOR_MAX_STATIC_PEERS 8
+#define COLLECTOR_HOST_MAX 64
+#define COLLECTOR_DEFAULT_PORT 80
+// Pulls running at once; further due peers wait in the queue for a free worker.
+#define COLLECTOR_PULL_WORKERS 3
+#define COLLECTOR_WORKER_STACK 5120
+#define COLLECTOR_TASK_STACK 4096
+#define COLLECTOR_TASK_PRIORITY 3
+#define COLLECTOR_DISCOVERY_INTERVAL_S 60
+#define COLLECTOR_DISCOVERY_TIMEOUT_MS 3000
+// A peer found over mDNS that has not answered a query for this long is no longer pulled.
+#define COLLECTOR_PEER_LOST_S 300
+#define COLLECTOR_PULL_INTERVAL_S 30
+// Batches per pull; a longer backlog continues after the other due peers had their turn.
+#define COLLECTOR_PULL_MAX_BATCHES 4
+#define COLLECTOR_PULL_TIMEOUT_MS 5000
+// Retry delay after a failed pull: starts at COLLECTOR_BACKOFF_BASE_MS, doubling up to COLLECTOR_BACKOFF_MAX_MS.
+#define COLLECTOR_BACKOFF_BASE_MS 2000
+#define COLLECTOR_BACKOFF_MAX_MS 300000
+// Gorilla blocks kept in RAM per peer; the oldest is dropped when the newest fills up.
+#define COLLECTOR_PEER_BLOCKS 2
+// Most recent samples requested from a peer on first contact.
+#define COLLECTOR_INITIAL_TAIL GORILLA_BLOCK_MAX_SAMPLES
+
+enum class PeerSource : uint8_t
+{
+    Mdns,
+    Static, // Listed in the collector_peers setting.
+};
+
+enum class PeerState : uint8_t
+{
+    Idle,
+    Queued,  // Due, waiting for a free worker.
+    Pulling,
+    Backoff, // Waiting to retry after a failure.
+    Lost,    // Gone from mDNS; its samples are still shown.
+};
+
+struct PeerAddress
+{
+    char host[COLLECTOR_HOST_MAX];
+    uint16_t port;
+};
+
+struct PeerStats
+{
+    // Device id the peer reported; empty for a static peer before its first answer.
+    char id[13];
+    PeerAddress address;
+    PeerSource source;
+    PeerState state;
+    // Last sample pulled, in the peer's own (boot id, timestamp) terms; pulls resume after it.
+    bool cursor_valid;
+    uint32_t cursor_boot_id;
+    int64_t cursor_timestamp;
+    // Samples held in RAM for the fleet view.
+    size_t held_samples;
+    bool has_latest;
+    RaptPillData latest;
+    uint64_t pulled_samples;
+    uint64_t pulled_bytes;
+    uint32_t pulls;
+    uint32_t failures;
+    esp_err_t last_error;
+    uint32_t backoff_ms;
+    // Boot-relative; -1 before the first pull.
+    int64_t last_pull_us;
+    uint32_t last_pull_ms;
+};
+
+struct CollectorStats
+{
+    bool enabled;
+    size_t peers;
+    uint32_t discovery_runs;
+    // Boot-relative; -1 before the first mDNS query.
+    int64_t last_discovery_us;
+    uint32_t active_pulls;
+    uint32_t peak_active_pulls;
+};
+
+/**
+ * @brief Pulls the history of other RaptMate devices into one fleet view.
+ *
+ * Every device advertises MDNS_SERVICE_TYPE and serves its stored history at
+ * /api/v1/history/delta, one Gorilla block per request after a (boot id,
+ * timestamp) cursor. A device in collector mode finds peers over mDNS, plus
+ * any listed in the collector_peers setting, and pulls them incrementally:
+ * each peer's cursor advances with every batch, so a pull only transfers what
+ * is new. The most recent samples of each peer are kept in RAM as Gorilla
+ * blocks for /api/v1/fleet.
+ *
+ * A scheduler task queues peers as they fall due, and COLLECTOR_PULL_WORKERS
+ * workers pull them, which bounds the concurrent connections however many
+ * peers there are. A pull stops after COLLECTOR_PULL_MAX_BATCHES batches and
+ * requeues the peer behind the others, and failing peers back off on their own.
+ */
+class Collector
+{
+public:
+    static Collector &instance();
+
+    /// Follow settings and run the scheduler; workers start once collector mode is enabled. Requires Wi-Fi.
+    esp_err_t start();
+
+    CollectorStats stats();
+
+    /// Copy the peer in table slot index; false when the slot is unused.
+    bool peer(size_t index, PeerStats &out);
+
+    /**
+     * @brief Copy the blocks held for a peer, oldest first.
+     * @param out Room for COLLECTOR_PEER_BLOCKS blocks of GORILLA_BLOCK_BYTES each
+     * @return Number of blocks copied, 0 for an unknown peer
+     */
+    size_t copyBlocks(const char *id, uint8_t *out);
+
+    static const char *stateName(PeerState state);
+    static const char *sourceName(PeerSource source);
+
+    /**
+     * @brief Parse a comma separated host[:port] list.
+     * @param out Destination, or nullptr to only validate
+     * @return Number of peers, or -1 if the list is malformed or longer than max
+     */
+    static int parsePeers(const char *list, PeerAddress *out, size_t max);
+
+private:
+    // The most recent samples of a peer; allocated when the peer is added.
+    struct PeerSeries
+    {
+        PeerSeries() : encoder(blocks[0], GORILLA_BLOCK_BYTES) {}
+
+        uint8_t blocks[COLLECTOR_PEER_BLOCKS][GORILLA_BLOCK_BYTES];
+        size_t newest = 0;
+        size_t filled = 1;
+        GorillaEncoder encoder;
+    };
+
+    struct Peer
+    {
+        bool used;
+        // Removed once its running pull finishes.
+        bool retired;
+        int64_t next_pull_us;
+        int64_t last_seen_us;
+        PeerStats stats;
+        PeerSeries *series;
+    };
+
+    // One pull worker and the response it is receiving.
+    struct Worker
+    {
+        Collector *owner;
+        uint8_t body[GORILLA_BLOCK_BYTES];
+        size_t body_length;
+        bool body_overflow;
+        char device[13];
+        bool has_cursor;
+        uint32_t cursor_boot_id;
+        int64_t cursor_timestamp;
+        uint32_t remaining;
+    };
+
+    Collector() = default;
+
+    static void schedulerTask(void *param);
+    static void workerTask(void *param);
+    static void onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx);
+    static void onGotIp(void *arg, esp_event_base_t base, int32_t id, void *data);
+    static esp_err_t onHttpEvent(esp_http_client_event_t *event);
+
+    void runScheduler();
+    void runWorker(Worker &worker);
+    esp_err_t startWorkers();
+    void reconfigure(const Settings &settings);
+    void discover();
+    /// Queue due peers; returns how long until the next one falls due.
+    TickType_t schedule(int64_t now);
+    /// Pull up to COLLECTOR_PULL_MAX_BATCHES batches; more is set when the peer has samples left.
+    esp_err_t pull(Worker &worker, size_t index, bool &more);
+    esp_err_t fetch(Worker &worker, esp_http_client_handle_t &client, const PeerStats &peer);
+    void finishPull(size_t index, esp_err_t err, bool more, int64_t start_us);
+
+    /// Table slot of a peer, adding it if needed; -1 when the table is full. Call with m_mutex held.
+    int findOrAdd(const char *id, const PeerAddress &address, PeerSource source);
+    void dropPeer(Peer &peer);
+    void resetSeries(Peer &peer);
+    void store(Peer &peer, const RaptPillData &sample);
+
+    SemaphoreHandle_t m_mutex = nullptr;
+    EventGroupHandle_t m_events = nullptr;
+    QueueHandle_t m_due = nullptr;
+    Peer m_peers[COLLECTOR_MAX_PEERS] = {};
+    CollectorStats m_stats = {};
+    Worker *m_workers = nullptr;
+    int64_t m_next_discovery_us = 0;
+};
+
+#endif // COLLECTOR_HPP
@@ -0,0 +1,137 @@
+#ifndef DECODER_REGISTRY_HPP
+#define DECODER_REGISTRY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "cJSON.h"
+#include "common/core.hpp"
+
+// Decoders that can be registered, and hash slots for their company ids; keep slots at least twice the decoders.
+#define DECODER_MAX 8
+#define DECODER_SLOTS 16
+// Advertising data type of manufacturer specific data, which starts with a little-endian company id.
+#define DECODER_AD_MANUFACTURER 0xFF
+#define DECODER_SIGNATURE_MAX 8
+
+// "RA" as the RAPT Pill sends it; the pill uses its name rather than an assigned company id.
+#define DECODER_RAPT_COMPANY 0x4152
+#define DECODER_RAPT_LENGTH 25
+// The pill repeats each advert; accept at most one sample per window.
+#define DECODER_RAPT_INTERVAL_US 1000000
+
+// Apple, whose iBeacon format the Tilt uses.
+#define DECODER_IBEACON_COMPANY 0x004C
+#define DECODER_IBEACON_LENGTH 25
+// The Tilt advertises every few seconds; one sample a minute is plenty for a fermentation.
+#define DECODER_TILT_INTERVAL_US 60000000
+
+/// Decodes the manufacturer data of one kind of hydrometer advert.
+struct HydrometerDecoder
+{
+    const char *name;
+    uint16_t company_id;
+    // Bytes that must follow the company id, checked before decode() runs.
+    uint8_t signature[DECODER_SIGNATURE_MAX];
+    uint8_t signature_length;
+    // Accepted manufacturer data lengths, company id included.
+    uint8_t min_length;
+    uint8_t max_length;
+    // Shortest time between samples accepted from one device.
+    int64_t min_interval_us;
+    /// Decode manufacturer data whose company id and signature matched; false rejects it.
+    bool (*decode)(const uint8_t *data, size_t length, RaptPillData &out);
+};
+
+struct DecoderMatch
+{
+    const HydrometerDecoder *decoder;
+    // Index of the decoder, as in stats().
+    size_t index;
+    const uint8_t *data;
+    size_t length;
+};
+
+struct DecoderCounters
+{
+    uint32_t matched;
+    uint32_t decoded;
+    uint32_t failed;
+};
+
+struct DecoderStats
+{
+    uint32_t adverts;
+    // Adverts without manufacturer data of a registered company and signature.
+    uint32_t rejected;
+    size_t count;
+    const char *names[DECODER_MAX];
+    DecoderCounters decoders[DECODER_MAX];
+};
+
+/**
+ * @brief Finds the decoder for an advert in constant time, before anything is parsed.
+ *
+ * Only the advertising data structures are walked to find the manufacturer
+ * data; its company id selects a hash slot, and the few decoders registered
+ * for that company are told apart by a signature of the bytes that follow.
+ * Adverts of other devices cost a walk over at most 31 bytes, which matters
+ * when the scanner hears hundreds of phones and beacons.
+ *
+ * RAPT Pill v1 and v2 and Tilt adverts are registered by default. Counters are
+ * written on the BLE host task, which calls match() and decode(), and read by
+ * stats() on any task, so they are relaxed atomics.
+ */
+class DecoderRegistry
+{
+public:
+    static DecoderRegistry &instance();
+
+    /**
+     * @brief Register a decoder, which must outlive the registry.
+     * @return ESP_ERR_INVALID_ARG if its minimum length does not cover the company id and signature, ESP_ERR_NO_MEM once the table is full
+     */
+    esp_err_t add(const HydrometerDecoder *decoder);
+
+    /// Find the decoder for raw advertising data; false if no registered decoder claims it.
+    bool match(const uint8_t *advert, size_t length, DecoderMatch &out);
+
+    /// Decode a matched advert and count the outcome.
+    bool decode(const DecoderMatch &match, RaptPillData &out);
+
+    DecoderStats stats();
+
+    /**
+     * @brief Decode the JSON an iSpindel, or firmware mimicking it, posts to an HTTP server.
+     *
+     * Gravity above 2 is taken as degrees Plato; temp_units may be C, F or K.
+     * Battery volts are mapped onto the percentage a RAPT Pill reports.
+     */
+    static bool decodeISpindel(const cJSON *json, RaptPillData &out);
+
+private:
+    DecoderRegistry();
+
+    static size_t slotFor(uint16_t company_id);
+
+    const HydrometerDecoder *m_decoders[DECODER_MAX] = {};
+    // Next decoder of the same company, or DECODER_MAX.
+    uint8_t m_next[DECODER_MAX] = {};
+    size_t m_count = 0;
+    // First decoder of the company hashed to each slot, or DECODER_MAX when empty.
+    uint8_t m_slots[DECODER_SLOTS];
+
+    struct Counters
+    {
+        std::atomic<uint32_t> matched{0};
+        std::atomic<uint32_t> decoded{0};
+        std::atomic<uint32_t> failed{0};
+    };
+
+    std::atomic<uint32_t> m_adverts{0};
+    std::atomic<uint32_t> m_rejected{0};
+    Counters m_counters[DECODER_MAX];
+};
+
+#endif // DECODER_REGISTRY_HPP
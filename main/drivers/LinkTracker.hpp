@@ -0,0 +1,68 @@
+#ifndef LINK_TRACKER_HPP
+#define LINK_TRACKER_HPP
+
+#include <cstdint>
+
+// Weight of a new value in the RSSI, cadence and repeat averages is 1 / LINK_EWMA_WEIGHT.
+#define LINK_EWMA_WEIGHT 8
+// Missing samples in a row that count as a gap rather than scattered loss.
+#define LINK_GAP_MISSED 2
+// Intervals in a row of the same multiple of the cadence after which the pill is taken to report slower.
+#define LINK_RELEARN_RUNS 8
+
+struct LinkStats
+{
+    uint32_t adverts;
+    // Adverts that passed the dedupe window and were decoded.
+    uint32_t samples;
+    // Adverts dropped as repeats of a sample already accepted.
+    uint32_t duplicates;
+    uint32_t decode_failures;
+    // Samples lost because the ingest queue stayed full.
+    uint32_t queue_drops;
+    int8_t rssi;
+    float rssi_avg;
+    // Adverts heard per sample; the pill repeats each one, so fewer means less link margin.
+    float adverts_per_sample;
+    // Learned interval between samples; 0 until two samples arrived.
+    int64_t cadence_us;
+    // Samples the cadence says should have arrived since it was learned, and those that did.
+    uint32_t expected;
+    uint32_t received;
+    uint32_t gaps;
+    int64_t longest_gap_us;
+    // When the last gap ended, by esp_timer time; 0 if there was none.
+    int64_t last_gap_us;
+    int64_t last_advert_us;
+    int64_t last_sample_us;
+};
+
+/**
+ * @brief Link quality of one advertising device, updated in O(1) per advert.
+ *
+ * The sample cadence is learned from the intervals between accepted samples:
+ * an interval of about k cadences counts k expected samples, one of which
+ * arrived, and its k-th part refines the cadence. Loss from RF range shows as
+ * expected samples that never arrived, while samples lost after reception are
+ * counted as queue drops, so the two can be told apart.
+ */
+class LinkTracker
+{
+public:
+    void advert(int8_t rssi, int64_t now_us);
+    void duplicate() { m_stats.duplicates++; }
+    void decodeFailure() { m_stats.decode_failures++; }
+    void queueDrop() { m_stats.queue_drops++; }
+    void sample(int64_t now_us);
+
+    const LinkStats &stats() const { return m_stats; }
+
+private:
+    LinkStats m_stats = {};
+    uint32_t m_adverts_since_sample = 0;
+    // Cadences spanned by the last intervals, and how many in a row spanned that many.
+    uint32_t m_last_step = 0;
+    uint32_t m_step_runs = 0;
+};
+
+#endif // LINK_TRACKER_HPP
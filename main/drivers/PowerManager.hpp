@@ -0,0 +1,89 @@
+#ifndef POWER_MANAGER_HPP
+#define POWER_MANAGER_HPP
+
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "common/Settings.hpp"
+
+// How often the main task samples CPU load.
+#define POWER_SAMPLE_INTERVAL_S 10
+
+enum class PowerProfile : uint8_t
+{
+    Performance,
+    Balanced,
+    LowPower,
+};
+#define POWER_PROFILE_COUNT 3
+
+struct PowerProfileConfig
+{
+    const char *name;
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep;
+    // Modem sleep level; WIFI_PS_NONE is not allowed while BLE shares the radio.
+    wifi_ps_type_t wifi_ps;
+    // Upper bound on scan window / scan interval, applied on top of the scan settings.
+    uint8_t scan_duty_percent;
+};
+
+/// Count, mean and worst case of a latency, in microseconds.
+struct LatencyStat
+{
+    uint32_t count;
+    int64_t total_us;
+    int64_t max_us;
+};
+
+struct PowerStats
+{
+    PowerProfile profile;
+    bool pm_enabled;
+    // Fraction of the last sample interval each core spent outside its idle task.
+    float cpu_load[portNUM_PROCESSORS];
+    uint32_t light_sleep_wakes;
+    int64_t light_sleep_us;
+    // Measured since the profile was applied, so profiles can be compared.
+    int64_t profile_since_us;
+    LatencyStat ingest;
+    LatencyStat http;
+};
+
+/**
+ * @brief Applies the configured power profile and measures its effect.
+ *
+ * A profile sets dynamic frequency scaling, automatic light sleep, the Wi-Fi
+ * modem sleep level and a cap on the BLE scan duty. Frequency scaling and light
+ * sleep need CONFIG_PM_ENABLE; without it only the radio settings apply. On the
+ * ESP32 the BLE controller keeps the chip out of light sleep unless it runs
+ * from an external 32 kHz crystal, so light sleep mainly pays off between
+ * scan windows on boards that have one.
+ */
+class PowerManager
+{
+public:
+    /// Apply the stored profile and follow settings changes. Call after Wi-Fi is initialized.
+    static void init();
+
+    static const PowerProfileConfig &config(uint8_t profile);
+    /// Parse a profile name as used by the API; returns false if unknown.
+    static bool parseProfile(const char *name, uint8_t &profile);
+
+    /// Update CPU load figures; called periodically from the main task.
+    static void sample();
+
+    static void recordIngestLatency(int64_t us);
+    static void recordHttpLatency(int64_t us);
+
+    static PowerStats stats();
+
+private:
+    static void apply(PowerProfile profile);
+    static void onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx);
+    static void record(LatencyStat &stat, int64_t us);
+};
+
+#endif // POWER_MANAGER_HPP
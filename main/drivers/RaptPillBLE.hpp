@@ -15,17 +15,47 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "common/core.hpp"
-#include "esp_spiffs.h"
-#include <vector>
+#include "common/TimeBase.hpp"
+#include "common/CompactSample.hpp"
+#include "common/Settings.hpp"
+#include "esp_timer.h"
+#include "common/HistoryStore.hpp"
+#include "drivers/DecoderRegistry.hpp"
+#include "drivers/LinkTracker.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include <time.h>
 #include <sys/time.h>
 #include <string>
+#include <atomic>
 #include "esp_bt.h"
 
 #define BLE_TAG "BLE"
+// Advertising devices whose last accepted sample and link statistics are kept; the one heard least recently makes room.
+#define BLE_MAX_SOURCES 4
+// How long the BLE host task waits for room in the ingest queue before the sample is counted as dropped.
+#define BLE_QUEUE_WAIT_MS 50
+// Samples the ingest queue holds; 17 compact items of 28 bytes fit the 480 bytes 10 full ones took.
+#define BLE_QUEUE_LENGTH 17
+
+/// Link statistics of one advertising device.
+struct DeviceLink
+{
+    // Bluetooth address as 12 hex digits, most significant first.
+    char id[13];
+    // Decoder of the last advert heard.
+    const char *decoder;
+    LinkStats stats;
+};
+// Shortest scan window the controller accepts, in 0.625 ms units.
+#define BLE_MIN_SCAN_WINDOW 4
+// How long init() waits for the NimBLE host to sync with the controller.
+#define BLE_SYNC_TIMEOUT_MS 5000
+// How often the receiver task retries discovery the controller refused, and how many times.
+#define BLE_SCAN_RETRY_MS 1000
+#define BLE_SCAN_ATTEMPTS 10
 
 class RaptPillBLE
 {
@@ -35,36 +65,84 @@ public:
     QueueHandle_t dataQueue;
     ~RaptPillBLE();
 
-    void init();
+    /// Mount the data partition and index the history; samples received meanwhile are buffered.
+    esp_err_t loadHistory();
+    /// Start the NimBLE host and begin scanning once it has synced with the controller.
+    esp_err_t init();
+    /// (Re)start discovery with the current settings; runs on the receiver task, so any task may call it.
     void startScan();
 
     RaptPillData getLatestData()
     {
-        return m_most_recent_data.back();
+        RaptPillData latest = {};
+        m_history->latest(latest);
+        return latest;
     }
 
-    std::vector<RaptPillData> getAllData()
-    {
-        return m_most_recent_data;
-    }
+    /**
+     * @brief Copy a window of the history, decoding only the blocks it touches.
+     * @param offset Index of the first record to copy
+     * @param out Destination buffer
+     * @param max Capacity of the destination buffer
+     * @return Number of records copied, 0 once offset is past the end
+     */
+    size_t copyData(size_t offset, RaptPillData *out, size_t max) { return m_history->copy(offset, out, max); }
+
+    /// Export row as served by /data, with the timestamp already resolved to unix seconds.
+    static int formatExportRow(const RaptPillData &data, int64_t timestamp, char *buffer, size_t size);
 
     void resetData();
 
+    /**
+     * @brief Queue a decoded sample for storage; every source, BLE or HTTP, ends up here.
+     * @param received_us When the sample arrived, for ingest latency
+     * @return ESP_ERR_TIMEOUT if the queue stayed full for wait
+     */
+    esp_err_t submit(RaptPillData &sample, int64_t received_us, TickType_t wait);
+
+    /// Copy the links of up to max devices heard since boot.
+    size_t links(DeviceLink *out, size_t max);
+    /// Copy the link of the device with id; false if it was not heard or made room for another.
+    bool link(const char *id, DeviceLink &out);
+
 private:
-    void ble_app_scan();
-    RaptPillData readLatestData();
-    std::vector<RaptPillData> readAllData();
-    static std::string getCsvHeader();
-    int parseManufacturerData(const uint8_t *data, size_t length, ble_addr_t addr);
+    // Queue item; the receive time lets the receiver task measure ingest latency.
+    struct PendingSample
+    {
+        CompactSample data;
+        // esp_timer time truncated to 32 bits; differences stay exact for over an hour.
+        uint32_t received_us;
+    };
+
+    /// Start discovery once; false if the controller refused.
+    bool ble_app_scan();
+    void onAdvert(const DecoderMatch &match, const ble_addr_t &addr, int8_t rssi);
     static int bleGapEvent(struct ble_gap_event *event, void *arg);
     int handleBleGapEvent(struct ble_gap_event *event);
-    static std::string formatDataAsString(const RaptPillData &data);
-    void createFileIfNotExist(const char *filename);
-    static void writeToFile(const char *filepath, const std::string &content);
     static void bleHostTask(void *);
-    std::vector<RaptPillData> m_most_recent_data = std::vector<RaptPillData>();
+    static void onHostSync();
+    static void onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx);
+    HistoryStore *m_history = nullptr;
     static RaptPillBLE *instance_;
-    int64_t last_timestamp = 0;
+    // Given on every host sync; init() waits for the first.
+    SemaphoreHandle_t m_synced = nullptr;
+    // Given by startScan(); the receiver task waits on it and dataQueue through m_receiver_set.
+    SemaphoreHandle_t m_scan_request = nullptr;
+    QueueSetHandle_t m_receiver_set = nullptr;
+    // Set once the host has synced and discovery was requested; read by settings listeners on other tasks.
+    std::atomic<bool> m_scanning = false;
+
+    struct Source
+    {
+        ble_addr_t addr;
+        const char *decoder;
+        int64_t last_accepted_us;
+        LinkTracker link;
+    };
+    // Written on the BLE host task; m_sources_mutex guards readers on other tasks.
+    SemaphoreHandle_t m_sources_mutex = nullptr;
+    Source m_sources[BLE_MAX_SOURCES] = {};
+    size_t m_source_count = 0;
 };
 
 #endif // RAPT_PILL_BLE_HPP
\ No newline at end of file
@@ -0,0 +1,223 @@
+#ifndef RULE_ENGINE_HPP
+#define RULE_ENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "common/core.hpp"
+#include "drivers/PowerManager.hpp"
+
+#define RULES_NVS_NAMESPACE "rules"
+#define RULES_NVS_TEXT_KEY "text"
+#define RULES_NVS_WEBHOOK_KEY "webhook"
+#define RULES_MAX 48
+// Longest rule, and the whole rule list with one rule per line.
+#define RULES_RULE_TEXT_MAX 48
+#define RULES_TEXT_MAX 1536
+#define RULES_WEBHOOK_MAX 129
+// Devices rules can refer to; slot 0 is this device.
+#define RULES_MAX_DEVICES 8
+// Smoothing window of a rate rule that gives no duration.
+#define RULES_DEFAULT_RATE_WINDOW_S 3600
+// Alerts waiting for the alert task; further alerts are dropped and counted while it is full.
+#define RULES_ALERT_QUEUE 16
+// Most recent alerts kept for /api/v1/alerts.
+#define RULES_RECENT_ALERTS 16
+#define RULES_MAX_LISTENERS 2
+#define RULES_TASK_STACK 4096
+#define RULES_TASK_PRIORITY 3
+#define RULES_WEBHOOK_TIMEOUT_MS 5000
+// Room for an alert formatted as JSON.
+#define RULES_ALERT_JSON_MAX 256
+
+enum class RuleKind : uint8_t
+{
+    Threshold, // The channel is above or below a value, optionally for a while.
+    Rate,      // The channel changes faster than a value per hour, smoothed over a window.
+    Stable,    // The channel stayed within a band for a while, such as a finished ferment.
+};
+
+/// A rule compiled for evaluation; the condition text is kept apart for reporting.
+struct Rule
+{
+    RuleKind kind;
+    // Index into the channel table of RuleEngine.cpp.
+    uint8_t channel;
+    bool above;
+    // Slot in the device table.
+    uint8_t device;
+    // Threshold, rate per hour, or band width.
+    float value;
+    // Hold time of a threshold, smoothing window of a rate, required time of a stable rule.
+    uint32_t duration_s;
+};
+
+/// Rules as compiled from text, with the devices they refer to.
+struct RuleSet
+{
+    Rule rules[RULES_MAX];
+    // Start and length of each rule's condition in the text.
+    uint16_t spans[RULES_MAX][2];
+    size_t count;
+    // Slot 0 is this device and stays empty.
+    char devices[RULES_MAX_DEVICES][13];
+    size_t device_count;
+};
+
+/// Incremental state of one rule, updated in O(1) per sample.
+struct RuleState
+{
+    bool active;
+    bool primed;
+    uint32_t boot_id;
+    int64_t last_timestamp;
+    float last_value;
+    // Smoothed rate per hour of a rate rule.
+    float rate;
+    // Band a stable rule has stayed in since since_timestamp.
+    float low;
+    float high;
+    // A threshold that holds since since_timestamp, or a rate that has a value.
+    bool holding;
+    // When the threshold started to hold, or the band was entered.
+    int64_t since_timestamp;
+    uint32_t fired;
+};
+
+struct RuleAlert
+{
+    uint32_t sequence;
+    uint8_t rule;
+    // Fired, or false once the condition cleared.
+    bool active;
+    // Device id of a peer; empty for this device.
+    char device[13];
+    char condition[RULES_RULE_TEXT_MAX];
+    // The channel value, or the smoothed rate of a rate rule.
+    float value;
+    // Unix seconds when resolved is set, else seconds since boot boot_id.
+    bool resolved;
+    uint32_t boot_id;
+    int64_t timestamp;
+};
+
+struct RuleEngineStats
+{
+    size_t rules;
+    // Time spent evaluating each sample against all rules.
+    LatencyStat evaluation;
+    uint32_t alerts;
+    uint32_t dropped_alerts;
+    uint32_t webhook_sent;
+    uint32_t webhook_failures;
+    esp_err_t webhook_error;
+};
+
+/**
+ * @brief Evaluates alert rules against every sample as it is ingested.
+ *
+ * Rules are plain text, one per line, compiled when they are configured:
+ *
+ *     [device:] channel > value [for duration]      threshold, held for duration
+ *     [device:] channel rate < value [for window]   change per hour, smoothed over window
+ *     [device:] channel stable value for duration   stayed within a band of width value
+ *
+ * Channels are sg, temp and battery; durations take s, m, h or d. A rule
+ * applies to this device unless it names a peer's device id, whose samples
+ * arrive through the Collector. Each rule keeps a fixed amount of state, so a
+ * sample costs O(rules) and no history is read.
+ *
+ * An alert is raised when a condition starts or stops to hold. Alerts are
+ * queued to the alert task, which posts them to the webhook and passes them to
+ * listeners such as the server's event stream, so ingest never waits on the
+ * network.
+ */
+class RuleEngine
+{
+public:
+    using Listener = void (*)(const RuleAlert &alert, void *ctx);
+
+    static RuleEngine &instance();
+
+    /// Load and compile the stored rules and start the alert task. Requires NVS.
+    esp_err_t start();
+
+    /// Evaluate a sample of this device (device nullptr) or of a peer; never blocks on the network.
+    void evaluate(const char *device, const RaptPillData &sample);
+
+    /**
+     * @brief Compile, store and apply new rules; rule state starts over.
+     * @param text Rules separated by newlines
+     * @param webhook URL to POST alerts to, empty for none
+     * @return ESP_ERR_INVALID_ARG if a rule does not compile; error() says which
+     */
+    esp_err_t configure(const char *text, const char *webhook);
+
+    /// Reason the last configure() failed.
+    const char *error() const { return m_error; }
+
+    /// Copy the rule at index with its condition text and state; false past the last rule.
+    bool rule(size_t index, char *condition, RuleState &state);
+
+    /// Copy the webhook URL; out needs RULES_WEBHOOK_MAX bytes.
+    void webhook(char *out);
+
+    /// Copy up to max recent alerts, newest first.
+    size_t recentAlerts(RuleAlert *out, size_t max);
+
+    RuleEngineStats stats();
+
+    /// Have alerts passed to listener on the alert task, after they were resolved.
+    esp_err_t subscribe(Listener listener, void *ctx);
+
+    /// Format an alert as the JSON object that webhooks and the event stream receive.
+    static int format(const RuleAlert &alert, char *out, size_t size);
+
+    /**
+     * @brief Compile rule text.
+     * @param text Rules separated by newlines; blank lines are skipped
+     * @param error Receives the reason on failure
+     * @return ESP_ERR_INVALID_ARG if a rule does not compile
+     */
+    static esp_err_t compile(const char *text, RuleSet &out, char *error, size_t error_size);
+
+private:
+    RuleEngine();
+
+    static void task(void *param);
+
+    bool step(const Rule &rule, RuleState &state, const RaptPillData &sample, float &reported);
+    void raise(size_t index, bool active, float value, const char *device, const RaptPillData &sample);
+    void deliver(RuleAlert &alert);
+    esp_err_t post(const RuleAlert &alert, const char *url);
+
+    SemaphoreHandle_t m_mutex;
+    // Serializes configure(), which compiles into m_staging before swapping it in.
+    SemaphoreHandle_t m_config_mutex;
+    QueueHandle_t m_alerts = nullptr;
+
+    RuleSet m_set = {};
+    RuleSet m_staging = {};
+    RuleState m_states[RULES_MAX] = {};
+    char m_text[RULES_TEXT_MAX] = {};
+    char m_webhook[RULES_WEBHOOK_MAX] = {};
+    char m_error[64] = {};
+
+    RuleEngineStats m_stats = {};
+    uint32_t m_sequence = 0;
+    RuleAlert m_recent[RULES_RECENT_ALERTS];
+    size_t m_recent_head = 0;
+    size_t m_recent_count = 0;
+
+    struct Subscriber
+    {
+        Listener listener;
+        void *ctx;
+    };
+    Subscriber m_listeners[RULES_MAX_LISTENERS] = {};
+};
+
+#endif // RULE_ENGINE_HPP
@@ -0,0 +1,148 @@
+#ifndef UPLINK_HPP
+#define UPLINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_http_client.h"
+#include "mqtt_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "common/core.hpp"
+#include "common/Gorilla.hpp"
+#include "common/HistoryBatch.hpp"
+#include "common/Settings.hpp"
+
+#define UPLINK_NVS_NAMESPACE "uplink"
+#define UPLINK_NVS_CURSOR_KEY "cursor"
+#define UPLINK_TASK_STACK 6144
+#define UPLINK_TASK_PRIORITY 3
+// Retry delay after a failed upload: starts at UPLINK_BACKOFF_BASE_MS, doubling up to UPLINK_BACKOFF_MAX_MS.
+#define UPLINK_BACKOFF_BASE_MS 1000
+#define UPLINK_BACKOFF_MAX_MS 300000
+// How long a broker or webhook gets to acknowledge a batch.
+#define UPLINK_ACK_TIMEOUT_MS 10000
+// Once caught up, wait for this many samples or this long before sending.
+#define UPLINK_MIN_BATCH 16
+#define UPLINK_MAX_DELAY_S 60
+// The acknowledged position is written to NVS at most this often, and whenever the backlog is cleared.
+#define UPLINK_CURSOR_COMMIT_S 60
+
+enum class UplinkMode : uint8_t
+{
+    Off,
+    Mqtt, // QoS 1 publish; the PUBACK acknowledges the batch.
+    Http, // POST to a webhook; any 2xx acknowledges the batch.
+};
+#define UPLINK_MODE_COUNT 3
+
+enum class UplinkState : uint8_t
+{
+    Off,
+    Idle,            // Caught up, or collecting a batch.
+    Sending,
+    Backoff,         // Waiting to retry after a failure.
+    WaitingForClock, // The next sample belongs to this boot, whose wall time is not known yet.
+};
+
+struct UplinkStats
+{
+    UplinkMode mode;
+    UplinkState state;
+    // Last acknowledged sample, the position uploads resume from after a reset.
+    bool cursor_valid;
+    uint32_t cursor_boot_id;
+    int64_t cursor_timestamp;
+    size_t backlog;
+    uint64_t sent_samples;
+    uint32_t sent_batches;
+    uint64_t sent_bytes;
+    // Samples that rotated out of storage before they could be sent.
+    uint64_t dropped_samples;
+    uint32_t failures;
+    esp_err_t last_error;
+    uint32_t backoff_ms;
+    // Batches sent back to back while a backlog remained, for the catch-up rate.
+    uint64_t catchup_samples;
+    int64_t catchup_us;
+    // Boot-relative, -1 before the first acknowledged batch.
+    int64_t last_success_us;
+};
+
+/**
+ * @brief Store-and-forward publisher of the history to an MQTT broker or HTTP webhook.
+ *
+ * The publisher reads from the stored history, so nothing is queued in RAM
+ * while the uplink is down. Its position is the (boot id, timestamp) of the
+ * last acknowledged sample, persisted in NVS, which stays valid across resets
+ * and rotation. Delivery is at least once: after a reset, up to
+ * UPLINK_CURSOR_COMMIT_S worth of samples may be sent again.
+ *
+ * Each upload is one Gorilla block (see Gorilla.hpp) of up to
+ * GORILLA_BLOCK_MAX_SAMPLES samples, with timestamps resolved to unix seconds
+ * (boot id 0). Samples of earlier boots whose wall time was never learned keep
+ * their boot id and seconds since that boot. Failures back off exponentially;
+ * getting an IP resets the backoff, and a backlog is then sent batch after
+ * batch without waiting. Everything runs on the publisher's own task, so
+ * neither ingest nor the HTTP server ever waits on the uplink.
+ */
+class Uplink
+{
+public:
+    static Uplink &instance();
+
+    /// Load the cursor, start the publisher task and follow settings. Requires Wi-Fi and the history.
+    esp_err_t start();
+
+    /// Wake the publisher after a sample was stored; never blocks.
+    void notify();
+
+    UplinkStats stats();
+
+    static const char *modeName(UplinkMode mode);
+    /// Parse a mode name as used by the API; returns false if unknown.
+    static bool parseMode(const char *name, uint8_t &mode);
+    static const char *stateName(UplinkState state);
+    /// True when url has a scheme the mode can use; any URL is valid while off.
+    static bool validUrl(UplinkMode mode, const char *url);
+
+private:
+    Uplink();
+
+    static void task(void *param);
+    static void onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx);
+    static void onGotIp(void *arg, esp_event_base_t base, int32_t id, void *data);
+    static void onMqttEvent(void *arg, esp_event_base_t base, int32_t id, void *data);
+
+    void run();
+    esp_err_t send(const Settings &settings, size_t samples);
+    esp_err_t sendMqtt(const Settings &settings);
+    esp_err_t sendHttp(const Settings &settings, size_t samples);
+    void disconnect();
+    void commitCursor();
+    void setState(UplinkState state);
+
+    SemaphoreHandle_t m_mutex;
+    EventGroupHandle_t m_events = nullptr;
+    UplinkStats m_stats = {};
+
+    // Next sample to send, as an absolute history number valid for m_epoch.
+    size_t m_next = 0;
+    uint32_t m_epoch = 0;
+    bool m_positioned = false;
+    bool m_cursor_dirty = false;
+    int64_t m_cursor_committed_us = 0;
+    int64_t m_last_send_us = 0;
+    int64_t m_retry_at_us = 0;
+
+    uint8_t m_buffer[GORILLA_BLOCK_BYTES];
+    HistoryBatch m_batch;
+
+    esp_mqtt_client_handle_t m_mqtt = nullptr;
+    int m_mqtt_msg_id = -1;
+    esp_http_client_handle_t m_http = nullptr;
+};
+
+#endif // UPLINK_HPP
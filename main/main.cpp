@@ -11,12 +11,81 @@
 #include "services/gap/ble_svc_gap.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_heap_caps.h"
 
 #include "esp_sntp.h"
 #include "esp_netif_sntp.h"
 #include "web/RaptMateServer.hpp"
 #include "drivers/RaptPillBLE.hpp"
 #include "drivers/WifiManager.hpp"
+#include "common/TimeBase.hpp"
+#include "common/Settings.hpp"
+#include "drivers/PowerManager.hpp"
+#include "common/Startup.hpp"
+#include "drivers/Uplink.hpp"
+#include "drivers/Collector.hpp"
+#include "drivers/RuleEngine.hpp"
+
+// How often the main task reports heap fragmentation.
+#define HEAP_REPORT_INTERVAL_S 300
+
+static esp_err_t loadHistoryStage(void *ctx)
+{
+    return static_cast<RaptPillBLE *>(ctx)->loadHistory();
+}
+
+static esp_err_t bleStage(void *ctx)
+{
+    return static_cast<RaptPillBLE *>(ctx)->init();
+}
+
+static esp_err_t wifiStage(void *ctx)
+{
+    static_cast<WiFiManager *>(ctx)->init();
+    return ESP_OK;
+}
+
+static esp_err_t powerStage(void *)
+{
+    PowerManager::init();
+    return ESP_OK;
+}
+
+static esp_err_t uplinkStage(void *)
+{
+    return Uplink::instance().start();
+}
+
+static esp_err_t collectorStage(void *)
+{
+    return Collector::instance().start();
+}
+
+static esp_err_t rulesStage(void *)
+{
+    return RuleEngine::instance().start();
+}
+
+static esp_err_t webStage(void *ctx)
+{
+    return static_cast<RaptMateServer *>(ctx)->mountWeb();
+}
+
+static esp_err_t httpStage(void *ctx)
+{
+    return static_cast<RaptMateServer *>(ctx)->start();
+}
+
+static void logHeapFragmentation()
+{
+    size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    // 1.0 means all free memory is one contiguous block.
+    float ratio = free_bytes ? static_cast<float>(largest_block) / free_bytes : 0.0f;
+    ESP_LOGI("main", "Heap free: %u, largest block: %u, fragmentation ratio: %.3f, minimum ever free: %u",
+             free_bytes, largest_block, ratio, heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+}
+
 extern "C" void app_main(void)
 {
     // Initialize NVS — required for Wi‑Fi.
@@ -26,20 +95,40 @@ extern "C" void app_main(void)
         nvs_flash_erase();
         nvs_flash_init();
     }
+    TimeBase::init();
+    SettingsStore::init();
 
+    // Constructing these only sets up state; the slow parts run as startup stages.
+    // Samples are accepted as soon as BLE scans, while the history may still be loading.
+    // The objects stay on this task's stack, which never unwinds.
     RaptPillBLE scanner;
-    scanner.init();
-
     WiFiManager wifiManager;
-    wifiManager.init();
-
-    // Create and initialize the server.
     RaptMateServer raptMateServer(&scanner, &wifiManager);
-    raptMateServer.init();
 
-    // The main task can now wait forever.
+    using S = StartupStage;
+    Startup::define(S::History, "history", 0, &loadHistoryStage, &scanner);
+    Startup::define(S::Ble, "ble", 0, &bleStage, &scanner);
+    Startup::define(S::Wifi, "wifi", 0, &wifiStage, &wifiManager);
+    Startup::define(S::Power, "power", Startup::bit(S::Wifi), &powerStage, nullptr);
+    Startup::define(S::Web, "web", 0, &webStage, &raptMateServer);
+    // Serve once /web is mounted, so early requests are not cached as misses; a failed
+    // mount still leaves the API up.
+    Startup::define(S::Http, "http", Startup::bit(S::Wifi), &httpStage, &raptMateServer, Startup::bit(S::Web));
+    Startup::define(S::Uplink, "uplink", Startup::bit(S::History) | Startup::bit(S::Wifi), &uplinkStage, nullptr);
+    Startup::define(S::Collector, "collector", Startup::bit(S::Wifi), &collectorStage, nullptr);
+    Startup::define(S::Rules, "rules", 0, &rulesStage, nullptr);
+    Startup::run();
+
+    // The main task only wakes to sample CPU load and report heap health now and then.
+    uint32_t seconds = 0;
     while (true)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        vTaskDelay(pdMS_TO_TICKS(POWER_SAMPLE_INTERVAL_S * 1000));
+        PowerManager::sample();
+        seconds += POWER_SAMPLE_INTERVAL_S;
+        if (seconds % HEAP_REPORT_INTERVAL_S == 0)
+        {
+            logHeapFragmentation();
+        }
     }
 }
@@ -0,0 +1,137 @@
+#include "web/AlertStream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include "esp_log.h"
+#include "freertos/task.h"
+
+static const char *ALERT_STREAM_TAG = "AlertStream";
+
+AlertStream &AlertStream::instance()
+{
+    static AlertStream stream;
+    return stream;
+}
+
+esp_err_t AlertStream::start()
+{
+    if (m_commands)
+    {
+        return ESP_OK;
+    }
+    m_commands = xQueueCreate(ALERT_STREAM_QUEUE_LENGTH, sizeof(Command));
+    if (!m_commands)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(&AlertStream::task, "alert_stream", ALERT_STREAM_TASK_STACK, this, ALERT_STREAM_TASK_PRIORITY,
+                    nullptr) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return RuleEngine::instance().subscribe(&AlertStream::onAlert, this);
+}
+
+esp_err_t AlertStream::open(httpd_req_t *req)
+{
+    if (!m_commands || m_open.fetch_add(1) >= ALERT_STREAM_MAX_CLIENTS)
+    {
+        m_open--;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_sendstr(req, "Too many alert streams");
+    }
+
+    Command command = {.req = nullptr, .alert = {}};
+    esp_err_t err = httpd_req_async_handler_begin(req, &command.req);
+    if (err != ESP_OK)
+    {
+        m_open--;
+        ESP_LOGE(ALERT_STREAM_TAG, "Failed to detach request: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start alert stream");
+        return ESP_FAIL;
+    }
+    if (xQueueSend(m_commands, &command, 0) != pdPASS)
+    {
+        m_open--;
+        httpd_resp_set_status(command.req, "503 Service Unavailable");
+        httpd_resp_set_hdr(command.req, "Retry-After", "1");
+        httpd_resp_sendstr(command.req, "Server busy");
+        httpd_req_async_handler_complete(command.req);
+    }
+    return ESP_OK;
+}
+
+void AlertStream::onAlert(const RuleAlert &alert, void *ctx)
+{
+    AlertStream *self = static_cast<AlertStream *>(ctx);
+    if (self->m_open.load() == 0)
+    {
+        return;
+    }
+    // Never hold up alert delivery for a slow stream; the alert stays in /api/v1/alerts.
+    Command command = {.req = nullptr, .alert = alert};
+    if (xQueueSend(self->m_commands, &command, 0) != pdPASS)
+    {
+        ESP_LOGW(ALERT_STREAM_TAG, "Stream queue full, alert %lu not streamed", static_cast<unsigned long>(alert.sequence));
+    }
+}
+
+void AlertStream::task(void *param)
+{
+    static_cast<AlertStream *>(param)->run();
+}
+
+void AlertStream::broadcast(const char *text)
+{
+    for (httpd_req_t *&req : m_streams)
+    {
+        // A failed send means the client is gone, so there is no one left to end the response for.
+        if (req && httpd_resp_send_chunk(req, text, HTTPD_RESP_USE_STRLEN) != ESP_OK)
+        {
+            httpd_req_async_handler_complete(req);
+            req = nullptr;
+            m_open--;
+            ESP_LOGI(ALERT_STREAM_TAG, "Alert stream closed");
+        }
+    }
+}
+
+void AlertStream::run()
+{
+    Command command;
+    char json[RULES_ALERT_JSON_MAX];
+    char event[RULES_ALERT_JSON_MAX + 64];
+    while (true)
+    {
+        if (xQueueReceive(m_commands, &command, pdMS_TO_TICKS(ALERT_STREAM_HEARTBEAT_MS)) != pdTRUE)
+        {
+            broadcast(": keepalive\n\n");
+            continue;
+        }
+
+        if (command.req)
+        {
+            // open() counted the stream, so a slot is free.
+            httpd_req_t *&slot = *std::find(m_streams, m_streams + ALERT_STREAM_MAX_CLIENTS, nullptr);
+            httpd_resp_set_type(command.req, "text/event-stream");
+            httpd_resp_set_hdr(command.req, "Cache-Control", "no-cache");
+            if (httpd_resp_send_chunk(command.req, "retry: 5000\n\n", HTTPD_RESP_USE_STRLEN) != ESP_OK)
+            {
+                httpd_req_async_handler_complete(command.req);
+                m_open--;
+                continue;
+            }
+            slot = command.req;
+            ESP_LOGI(ALERT_STREAM_TAG, "Alert stream opened, %d open", m_open.load());
+            continue;
+        }
+
+        RuleEngine::format(command.alert, json, sizeof(json));
+        int length = snprintf(event, sizeof(event), "id: %lu\nevent: alert\ndata: %s\n\n",
+                              static_cast<unsigned long>(command.alert.sequence), json);
+        if (length > 0 && static_cast<size_t>(length) < sizeof(event))
+        {
+            broadcast(event);
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#include "common/Arena.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "esp_log.h"
+#include "cJSON.h"
+
+static const char *ARENA_TAG = "Arena";
+
+// Arenas are few and long-lived (one per HTTP worker), so a fixed table is enough
+// to answer "does any arena own this pointer" in jsonFree.
+static constexpr size_t MAX_ARENAS = 4;
+static Arena *registered_arenas[MAX_ARENAS] = {};
+
+static thread_local Arena *current_arena = nullptr;
+
+Arena::Arena(uint8_t *buffer, size_t capacity) : m_buffer(buffer), m_capacity(capacity)
+{
+    for (auto &slot : registered_arenas)
+    {
+        if (slot == nullptr)
+        {
+            slot = this;
+            return;
+        }
+    }
+    ESP_LOGE(ARENA_TAG, "Too many arenas, cJSON frees from this one will hit the heap");
+}
+
+Arena::~Arena()
+{
+    for (auto &slot : registered_arenas)
+    {
+        if (slot == this)
+        {
+            slot = nullptr;
+        }
+    }
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_buffer);
+    uintptr_t start = (base + m_used + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+    size_t end = (start - base) + size;
+    if (end > m_capacity)
+    {
+        return nullptr;
+    }
+    m_used = end;
+    if (m_used > m_high_water)
+    {
+        m_high_water = m_used;
+    }
+    return reinterpret_cast<void *>(start);
+}
+
+char *Arena::format(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    size_t available = m_capacity - m_used;
+    char *out = reinterpret_cast<char *>(m_buffer + m_used);
+    int len = vsnprintf(out, available, fmt, args);
+    va_end(args);
+    if (len < 0 || static_cast<size_t>(len) >= available)
+    {
+        return nullptr;
+    }
+    return static_cast<char *>(allocate(len + 1, 1));
+}
+
+void Arena::reset()
+{
+    m_used = 0;
+}
+
+Arena *Arena::current()
+{
+    return current_arena;
+}
+
+void *Arena::jsonMalloc(size_t size)
+{
+    Arena *arena = current_arena;
+    if (arena)
+    {
+        void *ptr = arena->allocate(size);
+        if (ptr)
+        {
+            return ptr;
+        }
+        arena->m_fallbacks++;
+    }
+    return malloc(size);
+}
+
+void Arena::jsonFree(void *ptr)
+{
+    for (Arena *arena : registered_arenas)
+    {
+        if (arena && arena->owns(ptr))
+        {
+            return; // Released in bulk by reset().
+        }
+    }
+    free(ptr);
+}
+
+void Arena::installJsonHooks()
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = &Arena::jsonMalloc,
+        .free_fn = &Arena::jsonFree,
+    };
+    cJSON_InitHooks(&hooks);
+}
+
+ArenaScope::ArenaScope(Arena &arena) : m_arena(arena), m_previous(current_arena)
+{
+    current_arena = &m_arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+    m_arena.reset();
+    current_arena = m_previous;
+}
@@ -0,0 +1,88 @@
+#include "web/AsyncWorkers.hpp"
+#include "esp_log.h"
+#include "freertos/task.h"
+
+static const char *ASYNC_TAG = "AsyncWorkers";
+
+QueueHandle_t AsyncWorkers::s_jobs = nullptr;
+Arena *AsyncWorkers::s_server_arena = nullptr;
+
+static StaticArena<REQUEST_ARENA_SIZE> worker_arenas[ASYNC_WORKER_COUNT];
+static thread_local Arena *worker_arena = nullptr;
+
+esp_err_t AsyncWorkers::start(Arena &server_arena)
+{
+    s_server_arena = &server_arena;
+    if (s_jobs)
+    {
+        return ESP_OK;
+    }
+    s_jobs = xQueueCreate(ASYNC_QUEUE_LENGTH, sizeof(Job));
+    if (!s_jobs)
+    {
+        ESP_LOGE(ASYNC_TAG, "Failed to create job queue");
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < ASYNC_WORKER_COUNT; ++i)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "http_async_%d", i);
+        if (xTaskCreate(workerTask, name, ASYNC_WORKER_STACK_SIZE, &worker_arenas[i], ASYNC_WORKER_PRIORITY, nullptr) != pdPASS)
+        {
+            ESP_LOGE(ASYNC_TAG, "Failed to start %s", name);
+            return ESP_FAIL;
+        }
+    }
+    ESP_LOGI(ASYNC_TAG, "Started %d async HTTP workers", ASYNC_WORKER_COUNT);
+    return ESP_OK;
+}
+
+esp_err_t AsyncWorkers::submit(httpd_req_t *req, Handler handler)
+{
+    if (worker_arena || !s_jobs)
+    {
+        return handler(req);
+    }
+
+    Job job = {.req = nullptr, .handler = handler};
+    esp_err_t err = httpd_req_async_handler_begin(req, &job.req);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(ASYNC_TAG, "Failed to detach request: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start async handler");
+        return ESP_FAIL;
+    }
+
+    if (xQueueSend(s_jobs, &job, 0) != pdPASS)
+    {
+        ESP_LOGW(ASYNC_TAG, "All workers busy, rejecting %s", req->uri);
+        httpd_resp_set_status(job.req, "503 Service Unavailable");
+        httpd_resp_set_hdr(job.req, "Retry-After", "1");
+        httpd_resp_sendstr(job.req, "Server busy");
+        httpd_req_async_handler_complete(job.req);
+        return ESP_OK;
+    }
+    return ESP_OK;
+}
+
+Arena &AsyncWorkers::requestArena()
+{
+    return worker_arena ? *worker_arena : *s_server_arena;
+}
+
+void AsyncWorkers::workerTask(void *param)
+{
+    worker_arena = static_cast<Arena *>(param);
+    Job job;
+    while (true)
+    {
+        if (xQueueReceive(s_jobs, &job, portMAX_DELAY))
+        {
+            if (job.handler(job.req) != ESP_OK)
+            {
+                ESP_LOGW(ASYNC_TAG, "Async handler failed for %s", job.req->uri);
+            }
+            httpd_req_async_handler_complete(job.req);
+        }
+    }
+}
@@ -0,0 +1,799 @@
+#include "drivers/Collector.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <strings.h>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "mdns.h"
+#include "freertos/task.h"
+#include "drivers/RuleEngine.hpp"
+#include "drivers/WifiManager.hpp"
+
+static const char *COLLECTOR_TAG = "Collector";
+
+// Event bits of the scheduler task.
+#define COLLECTOR_WAKE (1u << 0)
+#define COLLECTOR_RECONFIGURE (1u << 1)
+#define COLLECTOR_DISCOVER (1u << 2)
+
+static uint16_t blockCount(const uint8_t *block)
+{
+    GorillaBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    return header.count;
+}
+
+Collector &Collector::instance()
+{
+    static Collector collector;
+    return collector;
+}
+
+const char *Collector::stateName(PeerState state)
+{
+    switch (state)
+    {
+    case PeerState::Idle:
+        return "idle";
+    case PeerState::Queued:
+        return "queued";
+    case PeerState::Pulling:
+        return "pulling";
+    case PeerState::Backoff:
+        return "backoff";
+    case PeerState::Lost:
+        return "lost";
+    }
+    return "unknown";
+}
+
+const char *Collector::sourceName(PeerSource source)
+{
+    switch (source)
+    {
+    case PeerSource::Mdns:
+        return "mdns";
+    case PeerSource::Static:
+        return "static";
+    }
+    return "unknown";
+}
+
+int Collector::parsePeers(const char *list, PeerAddress *out, size_t max)
+{
+    size_t count = 0;
+    const char *p = list;
+    while (*p != '\0')
+    {
+        const char *end = strchr(p, ',');
+        if (!end)
+        {
+            end = p + strlen(p);
+        }
+        const char *first = p;
+        const char *last = end;
+        p = *end ? end + 1 : end;
+        while (first < last && *first == ' ')
+        {
+            first++;
+        }
+        while (last > first && last[-1] == ' ')
+        {
+            last--;
+        }
+        if (first == last)
+        {
+            continue;
+        }
+
+        const char *colon = static_cast<const char *>(memchr(first, ':', last - first));
+        const char *host_end = colon ? colon : last;
+        size_t host_length = host_end - first;
+        if (host_length == 0 || host_length >= COLLECTOR_HOST_MAX || count == max)
+        {
+            return -1;
+        }
+        for (const char *c = first; c < host_end; ++c)
+        {
+            if (!isalnum(static_cast<unsigned char>(*c)) && *c != '.' && *c != '-')
+            {
+                return -1;
+            }
+        }
+        unsigned long port = COLLECTOR_DEFAULT_PORT;
+        if (colon)
+        {
+            char *port_end = nullptr;
+            port = strtoul(colon + 1, &port_end, 10);
+            if (!isdigit(static_cast<unsigned char>(colon[1])) || port_end != last || port == 0 || port > UINT16_MAX)
+            {
+                return -1;
+            }
+        }
+        if (out)
+        {
+            memcpy(out[count].host, first, host_length);
+            out[count].host[host_length] = '\0';
+            out[count].port = static_cast<uint16_t>(port);
+        }
+        count++;
+    }
+    return static_cast<int>(count);
+}
+
+esp_err_t Collector::start()
+{
+    m_mutex = xSemaphoreCreateMutex();
+    m_events = xEventGroupCreate();
+    m_due = xQueueCreate(COLLECTOR_MAX_PEERS, sizeof(uint8_t));
+    if (!m_mutex || !m_events || !m_due)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    m_stats.last_discovery_us = -1;
+
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &Collector::onGotIp, this, nullptr);
+    SettingsStore::subscribe(SETTINGS_COLLECTOR, &Collector::onSettingsChanged, this);
+    if (xTaskCreate(&Collector::schedulerTask, "collector", COLLECTOR_TASK_STACK, this, COLLECTOR_TASK_PRIORITY,
+                    nullptr) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(m_events, COLLECTOR_RECONFIGURE);
+    return ESP_OK;
+}
+
+CollectorStats Collector::stats()
+{
+    if (!m_mutex)
+    {
+        return {};
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    CollectorStats stats = m_stats;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
+
+bool Collector::peer(size_t index, PeerStats &out)
+{
+    if (index >= COLLECTOR_MAX_PEERS || !m_mutex)
+    {
+        return false;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    const Peer &peer = m_peers[index];
+    bool used = peer.used && !peer.retired;
+    if (used)
+    {
+        out = peer.stats;
+    }
+    xSemaphoreGive(m_mutex);
+    return used;
+}
+
+size_t Collector::copyBlocks(const char *id, uint8_t *out)
+{
+    if (id[0] == '\0' || !m_mutex)
+    {
+        return 0;
+    }
+    size_t copied = 0;
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    for (const Peer &peer : m_peers)
+    {
+        if (!peer.used || strcmp(peer.stats.id, id) != 0)
+        {
+            continue;
+        }
+        const PeerSeries &series = *peer.series;
+        for (size_t i = 0; i < series.filled; ++i)
+        {
+            size_t block = (series.newest + COLLECTOR_PEER_BLOCKS + 1 - series.filled + i) % COLLECTOR_PEER_BLOCKS;
+            memcpy(out + copied * GORILLA_BLOCK_BYTES, series.blocks[block], GORILLA_BLOCK_BYTES);
+            copied++;
+        }
+        break;
+    }
+    xSemaphoreGive(m_mutex);
+    return copied;
+}
+
+void Collector::onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx)
+{
+    Collector *self = static_cast<Collector *>(ctx);
+    xEventGroupSetBits(self->m_events, COLLECTOR_RECONFIGURE);
+}
+
+void Collector::onGotIp(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    Collector *self = static_cast<Collector *>(arg);
+    xEventGroupSetBits(self->m_events, COLLECTOR_DISCOVER);
+}
+
+void Collector::schedulerTask(void *param)
+{
+    static_cast<Collector *>(param)->runScheduler();
+}
+
+void Collector::workerTask(void *param)
+{
+    Worker *worker = static_cast<Worker *>(param);
+    worker->owner->runWorker(*worker);
+}
+
+void Collector::runScheduler()
+{
+    TickType_t wait = portMAX_DELAY;
+    while (true)
+    {
+        EventBits_t bits = xEventGroupWaitBits(m_events, COLLECTOR_WAKE | COLLECTOR_RECONFIGURE | COLLECTOR_DISCOVER,
+                                               pdTRUE, pdFALSE, wait);
+        Settings settings = SettingsStore::get();
+        if (bits & COLLECTOR_RECONFIGURE)
+        {
+            reconfigure(settings);
+        }
+        if (!settings.collector_enabled)
+        {
+            wait = portMAX_DELAY;
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if ((bits & COLLECTOR_DISCOVER) || now >= m_next_discovery_us)
+        {
+            discover();
+            now = esp_timer_get_time();
+            m_next_discovery_us = now + COLLECTOR_DISCOVERY_INTERVAL_S * 1000000LL;
+        }
+        wait = schedule(now);
+    }
+}
+
+esp_err_t Collector::startWorkers()
+{
+    if (m_workers)
+    {
+        return ESP_OK;
+    }
+    m_workers = new (std::nothrow) Worker[COLLECTOR_PULL_WORKERS]();
+    if (!m_workers)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < COLLECTOR_PULL_WORKERS; ++i)
+    {
+        m_workers[i].owner = this;
+        if (xTaskCreate(&Collector::workerTask, "collector_pull", COLLECTOR_WORKER_STACK, &m_workers[i],
+                        COLLECTOR_TASK_PRIORITY, nullptr) != pdPASS)
+        {
+            // The workers already running still serve the queue.
+            ESP_LOGE(COLLECTOR_TAG, "Started only %u of %d pull workers", static_cast<unsigned>(i),
+                     COLLECTOR_PULL_WORKERS);
+            return i ? ESP_OK : ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+void Collector::reconfigure(const Settings &settings)
+{
+    bool enabled = settings.collector_enabled != 0;
+    // Fails harmlessly until mDNS is up; it then advertises the role from the settings.
+    mdns_service_txt_item_set(MDNS_SERVICE_TYPE, MDNS_SERVICE_PROTO, "role", enabled ? "collector" : "node");
+    if (enabled && startWorkers() != ESP_OK)
+    {
+        ESP_LOGE(COLLECTOR_TAG, "No memory for pull workers, collector mode stays off");
+        enabled = false;
+    }
+
+    PeerAddress addresses[COLLECTOR_MAX_STATIC_PEERS];
+    int count = enabled ? parsePeers(settings.collector_peers, addresses, COLLECTOR_MAX_STATIC_PEERS) : 0;
+    count = count < 0 ? 0 : count;
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_stats.enabled = enabled;
+    for (Peer &peer : m_peers)
+    {
+        if (!peer.used)
+        {
+            continue;
+        }
+        bool listed = false;
+        for (int i = 0; i < count && peer.stats.source == PeerSource::Static; ++i)
+        {
+            listed |= strcmp(peer.stats.address.host, addresses[i].host) == 0 &&
+                      peer.stats.address.port == addresses[i].port;
+        }
+        if (!enabled || (peer.stats.source == PeerSource::Static && !listed))
+        {
+            dropPeer(peer);
+        }
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (findOrAdd("", addresses[i], PeerSource::Static) < 0)
+        {
+            ESP_LOGW(COLLECTOR_TAG, "Peer table full, ignoring %s", addresses[i].host);
+        }
+    }
+    m_next_discovery_us = 0;
+    xSemaphoreGive(m_mutex);
+    ESP_LOGI(COLLECTOR_TAG, "Collector mode %s, %d static peers", enabled ? "on" : "off", count);
+}
+
+int Collector::findOrAdd(const char *id, const PeerAddress &address, PeerSource source)
+{
+    int free_slot = -1;
+    int lost_slot = -1;
+    for (size_t i = 0; i < COLLECTOR_MAX_PEERS; ++i)
+    {
+        Peer &peer = m_peers[i];
+        if (!peer.used)
+        {
+            free_slot = free_slot < 0 ? static_cast<int>(i) : free_slot;
+            continue;
+        }
+        if (peer.retired)
+        {
+            continue;
+        }
+        if (id[0] != '\0' && strcmp(peer.stats.id, id) == 0)
+        {
+            // DHCP may have moved a peer found over mDNS; listed addresses stay as configured.
+            if (peer.stats.source == PeerSource::Mdns)
+            {
+                peer.stats.address = address;
+            }
+            return static_cast<int>(i);
+        }
+        if (strcmp(peer.stats.address.host, address.host) == 0 && peer.stats.address.port == address.port)
+        {
+            return static_cast<int>(i);
+        }
+        if (peer.stats.state == PeerState::Lost && lost_slot < 0)
+        {
+            lost_slot = static_cast<int>(i);
+        }
+    }
+
+    int slot = free_slot;
+    if (slot < 0 && lost_slot >= 0)
+    {
+        dropPeer(m_peers[lost_slot]);
+        slot = lost_slot;
+    }
+    if (slot < 0)
+    {
+        return -1;
+    }
+    PeerSeries *series = new (std::nothrow) PeerSeries();
+    if (!series)
+    {
+        return -1;
+    }
+    Peer &peer = m_peers[slot];
+    peer = {};
+    peer.used = true;
+    peer.series = series;
+    peer.last_seen_us = esp_timer_get_time();
+    snprintf(peer.stats.id, sizeof(peer.stats.id), "%s", id);
+    peer.stats.address = address;
+    peer.stats.source = source;
+    peer.stats.state = PeerState::Idle;
+    peer.stats.last_pull_us = -1;
+    m_stats.peers++;
+    ESP_LOGI(COLLECTOR_TAG, "Added %s peer %s at %s:%u", sourceName(source), id[0] ? id : "?", address.host,
+             address.port);
+    return slot;
+}
+
+void Collector::dropPeer(Peer &peer)
+{
+    if (peer.stats.state == PeerState::Pulling)
+    {
+        // The worker drops it once the pull finishes.
+        peer.retired = true;
+        return;
+    }
+    delete peer.series;
+    peer = {};
+    m_stats.peers--;
+}
+
+void Collector::discover()
+{
+    mdns_result_t *results = nullptr;
+    esp_err_t err = mdns_query_ptr(MDNS_SERVICE_TYPE, MDNS_SERVICE_PROTO, COLLECTOR_DISCOVERY_TIMEOUT_MS,
+                                   COLLECTOR_MAX_PEERS, &results);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(COLLECTOR_TAG, "mDNS query failed: %s", esp_err_to_name(err));
+    }
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_stats.discovery_runs++;
+    m_stats.last_discovery_us = now;
+    for (mdns_result_t *result = results; result; result = result->next)
+    {
+        const char *id = nullptr;
+        const char *api = nullptr;
+        for (size_t i = 0; i < result->txt_count; ++i)
+        {
+            if (strcmp(result->txt[i].key, "id") == 0)
+            {
+                id = result->txt[i].value;
+            }
+            else if (strcmp(result->txt[i].key, "api") == 0)
+            {
+                api = result->txt[i].value;
+            }
+        }
+        if (!id || strlen(id) >= sizeof(PeerStats::id) || strcmp(id, WiFiManager::deviceId()) == 0)
+        {
+            continue;
+        }
+        if (!api || strcmp(api, MDNS_API_VERSION) != 0)
+        {
+            ESP_LOGW(COLLECTOR_TAG, "Ignoring peer %s with API version %s", id, api ? api : "?");
+            continue;
+        }
+        PeerAddress address = {};
+        address.port = result->port;
+        for (mdns_ip_addr_t *addr = result->addr; addr; addr = addr->next)
+        {
+            if (addr->addr.type == ESP_IPADDR_TYPE_V4)
+            {
+                snprintf(address.host, sizeof(address.host), IPSTR, IP2STR(&addr->addr.u_addr.ip4));
+                break;
+            }
+        }
+        if (address.host[0] == '\0')
+        {
+            continue;
+        }
+        int index = findOrAdd(id, address, PeerSource::Mdns);
+        if (index < 0)
+        {
+            ESP_LOGW(COLLECTOR_TAG, "Peer table full, ignoring %s", id);
+            continue;
+        }
+        Peer &peer = m_peers[index];
+        peer.last_seen_us = now;
+        if (peer.stats.state == PeerState::Lost)
+        {
+            peer.stats.state = PeerState::Idle;
+            peer.next_pull_us = 0;
+        }
+    }
+    for (Peer &peer : m_peers)
+    {
+        bool waiting = peer.stats.state == PeerState::Idle || peer.stats.state == PeerState::Backoff;
+        if (peer.used && peer.stats.source == PeerSource::Mdns && waiting &&
+            now - peer.last_seen_us > COLLECTOR_PEER_LOST_S * 1000000LL)
+        {
+            ESP_LOGW(COLLECTOR_TAG, "Lost peer %s", peer.stats.id);
+            peer.stats.state = PeerState::Lost;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    mdns_query_results_free(results);
+}
+
+TickType_t Collector::schedule(int64_t now)
+{
+    int64_t next_us = m_next_discovery_us;
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    while (true)
+    {
+        // Longest overdue first, so a peer that requeued itself goes behind the others.
+        Peer *due = nullptr;
+        for (Peer &peer : m_peers)
+        {
+            bool waiting = peer.stats.state == PeerState::Idle || peer.stats.state == PeerState::Backoff;
+            if (!peer.used || peer.retired || !waiting)
+            {
+                continue;
+            }
+            if (peer.next_pull_us > now)
+            {
+                next_us = peer.next_pull_us < next_us ? peer.next_pull_us : next_us;
+                continue;
+            }
+            if (!due || peer.next_pull_us < due->next_pull_us)
+            {
+                due = &peer;
+            }
+        }
+        if (!due)
+        {
+            break;
+        }
+        uint8_t index = static_cast<uint8_t>(due - m_peers);
+        due->stats.state = PeerState::Queued;
+        if (xQueueSend(m_due, &index, 0) != pdPASS)
+        {
+            due->stats.state = PeerState::Idle;
+            break;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    int64_t wait_us = next_us - now;
+    return wait_us <= 0 ? 0 : pdMS_TO_TICKS(wait_us / 1000 + 1);
+}
+
+void Collector::runWorker(Worker &worker)
+{
+    uint8_t index;
+    while (true)
+    {
+        if (xQueueReceive(m_due, &index, portMAX_DELAY) != pdPASS)
+        {
+            continue;
+        }
+        int64_t start_us = esp_timer_get_time();
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        Peer &peer = m_peers[index];
+        // The slot may have been dropped or reused since it was queued.
+        bool take = peer.used && !peer.retired && peer.stats.state == PeerState::Queued;
+        if (take)
+        {
+            peer.stats.state = PeerState::Pulling;
+            m_stats.active_pulls++;
+            if (m_stats.active_pulls > m_stats.peak_active_pulls)
+            {
+                m_stats.peak_active_pulls = m_stats.active_pulls;
+            }
+        }
+        xSemaphoreGive(m_mutex);
+        if (!take)
+        {
+            continue;
+        }
+
+        bool more = false;
+        esp_err_t err = pull(worker, index, more);
+        finishPull(index, err, more, start_us);
+        xEventGroupSetBits(m_events, COLLECTOR_WAKE);
+    }
+}
+
+esp_err_t Collector::pull(Worker &worker, size_t index, bool &more)
+{
+    esp_http_client_handle_t client = nullptr;
+    esp_err_t err = ESP_OK;
+    more = false;
+    for (int batch = 0; batch < COLLECTOR_PULL_MAX_BATCHES; ++batch)
+    {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        PeerStats peer = m_peers[index].stats;
+        xSemaphoreGive(m_mutex);
+
+        err = fetch(worker, client, peer);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+        int status = esp_http_client_get_status_code(client);
+        if (status == 204)
+        {
+            more = false;
+            break;
+        }
+        if (status != 200 || worker.body_overflow || !worker.has_cursor || worker.device[0] == '\0' ||
+            worker.body_length < sizeof(GorillaBlockHeader) || worker.body[0] != GORILLA_BLOCK_VERSION)
+        {
+            ESP_LOGW(COLLECTOR_TAG, "Unexpected answer from %s:%u (status %d)", peer.address.host,
+                     peer.address.port, status);
+            err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+        // Check the whole block before any of it is stored, so the cursor never skips samples.
+        GorillaDecoder check = GorillaDecoder::sealed(worker.body, worker.body_length);
+        uint16_t count = check.remaining();
+        RaptPillData sample;
+        uint16_t decoded = 0;
+        while (check.next(sample))
+        {
+            decoded++;
+        }
+        if (decoded != count)
+        {
+            err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        Peer &target = m_peers[index];
+        bool replaced = target.stats.id[0] != '\0' && strcmp(target.stats.id, worker.device) != 0;
+        if (replaced)
+        {
+            // Another device answers at this address now; its history starts over.
+            ESP_LOGW(COLLECTOR_TAG, "%s:%u is now %s, was %s", peer.address.host, peer.address.port, worker.device,
+                     target.stats.id);
+            resetSeries(target);
+        }
+        else
+        {
+            GorillaDecoder decoder = GorillaDecoder::sealed(worker.body, worker.body_length);
+            while (decoder.next(sample))
+            {
+                store(target, sample);
+                RuleEngine::instance().evaluate(worker.device, sample);
+            }
+            target.stats.cursor_valid = true;
+            target.stats.cursor_boot_id = worker.cursor_boot_id;
+            target.stats.cursor_timestamp = worker.cursor_timestamp;
+            target.stats.pulled_samples += count;
+            target.stats.pulled_bytes += worker.body_length;
+        }
+        snprintf(target.stats.id, sizeof(target.stats.id), "%s", worker.device);
+        xSemaphoreGive(m_mutex);
+
+        more = replaced || worker.remaining > 0;
+        if (!more)
+        {
+            break;
+        }
+    }
+    if (client)
+    {
+        esp_http_client_cleanup(client);
+    }
+    return err;
+}
+
+esp_err_t Collector::fetch(Worker &worker, esp_http_client_handle_t &client, const PeerStats &peer)
+{
+    char url[COLLECTOR_HOST_MAX + 96];
+    if (peer.cursor_valid)
+    {
+        snprintf(url, sizeof(url), "http://%s:%u/api/v1/history/delta?boot=%lu&ts=%lld", peer.address.host,
+                 peer.address.port, static_cast<unsigned long>(peer.cursor_boot_id), peer.cursor_timestamp);
+    }
+    else
+    {
+        snprintf(url, sizeof(url), "http://%s:%u/api/v1/history/delta?tail=%d", peer.address.host, peer.address.port,
+                 COLLECTOR_INITIAL_TAIL);
+    }
+
+    worker.body_length = 0;
+    worker.body_overflow = false;
+    worker.device[0] = '\0';
+    worker.has_cursor = false;
+    worker.remaining = 0;
+    if (!client)
+    {
+        esp_http_client_config_t config = {};
+        config.url = url;
+        config.method = HTTP_METHOD_GET;
+        config.timeout_ms = COLLECTOR_PULL_TIMEOUT_MS;
+        config.event_handler = &Collector::onHttpEvent;
+        config.user_data = &worker;
+        // The batches of one pull share a connection.
+        config.keep_alive_enable = true;
+        client = esp_http_client_init(&config);
+        if (!client)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    else
+    {
+        esp_http_client_set_url(client, url);
+    }
+    return esp_http_client_perform(client);
+}
+
+esp_err_t Collector::onHttpEvent(esp_http_client_event_t *event)
+{
+    Worker &worker = *static_cast<Worker *>(event->user_data);
+    switch (event->event_id)
+    {
+    case HTTP_EVENT_ON_HEADER:
+        if (strcasecmp(event->header_key, "X-RaptMate-Device") == 0)
+        {
+            snprintf(worker.device, sizeof(worker.device), "%s", event->header_value);
+        }
+        else if (strcasecmp(event->header_key, "X-RaptMate-Cursor") == 0)
+        {
+            unsigned long boot_id;
+            long long timestamp;
+            worker.has_cursor = sscanf(event->header_value, "%lu:%lld", &boot_id, &timestamp) == 2;
+            worker.cursor_boot_id = static_cast<uint32_t>(boot_id);
+            worker.cursor_timestamp = timestamp;
+        }
+        else if (strcasecmp(event->header_key, "X-RaptMate-Remaining") == 0)
+        {
+            worker.remaining = strtoul(event->header_value, nullptr, 10);
+        }
+        break;
+    case HTTP_EVENT_ON_DATA:
+        if (worker.body_length + event->data_len > sizeof(worker.body))
+        {
+            worker.body_overflow = true;
+            break;
+        }
+        memcpy(worker.body + worker.body_length, event->data, event->data_len);
+        worker.body_length += event->data_len;
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+void Collector::finishPull(size_t index, esp_err_t err, bool more, int64_t start_us)
+{
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    Peer &peer = m_peers[index];
+    m_stats.active_pulls--;
+    peer.stats.pulls++;
+    peer.stats.last_pull_us = now;
+    peer.stats.last_pull_ms = static_cast<uint32_t>((now - start_us) / 1000);
+    if (err == ESP_OK)
+    {
+        peer.stats.backoff_ms = 0;
+        peer.stats.state = PeerState::Idle;
+        peer.next_pull_us = more ? now : now + COLLECTOR_PULL_INTERVAL_S * 1000000LL;
+    }
+    else
+    {
+        peer.stats.failures++;
+        peer.stats.last_error = err;
+        peer.stats.backoff_ms = peer.stats.backoff_ms ? peer.stats.backoff_ms * 2 : COLLECTOR_BACKOFF_BASE_MS;
+        if (peer.stats.backoff_ms > COLLECTOR_BACKOFF_MAX_MS)
+        {
+            peer.stats.backoff_ms = COLLECTOR_BACKOFF_MAX_MS;
+        }
+        peer.stats.state = PeerState::Backoff;
+        peer.next_pull_us = now + peer.stats.backoff_ms * 1000LL;
+        ESP_LOGW(COLLECTOR_TAG, "Pull from %s:%u failed (%s), retrying in %lu ms", peer.stats.address.host,
+                 peer.stats.address.port, esp_err_to_name(err), static_cast<unsigned long>(peer.stats.backoff_ms));
+    }
+    if (peer.retired)
+    {
+        dropPeer(peer);
+    }
+    xSemaphoreGive(m_mutex);
+}
+
+void Collector::resetSeries(Peer &peer)
+{
+    PeerSeries &series = *peer.series;
+    series.newest = 0;
+    series.filled = 1;
+    series.encoder = GorillaEncoder(series.blocks[0], GORILLA_BLOCK_BYTES);
+    peer.stats.cursor_valid = false;
+    peer.stats.held_samples = 0;
+    peer.stats.has_latest = false;
+}
+
+void Collector::store(Peer &peer, const RaptPillData &sample)
+{
+    PeerSeries &series = *peer.series;
+    if (!series.encoder.append(sample))
+    {
+        series.newest = (series.newest + 1) % COLLECTOR_PEER_BLOCKS;
+        if (series.filled < COLLECTOR_PEER_BLOCKS)
+        {
+            series.filled++;
+        }
+        series.encoder = GorillaEncoder(series.blocks[series.newest], GORILLA_BLOCK_BYTES);
+        series.encoder.append(sample);
+    }
+    size_t held = 0;
+    for (size_t i = 0; i < series.filled; ++i)
+    {
+        held += blockCount(series.blocks[(series.newest + COLLECTOR_PEER_BLOCKS - i) % COLLECTOR_PEER_BLOCKS]);
+    }
+    peer.stats.held_samples = held;
+    peer.stats.latest = sample;
+    peer.stats.has_latest = true;
+}
@@ -0,0 +1,370 @@
+#include "drivers/DecoderRegistry.hpp"
+#include <cstring>
+#include "esp_log.h"
+#include "common/CompactSample.hpp"
+
+static const char *DECODER_TAG = "Decoders";
+
+// Every value a fixed point field of a RAPT Pill advert decodes to survives CompactSample.
+static_assert(CompactCodec::lossless<AccelChannel, int16_t>(), "Acceleration does not round-trip");
+static_assert(CompactCodec::lossless<BatteryChannel, uint16_t>(), "Battery does not round-trip");
+
+namespace
+{
+    // Bytes 4..19 of a Tilt's iBeacon UUID, A495BBx0-C5B1-4B44-B512-1370F02D74DE, where x is the colour.
+    const uint8_t tilt_uuid_tail[] = {0xC5, 0xB1, 0x4B, 0x44, 0xB5, 0x12, 0x13, 0x70, 0xF0, 0x2D, 0x74, 0xDE};
+
+    // iSpindel batteries are single Li-ion cells.
+    constexpr float ispindel_battery_empty_v = 3.0f;
+    constexpr float ispindel_battery_full_v = 4.2f;
+
+    uint16_t readU16(const uint8_t *data)
+    {
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    uint32_t readU32(const uint8_t *data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    }
+
+    bool decodeRaptV1(const uint8_t *data, size_t length, RaptPillData &out)
+    {
+        // The registry only passes matching lengths; a decoder called directly must not read past the data.
+        if (length < DECODER_RAPT_LENGTH)
+        {
+            return false;
+        }
+
+        float temp_celsius = readU16(data + 11) / 256.0f;
+        // Specific gravity (raw value).
+        float sg = static_cast<float>(readU32(data + 13));
+        // Raw accelerometer data, scaled.
+        float accel_x = static_cast<int16_t>(readU16(data + 17)) / 16.0f;
+        float accel_y = static_cast<int16_t>(readU16(data + 19)) / 16.0f;
+        float accel_z = static_cast<int16_t>(readU16(data + 21)) / 16.0f;
+        // Battery state-of-charge (percentage * 256).
+        float battery = readU16(data + 23) / 256.0f;
+
+        out = {
+            .timestamp = 0,
+            .gravity_velocity = 0.0f, // Not available in version 0x01
+            .temperature_celsius = temp_celsius,
+            .specific_gravity = sg,
+            .accel_x = accel_x,
+            .accel_y = accel_y,
+            .accel_z = accel_z,
+            .battery = battery,
+            .boot_id = 0};
+
+        // The MAC address is only formatted when debug logging is compiled in.
+        ESP_LOGD(DECODER_TAG, "MAC Address: %02X:%02X:%02X:%02X:%02X:%02X, Specific Gravity: %.4f, Temperature: %.2f °C, Battery: %.2f%%, "
+                              "Accelerometer (X, Y, Z): %.2f, %.2f, %.2f",
+                 data[5], data[6], data[7], data[8], data[9], data[10], sg, temp_celsius, battery, accel_x, accel_y, accel_z);
+        return true;
+    }
+
+    bool decodeRaptV2(const uint8_t *data, size_t length, RaptPillData &out)
+    {
+        if (length < DECODER_RAPT_LENGTH)
+        {
+            return false;
+        }
+
+        // Gravity velocity is only valid when flagged.
+        uint8_t cc = data[6];
+        float gv = 0.0f;
+        if (cc == 0x01)
+        {
+            uint32_t gv_raw = readU32(data + 7);
+            memcpy(&gv, &gv_raw, sizeof(float));
+        }
+
+        // Temperature (Kelvin * 128), converted to Celsius.
+        float temp_celsius = TemperatureChannel::decode(readU16(data + 11));
+        // Specific gravity (as a float).
+        uint32_t sg_raw = readU32(data + 13);
+        float sg;
+        memcpy(&sg, &sg_raw, sizeof(float));
+        // Fixed point fields decode as CompactSample does, so they survive it unchanged.
+        float accel_x = AccelChannel::decode(static_cast<int16_t>(readU16(data + 17)));
+        float accel_y = AccelChannel::decode(static_cast<int16_t>(readU16(data + 19)));
+        float accel_z = AccelChannel::decode(static_cast<int16_t>(readU16(data + 21)));
+        float battery = BatteryChannel::decode(readU16(data + 23));
+
+        out = {
+            .timestamp = 0,
+            .gravity_velocity = gv,
+            .temperature_celsius = temp_celsius,
+            .specific_gravity = sg,
+            .accel_x = accel_x,
+            .accel_y = accel_y,
+            .accel_z = accel_z,
+            .battery = battery,
+            .boot_id = 0};
+
+        ESP_LOGD(DECODER_TAG, "Gravity Velocity Valid: %s, Gravity Velocity: %.2f points/day, Temperature: %.2f °C, Specific Gravity: %.4f, "
+                              "Accelerometer (X, Y, Z): %.2f, %.2f, %.2f, Battery: %.2f%%",
+                 cc == 0x01 ? "Yes" : "No", gv, temp_celsius, sg, accel_x, accel_y, accel_z, battery);
+        return true;
+    }
+
+    bool decodeTilt(const uint8_t *data, size_t length, RaptPillData &out)
+    {
+        if (length < DECODER_IBEACON_LENGTH)
+        {
+            return false;
+        }
+
+        // The colour sits in the high nibble of UUID byte 3: 0x10 red to 0x80 pink.
+        uint8_t colour = data[7];
+        if ((colour & 0x0F) != 0 || colour < 0x10 || colour > 0x80 ||
+            memcmp(data + 8, tilt_uuid_tail, sizeof(tilt_uuid_tail)) != 0)
+        {
+            return false;
+        }
+
+        // Major is the temperature in Fahrenheit and minor the gravity * 1000; a Tilt Pro sends ten times both.
+        uint16_t major = readU16(data + 20);
+        uint16_t minor = readU16(data + 22);
+        bool pro = minor > 5000;
+        float fahrenheit = pro ? major / 10.0f : major;
+        float sg = pro ? minor / 10000.0f : minor / 1000.0f;
+
+        // A Tilt has no accelerometer or battery gauge to report.
+        out = {
+            .timestamp = 0,
+            .gravity_velocity = 0.0f,
+            .temperature_celsius = (fahrenheit - 32.0f) * 5.0f / 9.0f,
+            .specific_gravity = sg,
+            .accel_x = 0.0f,
+            .accel_y = 0.0f,
+            .accel_z = 0.0f,
+            .battery = 0.0f,
+            .boot_id = 0};
+
+        ESP_LOGD(DECODER_TAG, "Tilt%s colour %u, Specific Gravity: %.4f, Temperature: %.2f °C",
+                 pro ? " Pro" : "", colour >> 4, sg, out.temperature_celsius);
+        return true;
+    }
+
+    const HydrometerDecoder rapt_v1 = {
+        .name = "rapt_v1",
+        .company_id = DECODER_RAPT_COMPANY,
+        .signature = {'P', 'T', 0x01},
+        .signature_length = 3,
+        .min_length = DECODER_RAPT_LENGTH,
+        .max_length = DECODER_RAPT_LENGTH,
+        .min_interval_us = DECODER_RAPT_INTERVAL_US,
+        .decode = &decodeRaptV1,
+    };
+
+    const HydrometerDecoder rapt_v2 = {
+        .name = "rapt_v2",
+        .company_id = DECODER_RAPT_COMPANY,
+        .signature = {'P', 'T', 0x02},
+        .signature_length = 3,
+        .min_length = DECODER_RAPT_LENGTH,
+        .max_length = DECODER_RAPT_LENGTH,
+        .min_interval_us = DECODER_RAPT_INTERVAL_US,
+        .decode = &decodeRaptV2,
+    };
+
+    // iBeacon type and length, then the part of the UUID all Tilt colours share.
+    const HydrometerDecoder tilt = {
+        .name = "tilt",
+        .company_id = DECODER_IBEACON_COMPANY,
+        .signature = {0x02, 0x15, 0xA4, 0x95, 0xBB},
+        .signature_length = 5,
+        .min_length = DECODER_IBEACON_LENGTH,
+        .max_length = DECODER_IBEACON_LENGTH,
+        .min_interval_us = DECODER_TILT_INTERVAL_US,
+        .decode = &decodeTilt,
+    };
+}
+
+DecoderRegistry &DecoderRegistry::instance()
+{
+    static DecoderRegistry registry;
+    return registry;
+}
+
+DecoderRegistry::DecoderRegistry()
+{
+    memset(m_slots, DECODER_MAX, sizeof(m_slots));
+    add(&rapt_v1);
+    add(&rapt_v2);
+    add(&tilt);
+}
+
+size_t DecoderRegistry::slotFor(uint16_t company_id)
+{
+    return (company_id ^ (company_id >> 8) ^ (company_id >> 4)) & (DECODER_SLOTS - 1);
+}
+
+esp_err_t DecoderRegistry::add(const HydrometerDecoder *decoder)
+{
+    static_assert((DECODER_SLOTS & (DECODER_SLOTS - 1)) == 0, "DECODER_SLOTS must be a power of two");
+    static_assert(DECODER_SLOTS >= 2 * DECODER_MAX, "Keep the slots at most half full");
+    if (decoder->signature_length > DECODER_SIGNATURE_MAX || decoder->min_length < 2 + decoder->signature_length)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (m_count == DECODER_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t index = m_count++;
+    m_decoders[index] = decoder;
+    m_next[index] = DECODER_MAX;
+
+    // Open addressing by company; decoders of a company already present join the end of its chain.
+    size_t slot = slotFor(decoder->company_id);
+    while (m_slots[slot] != DECODER_MAX && m_decoders[m_slots[slot]]->company_id != decoder->company_id)
+    {
+        slot = (slot + 1) & (DECODER_SLOTS - 1);
+    }
+    if (m_slots[slot] == DECODER_MAX)
+    {
+        m_slots[slot] = static_cast<uint8_t>(index);
+        return ESP_OK;
+    }
+    size_t last = m_slots[slot];
+    while (m_next[last] != DECODER_MAX)
+    {
+        last = m_next[last];
+    }
+    m_next[last] = static_cast<uint8_t>(index);
+    return ESP_OK;
+}
+
+bool DecoderRegistry::match(const uint8_t *advert, size_t length, DecoderMatch &out)
+{
+    m_adverts.fetch_add(1, std::memory_order_relaxed);
+    // Walk the length-type-value structures for the manufacturer data and nothing else.
+    size_t offset = 0;
+    while (offset + 1 < length)
+    {
+        size_t field = advert[offset];
+        if (field == 0 || offset + 1 + field > length)
+        {
+            break;
+        }
+        uint8_t type = advert[offset + 1];
+        const uint8_t *data = advert + offset + 2;
+        size_t data_length = field - 1;
+        offset += 1 + field;
+        if (type != DECODER_AD_MANUFACTURER || data_length < 2)
+        {
+            continue;
+        }
+
+        uint16_t company_id = static_cast<uint16_t>(data[0] | (data[1] << 8));
+        size_t slot = slotFor(company_id);
+        while (m_slots[slot] != DECODER_MAX && m_decoders[m_slots[slot]]->company_id != company_id)
+        {
+            slot = (slot + 1) & (DECODER_SLOTS - 1);
+        }
+        for (size_t index = m_slots[slot]; index != DECODER_MAX; index = m_next[index])
+        {
+            const HydrometerDecoder *decoder = m_decoders[index];
+            if (data_length >= decoder->min_length && data_length <= decoder->max_length &&
+                memcmp(data + 2, decoder->signature, decoder->signature_length) == 0)
+            {
+                m_counters[index].matched.fetch_add(1, std::memory_order_relaxed);
+                out = {.decoder = decoder, .index = index, .data = data, .length = data_length};
+                return true;
+            }
+        }
+        break;
+    }
+    m_rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool DecoderRegistry::decode(const DecoderMatch &match, RaptPillData &out)
+{
+    bool decoded = match.decoder->decode(match.data, match.length, out);
+    if (decoded)
+    {
+        m_counters[match.index].decoded.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_counters[match.index].failed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return decoded;
+}
+
+DecoderStats DecoderRegistry::stats()
+{
+    DecoderStats stats = {};
+    stats.adverts = m_adverts.load(std::memory_order_relaxed);
+    stats.rejected = m_rejected.load(std::memory_order_relaxed);
+    stats.count = m_count;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        stats.names[i] = m_decoders[i]->name;
+        stats.decoders[i] = {
+            .matched = m_counters[i].matched.load(std::memory_order_relaxed),
+            .decoded = m_counters[i].decoded.load(std::memory_order_relaxed),
+            .failed = m_counters[i].failed.load(std::memory_order_relaxed),
+        };
+    }
+    return stats;
+}
+
+bool DecoderRegistry::decodeISpindel(const cJSON *json, RaptPillData &out)
+{
+    const cJSON *gravity = cJSON_GetObjectItem(json, "gravity");
+    const cJSON *temperature = cJSON_GetObjectItem(json, "temperature");
+    const cJSON *units = cJSON_GetObjectItem(json, "temp_units");
+    const cJSON *battery = cJSON_GetObjectItem(json, "battery");
+    if (!cJSON_IsNumber(gravity) || !cJSON_IsNumber(temperature) || (units && !cJSON_IsString(units)))
+    {
+        return false;
+    }
+
+    float sg = static_cast<float>(gravity->valuedouble);
+    if (sg > 2.0f)
+    {
+        // Degrees Plato.
+        sg = 1.0f + sg / (258.6f - sg / 258.2f * 227.1f);
+    }
+    float celsius = static_cast<float>(temperature->valuedouble);
+    const char *unit = units ? units->valuestring : "C";
+    if (strcmp(unit, "F") == 0)
+    {
+        celsius = (celsius - 32.0f) * 5.0f / 9.0f;
+    }
+    else if (strcmp(unit, "K") == 0)
+    {
+        celsius -= 273.15f;
+    }
+    else if (strcmp(unit, "C") != 0)
+    {
+        return false;
+    }
+    float percent = 0.0f;
+    if (cJSON_IsNumber(battery))
+    {
+        percent = (static_cast<float>(battery->valuedouble) - ispindel_battery_empty_v) * 100.0f /
+                  (ispindel_battery_full_v - ispindel_battery_empty_v);
+        percent = percent < 0.0f ? 0.0f : percent > 100.0f ? 100.0f : percent;
+        // Report it in the 1/256 % steps of a pill, which CompactSample holds exactly.
+        percent = BatteryChannel::decode(BatteryChannel::encode(percent));
+    }
+
+    // The tilt angle is not in accelerometer units, so the accelerometer channels stay 0.
+    out = {
+        .timestamp = 0,
+        .gravity_velocity = 0.0f,
+        .temperature_celsius = celsius,
+        .specific_gravity = sg,
+        .accel_x = 0.0f,
+        .accel_y = 0.0f,
+        .accel_z = 0.0f,
+        .battery = percent,
+        .boot_id = 0};
+    return true;
+}
@@ -0,0 +1,374 @@
+#include "storage/FileBackend.hpp"
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_littlefs.h"
+
+static const char *FILE_TAG = "FileBackend";
+
+// SPIFFS keeps descriptors open for the log and the tail log, plus one for a reader and one for the legacy import.
+#define SPIFFS_MAX_FILES 4
+
+static size_t fileSize(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
+FileBackend::FileBackend(const char *base_path, const char *partition_label)
+    : m_base_path(base_path), m_partition_label(partition_label)
+{
+    snprintf(m_log_path, sizeof(m_log_path), "%s/history.log", base_path);
+    snprintf(m_old_path, sizeof(m_old_path), "%s/history.old", base_path);
+    snprintf(m_tail_path, sizeof(m_tail_path), "%s/tail.log", base_path);
+}
+
+FileBackend::~FileBackend()
+{
+    if (m_log)
+    {
+        fclose(m_log);
+    }
+    if (m_tail)
+    {
+        fclose(m_tail);
+    }
+}
+
+esp_err_t FileBackend::doMount()
+{
+    esp_err_t err = mountFilesystem();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    size_t total = 0, used = 0;
+    filesystemInfo(total, used);
+    m_segment_limit = total * FILE_BACKEND_SEGMENT_PERCENT / 100;
+
+    ReadState scan = {.skip = 0, .remaining = SIZE_MAX, .visitor = nullptr, .ctx = nullptr, .bytes_read = 0, .records = 0, .stopped = false};
+    readFile(m_old_path, scan);
+    m_old_size = fileSize(m_old_path);
+    m_old_records = scan.records;
+
+    scan.records = 0;
+    size_t valid = readFile(m_log_path, scan);
+    m_log_size = fileSize(m_log_path);
+    m_log_records = scan.records;
+    if (valid != m_log_size)
+    {
+        // Appending after a torn frame would leave the new records unreachable.
+        ESP_LOGW(FILE_TAG, "Torn record at offset %u of %s, rotating", (unsigned)valid, m_log_path);
+        doRotate();
+        noteRotation();
+    }
+
+    ReadState tail_scan = {.skip = 0, .remaining = SIZE_MAX, .visitor = nullptr, .ctx = nullptr, .bytes_read = 0, .records = 0, .stopped = false};
+    m_tail_size = readFile(m_tail_path, tail_scan);
+    if (m_tail_size != fileSize(m_tail_path))
+    {
+        // Keep the frames before the torn one; appending behind it would hide new ones.
+        ESP_LOGW(FILE_TAG, "Torn record at offset %u of %s", (unsigned)m_tail_size, m_tail_path);
+        char copy_path[FILE_BACKEND_PATH_MAX];
+        snprintf(copy_path, sizeof(copy_path), "%s/tail.new", m_base_path);
+        FILE *copy = fopen(copy_path, "wb");
+        if (copy)
+        {
+            ReadState copy_state = {.skip = 0, .remaining = SIZE_MAX, .visitor = [](const uint8_t *record, size_t length, void *ctx)
+                                    { return writeFrame(static_cast<FILE *>(ctx), record, length) == ESP_OK; },
+                                    .ctx = copy, .bytes_read = 0, .records = 0, .stopped = false};
+            readFile(m_tail_path, copy_state);
+            fclose(copy);
+            remove(m_tail_path);
+            rename(copy_path, m_tail_path);
+        }
+        m_tail_size = fileSize(m_tail_path);
+    }
+
+    err = m_log ? ESP_OK : openLog();
+    if (err == ESP_OK)
+    {
+        importLegacyCsv();
+    }
+    return err;
+}
+
+esp_err_t FileBackend::openLog()
+{
+    m_log = fopen(m_log_path, "ab");
+    if (!m_log)
+    {
+        ESP_LOGE(FILE_TAG, "Failed to open %s", m_log_path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void FileBackend::importLegacyCsv()
+{
+    // Earlier firmware kept one CSV row per sample in data.csv.
+    char legacy_path[FILE_BACKEND_PATH_MAX];
+    snprintf(legacy_path, sizeof(legacy_path), "%s/data.csv", m_base_path);
+    FILE *csv = fopen(legacy_path, "r");
+    if (!csv)
+    {
+        return;
+    }
+
+    char line[256];
+    size_t imported = 0;
+    while (fgets(line, sizeof(line), csv))
+    {
+        size_t length = strcspn(line, "\r\n");
+        if (length > 0 && doAppend(line, length) == ESP_OK)
+        {
+            imported++;
+        }
+    }
+    fclose(csv);
+    remove(legacy_path);
+    ESP_LOGI(FILE_TAG, "Imported %u records from %s", (unsigned)imported, legacy_path);
+}
+
+esp_err_t FileBackend::doAppend(const void *record, size_t length)
+{
+    if (!m_log)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t frame_size = sizeof(StorageFrameHeader) + length;
+    if (m_log_size > 0 && m_log_size + frame_size > m_segment_limit)
+    {
+        doRotate();
+        noteRotation();
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (writeFrame(m_log, record, length) == ESP_OK)
+        {
+            m_log_size += frame_size;
+            m_log_records++;
+            return ESP_OK;
+        }
+        // Most likely the filesystem is full. Whatever part of the frame made it
+        // now ends the old generation, and dropping that generation frees space.
+        ESP_LOGW(FILE_TAG, "Write to %s failed, rotating", m_log_path);
+        m_log_size = fileSize(m_log_path);
+        doRotate();
+        noteRotation();
+        if (!m_log)
+        {
+            break;
+        }
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t FileBackend::writeFrame(FILE *file, const void *record, size_t length)
+{
+    StorageFrameHeader header = {.length = static_cast<uint16_t>(length), .crc = frameCrc(record, length)};
+    if (fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(record, 1, length, file) == length &&
+        fflush(file) == 0)
+    {
+        return ESP_OK;
+    }
+    clearerr(file);
+    return ESP_FAIL;
+}
+
+size_t FileBackend::readFile(const char *path, ReadState &state)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    size_t offset = 0;
+    StorageFrameHeader header;
+    while (!state.stopped && fread(&header, sizeof(header), 1, file) == 1)
+    {
+        if (header.length == 0 || header.length > STORAGE_MAX_RECORD ||
+            fread(m_record, 1, header.length, file) != header.length ||
+            frameCrc(m_record, header.length) != header.crc)
+        {
+            break;
+        }
+        offset += sizeof(header) + header.length;
+        state.bytes_read += sizeof(header) + header.length;
+        state.records++;
+
+        if (state.skip > 0)
+        {
+            state.skip--;
+            continue;
+        }
+        if (state.remaining == 0)
+        {
+            state.stopped = true;
+            break;
+        }
+        state.remaining--;
+        if (state.visitor && !state.visitor(m_record, header.length, state.ctx))
+        {
+            state.stopped = true;
+        }
+    }
+    fclose(file);
+    return offset;
+}
+
+esp_err_t FileBackend::doRead(size_t first, size_t count, RecordVisitor visitor, void *ctx, size_t &bytes_read)
+{
+    // Records of the old generation come first; skip the whole file when possible.
+    ReadState state = {.skip = first, .remaining = count, .visitor = visitor, .ctx = ctx, .bytes_read = 0, .records = 0, .stopped = false};
+    if (first >= m_old_records)
+    {
+        state.skip -= m_old_records;
+    }
+    else
+    {
+        readFile(m_old_path, state);
+    }
+    if (!state.stopped && state.remaining > 0)
+    {
+        readFile(m_log_path, state);
+    }
+    bytes_read = state.bytes_read;
+    return ESP_OK;
+}
+
+esp_err_t FileBackend::doTruncate()
+{
+    if (m_log)
+    {
+        fclose(m_log);
+        m_log = nullptr;
+    }
+    remove(m_old_path);
+    remove(m_log_path);
+    m_log_size = m_old_size = 0;
+    m_log_records = m_old_records = 0;
+    return openLog();
+}
+
+esp_err_t FileBackend::doRotate()
+{
+    if (m_log)
+    {
+        fclose(m_log);
+        m_log = nullptr;
+    }
+    remove(m_old_path);
+    if (rename(m_log_path, m_old_path) != 0)
+    {
+        // Nothing to keep; start over rather than appending behind a bad frame.
+        remove(m_log_path);
+        m_old_size = 0;
+        m_old_records = 0;
+    }
+    else
+    {
+        m_old_size = m_log_size;
+        m_old_records = m_log_records;
+    }
+    m_log_size = 0;
+    m_log_records = 0;
+    return openLog();
+}
+
+esp_err_t FileBackend::doSync()
+{
+    if (!m_log || fflush(m_log) != 0 || fsync(fileno(m_log)) != 0)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+size_t FileBackend::doRecords()
+{
+    return m_old_records + m_log_records;
+}
+
+esp_err_t FileBackend::doAppendTail(const void *record, size_t length)
+{
+    if (!m_tail)
+    {
+        m_tail = fopen(m_tail_path, "ab");
+        if (!m_tail)
+        {
+            ESP_LOGE(FILE_TAG, "Failed to open %s", m_tail_path);
+            return ESP_FAIL;
+        }
+    }
+    esp_err_t err = writeFrame(m_tail, record, length);
+    if (err == ESP_OK)
+    {
+        m_tail_size += sizeof(StorageFrameHeader) + length;
+    }
+    return err;
+}
+
+esp_err_t FileBackend::doReadTail(RecordVisitor visitor, void *ctx)
+{
+    ReadState state = {.skip = 0, .remaining = SIZE_MAX, .visitor = visitor, .ctx = ctx, .bytes_read = 0, .records = 0, .stopped = false};
+    readFile(m_tail_path, state);
+    return ESP_OK;
+}
+
+esp_err_t FileBackend::doClearTail()
+{
+    if (m_tail)
+    {
+        fclose(m_tail);
+        m_tail = nullptr;
+    }
+    remove(m_tail_path);
+    m_tail_size = 0;
+    return ESP_OK;
+}
+
+void FileBackend::spaceStats(StorageStats &stats)
+{
+    size_t total = 0, used = 0;
+    filesystemInfo(total, used);
+    stats.capacity_bytes = total;
+    stats.used_bytes = used;
+    stats.payload_bytes = m_old_size + m_log_size - (m_old_records + m_log_records) * sizeof(StorageFrameHeader);
+}
+
+esp_err_t SpiffsBackend::mountFilesystem()
+{
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = m_base_path,
+        .partition_label = m_partition_label,
+        .max_files = SPIFFS_MAX_FILES,
+        .format_if_mount_failed = false,
+    };
+    return esp_vfs_spiffs_register(&conf);
+}
+
+esp_err_t SpiffsBackend::filesystemInfo(size_t &total, size_t &used)
+{
+    return esp_spiffs_info(m_partition_label, &total, &used);
+}
+
+esp_err_t LittleFsBackend::mountFilesystem()
+{
+    esp_vfs_littlefs_conf_t conf = {};
+    conf.base_path = m_base_path;
+    conf.partition_label = m_partition_label;
+    // The partition may still hold SPIFFS or raw records from another backend.
+    conf.format_if_mount_failed = true;
+    return esp_vfs_littlefs_register(&conf);
+}
+
+esp_err_t LittleFsBackend::filesystemInfo(size_t &total, size_t &used)
+{
+    return esp_littlefs_info(m_partition_label, &total, &used);
+}
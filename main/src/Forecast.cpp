@@ -0,0 +1,437 @@
+#include "common/Forecast.hpp"
+#include <cmath>
+#include <cstring>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "common/HistoryStore.hpp"
+#include "common/TimeBase.hpp"
+
+static const char *FORECAST_TAG = "Forecast";
+
+namespace
+{
+    constexpr size_t parameter_count = 4;
+
+    // Parameters in gravity points (1000 * (SG - 1)) and hours, which keeps single precision well conditioned.
+    struct Logistic
+    {
+        float p[parameter_count];
+
+        float &final() { return p[0]; }
+        float &amplitude() { return p[1]; }
+        float &rate() { return p[2]; }
+        float &midpoint() { return p[3]; }
+
+        // Value at hours, and its partial derivatives by each parameter if gradient is given.
+        float evaluate(float hours, float *gradient) const
+        {
+            float exponent = p[2] * (hours - p[3]);
+            exponent = exponent > 30.0f ? 30.0f : exponent < -30.0f ? -30.0f : exponent;
+            float e = expf(exponent);
+            float d = 1.0f + e;
+            if (gradient)
+            {
+                float slope = p[1] * e / (d * d);
+                gradient[0] = 1.0f;
+                gradient[1] = 1.0f / d;
+                gradient[2] = -slope * (hours - p[3]);
+                gradient[3] = slope * p[2];
+            }
+            return p[0] + p[1] / d;
+        }
+    };
+
+    float toPoints(float gravity)
+    {
+        return (gravity - 1.0f) * 1000.0f;
+    }
+
+    float toGravity(float points)
+    {
+        return 1.0f + points / 1000.0f;
+    }
+
+    float cost(const Logistic &model, const ForecastPoint *points, size_t count)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float residual = toPoints(points[i].gravity) - model.evaluate(points[i].hours, nullptr);
+            sum += residual * residual;
+        }
+        return sum;
+    }
+
+    // Keep the curve decreasing and within gravities a hydrometer reads.
+    void constrain(Logistic &model)
+    {
+        model.final() = model.final() < -20.0f ? -20.0f : model.final() > 200.0f ? 200.0f : model.final();
+        model.amplitude() = model.amplitude() < 0.1f ? 0.1f : model.amplitude();
+        model.rate() = model.rate() < 0.001f ? 0.001f : model.rate() > 10.0f ? 10.0f : model.rate();
+    }
+
+    // Solve the symmetric system a x = b in place by Gaussian elimination with partial pivoting.
+    bool solve(float a[parameter_count][parameter_count], float b[parameter_count], float x[parameter_count])
+    {
+        for (size_t column = 0; column < parameter_count; ++column)
+        {
+            size_t pivot = column;
+            for (size_t row = column + 1; row < parameter_count; ++row)
+            {
+                if (fabsf(a[row][column]) > fabsf(a[pivot][column]))
+                {
+                    pivot = row;
+                }
+            }
+            if (fabsf(a[pivot][column]) < 1e-12f)
+            {
+                return false;
+            }
+            if (pivot != column)
+            {
+                for (size_t k = 0; k < parameter_count; ++k)
+                {
+                    float swap = a[column][k];
+                    a[column][k] = a[pivot][k];
+                    a[pivot][k] = swap;
+                }
+                float swap = b[column];
+                b[column] = b[pivot];
+                b[pivot] = swap;
+            }
+            for (size_t row = column + 1; row < parameter_count; ++row)
+            {
+                float factor = a[row][column] / a[column][column];
+                for (size_t k = column; k < parameter_count; ++k)
+                {
+                    a[row][k] -= factor * a[column][k];
+                }
+                b[row] -= factor * b[column];
+            }
+        }
+        for (size_t row = parameter_count; row-- > 0;)
+        {
+            float sum = b[row];
+            for (size_t k = row + 1; k < parameter_count; ++k)
+            {
+                sum -= a[row][k] * x[k];
+            }
+            x[row] = sum / a[row][row];
+        }
+        return true;
+    }
+}
+
+Forecast &Forecast::instance()
+{
+    static Forecast forecast;
+    return forecast;
+}
+
+Forecast::Forecast()
+{
+    m_mutex = xSemaphoreCreateMutex();
+}
+
+ForecastResult Forecast::current()
+{
+    HistoryRange range = HistoryStore::instance().storedRange();
+    uint32_t generation = TimeBase::generation();
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool stale = !m_valid || generation != m_generation || range.epoch != m_result.epoch || range.end < m_result.end ||
+                 range.end - m_result.end >= FORECAST_REFIT_SAMPLES;
+    if (stale)
+    {
+        m_generation = generation;
+        refit(range.epoch, range.end);
+    }
+    else
+    {
+        m_stats.cached++;
+    }
+    ForecastResult result = m_result;
+    xSemaphoreGive(m_mutex);
+    return result;
+}
+
+ForecastStats Forecast::stats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    ForecastStats stats = m_stats;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
+
+const char *Forecast::stateName(ForecastState state)
+{
+    switch (state)
+    {
+    case ForecastState::NoFit:
+        return "no_fit";
+    case ForecastState::Fermenting:
+        return "fermenting";
+    case ForecastState::Complete:
+        return "complete";
+    default:
+        return "insufficient_data";
+    }
+}
+
+size_t Forecast::collect(bool &resolved)
+{
+    // A boot without a known wall time cannot be placed next to the others, so it is left out.
+    // Without any wall time the newest boot is fitted on its own clock, which needs no placing.
+    uint32_t newest_boot = 0;
+    size_t samples = scan(false, 0, newest_boot);
+    resolved = samples > 0;
+    if (samples == 0 && newest_boot != 0)
+    {
+        samples = scan(true, newest_boot, newest_boot);
+    }
+    return samples;
+}
+
+size_t Forecast::scan(bool unresolved, uint32_t boot_id, uint32_t &newest_boot)
+{
+    HistoryStore &history = HistoryStore::instance();
+    size_t size = history.size();
+    size_t offset = size > FORECAST_MAX_SAMPLES ? size - FORECAST_MAX_SAMPLES : 0;
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_width = FORECAST_MIN_BUCKET_S;
+
+    uint32_t current_boot = UINT32_MAX;
+    bool offset_known = false;
+    int64_t boot_offset = 0;
+    size_t samples = 0;
+    size_t copied;
+    while ((copied = history.copy(offset, m_chunk, FORECAST_READ_CHUNK)) > 0)
+    {
+        offset += copied;
+        for (size_t i = 0; i < copied; ++i)
+        {
+            const RaptPillData &sample = m_chunk[i];
+            if (sample.boot_id != current_boot)
+            {
+                current_boot = sample.boot_id;
+                offset_known = TimeBase::offsetFor(current_boot, boot_offset);
+            }
+            newest_boot = sample.boot_id;
+            if (unresolved ? sample.boot_id != boot_id : !offset_known)
+            {
+                continue;
+            }
+            if (!(sample.specific_gravity > 0.9f && sample.specific_gravity < 1.2f))
+            {
+                continue;
+            }
+            int64_t wall = unresolved ? sample.timestamp : sample.timestamp + boot_offset;
+            if (samples == 0)
+            {
+                m_origin = wall;
+            }
+            // Offsets corrected later can step back a little; keep such samples in the first bucket.
+            int64_t elapsed = wall > m_origin ? wall - m_origin : 0;
+            // Halve the resolution until the sample fits, so the buckets always cover everything read.
+            while (elapsed / m_width >= FORECAST_POINTS)
+            {
+                for (size_t j = 0; j < FORECAST_POINTS / 2; ++j)
+                {
+                    const Bucket &a = m_buckets[2 * j];
+                    const Bucket &b = m_buckets[2 * j + 1];
+                    m_buckets[j] = {a.time_sum + b.time_sum, a.gravity_sum + b.gravity_sum, a.count + b.count};
+                }
+                memset(m_buckets + FORECAST_POINTS / 2, 0, sizeof(Bucket) * FORECAST_POINTS / 2);
+                m_width *= 2;
+            }
+            Bucket &bucket = m_buckets[elapsed / m_width];
+            bucket.time_sum += elapsed;
+            bucket.gravity_sum += lroundf(sample.specific_gravity * FORECAST_GRAVITY_SCALE);
+            bucket.count++;
+            samples++;
+        }
+    }
+    return samples;
+}
+
+void Forecast::refit(uint32_t epoch, size_t end)
+{
+    int64_t start_us = esp_timer_get_time();
+    ForecastResult result = {};
+    result.state = ForecastState::InsufficientData;
+    result.epoch = epoch;
+    result.end = end;
+    result.samples = collect(result.resolved);
+
+    // Bucket means, from the gravity peak on and within the window before the last sample.
+    int64_t times[FORECAST_POINTS];
+    size_t count = 0;
+    int64_t last = INT64_MIN;
+    for (const Bucket &bucket : m_buckets)
+    {
+        if (bucket.count > 0)
+        {
+            times[count] = bucket.time_sum / bucket.count;
+            m_points[count].gravity = static_cast<float>(bucket.gravity_sum / bucket.count) / FORECAST_GRAVITY_SCALE;
+            last = times[count];
+            count++;
+        }
+    }
+    size_t first = 0;
+    while (first < count && times[first] < last - FORECAST_WINDOW_S)
+    {
+        first++;
+    }
+    for (size_t i = first; i < count; ++i)
+    {
+        if (m_points[i].gravity > m_points[first].gravity)
+        {
+            first = i;
+        }
+    }
+    size_t points = count - first;
+    float lowest = points > 0 ? m_points[first].gravity : 0.0f;
+    for (size_t i = 0; i < points; ++i)
+    {
+        m_points[i].gravity = m_points[first + i].gravity;
+        m_points[i].hours = static_cast<float>(times[first + i] - times[first]) / 3600.0f;
+        lowest = m_points[i].gravity < lowest ? m_points[i].gravity : lowest;
+    }
+    result.points = points;
+
+    if (points >= FORECAST_MIN_POINTS && last - times[first] >= FORECAST_MIN_SPAN_S &&
+        toPoints(m_points[0].gravity) - toPoints(lowest) >= FORECAST_MIN_DROP_POINTS)
+    {
+        result.state = ForecastState::NoFit;
+        ForecastModel &model = result.model;
+        if (fit(m_points, points, model))
+        {
+            float amplitude = toPoints(model.original_gravity) - toPoints(model.final_gravity);
+            float done_h = amplitude > FORECAST_DONE_POINTS
+                               ? model.midpoint_h + logf(amplitude / FORECAST_DONE_POINTS - 1.0f) / model.rate
+                               : 0.0f;
+            float last_h = m_points[points - 1].hours;
+            Logistic curve = {{toPoints(model.final_gravity), amplitude, model.rate, model.midpoint_h}};
+            result.state = last_h >= done_h ? ForecastState::Complete : ForecastState::Fermenting;
+            result.current_gravity = toGravity(curve.evaluate(last_h, nullptr));
+            result.start = m_origin + times[first];
+            result.midpoint = result.start + static_cast<int64_t>(model.midpoint_h * 3600.0f);
+            result.completion = result.start + static_cast<int64_t>((done_h > 0.0f ? done_h : 0.0f) * 3600.0f);
+        }
+    }
+    result.last = m_origin + last;
+    m_result = result;
+    m_valid = true;
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    m_stats.fit.count++;
+    m_stats.fit.total_us += elapsed_us;
+    m_stats.fit.max_us = elapsed_us > m_stats.fit.max_us ? elapsed_us : m_stats.fit.max_us;
+    ESP_LOGI(FORECAST_TAG, "Fitted %u points from %u samples in %lld us", static_cast<unsigned>(points),
+             static_cast<unsigned>(result.samples), static_cast<long long>(elapsed_us));
+}
+
+bool Forecast::fit(const ForecastPoint *points, size_t count, ForecastModel &out)
+{
+    if (count < parameter_count)
+    {
+        return false;
+    }
+
+    // Start from a curve through the first point that halves the observed drop where the data does.
+    float lowest = toPoints(points[0].gravity);
+    for (size_t i = 1; i < count; ++i)
+    {
+        float value = toPoints(points[i].gravity);
+        lowest = value < lowest ? value : lowest;
+    }
+    Logistic model;
+    model.final() = lowest - 1.0f;
+    model.amplitude() = toPoints(points[0].gravity) - model.final();
+    float span = points[count - 1].hours;
+    model.midpoint() = span;
+    float half = model.final() + model.amplitude() / 2.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (toPoints(points[i].gravity) <= half)
+        {
+            model.midpoint() = points[i].hours;
+            break;
+        }
+    }
+    model.rate() = 8.0f / (span > 2.0f ? span : 2.0f);
+    constrain(model);
+
+    float current = cost(model, points, count);
+    float lambda = 1e-3f;
+    uint8_t iterations = 0;
+    while (iterations < FORECAST_MAX_ITERATIONS)
+    {
+        iterations++;
+        float normal[parameter_count][parameter_count] = {};
+        float gradient[parameter_count] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            float jacobian[parameter_count];
+            float residual = toPoints(points[i].gravity) - model.evaluate(points[i].hours, jacobian);
+            for (size_t r = 0; r < parameter_count; ++r)
+            {
+                gradient[r] += jacobian[r] * residual;
+                for (size_t c = 0; c <= r; ++c)
+                {
+                    normal[r][c] += jacobian[r] * jacobian[c];
+                }
+            }
+        }
+
+        // Damp until a step lowers the cost; give up once the damping swamps the system.
+        bool improved = false;
+        float previous = current;
+        while (lambda < 1e8f)
+        {
+            float damped[parameter_count][parameter_count];
+            float rhs[parameter_count];
+            for (size_t r = 0; r < parameter_count; ++r)
+            {
+                for (size_t c = 0; c < parameter_count; ++c)
+                {
+                    damped[r][c] = r >= c ? normal[r][c] : normal[c][r];
+                }
+                damped[r][r] += lambda * (normal[r][r] + 1e-6f);
+                rhs[r] = gradient[r];
+            }
+            float step[parameter_count];
+            Logistic trial = model;
+            if (solve(damped, rhs, step))
+            {
+                for (size_t r = 0; r < parameter_count; ++r)
+                {
+                    trial.p[r] += step[r];
+                }
+                constrain(trial);
+                float trial_cost = cost(trial, points, count);
+                if (trial_cost < current)
+                {
+                    model = trial;
+                    current = trial_cost;
+                    lambda = lambda * 0.1f > 1e-7f ? lambda * 0.1f : 1e-7f;
+                    improved = true;
+                    break;
+                }
+            }
+            lambda *= 10.0f;
+        }
+        if (!improved || previous - current <= 1e-6f * previous)
+        {
+            break;
+        }
+    }
+
+    out.final_gravity = toGravity(model.final());
+    out.original_gravity = toGravity(model.final() + model.amplitude());
+    out.rate = model.rate();
+    out.midpoint_h = model.midpoint();
+    out.rmse = sqrtf(current / count) / 1000.0f;
+    out.iterations = iterations;
+    return std::isfinite(current) && model.amplitude() >= FORECAST_DONE_POINTS;
+}
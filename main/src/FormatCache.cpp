@@ -0,0 +1,211 @@
+#include "web/FormatCache.hpp"
+#include <cstring>
+
+// Fixed at build time so cached text never fragments the shared heap.
+static char format_pool[FORMAT_CACHE_BYTES > 0 ? FORMAT_CACHE_BYTES : 1];
+
+FormatCache &FormatCache::instance()
+{
+    static FormatCache cache;
+    return cache;
+}
+
+FormatCache::FormatCache()
+{
+    m_mutex = xSemaphoreCreateMutex();
+}
+
+void FormatCache::evict(Entry &entry)
+{
+    entry = {};
+}
+
+FormatCache::Entry *FormatCache::oldest()
+{
+    Entry *found = nullptr;
+    for (Entry &entry : m_entries)
+    {
+        // Wrap-safe, the sequence counter may overflow.
+        if (entry.text && (!found || static_cast<int32_t>(entry.seq - found->seq) < 0))
+        {
+            found = &entry;
+        }
+    }
+    return found;
+}
+
+const FormatCache::Entry *FormatCache::acquire(size_t id, uint32_t generation, const TimeResolver &before)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    Entry *found = nullptr;
+    for (Entry &entry : m_entries)
+    {
+        if (entry.text && entry.id == id && entry.generation == generation && entry.before == before)
+        {
+            entry.pins++;
+            found = &entry;
+            break;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    return found;
+}
+
+void FormatCache::release(const Entry *entry)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    const_cast<Entry *>(entry)->pins--;
+    xSemaphoreGive(m_mutex);
+}
+
+FormatCache::Reservation FormatCache::reserve(size_t id, size_t samples, size_t oldest_id, uint32_t generation)
+{
+    Reservation reservation = {};
+    // Such a block would only evict everything older before giving up.
+    if (samples * FORMAT_CACHE_MIN_ROW_BYTES >= FORMAT_CACHE_BYTES)
+    {
+        return reservation;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool slot_free = false;
+    for (Entry &entry : m_entries)
+    {
+        if (entry.text && entry.pins == 0 && (entry.id < oldest_id || entry.generation != generation))
+        {
+            evict(entry);
+        }
+        slot_free |= entry.text == nullptr;
+    }
+    Entry *tail = oldest();
+    if (!slot_free && tail && tail->pins == 0 && tail->id < id)
+    {
+        evict(*tail);
+        slot_free = true;
+        tail = oldest();
+    }
+    if (!m_reserved && slot_free)
+    {
+        // An empty ring starts over at the front.
+        m_head = tail ? m_head : 0;
+        m_reserved = true;
+        reservation = {.active = true, .id = id, .text = format_pool + m_head, .length = 0, .capacity = 0};
+    }
+    xSemaphoreGive(m_mutex);
+    return reservation;
+}
+
+bool FormatCache::claim(Reservation &reservation, size_t capacity)
+{
+    // The head never catches up with the oldest entry, so a full ring is not mistaken for an empty one.
+    if (capacity >= FORMAT_CACHE_BYTES)
+    {
+        return false;
+    }
+    while (true)
+    {
+        size_t start = reservation.text - format_pool;
+        Entry *tail = oldest();
+        size_t tail_start = tail ? tail->text - format_pool : FORMAT_CACHE_BYTES;
+        bool wrapped = tail && tail_start > start;
+        if (wrapped ? start + capacity < tail_start : start + capacity <= FORMAT_CACHE_BYTES)
+        {
+            reservation.capacity = capacity;
+            return true;
+        }
+        if (!wrapped && (!tail || capacity < tail_start))
+        {
+            memmove(format_pool, reservation.text, reservation.length);
+            reservation.text = format_pool;
+            reservation.capacity = capacity;
+            return true;
+        }
+        // Make room only at the expense of older blocks.
+        if (tail->pins > 0 || tail->id >= reservation.id)
+        {
+            return false;
+        }
+        evict(*tail);
+    }
+}
+
+bool FormatCache::append(Reservation &reservation, const char *text, size_t length)
+{
+    if (!reservation.active)
+    {
+        return false;
+    }
+    // The claimed space belongs to this reservation alone, so it is written without the lock.
+    if (reservation.length + length > reservation.capacity)
+    {
+        size_t grow = length > FORMAT_CACHE_GROW_BYTES ? length : FORMAT_CACHE_GROW_BYTES;
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        bool claimed = claim(reservation, reservation.capacity + grow);
+        if (!claimed)
+        {
+            m_reserved = false;
+            reservation.active = false;
+        }
+        xSemaphoreGive(m_mutex);
+        if (!claimed)
+        {
+            return false;
+        }
+    }
+    memcpy(reservation.text + reservation.length, text, length);
+    reservation.length += length;
+    return true;
+}
+
+void FormatCache::insert(Reservation &reservation, uint32_t generation, const TimeResolver &before,
+                         const TimeResolver &after)
+{
+    if (!reservation.active)
+    {
+        return;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_reserved = false;
+    reservation.active = false;
+    Entry *slot = nullptr;
+    for (Entry &entry : m_entries)
+    {
+        if (entry.text && entry.id == reservation.id && entry.generation == generation && entry.before == before)
+        {
+            // Another request cached the same block meanwhile.
+            slot = nullptr;
+            break;
+        }
+        if (!entry.text && !slot)
+        {
+            slot = &entry;
+        }
+    }
+    if (slot && reservation.length > 0)
+    {
+        *slot = {
+            .id = reservation.id,
+            .generation = generation,
+            .before = before,
+            .after = after,
+            .text = reservation.text,
+            .length = reservation.length,
+            .seq = m_seq++,
+            .pins = 0,
+        };
+        // Only the text is kept; the rest of the claimed space goes back to the ring.
+        m_head = (reservation.text - format_pool) + reservation.length;
+    }
+    xSemaphoreGive(m_mutex);
+}
+
+void FormatCache::discard(Reservation &reservation)
+{
+    if (!reservation.active)
+    {
+        return;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_reserved = false;
+    reservation.active = false;
+    xSemaphoreGive(m_mutex);
+}
@@ -0,0 +1,447 @@
+#include "common/Gorilla.hpp"
+#include <cstddef>
+#include <cstring>
+
+static float RaptPillData::*const float_channels[GORILLA_FLOAT_CHANNELS] = {
+    &RaptPillData::gravity_velocity,
+    &RaptPillData::temperature_celsius,
+    &RaptPillData::specific_gravity,
+    &RaptPillData::accel_x,
+    &RaptPillData::accel_y,
+    &RaptPillData::accel_z,
+    &RaptPillData::battery,
+};
+
+// No XOR window yet; forces the explicit '11' form.
+#define GORILLA_NO_WINDOW 0xFF
+#define GORILLA_HEADER_BITS (sizeof(GorillaBlockHeader) * 8)
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+GorillaEncoder::GorillaEncoder(uint8_t *buffer, size_t capacity, size_t reserve)
+    : m_buffer(buffer), m_capacity(capacity), m_reserve(reserve < capacity ? reserve : 0)
+{
+    reset();
+}
+
+void GorillaEncoder::reset()
+{
+    memset(m_buffer, 0, m_capacity);
+    m_table_bytes = 0;
+    m_last_bit_pos = 0;
+    m_state = {};
+    m_state.bit_pos = GORILLA_HEADER_BITS;
+    memset(m_state.leading, GORILLA_NO_WINDOW, sizeof(m_state.leading));
+    m_buffer[0] = GORILLA_BLOCK_VERSION;
+}
+
+void GorillaEncoder::writeBits(uint64_t value, int bits)
+{
+    if (m_state.bit_pos + bits > (m_capacity - m_reserve) * 8)
+    {
+        m_overflow = true;
+        return;
+    }
+    // MSB first; the buffer is zeroed, so only set bits need writing.
+    for (int i = bits - 1; i >= 0; --i)
+    {
+        if ((value >> i) & 1)
+        {
+            m_buffer[m_state.bit_pos / 8] |= 0x80 >> (m_state.bit_pos % 8);
+        }
+        m_state.bit_pos++;
+    }
+}
+
+void GorillaEncoder::writeTimestamp(int64_t timestamp)
+{
+    int64_t delta = timestamp - m_state.timestamp;
+    int64_t dod = delta - m_state.delta;
+    if (dod == 0)
+    {
+        writeBits(0b0, 1);
+    }
+    else if (dod >= -63 && dod <= 64)
+    {
+        writeBits(0b10, 2);
+        writeBits(dod + 63, 7);
+    }
+    else if (dod >= -255 && dod <= 256)
+    {
+        writeBits(0b110, 3);
+        writeBits(dod + 255, 9);
+    }
+    else if (dod >= -2047 && dod <= 2048)
+    {
+        writeBits(0b1110, 4);
+        writeBits(dod + 2047, 12);
+    }
+    else
+    {
+        writeBits(0b1111, 4);
+        writeBits(static_cast<uint64_t>(dod), 64);
+    }
+    m_state.delta = delta;
+    m_state.timestamp = timestamp;
+}
+
+void GorillaEncoder::writeFloat(int channel, float value)
+{
+    uint32_t bits = floatBits(value);
+    uint32_t x = bits ^ m_state.values[channel];
+    m_state.values[channel] = bits;
+    if (x == 0)
+    {
+        writeBits(0b0, 1);
+        return;
+    }
+
+    uint8_t leading = __builtin_clz(x);
+    uint8_t trailing = __builtin_ctz(x);
+    if (leading > 31)
+    {
+        leading = 31;
+    }
+    uint8_t &window_leading = m_state.leading[channel];
+    uint8_t &window_trailing = m_state.trailing[channel];
+    if (window_leading != GORILLA_NO_WINDOW && leading >= window_leading && trailing >= window_trailing)
+    {
+        writeBits(0b10, 2);
+        writeBits(x >> window_trailing, 32 - window_leading - window_trailing);
+        return;
+    }
+
+    int meaningful = 32 - leading - trailing;
+    writeBits(0b11, 2);
+    writeBits(leading, 5);
+    writeBits(meaningful - 1, 5);
+    writeBits(x >> trailing, meaningful);
+    window_leading = leading;
+    window_trailing = trailing;
+}
+
+bool GorillaEncoder::append(const RaptPillData &sample)
+{
+    if (full() || m_table_bytes > 0)
+    {
+        return false;
+    }
+    State saved = m_state;
+    m_overflow = false;
+
+    if (m_state.count == 0)
+    {
+        writeBits(sample.boot_id, 32);
+        writeBits(static_cast<uint64_t>(sample.timestamp), 64);
+        m_state.boot_id = sample.boot_id;
+        m_state.timestamp = sample.timestamp;
+        for (int c = 0; c < GORILLA_FLOAT_CHANNELS; ++c)
+        {
+            m_state.values[c] = floatBits(sample.*float_channels[c]);
+            writeBits(m_state.values[c], 32);
+        }
+    }
+    else
+    {
+        if (sample.boot_id == m_state.boot_id)
+        {
+            writeBits(0b0, 1);
+            writeTimestamp(sample.timestamp);
+        }
+        else
+        {
+            // Monotonic time restarts with the boot; deltas from the old boot mean nothing.
+            writeBits(0b1, 1);
+            writeBits(sample.boot_id, 32);
+            writeBits(static_cast<uint64_t>(sample.timestamp), 64);
+            m_state.boot_id = sample.boot_id;
+            m_state.timestamp = sample.timestamp;
+            m_state.delta = 0;
+        }
+        for (int c = 0; c < GORILLA_FLOAT_CHANNELS; ++c)
+        {
+            writeFloat(c, sample.*float_channels[c]);
+        }
+    }
+
+    if (m_overflow)
+    {
+        // Clear the partial bits and restore the encoder to before this sample.
+        size_t first_byte = saved.bit_pos / 8;
+        if (saved.bit_pos % 8)
+        {
+            m_buffer[first_byte] &= 0xFF << (8 - saved.bit_pos % 8);
+            first_byte++;
+        }
+        memset(m_buffer + first_byte, 0, m_capacity - first_byte);
+        m_state = saved;
+        return false;
+    }
+
+    m_last_bit_pos = saved.bit_pos;
+    m_state.count++;
+    GorillaBlockHeader header = {.version = GORILLA_BLOCK_VERSION, .flags = 0, .count = m_state.count};
+    memcpy(m_buffer, &header, sizeof(header));
+    return true;
+}
+
+size_t GorillaEncoder::lastDelta(uint8_t *out, size_t max) const
+{
+    size_t first = m_last_bit_pos / 8;
+    size_t bytes = (m_state.bit_pos + 7) / 8 - first;
+    if (m_state.count == 0 || m_last_bit_pos == 0 || GORILLA_DELTA_HEADER_BYTES + bytes > max)
+    {
+        return 0;
+    }
+    uint16_t start = static_cast<uint16_t>(m_last_bit_pos);
+    uint16_t end = static_cast<uint16_t>(m_state.bit_pos);
+    memcpy(out, &start, sizeof(start));
+    memcpy(out + sizeof(start), &end, sizeof(end));
+    memcpy(out + GORILLA_DELTA_HEADER_BYTES, m_buffer + first, bytes);
+    return GORILLA_DELTA_HEADER_BYTES + bytes;
+}
+
+bool GorillaEncoder::replayDelta(const uint8_t *record, size_t length)
+{
+    uint16_t start;
+    uint16_t end;
+    if (length <= GORILLA_DELTA_HEADER_BYTES || full() || m_table_bytes > 0)
+    {
+        return false;
+    }
+    memcpy(&start, record, sizeof(start));
+    memcpy(&end, record + sizeof(start), sizeof(end));
+    size_t first = start / 8;
+    size_t bytes = length - GORILLA_DELTA_HEADER_BYTES;
+    if (start != m_state.bit_pos || end <= start || end > (m_capacity - m_reserve) * 8 ||
+        bytes != (end + 7u) / 8 - first)
+    {
+        return false;
+    }
+
+    // Keep the bits before start as they are and leave everything after end zeroed.
+    uint8_t kept = static_cast<uint8_t>(0xFF << (8 - start % 8));
+    uint8_t written = m_buffer[first] & kept;
+    memcpy(m_buffer + first, record + GORILLA_DELTA_HEADER_BYTES, bytes);
+    m_buffer[first] = written | (m_buffer[first] & ~kept);
+    if (end % 8)
+    {
+        m_buffer[end / 8] &= 0xFF << (8 - end % 8);
+    }
+    m_last_bit_pos = start;
+    m_state.bit_pos = end;
+    m_state.count++;
+    return true;
+}
+
+bool GorillaEncoder::resume(RaptPillData &last)
+{
+    uint16_t count = m_state.count;
+    size_t end = m_state.bit_pos;
+    GorillaDecoder decoder(m_buffer, (end + 7) / 8, count);
+
+    // Encoding is deterministic: appending the decoded samples again sets only bits that are
+    // already set, right behind the decoder, and leaves the state the next sample needs.
+    m_state = {};
+    m_state.bit_pos = GORILLA_HEADER_BITS;
+    memset(m_state.leading, GORILLA_NO_WINDOW, sizeof(m_state.leading));
+    RaptPillData sample;
+    while (decoder.next(sample))
+    {
+        if (!append(sample))
+        {
+            return false;
+        }
+        last = sample;
+    }
+    return m_state.count == count && m_state.bit_pos == end;
+}
+
+bool GorillaEncoder::appendBootOffsets(const GorillaBootOffset *offsets, size_t count)
+{
+    size_t start = (m_state.bit_pos + 7) / 8;
+    size_t bytes = count * GORILLA_BOOT_OFFSET_BYTES + 1;
+    if (m_table_bytes > 0 || count > GORILLA_MAX_BOOT_OFFSETS || start + bytes > m_capacity)
+    {
+        return false;
+    }
+    uint8_t *p = m_buffer + start;
+    for (size_t i = 0; i < count; ++i)
+    {
+        memcpy(p, &offsets[i].boot_id, sizeof(offsets[i].boot_id));
+        memcpy(p + sizeof(offsets[i].boot_id), &offsets[i].offset, sizeof(offsets[i].offset));
+        p += GORILLA_BOOT_OFFSET_BYTES;
+    }
+    *p = static_cast<uint8_t>(count);
+    m_buffer[offsetof(GorillaBlockHeader, flags)] |= GORILLA_FLAG_BOOT_OFFSETS;
+    m_table_bytes = bytes;
+    return true;
+}
+
+void GorillaEncoder::removeBootOffsets()
+{
+    size_t start = (m_state.bit_pos + 7) / 8;
+    memset(m_buffer + start, 0, m_table_bytes);
+    m_buffer[offsetof(GorillaBlockHeader, flags)] &= ~GORILLA_FLAG_BOOT_OFFSETS;
+    m_table_bytes = 0;
+}
+
+GorillaDecoder::GorillaDecoder(const uint8_t *data, size_t size, uint16_t count)
+    : m_data(data), m_bits(size * 8), m_bit_pos(GORILLA_HEADER_BITS), m_remaining(count)
+{
+    if (size < sizeof(GorillaBlockHeader) || data[0] != GORILLA_BLOCK_VERSION)
+    {
+        m_remaining = 0;
+    }
+}
+
+GorillaDecoder GorillaDecoder::sealed(const uint8_t *data, size_t size)
+{
+    GorillaBlockHeader header = {};
+    if (size >= sizeof(header))
+    {
+        memcpy(&header, data, sizeof(header));
+    }
+    return GorillaDecoder(data, size, header.count);
+}
+
+size_t GorillaDecoder::bootOffsets(const uint8_t *data, size_t size, GorillaBootOffset *out, size_t max)
+{
+    if (size <= sizeof(GorillaBlockHeader) || data[0] != GORILLA_BLOCK_VERSION ||
+        !(data[offsetof(GorillaBlockHeader, flags)] & GORILLA_FLAG_BOOT_OFFSETS))
+    {
+        return 0;
+    }
+    size_t count = data[size - 1];
+    size_t bytes = count * GORILLA_BOOT_OFFSET_BYTES + 1;
+    if (count > GORILLA_MAX_BOOT_OFFSETS || bytes > size - sizeof(GorillaBlockHeader))
+    {
+        return 0;
+    }
+    const uint8_t *p = data + size - bytes;
+    size_t copied = 0;
+    for (; copied < count && copied < max; ++copied)
+    {
+        memcpy(&out[copied].boot_id, p, sizeof(out[copied].boot_id));
+        memcpy(&out[copied].offset, p + sizeof(out[copied].boot_id), sizeof(out[copied].offset));
+        p += GORILLA_BOOT_OFFSET_BYTES;
+    }
+    return copied;
+}
+
+uint64_t GorillaDecoder::readBits(int bits)
+{
+    if (m_bit_pos + bits > m_bits)
+    {
+        m_error = true;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bits; ++i)
+    {
+        value = (value << 1) | ((m_data[m_bit_pos / 8] >> (7 - m_bit_pos % 8)) & 1);
+        m_bit_pos++;
+    }
+    return value;
+}
+
+float GorillaDecoder::readFloat(int channel)
+{
+    if (readBits(1))
+    {
+        uint32_t x;
+        if (readBits(1))
+        {
+            m_leading[channel] = readBits(5);
+            int meaningful = readBits(5) + 1;
+            m_trailing[channel] = 32 - m_leading[channel] - meaningful;
+            x = readBits(meaningful) << m_trailing[channel];
+        }
+        else
+        {
+            int meaningful = 32 - m_leading[channel] - m_trailing[channel];
+            x = readBits(meaningful) << m_trailing[channel];
+        }
+        m_values[channel] ^= x;
+    }
+    float value;
+    memcpy(&value, &m_values[channel], sizeof(value));
+    return value;
+}
+
+bool GorillaDecoder::next(RaptPillData &sample)
+{
+    if (m_remaining == 0 || m_error)
+    {
+        return false;
+    }
+
+    if (m_first)
+    {
+        m_first = false;
+        m_boot_id = readBits(32);
+        m_timestamp = static_cast<int64_t>(readBits(64));
+        for (int c = 0; c < GORILLA_FLOAT_CHANNELS; ++c)
+        {
+            m_values[c] = readBits(32);
+        }
+    }
+    else
+    {
+        if (readBits(1))
+        {
+            m_boot_id = readBits(32);
+            m_timestamp = static_cast<int64_t>(readBits(64));
+            m_delta = 0;
+        }
+        else
+        {
+            int64_t dod;
+            if (!readBits(1))
+            {
+                dod = 0;
+            }
+            else if (!readBits(1))
+            {
+                dod = static_cast<int64_t>(readBits(7)) - 63;
+            }
+            else if (!readBits(1))
+            {
+                dod = static_cast<int64_t>(readBits(9)) - 255;
+            }
+            else if (!readBits(1))
+            {
+                dod = static_cast<int64_t>(readBits(12)) - 2047;
+            }
+            else
+            {
+                dod = static_cast<int64_t>(readBits(64));
+            }
+            m_delta += dod;
+            m_timestamp += m_delta;
+        }
+        for (int c = 0; c < GORILLA_FLOAT_CHANNELS; ++c)
+        {
+            readFloat(c);
+        }
+    }
+    if (m_error)
+    {
+        return false;
+    }
+
+    sample = {};
+    sample.timestamp = m_timestamp;
+    sample.boot_id = m_boot_id;
+    for (int c = 0; c < GORILLA_FLOAT_CHANNELS; ++c)
+    {
+        memcpy(&(sample.*float_channels[c]), &m_values[c], sizeof(float));
+    }
+    m_remaining--;
+    return true;
+}
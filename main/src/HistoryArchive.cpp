@@ -0,0 +1,461 @@
+#include "common/HistoryArchive.hpp"
+#include <cstring>
+#include "esp_log.h"
+#include "storage/StorageBackend.hpp"
+
+static const char *ARCHIVE_TAG = "Archive";
+
+static_assert(sizeof(HistoryArchiveHeader) == 8, "Archive header layout changed");
+static_assert(sizeof(HistoryArchiveFrameHeader) == 6, "Archive frame header layout changed");
+static_assert(sizeof(Settings) <= GORILLA_BLOCK_BYTES, "Settings frame must fit the payload buffer");
+
+HistoryBackup::HistoryBackup()
+    : m_encoder(m_block, sizeof(m_block))
+{
+}
+
+esp_err_t HistoryBackup::write(Sink sink, void *ctx)
+{
+    m_sink = sink;
+    m_ctx = ctx;
+    m_samples = 0;
+    m_blocks = 0;
+
+    HistoryArchiveHeader header = {};
+    memcpy(header.magic, HISTORY_ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = HISTORY_ARCHIVE_VERSION;
+    if (!m_sink(&header, sizeof(header), m_ctx))
+    {
+        return ESP_FAIL;
+    }
+
+    // The archive may be downloaded by anyone on the network; the password stays on the device.
+    Settings settings = SettingsStore::get();
+    memset(settings.wifi_password, 0, sizeof(settings.wifi_password));
+    if (!writeFrame(ArchiveFrame::Settings, &settings, sizeof(settings)))
+    {
+        return ESP_FAIL;
+    }
+
+    HistoryStore &history = HistoryStore::instance();
+    HistoryRange range = history.storedRange();
+    TimeResolver resolver;
+    RaptPillData last = {};
+    m_encoder.reset();
+    for (size_t sample = range.first; sample < range.end;)
+    {
+        size_t want = range.end - sample;
+        want = want < HISTORY_ARCHIVE_READ_CHUNK ? want : HISTORY_ARCHIVE_READ_CHUNK;
+        size_t copied = history.copyStored(sample, m_chunk, want);
+        if (copied == 0)
+        {
+            break;
+        }
+        for (size_t i = 0; i < copied; ++i)
+        {
+            if (!append(resolver, m_chunk[i]))
+            {
+                return ESP_FAIL;
+            }
+        }
+        last = m_chunk[copied - 1];
+        sample += copied;
+    }
+    // The newest reading may still be held back by the deadband rather than stored.
+    RaptPillData latest;
+    if (history.latest(latest) && (m_samples == 0 || latest.boot_id != last.boot_id || latest.timestamp != last.timestamp) &&
+        !append(resolver, latest))
+    {
+        return ESP_FAIL;
+    }
+    if (m_encoder.count() > 0 && !writeBlock())
+    {
+        return ESP_FAIL;
+    }
+    return writeFrame(ArchiveFrame::End, &m_samples, sizeof(m_samples)) ? ESP_OK : ESP_FAIL;
+}
+
+bool HistoryBackup::append(TimeResolver &resolver, const RaptPillData &sample)
+{
+    RaptPillData resolved = sample;
+    resolved.timestamp = resolver.resolve(sample);
+    resolved.boot_id = 0;
+    if (!m_encoder.append(resolved) && (!writeBlock() || !m_encoder.append(resolved)))
+    {
+        return false;
+    }
+    m_samples++;
+    return true;
+}
+
+bool HistoryBackup::writeFrame(ArchiveFrame type, const void *payload, size_t length)
+{
+    HistoryArchiveFrameHeader header = {
+        .type = static_cast<uint8_t>(type),
+        .reserved = 0,
+        .length = static_cast<uint16_t>(length),
+        .crc = StorageBackend::frameCrc(payload, length),
+    };
+    return m_sink(&header, sizeof(header), m_ctx) && m_sink(payload, length, m_ctx);
+}
+
+bool HistoryBackup::writeBlock()
+{
+    if (!writeFrame(ArchiveFrame::Block, m_encoder.data(), m_encoder.size()))
+    {
+        return false;
+    }
+    m_blocks++;
+    m_encoder.reset();
+    return true;
+}
+
+HistoryRestore::HistoryRestore()
+    : m_encoder(m_record + 1, GORILLA_BLOCK_BYTES)
+{
+    m_record[0] = HISTORY_BLOCK_TAG;
+}
+
+esp_err_t HistoryRestore::fail(esp_err_t err, const char *message)
+{
+    if (!m_error)
+    {
+        m_error = message;
+        m_err = err;
+        ESP_LOGW(ARCHIVE_TAG, "Restore failed: %s", message);
+    }
+    return err;
+}
+
+esp_err_t HistoryRestore::begin()
+{
+    if (m_started)
+    {
+        return ESP_OK;
+    }
+    m_started = true;
+    ESP_LOGI(ARCHIVE_TAG, "Restoring history from %s", m_format == Format::Archive ? "an archive" : "CSV rows");
+    if (HistoryStore::instance().clear() != ESP_OK)
+    {
+        return fail(ESP_FAIL, "Failed to clear the stored history");
+    }
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::detect()
+{
+    if (memcmp(m_header.magic, HISTORY_ARCHIVE_MAGIC, sizeof(m_header.magic)) != 0)
+    {
+        // Not an archive: hand the bytes held so far to the CSV parser.
+        m_format = Format::Csv;
+        return feedCsv(reinterpret_cast<const uint8_t *>(&m_header), m_header_fill);
+    }
+    m_format = Format::Archive;
+    m_stats.archive = true;
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::feed(const uint8_t *data, size_t length)
+{
+    if (m_error)
+    {
+        return m_err;
+    }
+    if (m_format == Format::Unknown)
+    {
+        size_t take = sizeof(m_header.magic) - m_header_fill;
+        take = take < length ? take : length;
+        memcpy(reinterpret_cast<uint8_t *>(&m_header) + m_header_fill, data, take);
+        m_header_fill += take;
+        data += take;
+        length -= take;
+        if (m_header_fill < sizeof(m_header.magic))
+        {
+            return ESP_OK;
+        }
+        esp_err_t err = detect();
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return m_format == Format::Archive ? feedArchive(data, length) : feedCsv(data, length);
+}
+
+esp_err_t HistoryRestore::feedArchive(const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        if (m_header_fill < sizeof(m_header))
+        {
+            size_t take = sizeof(m_header) - m_header_fill;
+            take = take < length ? take : length;
+            memcpy(reinterpret_cast<uint8_t *>(&m_header) + m_header_fill, data, take);
+            m_header_fill += take;
+            data += take;
+            length -= take;
+            if (m_header_fill == sizeof(m_header))
+            {
+                if (m_header.version != HISTORY_ARCHIVE_VERSION)
+                {
+                    return fail(ESP_ERR_INVALID_ARG, "Unsupported archive version");
+                }
+            }
+            continue;
+        }
+        if (m_ended)
+        {
+            return fail(ESP_ERR_INVALID_ARG, "Data after the end of the archive");
+        }
+
+        if (m_frame_fill < sizeof(m_frame))
+        {
+            size_t take = sizeof(m_frame) - m_frame_fill;
+            take = take < length ? take : length;
+            memcpy(reinterpret_cast<uint8_t *>(&m_frame) + m_frame_fill, data, take);
+            m_frame_fill += take;
+            data += take;
+            length -= take;
+            if (m_frame_fill == sizeof(m_frame) && m_frame.length > GORILLA_BLOCK_BYTES)
+            {
+                return fail(ESP_ERR_INVALID_ARG, "Archive frame too long");
+            }
+            if (m_frame_fill < sizeof(m_frame) || m_frame.length > 0)
+            {
+                continue;
+            }
+        }
+
+        size_t take = m_frame.length - m_payload_fill;
+        take = take < length ? take : length;
+        memcpy(m_record + 1 + m_payload_fill, data, take);
+        m_payload_fill += take;
+        data += take;
+        length -= take;
+        if (m_payload_fill == m_frame.length)
+        {
+            esp_err_t err = finishFrame();
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+            m_frame_fill = 0;
+            m_payload_fill = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::finishFrame()
+{
+    const uint8_t *payload = m_record + 1;
+    if (StorageBackend::frameCrc(payload, m_frame.length) != m_frame.crc)
+    {
+        return fail(ESP_ERR_INVALID_ARG, "Archive frame is corrupt");
+    }
+    switch (static_cast<ArchiveFrame>(m_frame.type))
+    {
+    case ArchiveFrame::Settings:
+        if (m_frame.length < SETTINGS_MIN_BLOB_SIZE)
+        {
+            return fail(ESP_ERR_INVALID_ARG, "Settings frame too short");
+        }
+        // Fields are only ever appended, so older archives leave the newer ones at their defaults.
+        m_settings = SettingsStore::defaults();
+        memcpy(&m_settings, payload, m_frame.length < sizeof(m_settings) ? m_frame.length : sizeof(m_settings));
+        m_stats.settings = true;
+        return ESP_OK;
+    case ArchiveFrame::Block:
+    {
+        // Cleared only now, so an upload that is not an archive after all leaves the history alone.
+        esp_err_t err = begin();
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        err = HistoryStore::instance().importBlock(m_record, 1 + m_frame.length);
+        if (err == ESP_ERR_INVALID_ARG)
+        {
+            return fail(err, "Archive holds an unreadable block");
+        }
+        if (err != ESP_OK)
+        {
+            return fail(err, "Failed to store a block");
+        }
+        m_stats.samples += GorillaDecoder::sealed(payload, m_frame.length).remaining();
+        m_stats.blocks++;
+        return ESP_OK;
+    }
+    case ArchiveFrame::End:
+    {
+        uint32_t samples;
+        if (m_frame.length != sizeof(samples))
+        {
+            return fail(ESP_ERR_INVALID_ARG, "Malformed end frame");
+        }
+        memcpy(&samples, payload, sizeof(samples));
+        if (samples != m_stats.samples)
+        {
+            return fail(ESP_ERR_INVALID_ARG, "Archive is missing samples");
+        }
+        m_ended = true;
+        // An archive of an empty history still replaces this one.
+        return begin();
+    }
+    }
+    // Frames added by newer firmware carry nothing this one could use.
+    ESP_LOGW(ARCHIVE_TAG, "Skipping unknown archive frame 0x%02x", m_frame.type);
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::applySettings()
+{
+    if (m_settings.version != SETTINGS_VERSION)
+    {
+        return fail(ESP_ERR_INVALID_ARG, "Archive settings are from incompatible firmware");
+    }
+    // The archive carries no password, and the device should stay reachable where it is now.
+    Settings current = SettingsStore::get();
+    memcpy(m_settings.wifi_ssid, current.wifi_ssid, sizeof(m_settings.wifi_ssid));
+    memcpy(m_settings.wifi_password, current.wifi_password, sizeof(m_settings.wifi_password));
+    esp_err_t err = SettingsStore::update(m_settings);
+    if (err != ESP_OK)
+    {
+        return fail(err, err == ESP_ERR_INVALID_ARG ? SettingsStore::lastError() : "Failed to save the settings");
+    }
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::feedCsv(const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        const uint8_t *newline = static_cast<const uint8_t *>(memchr(data, '\n', length));
+        size_t take = newline ? newline - data : length;
+        if (!m_line_overflow)
+        {
+            if (m_line_length + take <= sizeof(m_line))
+            {
+                memcpy(m_line + m_line_length, data, take);
+                m_line_length += take;
+            }
+            else
+            {
+                m_line_overflow = true;
+            }
+        }
+        if (!newline)
+        {
+            return ESP_OK;
+        }
+        data += take + 1;
+        length -= take + 1;
+        esp_err_t err = finishRow();
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::finishRow()
+{
+    RaptPillData sample;
+    bool parsed = !m_line_overflow && HistoryStore::parseCsvRow(reinterpret_cast<const uint8_t *>(m_line), m_line_length, sample);
+    bool blank = !m_line_overflow && (m_line_length == 0 || (m_line_length == 1 && m_line[0] == '\r'));
+    m_line_length = 0;
+    m_line_overflow = false;
+    if (!parsed)
+    {
+        m_stats.skipped_rows += blank ? 0 : 1;
+        return ESP_OK;
+    }
+
+    esp_err_t err = begin();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (!m_encoder.append(sample))
+    {
+        err = flushBlock();
+        if (err == ESP_OK && !m_encoder.append(sample))
+        {
+            err = fail(ESP_FAIL, "Failed to encode a row");
+        }
+    }
+    if (err == ESP_OK)
+    {
+        m_stats.samples++;
+    }
+    return err;
+}
+
+esp_err_t HistoryRestore::flushBlock()
+{
+    if (m_encoder.count() == 0)
+    {
+        return ESP_OK;
+    }
+    esp_err_t err = HistoryStore::instance().importBlock(m_record, 1 + m_encoder.size());
+    if (err != ESP_OK)
+    {
+        return fail(err, "Failed to store a block");
+    }
+    m_stats.blocks++;
+    m_encoder.reset();
+    return ESP_OK;
+}
+
+esp_err_t HistoryRestore::finish()
+{
+    if (m_error)
+    {
+        return m_err;
+    }
+    switch (m_format)
+    {
+    case Format::Unknown:
+        if (m_header_fill == 0)
+        {
+            return fail(ESP_ERR_INVALID_ARG, "Nothing to restore");
+        }
+        // Shorter than the magic, so at most one short row.
+        m_format = Format::Csv;
+        feedCsv(reinterpret_cast<const uint8_t *>(&m_header), m_header_fill);
+        [[fallthrough]];
+    case Format::Csv:
+        if (!m_error && m_line_length > 0)
+        {
+            finishRow();
+        }
+        if (!m_error)
+        {
+            flushBlock();
+        }
+        if (!m_error && m_stats.samples == 0)
+        {
+            fail(ESP_ERR_INVALID_ARG, "No archive or CSV rows found");
+        }
+        break;
+    case Format::Archive:
+        if (!m_ended)
+        {
+            fail(ESP_ERR_INVALID_ARG, "Archive is truncated");
+        }
+        else if (m_stats.settings)
+        {
+            applySettings();
+        }
+        break;
+    }
+    if (m_error)
+    {
+        return m_err;
+    }
+    ESP_LOGI(ARCHIVE_TAG, "Restored %lu samples in %lu blocks, skipped %lu rows",
+             static_cast<unsigned long>(m_stats.samples), static_cast<unsigned long>(m_stats.blocks),
+             static_cast<unsigned long>(m_stats.skipped_rows));
+    return ESP_OK;
+}
@@ -0,0 +1,49 @@
+#include "common/HistoryBatch.hpp"
+#include "common/HistoryStore.hpp"
+#include "common/TimeBase.hpp"
+
+HistoryBatch::HistoryBatch(uint8_t *buffer, size_t capacity)
+    : m_encoder(buffer, capacity)
+{
+}
+
+size_t HistoryBatch::build(size_t sample, size_t end)
+{
+    HistoryStore &history = HistoryStore::instance();
+    m_encoder.reset();
+    size_t count = 0;
+    while (sample < end && !m_encoder.full())
+    {
+        size_t want = end - sample;
+        want = want < HISTORY_BATCH_READ_CHUNK ? want : HISTORY_BATCH_READ_CHUNK;
+        size_t room = GORILLA_BLOCK_MAX_SAMPLES - count;
+        want = want < room ? want : room;
+        size_t copied = history.copyStored(sample, m_chunk, want);
+        if (copied == 0)
+        {
+            break;
+        }
+        for (size_t i = 0; i < copied; ++i)
+        {
+            RaptPillData resolved = m_chunk[i];
+            int64_t offset;
+            if (resolved.boot_id != 0 && TimeBase::offsetFor(resolved.boot_id, offset))
+            {
+                resolved.timestamp += offset;
+                resolved.boot_id = 0;
+            }
+            else if (resolved.boot_id != 0 && resolved.boot_id == TimeBase::bootId())
+            {
+                return count;
+            }
+            if (!m_encoder.append(resolved))
+            {
+                return count;
+            }
+            m_last = m_chunk[i];
+            count++;
+        }
+        sample += copied;
+    }
+    return count;
+}
@@ -0,0 +1,217 @@
+#include "common/HistoryExport.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "common/TimeBase.hpp"
+
+static_assert(sizeof(HistoryExportBlockHeader) == 8, "Export block header layout changed");
+
+namespace
+{
+    struct CsvColumn
+    {
+        int width;
+        int precision;
+        float RaptPillData::*member;
+    };
+
+    const char csv_header[] = "timestamp,gravity_velocity,temperature_celsius,specific_gravity,accel_x,accel_y,accel_z,battery,boot_id\n";
+    constexpr size_t csv_header_length = sizeof(csv_header) - 1;
+
+    // Between the timestamp and the boot id, both integers.
+    constexpr CsvColumn csv_columns[] = {
+        {9, 2, &RaptPillData::gravity_velocity},
+        {7, 2, &RaptPillData::temperature_celsius},
+        {7, 4, &RaptPillData::specific_gravity},
+        {9, 2, &RaptPillData::accel_x},
+        {9, 2, &RaptPillData::accel_y},
+        {9, 2, &RaptPillData::accel_z},
+        {7, 2, &RaptPillData::battery},
+    };
+    constexpr int timestamp_width = 11;
+    constexpr int boot_id_width = 10;
+
+    constexpr size_t rowBytes()
+    {
+        size_t bytes = timestamp_width + 1 + boot_id_width + 1;
+        for (const CsvColumn &column : csv_columns)
+        {
+            bytes += column.width + 1;
+        }
+        return bytes;
+    }
+    static_assert(rowBytes() == HISTORY_EXPORT_ROW_BYTES, "HISTORY_EXPORT_ROW_BYTES does not match the columns");
+
+    // Clamp a finite value so it prints within width; nan and inf always fit.
+    float fitWidth(float value, int width, int precision)
+    {
+        float limit = powf(10.0f, static_cast<float>(width - precision - 2)) - 1.0f;
+        return value > limit ? limit : value < -limit ? -limit : value;
+    }
+}
+
+HistoryExport::HistoryExport(HistoryExportFormat format, size_t from, size_t count)
+    : m_format(format)
+{
+    HistoryStore &history = HistoryStore::instance();
+    HistoryRange sealed = history.sealedRange();
+    size_t first = from < sealed.first ? sealed.first : from > sealed.end ? sealed.end : from;
+    size_t end = count < sealed.end - first ? first + count : sealed.end;
+    m_range = {.epoch = sealed.epoch, .first = first, .end = end};
+
+    if (m_format == HistoryExportFormat::Csv)
+    {
+        m_length = csv_header_length + (end - first) * HISTORY_EXPORT_ROW_BYTES;
+        return;
+    }
+
+    // Whole blocks only, so the selection starts and ends on block boundaries.
+    HistorySegment segment;
+    if (first < end && history.segment(first, segment))
+    {
+        m_range.first = segment.first_sample;
+    }
+    size_t sample = m_range.first;
+    while (sample < end && history.segment(sample, segment))
+    {
+        if (!segment.legacy)
+        {
+            m_length += sizeof(HistoryExportBlockHeader) + segment.bytes;
+        }
+        sample = segment.first_sample + segment.samples;
+    }
+    m_range.end = sample > m_range.first ? sample : m_range.first;
+}
+
+esp_err_t HistoryExport::write(size_t first, size_t last, Sink sink, void *ctx)
+{
+    m_sink = sink;
+    m_ctx = ctx;
+    if (first > last || m_length == 0)
+    {
+        return ESP_OK;
+    }
+    last = last < m_length ? last : m_length - 1;
+    return m_format == HistoryExportFormat::Csv ? writeCsv(first, last) : writeBlocks(first, last);
+}
+
+esp_err_t HistoryExport::writeCsv(size_t first, size_t last)
+{
+    if (!emit(csv_header, csv_header_length, 0, first, last))
+    {
+        return ESP_FAIL;
+    }
+    if (last < csv_header_length)
+    {
+        return ESP_OK;
+    }
+
+    HistoryStore &history = HistoryStore::instance();
+    size_t row = first > csv_header_length ? (first - csv_header_length) / HISTORY_EXPORT_ROW_BYTES : 0;
+    size_t end_row = (last - csv_header_length) / HISTORY_EXPORT_ROW_BYTES + 1;
+    char text[HISTORY_EXPORT_ROW_BYTES + 1];
+    while (row < end_row)
+    {
+        size_t want = end_row - row < HISTORY_EXPORT_READ_CHUNK ? end_row - row : HISTORY_EXPORT_READ_CHUNK;
+        size_t copied = history.copySealed(m_range.first + row, m_chunk, want);
+        if (copied == 0)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        for (size_t i = 0; i < copied; ++i, ++row)
+        {
+            formatRow(m_chunk[i], text);
+            if (!emit(text, HISTORY_EXPORT_ROW_BYTES, csv_header_length + row * HISTORY_EXPORT_ROW_BYTES, first, last))
+            {
+                return ESP_FAIL;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t HistoryExport::writeBlocks(size_t first, size_t last)
+{
+    // Only the index is walked up to the first requested byte; blocks are read from there on.
+    HistoryStore &history = HistoryStore::instance();
+    size_t offset = 0;
+    size_t sample = m_range.first;
+    while (sample < m_range.end && offset <= last)
+    {
+        HistorySegment segment;
+        if (!history.segment(sample, segment))
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        sample = segment.first_sample + segment.samples;
+        if (segment.legacy)
+        {
+            continue;
+        }
+        size_t size = sizeof(HistoryExportBlockHeader) + segment.bytes;
+        if (offset + size > first)
+        {
+            HistoryExportBlockHeader header = {
+                .first_sample = static_cast<uint32_t>(segment.first_sample),
+                .samples = static_cast<uint16_t>(segment.samples),
+                .length = static_cast<uint16_t>(segment.bytes),
+            };
+            if (!emit(&header, sizeof(header), offset, first, last))
+            {
+                return ESP_FAIL;
+            }
+            size_t body = offset + sizeof(header);
+            if (body <= last)
+            {
+                if (history.readBlock(segment, m_block, sizeof(m_block)) != segment.bytes)
+                {
+                    return ESP_ERR_INVALID_STATE;
+                }
+                if (!emit(m_block, segment.bytes, body, first, last))
+                {
+                    return ESP_FAIL;
+                }
+            }
+        }
+        offset += size;
+    }
+    return ESP_OK;
+}
+
+bool HistoryExport::emit(const void *piece, size_t length, size_t offset, size_t first, size_t last)
+{
+    if (offset > last || offset + length <= first)
+    {
+        return true;
+    }
+    size_t begin = first > offset ? first - offset : 0;
+    size_t end = last - offset + 1 < length ? last - offset + 1 : length;
+    return m_sink(static_cast<const uint8_t *>(piece) + begin, end - begin, m_ctx);
+}
+
+int HistoryExport::formatRow(const RaptPillData &sample, char *row)
+{
+    if (sample.boot_id != m_boot_id)
+    {
+        m_boot_id = sample.boot_id;
+        m_offset_known = sample.boot_id != 0 && TimeBase::offsetFor(sample.boot_id, m_offset);
+    }
+    int64_t timestamp = sample.timestamp;
+    uint32_t boot_id = sample.boot_id;
+    if (m_offset_known)
+    {
+        timestamp += m_offset;
+        boot_id = 0;
+    }
+    timestamp = timestamp > 99999999999LL ? 99999999999LL : timestamp < -9999999999LL ? -9999999999LL : timestamp;
+
+    constexpr size_t size = HISTORY_EXPORT_ROW_BYTES + 1;
+    int length = snprintf(row, size, "%*lld", timestamp_width, static_cast<long long>(timestamp));
+    for (const CsvColumn &column : csv_columns)
+    {
+        float value = fitWidth(sample.*column.member, column.width, column.precision);
+        length += snprintf(row + length, size - length, ",%*.*f", column.width, column.precision, value);
+    }
+    length += snprintf(row + length, size - length, ",%*lu\n", boot_id_width, static_cast<unsigned long>(boot_id));
+    return length;
+}
@@ -0,0 +1,1054 @@
+#include "common/HistoryStore.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "common/TimeBase.hpp"
+
+static const char *HISTORY_TAG = "History";
+
+HistoryStore &HistoryStore::instance()
+{
+    // Static rather than a member of the scanner, which lives on the main task's stack.
+    static HistoryStore store;
+    return store;
+}
+
+HistoryStore::HistoryStore()
+    : m_encoder(m_open_record + 1, GORILLA_BLOCK_BYTES, GORILLA_BOOT_TABLE_BYTES), m_cursor(m_cache, 0, 0)
+{
+    m_mutex = xSemaphoreCreateMutex();
+    m_archive_mutex = xSemaphoreCreateMutex();
+    m_open_record[0] = HISTORY_BLOCK_TAG;
+    TimeBase::setArchive(archivedOffset, this);
+}
+
+namespace
+{
+    const double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    constexpr int max_power_of_ten = sizeof(powers_of_ten) / sizeof(powers_of_ten[0]) - 1;
+
+    float RaptPillData::*const csv_floats[] = {
+        &RaptPillData::gravity_velocity,
+        &RaptPillData::temperature_celsius,
+        &RaptPillData::specific_gravity,
+        &RaptPillData::accel_x,
+        &RaptPillData::accel_y,
+        &RaptPillData::accel_z,
+        &RaptPillData::battery,
+    };
+
+    bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    bool matchWord(const char *&p, const char *end, const char *word)
+    {
+        size_t length = strlen(word);
+        if (static_cast<size_t>(end - p) < length || strncasecmp(p, word, length) != 0)
+        {
+            return false;
+        }
+        p += length;
+        return true;
+    }
+
+    bool parseInteger(const char *&p, const char *end, int64_t &out)
+    {
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            p++;
+        }
+        const char *digits = p;
+        uint64_t value = 0;
+        while (p < end && isDigit(*p) && p - digits < 19)
+        {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        if (p == digits || (p < end && isDigit(*p)))
+        {
+            return false;
+        }
+        out = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+        return true;
+    }
+
+    // Decimal as printed by %f, with an optional exponent. The digits are collected as
+    // an integer and scaled once, which is exact for the precision rows are written with.
+    bool parseDecimal(const char *&p, const char *end, float &out)
+    {
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            p++;
+        }
+        if (matchWord(p, end, "nan"))
+        {
+            out = negative ? -NAN : NAN;
+            return true;
+        }
+        if (matchWord(p, end, "inf"))
+        {
+            matchWord(p, end, "inity");
+            out = negative ? -INFINITY : INFINITY;
+            return true;
+        }
+
+        uint64_t mantissa = 0;
+        int significant = 0;
+        int scale = 0;
+        bool any = false;
+        for (bool fraction = false; p < end; ++p)
+        {
+            if (*p == '.' && !fraction)
+            {
+                fraction = true;
+                continue;
+            }
+            if (!isDigit(*p))
+            {
+                break;
+            }
+            any = true;
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                significant += mantissa != 0;
+                scale -= fraction;
+            }
+            else
+            {
+                scale += !fraction;
+            }
+        }
+        if (!any)
+        {
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            int64_t exponent;
+            ++p;
+            if (!parseInteger(p, end, exponent) || exponent < -64 || exponent > 64)
+            {
+                return false;
+            }
+            scale += static_cast<int>(exponent);
+        }
+
+        double value = static_cast<double>(mantissa);
+        while (scale > max_power_of_ten)
+        {
+            value *= powers_of_ten[max_power_of_ten];
+            scale -= max_power_of_ten;
+        }
+        while (scale < -max_power_of_ten)
+        {
+            value /= powers_of_ten[max_power_of_ten];
+            scale += max_power_of_ten;
+        }
+        value = scale < 0 ? value / powers_of_ten[-scale] : value * powers_of_ten[scale];
+        out = static_cast<float>(negative ? -value : value);
+        return true;
+    }
+}
+
+bool HistoryStore::parseCsvRow(const uint8_t *record, size_t length, RaptPillData &data)
+{
+    const char *p = reinterpret_cast<const char *>(record);
+    const char *end = p + length;
+    while (end > p && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+    {
+        end--;
+    }
+
+    data = {};
+    if (!parseInteger(p, end, data.timestamp))
+    {
+        return false;
+    }
+    for (float RaptPillData::*field : csv_floats)
+    {
+        if (p == end || *p++ != ',' || !parseDecimal(p, end, data.*field))
+        {
+            return false;
+        }
+    }
+    // Rows written before boot ids existed have 8 columns and unix timestamps, which is boot 0.
+    if (p < end)
+    {
+        int64_t boot_id;
+        if (*p++ != ',' || !parseInteger(p, end, boot_id) || boot_id < 0 || boot_id > UINT32_MAX)
+        {
+            return false;
+        }
+        data.boot_id = static_cast<uint32_t>(boot_id);
+    }
+    return p == end;
+}
+
+esp_err_t HistoryStore::load(StorageBackend &storage)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_storage = &storage;
+    m_segments.clear();
+    m_base_record = 0;
+    m_next_record = 0;
+    m_sealed_end = 0;
+    m_encoder.reset();
+    m_cache_record = SIZE_MAX;
+    m_cursor_sample = SIZE_MAX;
+    m_latest = {};
+    m_epoch++;
+    xSemaphoreTake(m_archive_mutex, portMAX_DELAY);
+    m_archive.clear();
+    xSemaphoreGive(m_archive_mutex);
+
+    esp_err_t err = storage.read(0, SIZE_MAX, [](const uint8_t *record, size_t length, void *ctx)
+    {
+        HistoryStore *self = static_cast<HistoryStore *>(ctx);
+        size_t index = self->m_next_record++;
+        Segment segment = {.record = index, .records = 1, .first_sample = self->m_sealed_end, .samples = 0, .bytes = length - 1, .legacy = false};
+        RaptPillData data;
+        if (record[0] == HISTORY_BLOCK_TAG)
+        {
+            segment.samples = GorillaDecoder::sealed(record + 1, length - 1).remaining();
+            self->archiveOffsets(record + 1, length - 1, index);
+        }
+        else if (parseCsvRow(record, length, data))
+        {
+            Segment *last = self->m_segments.empty() ? nullptr : &self->m_segments.back();
+            if (last && last->legacy && last->record + last->records == index)
+            {
+                last->records++;
+                last->samples++;
+                last->bytes += length;
+                self->m_sealed_end++;
+                return true;
+            }
+            segment.samples = 1;
+            segment.bytes = length;
+            segment.legacy = true;
+        }
+
+        if (segment.samples == 0)
+        {
+            ESP_LOGW(HISTORY_TAG, "Skipping unreadable record %zu", index);
+            return true;
+        }
+        self->m_segments.push_back(segment);
+        self->m_sealed_end += segment.samples;
+        return true;
+    }, this);
+
+    if (err == ESP_OK && !m_segments.empty())
+    {
+        copySegment(m_segments.back(), m_sealed_end - 1, &m_latest, 1);
+    }
+
+    // Rebuild the open block from the tail log, which holds the encoded bits of each sample.
+    struct TailReplay
+    {
+        GorillaEncoder &encoder;
+        bool complete;
+    } replay = {.encoder = m_encoder, .complete = true};
+    storage.readTail([](const uint8_t *record, size_t length, void *ctx)
+    {
+        auto *replay = static_cast<TailReplay *>(ctx);
+        replay->complete = replay->encoder.replayDelta(record, length);
+        return replay->complete;
+    }, &replay);
+    bool tail_complete = replay.complete;
+    if (!tail_complete)
+    {
+        ESP_LOGW(HISTORY_TAG, "Tail log breaks off after %u samples, dropping the rest", m_encoder.count());
+    }
+    RaptPillData tail_latest;
+    if (m_encoder.count() > 0 && !m_encoder.resume(tail_latest))
+    {
+        ESP_LOGE(HISTORY_TAG, "Tail log does not decode, dropping %u samples", m_encoder.count());
+        m_encoder.reset();
+        tail_complete = false;
+    }
+    else if (m_encoder.count() > 0)
+    {
+        m_latest = tail_latest;
+    }
+
+    // A reset between sealing a block and clearing the tail leaves the block's samples in both.
+    if (m_encoder.count() > 0 && !m_segments.empty() && !m_segments.back().legacy &&
+        m_segments.back().samples == m_encoder.count())
+    {
+        RaptPillData sealed_first = {};
+        RaptPillData open_first = {};
+        GorillaDecoder(m_open_record + 1, m_encoder.size(), 1).next(open_first);
+        const Segment &last = m_segments.back();
+        if (copySegment(last, last.first_sample, &sealed_first, 1) == 1 &&
+            sealed_first.timestamp == open_first.timestamp && sealed_first.boot_id == open_first.boot_id)
+        {
+            ESP_LOGI(HISTORY_TAG, "Tail log duplicates the last block, clearing it");
+            m_encoder.reset();
+            storage.clearTail();
+            copySegment(last, m_sealed_end - 1, &m_latest, 1);
+        }
+    }
+    if (!tail_complete)
+    {
+        // Later samples would log behind the records that were dropped; start the tail afresh.
+        if (m_encoder.count() == 0)
+        {
+            storage.clearTail();
+        }
+        else if (seal() != ESP_OK)
+        {
+            ESP_LOGW(HISTORY_TAG, "Failed to seal the rebuilt block");
+        }
+    }
+
+    m_door.reset();
+    if (end() > firstSample())
+    {
+        m_door.restart(m_latest);
+    }
+    ESP_LOGI(HISTORY_TAG, "Indexed %zu samples in %zu segments, %u in the open block, %zu archived boot offsets",
+             m_sealed_end, m_segments.size(), m_encoder.count(), m_archive.size());
+    if (!m_archive.empty())
+    {
+        TimeBase::archiveChanged();
+    }
+
+    // Boot ids order the history; after NVS was erased they would start over below the stored ones.
+    // Samples still buffered carry no boot id of their own and take the raised one.
+    if (m_epoch == 1 && m_latest.boot_id != 0 && m_latest.boot_id >= TimeBase::bootId())
+    {
+        TimeBase::raiseBootId(m_latest.boot_id + 1);
+    }
+
+    // Replay what arrived meanwhile; append() keeps buffering until the ring is drained.
+    size_t replayed = 0;
+    while (true)
+    {
+        RaptPillData sample;
+        portENTER_CRITICAL(&m_early_lock);
+        if (m_early_count == 0)
+        {
+            m_loaded = true;
+            portEXIT_CRITICAL(&m_early_lock);
+            break;
+        }
+        CompactSample early = m_early[m_early_head];
+        m_early_head = (m_early_head + 1) % HISTORY_EARLY_SAMPLES;
+        m_early_count--;
+        portEXIT_CRITICAL(&m_early_lock);
+        sample = CompactCodec::decode(early, TimeBase::bootId());
+        ingest(sample);
+        replayed++;
+    }
+    if (replayed > 0 || m_early_dropped > 0)
+    {
+        ESP_LOGI(HISTORY_TAG, "Replayed %zu samples received while loading, dropped %lu",
+                 replayed, static_cast<unsigned long>(m_early_dropped));
+    }
+
+    m_version.fetch_add(1, std::memory_order_release);
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+bool HistoryStore::loaded()
+{
+    portENTER_CRITICAL(&m_early_lock);
+    bool loaded = m_loaded;
+    portEXIT_CRITICAL(&m_early_lock);
+    return loaded;
+}
+
+esp_err_t HistoryStore::append(const RaptPillData &sample)
+{
+    portENTER_CRITICAL(&m_early_lock);
+    if (!m_loaded)
+    {
+        if (!CompactCodec::fits(sample, TimeBase::bootId()))
+        {
+            // Only samples stamped in this boot arrive before the history is loaded.
+            m_early_dropped++;
+            portEXIT_CRITICAL(&m_early_lock);
+            return ESP_ERR_INVALID_ARG;
+        }
+        // Overwrite the oldest sample once the ring is full.
+        size_t slot = (m_early_head + m_early_count) % HISTORY_EARLY_SAMPLES;
+        if (m_early_count == HISTORY_EARLY_SAMPLES)
+        {
+            m_early_head = (m_early_head + 1) % HISTORY_EARLY_SAMPLES;
+            m_early_dropped++;
+        }
+        else
+        {
+            m_early_count++;
+        }
+        m_early[slot] = CompactCodec::encode(sample);
+        portEXIT_CRITICAL(&m_early_lock);
+        m_version.fetch_add(1, std::memory_order_release);
+        return ESP_OK;
+    }
+    portEXIT_CRITICAL(&m_early_lock);
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = ingest(sample);
+    m_version.fetch_add(1, std::memory_order_release);
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t HistoryStore::ingest(const RaptPillData &sample)
+{
+    RaptPillData stored[2];
+    size_t count = m_door.offer(sample, stored);
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < count && err == ESP_OK; ++i)
+    {
+        err = store(stored[i]);
+    }
+    m_offered_samples++;
+    m_latest = sample;
+    return err;
+}
+
+esp_err_t HistoryStore::store(const RaptPillData &sample)
+{
+    esp_err_t err = ESP_OK;
+    if (!m_encoder.append(sample))
+    {
+        err = seal();
+        if (err == ESP_OK && !m_encoder.append(sample))
+        {
+            err = ESP_FAIL;
+        }
+    }
+    if (err == ESP_OK)
+    {
+        m_stored_samples++;
+        // The sample is kept in RAM even if the tail write fails; it is only lost on a reset.
+        uint8_t delta[GORILLA_DELTA_MAX_BYTES];
+        size_t length = m_encoder.lastDelta(delta, sizeof(delta));
+        if (m_storage->appendTail(delta, length) != ESP_OK)
+        {
+            ESP_LOGW(HISTORY_TAG, "Failed to write the tail log");
+        }
+        if (m_encoder.full())
+        {
+            err = seal();
+        }
+    }
+    return err;
+}
+
+esp_err_t HistoryStore::seal()
+{
+    uint16_t count = m_encoder.count();
+    if (count == 0)
+    {
+        return ESP_OK;
+    }
+    sealBootOffsets();
+    esp_err_t err = m_storage->append(m_open_record, 1 + m_encoder.size());
+    if (err != ESP_OK)
+    {
+        // Keep the block open and retry on the next sample.
+        m_encoder.removeBootOffsets();
+        return err;
+    }
+
+    Segment segment = {.record = m_next_record++, .records = 1, .first_sample = m_sealed_end, .samples = count, .bytes = m_encoder.size(), .legacy = false};
+    archiveOffsets(m_open_record + 1, m_encoder.size(), segment.record);
+    m_segments.push_back(segment);
+    m_sealed_end += count;
+    m_encoder.reset();
+    m_storage->clearTail();
+    dropRotated();
+    return ESP_OK;
+}
+
+void HistoryStore::sealBootOffsets()
+{
+    // The boots of the block, newest last; a block rarely spans more than one restart.
+    GorillaBootOffset table[GORILLA_MAX_BOOT_OFFSETS];
+    size_t count = 0;
+    GorillaDecoder decoder(m_open_record + 1, m_encoder.size(), m_encoder.count());
+    RaptPillData sample;
+    uint32_t last_boot = 0;
+    while (decoder.next(sample))
+    {
+        if (sample.boot_id == 0 || sample.boot_id == last_boot)
+        {
+            continue;
+        }
+        last_boot = sample.boot_id;
+        int64_t offset;
+        if (!TimeBase::offsetFor(sample.boot_id, offset))
+        {
+            continue;
+        }
+        if (count == GORILLA_MAX_BOOT_OFFSETS)
+        {
+            memmove(table, table + 1, sizeof(table) - sizeof(table[0]));
+            count--;
+        }
+        table[count++] = {.boot_id = sample.boot_id, .offset = offset};
+    }
+    if (count > 0)
+    {
+        m_encoder.appendBootOffsets(table, count);
+    }
+}
+
+size_t HistoryStore::archiveOffsets(const uint8_t *block, size_t size, size_t record)
+{
+    GorillaBootOffset table[GORILLA_MAX_BOOT_OFFSETS];
+    size_t count = GorillaDecoder::bootOffsets(block, size, table, GORILLA_MAX_BOOT_OFFSETS);
+    if (count == 0)
+    {
+        return 0;
+    }
+    xSemaphoreTake(m_archive_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto at = std::lower_bound(m_archive.begin(), m_archive.end(), table[i].boot_id, [](const ArchivedOffset &entry, uint32_t boot_id)
+        {
+            return entry.boot_id < boot_id;
+        });
+        if (at != m_archive.end() && at->boot_id == table[i].boot_id)
+        {
+            // Later blocks may know a corrected offset, and rotate out later.
+            at->offset = table[i].offset;
+            at->record = record > at->record ? record : at->record;
+        }
+        else
+        {
+            m_archive.insert(at, {.boot_id = table[i].boot_id, .offset = table[i].offset, .record = record});
+        }
+    }
+    xSemaphoreGive(m_archive_mutex);
+    return count;
+}
+
+bool HistoryStore::archivedOffset(uint32_t boot_id, int64_t &offset, void *ctx)
+{
+    HistoryStore *self = static_cast<HistoryStore *>(ctx);
+    xSemaphoreTake(self->m_archive_mutex, portMAX_DELAY);
+    auto at = std::lower_bound(self->m_archive.begin(), self->m_archive.end(), boot_id, [](const ArchivedOffset &entry, uint32_t id)
+    {
+        return entry.boot_id < id;
+    });
+    bool found = at != self->m_archive.end() && at->boot_id == boot_id;
+    if (found)
+    {
+        offset = at->offset;
+    }
+    xSemaphoreGive(self->m_archive_mutex);
+    return found;
+}
+
+void HistoryStore::dropRotated()
+{
+    size_t kept = m_storage->records();
+    size_t expected = m_next_record - m_base_record;
+    if (kept >= expected)
+    {
+        return;
+    }
+    m_base_record += expected - kept;
+
+    xSemaphoreTake(m_archive_mutex, portMAX_DELAY);
+    m_archive.erase(std::remove_if(m_archive.begin(), m_archive.end(), [this](const ArchivedOffset &entry)
+    {
+        return entry.record < m_base_record;
+    }), m_archive.end());
+    xSemaphoreGive(m_archive_mutex);
+
+    auto first_kept = std::find_if(m_segments.begin(), m_segments.end(), [this](const Segment &segment)
+    {
+        return segment.record + segment.records > m_base_record;
+    });
+    m_segments.erase(m_segments.begin(), first_kept);
+
+    // Legacy rows rotate out one record at a time, which can split a run.
+    if (!m_segments.empty() && m_segments.front().record < m_base_record)
+    {
+        Segment &front = m_segments.front();
+        size_t dropped = m_base_record - front.record;
+        front.record += dropped;
+        front.records -= dropped;
+        front.first_sample += dropped;
+        front.samples -= dropped;
+    }
+}
+
+size_t HistoryStore::firstSample() const
+{
+    return m_segments.empty() ? m_sealed_end : m_segments.front().first_sample;
+}
+
+size_t HistoryStore::storedEnd() const
+{
+    return m_sealed_end + m_encoder.count();
+}
+
+size_t HistoryStore::end() const
+{
+    RaptPillData held;
+    return storedEnd() + (m_door.pending(held) ? 1 : 0);
+}
+
+size_t HistoryStore::visibleStart() const
+{
+    size_t first = firstSample();
+    size_t last = end();
+    if (m_retention > 0 && last - first > m_retention)
+    {
+        return last - m_retention;
+    }
+    return first;
+}
+
+bool HistoryStore::loadBlock(const Segment &segment)
+{
+    if (m_cache_record == segment.record)
+    {
+        return true;
+    }
+    m_cache_record = SIZE_MAX;
+    m_cursor_sample = SIZE_MAX;
+    m_cache_size = 0;
+
+    m_storage->read(segment.record - m_base_record, 1, [](const uint8_t *record, size_t length, void *ctx)
+    {
+        HistoryStore *self = static_cast<HistoryStore *>(ctx);
+        if (length > 1 && record[0] == HISTORY_BLOCK_TAG && length - 1 <= GORILLA_BLOCK_BYTES)
+        {
+            memcpy(self->m_cache, record + 1, length - 1);
+            self->m_cache_size = length - 1;
+        }
+        return false;
+    }, this);
+
+    if (m_cache_size == 0)
+    {
+        ESP_LOGE(HISTORY_TAG, "Failed to read block at record %zu", segment.record);
+        return false;
+    }
+    m_cache_record = segment.record;
+    return true;
+}
+
+size_t HistoryStore::copySegment(const Segment &segment, size_t sample, RaptPillData *out, size_t max)
+{
+    size_t available = segment.first_sample + segment.samples - sample;
+    if (max > available)
+    {
+        max = available;
+    }
+
+    if (segment.legacy)
+    {
+        struct CopyState
+        {
+            RaptPillData *out;
+            size_t count;
+        } state = {out, 0};
+        m_storage->read(segment.record - m_base_record + (sample - segment.first_sample), max,
+                        [](const uint8_t *record, size_t length, void *ctx)
+        {
+            CopyState *state = static_cast<CopyState *>(ctx);
+            parseCsvRow(record, length, state->out[state->count++]);
+            return true;
+        }, &state);
+        return state.count;
+    }
+
+    if (!loadBlock(segment))
+    {
+        return 0;
+    }
+    if (m_cursor_sample != sample)
+    {
+        m_cursor = GorillaDecoder::sealed(m_cache, m_cache_size);
+        m_cursor_sample = segment.first_sample;
+        RaptPillData skipped;
+        while (m_cursor_sample < sample && m_cursor.next(skipped))
+        {
+            m_cursor_sample++;
+        }
+        if (m_cursor_sample != sample)
+        {
+            m_cursor_sample = SIZE_MAX;
+            return 0;
+        }
+    }
+
+    size_t count = 0;
+    while (count < max && m_cursor.next(out[count]))
+    {
+        count++;
+    }
+    m_cursor_sample = count > 0 ? m_cursor_sample + count : SIZE_MAX;
+    return count;
+}
+
+size_t HistoryStore::copyOpen(size_t sample, RaptPillData *out, size_t max)
+{
+    GorillaDecoder decoder(m_open_record + 1, m_encoder.size(), m_encoder.count());
+    RaptPillData skipped;
+    for (size_t index = m_sealed_end; index < sample; ++index)
+    {
+        decoder.next(skipped);
+    }
+    size_t count = 0;
+    while (count < max && decoder.next(out[count]))
+    {
+        count++;
+    }
+    return count;
+}
+
+size_t HistoryStore::copyRange(size_t sample, size_t last, RaptPillData *out, size_t max)
+{
+    int64_t start_us = esp_timer_get_time();
+    size_t count = 0;
+    while (count < max && sample < last)
+    {
+        size_t copied;
+        if (sample >= storedEnd())
+        {
+            // The sample the deadband holds back ends the series.
+            copied = m_door.pending(out[count]) ? 1 : 0;
+        }
+        else if (sample >= m_sealed_end)
+        {
+            copied = copyOpen(sample, out + count, max - count);
+        }
+        else
+        {
+            // Last segment starting at or before the sample.
+            auto next = std::upper_bound(m_segments.begin(), m_segments.end(), sample, [](size_t value, const Segment &segment)
+            {
+                return value < segment.first_sample;
+            });
+            copied = copySegment(*(next - 1), sample, out + count, max - count);
+        }
+        if (copied == 0)
+        {
+            break;
+        }
+        count += copied;
+        sample += copied;
+    }
+    m_decoded_samples += count;
+    m_decode_us += esp_timer_get_time() - start_us;
+    return count;
+}
+
+size_t HistoryStore::copy(size_t offset, RaptPillData *out, size_t max)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t count = copyRange(visibleStart() + offset, end(), out, max);
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+HistoryRange HistoryStore::storedRange()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    HistoryRange range = {.epoch = m_epoch, .first = firstSample(), .end = storedEnd()};
+    xSemaphoreGive(m_mutex);
+    return range;
+}
+
+size_t HistoryStore::copyStored(size_t sample, RaptPillData *out, size_t max)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t first = firstSample();
+    size_t count = copyRange(sample < first ? first : sample, storedEnd(), out, max);
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+HistoryRange HistoryStore::sealedRange()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    HistoryRange range = {.epoch = m_epoch, .first = firstSample(), .end = m_sealed_end};
+    xSemaphoreGive(m_mutex);
+    return range;
+}
+
+size_t HistoryStore::copySealed(size_t sample, RaptPillData *out, size_t max)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t count = sample < firstSample() ? 0 : copyRange(sample, m_sealed_end, out, max);
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+bool HistoryStore::segment(size_t sample, HistorySegment &out)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool found = sample >= firstSample() && sample < m_sealed_end;
+    if (found)
+    {
+        auto next = std::upper_bound(m_segments.begin(), m_segments.end(), sample, [](size_t value, const Segment &segment)
+        {
+            return value < segment.first_sample;
+        });
+        const Segment &segment = *(next - 1);
+        out = {.record = segment.record, .first_sample = segment.first_sample, .samples = segment.samples,
+               .bytes = segment.legacy ? 0 : segment.bytes, .legacy = segment.legacy};
+    }
+    xSemaphoreGive(m_mutex);
+    return found;
+}
+
+size_t HistoryStore::readBlock(const HistorySegment &segment, uint8_t *out, size_t max)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t length = 0;
+    // Record numbers are never reused while the device runs, so a matching entry is the same block.
+    auto next = std::upper_bound(m_segments.begin(), m_segments.end(), segment.first_sample, [](size_t value, const Segment &entry)
+    {
+        return value < entry.first_sample;
+    });
+    if (next != m_segments.begin() && (next - 1)->record == segment.record && !(next - 1)->legacy &&
+        loadBlock(*(next - 1)) && m_cache_size <= max)
+    {
+        memcpy(out, m_cache, m_cache_size);
+        length = m_cache_size;
+    }
+    xSemaphoreGive(m_mutex);
+    return length;
+}
+
+size_t HistoryStore::seekAfter(uint32_t boot_id, int64_t timestamp)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t low = firstSample();
+    size_t high = storedEnd();
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        RaptPillData sample;
+        if (copyRange(mid, mid + 1, &sample, 1) == 0)
+        {
+            break;
+        }
+        bool after = sample.boot_id > boot_id || (sample.boot_id == boot_id && sample.timestamp > timestamp);
+        if (after)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    return low;
+}
+
+size_t HistoryStore::size()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t count = end() - visibleStart();
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+bool HistoryStore::block(size_t offset, HistoryBlock &out)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t start = visibleStart();
+    size_t sample = start + offset;
+    bool found = sample < end();
+    if (found && sample < m_sealed_end)
+    {
+        auto next = std::upper_bound(m_segments.begin(), m_segments.end(), sample, [](size_t value, const Segment &segment)
+        {
+            return value < segment.first_sample;
+        });
+        const Segment &segment = *(next - 1);
+        size_t first = segment.first_sample > start ? segment.first_sample : start;
+        out.offset = first - start;
+        out.samples = segment.first_sample + segment.samples - first;
+        out.id = segment.record;
+        out.immutable = !segment.legacy && first == segment.first_sample;
+    }
+    else if (found)
+    {
+        // The open block and the held sample change with every append.
+        size_t first = m_sealed_end > start ? m_sealed_end : start;
+        out.offset = first - start;
+        out.samples = end() - first;
+        out.id = SIZE_MAX;
+        out.immutable = false;
+    }
+    xSemaphoreGive(m_mutex);
+    return found;
+}
+
+bool HistoryStore::latest(RaptPillData &out)
+{
+    // Answer from the early samples rather than waiting for load() to finish.
+    portENTER_CRITICAL(&m_early_lock);
+    if (!m_loaded)
+    {
+        bool found = m_early_count > 0;
+        CompactSample last = found ? m_early[(m_early_head + m_early_count - 1) % HISTORY_EARLY_SAMPLES] : CompactSample{};
+        portEXIT_CRITICAL(&m_early_lock);
+        out = found ? CompactCodec::decode(last, TimeBase::bootId()) : RaptPillData{};
+        return found;
+    }
+    portEXIT_CRITICAL(&m_early_lock);
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool found = end() > firstSample();
+    out = m_latest;
+    xSemaphoreGive(m_mutex);
+    return found;
+}
+
+esp_err_t HistoryStore::clear()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&m_early_lock);
+    m_early_count = 0;
+    portEXIT_CRITICAL(&m_early_lock);
+    if (!m_storage)
+    {
+        m_version.fetch_add(1, std::memory_order_release);
+        xSemaphoreGive(m_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = m_storage->truncate();
+    if (err == ESP_OK)
+    {
+        err = m_storage->clearTail();
+    }
+    // Keep numbering where it was, so cached blocks of the old history never match.
+    m_segments.clear();
+    xSemaphoreTake(m_archive_mutex, portMAX_DELAY);
+    m_archive.clear();
+    xSemaphoreGive(m_archive_mutex);
+    m_base_record = m_next_record;
+    m_sealed_end += m_encoder.count();
+    m_encoder.reset();
+    m_latest = {};
+    m_door.reset();
+    m_version.fetch_add(1, std::memory_order_release);
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t HistoryStore::importBlock(const uint8_t *record, size_t length)
+{
+    if (length < 2 || length > 1 + GORILLA_BLOCK_BYTES || record[0] != HISTORY_BLOCK_TAG)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    GorillaDecoder decoder = GorillaDecoder::sealed(record + 1, length - 1);
+    uint16_t count = decoder.remaining();
+    RaptPillData last = {};
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        if (!decoder.next(last))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (count == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    if (!m_storage)
+    {
+        xSemaphoreGive(m_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = m_storage->append(record, length);
+    if (err == ESP_OK)
+    {
+        Segment segment = {.record = m_next_record++, .records = 1, .first_sample = m_sealed_end, .samples = count, .bytes = length - 1, .legacy = false};
+        m_segments.push_back(segment);
+        m_sealed_end += count;
+        if (archiveOffsets(record + 1, length - 1, segment.record) > 0)
+        {
+            TimeBase::archiveChanged();
+        }
+        RaptPillData held;
+        if (m_encoder.count() > 0)
+        {
+            // The open block's samples moved up by count; readers holding numbers must seek again.
+            m_epoch++;
+        }
+        else if (!m_door.pending(held))
+        {
+            m_latest = last;
+            m_door.restart(last);
+        }
+        dropRotated();
+        m_version.fetch_add(1, std::memory_order_release);
+    }
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+void HistoryStore::setDeadband(const DeadbandConfig &config)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_door.configure(config);
+    xSemaphoreGive(m_mutex);
+}
+
+void HistoryStore::setRetention(uint32_t max_samples)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_retention = max_samples;
+    m_version.fetch_add(1, std::memory_order_release);
+    xSemaphoreGive(m_mutex);
+}
+
+HistoryStats HistoryStore::stats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    HistoryStats stats = {};
+    stats.samples = end() - visibleStart();
+    stats.offered_samples = m_offered_samples;
+    stats.stored_samples = m_stored_samples;
+    stats.open_samples = m_encoder.count();
+    size_t block_bytes = m_encoder.size();
+    size_t block_samples = m_encoder.count();
+    for (const Segment &segment : m_segments)
+    {
+        if (segment.legacy)
+        {
+            stats.legacy_rows += segment.samples;
+        }
+        else
+        {
+            stats.sealed_blocks++;
+            block_bytes += segment.bytes;
+            block_samples += segment.samples;
+        }
+    }
+    stats.bytes_per_sample = block_samples ? static_cast<float>(block_bytes) / block_samples : 0.0f;
+    stats.decoded_samples = m_decoded_samples;
+    stats.decode_us = m_decode_us;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
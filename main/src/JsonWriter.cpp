@@ -0,0 +1,187 @@
+#include "web/JsonWriter.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "esp_log.h"
+
+static const char *JSON_TAG = "JsonWriter";
+
+void ChunkedResponse::write(const char *data, size_t len)
+{
+    while (m_ok && len > 0)
+    {
+        if (m_used == m_size)
+        {
+            flush();
+            continue;
+        }
+        size_t n = len < m_size - m_used ? len : m_size - m_used;
+        memcpy(m_buffer + m_used, data, n);
+        m_used += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChunkedResponse::write(const char *str)
+{
+    write(str, strlen(str));
+}
+
+void ChunkedResponse::print(const char *fmt, ...)
+{
+    char scratch[96];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(scratch, sizeof(scratch), fmt, args);
+    va_end(args);
+    if (len > 0)
+    {
+        write(scratch, static_cast<size_t>(len) < sizeof(scratch) ? len : sizeof(scratch) - 1);
+    }
+}
+
+void ChunkedResponse::flush()
+{
+    if (m_ok && m_used > 0)
+    {
+        if (httpd_resp_send_chunk(m_req, m_buffer, m_used) != ESP_OK)
+        {
+            ESP_LOGE(JSON_TAG, "Error sending response chunk");
+            m_ok = false;
+        }
+    }
+    m_used = 0;
+}
+
+esp_err_t ChunkedResponse::finish()
+{
+    flush();
+    if (!m_ok)
+    {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(m_req, NULL, 0);
+}
+
+void JsonWriter::separator()
+{
+    if (m_after_key)
+    {
+        m_after_key = false;
+        return;
+    }
+    uint32_t bit = 1u << m_depth;
+    if (m_has_items & bit)
+    {
+        m_out.write(",", 1);
+    }
+    m_has_items |= bit;
+}
+
+void JsonWriter::push()
+{
+    m_depth++;
+    m_has_items &= ~(1u << m_depth);
+}
+
+void JsonWriter::pop()
+{
+    m_depth--;
+}
+
+void JsonWriter::beginObject()
+{
+    separator();
+    m_out.write("{", 1);
+    push();
+}
+
+void JsonWriter::endObject()
+{
+    pop();
+    m_out.write("}", 1);
+}
+
+void JsonWriter::beginArray()
+{
+    separator();
+    m_out.write("[", 1);
+    push();
+}
+
+void JsonWriter::endArray()
+{
+    pop();
+    m_out.write("]", 1);
+}
+
+void JsonWriter::key(const char *name)
+{
+    separator();
+    m_out.write("\"", 1);
+    m_out.write(name);
+    m_out.write("\":", 2);
+    m_after_key = true;
+}
+
+void JsonWriter::value(const char *str)
+{
+    separator();
+    m_out.write("\"", 1);
+    // Escape only what can appear in our own strings: quotes, backslashes and control characters.
+    const char *run = str;
+    for (const char *p = str; *p; ++p)
+    {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\' || c < 0x20)
+        {
+            m_out.write(run, p - run);
+            char escaped[8];
+            int len = (c == '"' || c == '\\') ? snprintf(escaped, sizeof(escaped), "\\%c", c)
+                                               : snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            m_out.write(escaped, len);
+            run = p + 1;
+        }
+    }
+    m_out.write(run);
+    m_out.write("\"", 1);
+}
+
+void JsonWriter::value(int64_t number)
+{
+    separator();
+    m_out.print("%lld", static_cast<long long>(number));
+}
+
+void JsonWriter::value(float number, int precision)
+{
+    separator();
+    if (std::isfinite(number))
+    {
+        m_out.print("%.*f", precision, number);
+    }
+    else
+    {
+        m_out.write("null", 4);
+    }
+}
+
+void JsonWriter::value(bool flag)
+{
+    separator();
+    if (flag)
+    {
+        m_out.write("true", 4);
+    }
+    else
+    {
+        m_out.write("false", 5);
+    }
+}
+
+void JsonWriter::null()
+{
+    separator();
+    m_out.write("null", 4);
+}
@@ -0,0 +1,59 @@
+#include "drivers/LinkTracker.hpp"
+
+void LinkTracker::advert(int8_t rssi, int64_t now_us)
+{
+    m_stats.rssi_avg = m_stats.adverts == 0 ? rssi : m_stats.rssi_avg + (rssi - m_stats.rssi_avg) / LINK_EWMA_WEIGHT;
+    m_stats.rssi = rssi;
+    m_stats.adverts++;
+    m_stats.last_advert_us = now_us;
+    m_adverts_since_sample++;
+}
+
+void LinkTracker::sample(int64_t now_us)
+{
+    float repeats = static_cast<float>(m_adverts_since_sample);
+    m_stats.adverts_per_sample = m_stats.samples == 0 ? repeats
+                                                      : m_stats.adverts_per_sample + (repeats - m_stats.adverts_per_sample) / LINK_EWMA_WEIGHT;
+    m_adverts_since_sample = 0;
+    int64_t last_us = m_stats.last_sample_us;
+    m_stats.samples++;
+    m_stats.last_sample_us = now_us;
+    if (m_stats.samples == 1)
+    {
+        return;
+    }
+
+    int64_t interval = now_us - last_us;
+    if (m_stats.cadence_us == 0)
+    {
+        m_stats.cadence_us = interval;
+        return;
+    }
+
+    // Cadences this interval spans, at least one even if the pill reported early.
+    int64_t cadence = m_stats.cadence_us;
+    uint32_t steps = static_cast<uint32_t>((interval + cadence / 2) / cadence);
+    steps = steps == 0 ? 1 : steps;
+    m_step_runs = steps == m_last_step ? m_step_runs + 1 : 1;
+    m_last_step = steps;
+    if (steps > 1 && m_step_runs >= LINK_RELEARN_RUNS)
+    {
+        // Steady multiples are a slower reporting interval, not steady loss.
+        m_stats.cadence_us = interval;
+        m_step_runs = 0;
+        steps = 1;
+    }
+    else
+    {
+        m_stats.cadence_us += (interval / steps - cadence) / LINK_EWMA_WEIGHT;
+    }
+
+    m_stats.expected += steps;
+    m_stats.received++;
+    if (steps - 1 >= LINK_GAP_MISSED)
+    {
+        m_stats.gaps++;
+        m_stats.last_gap_us = now_us;
+        m_stats.longest_gap_us = interval > m_stats.longest_gap_us ? interval : m_stats.longest_gap_us;
+    }
+}
@@ -0,0 +1,172 @@
+#include "drivers/PowerManager.hpp"
+#include <cstring>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+static const char *POWER_TAG = "PowerManager";
+
+static const PowerProfileConfig profiles[POWER_PROFILE_COUNT] = {
+    {"performance", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, false, WIFI_PS_MIN_MODEM, 100},
+    {"balanced", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, 80, false, WIFI_PS_MIN_MODEM, 50},
+    {"low_power", 80, CONFIG_XTAL_FREQ, true, WIFI_PS_MAX_MODEM, 10},
+};
+
+namespace
+{
+    portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+    PowerStats current = {};
+
+    // Previous idle counters per core, for the load over the last interval.
+    uint32_t last_idle[portNUM_PROCESSORS] = {};
+    int64_t last_sample_us = 0;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    // Runs with the scheduler stopped, right after the chip wakes from light sleep.
+    IRAM_ATTR esp_err_t onLightSleepExit(int64_t sleep_time_us, void *arg)
+    {
+        portENTER_CRITICAL_SAFE(&stats_lock);
+        current.light_sleep_wakes++;
+        current.light_sleep_us += sleep_time_us;
+        portEXIT_CRITICAL_SAFE(&stats_lock);
+        return ESP_OK;
+    }
+#endif
+}
+
+const PowerProfileConfig &PowerManager::config(uint8_t profile)
+{
+    return profiles[profile < POWER_PROFILE_COUNT ? profile : static_cast<uint8_t>(PowerProfile::Balanced)];
+}
+
+bool PowerManager::parseProfile(const char *name, uint8_t &profile)
+{
+    for (uint8_t i = 0; i < POWER_PROFILE_COUNT; ++i)
+    {
+        if (strcmp(name, profiles[i].name) == 0)
+        {
+            profile = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PowerManager::init()
+{
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t callbacks = {};
+    callbacks.exit_cb = &onLightSleepExit;
+    if (esp_pm_light_sleep_register_cbs(&callbacks) != ESP_OK)
+    {
+        ESP_LOGW(POWER_TAG, "Failed to register light sleep callback, wake counts unavailable");
+    }
+#endif
+    apply(static_cast<PowerProfile>(SettingsStore::get().power_profile));
+    SettingsStore::subscribe(SETTINGS_POWER, &PowerManager::onSettingsChanged, nullptr);
+}
+
+void PowerManager::onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx)
+{
+    apply(static_cast<PowerProfile>(settings.power_profile));
+}
+
+void PowerManager::apply(PowerProfile profile)
+{
+    const PowerProfileConfig &cfg = config(static_cast<uint8_t>(profile));
+    bool pm_enabled = false;
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = cfg.max_freq_mhz,
+        .min_freq_mhz = cfg.min_freq_mhz,
+        .light_sleep_enable = cfg.light_sleep,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err == ESP_OK)
+    {
+        pm_enabled = true;
+    }
+    else
+    {
+        ESP_LOGE(POWER_TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+    }
+#endif
+    esp_err_t ps_err = esp_wifi_set_ps(cfg.wifi_ps);
+    if (ps_err != ESP_OK)
+    {
+        ESP_LOGW(POWER_TAG, "Failed to set Wi-Fi power save: %s", esp_err_to_name(ps_err));
+    }
+
+    // Start a fresh measurement so figures always belong to one profile.
+    portENTER_CRITICAL(&stats_lock);
+    current = {};
+    current.profile = profile;
+    current.pm_enabled = pm_enabled;
+    current.profile_since_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&stats_lock);
+
+    ESP_LOGI(POWER_TAG, "Power profile %s: CPU %d-%d MHz, light sleep %s, scan duty <= %u%%",
+             cfg.name, cfg.min_freq_mhz, cfg.max_freq_mhz, cfg.light_sleep ? "on" : "off", cfg.scan_duty_percent);
+}
+
+void PowerManager::sample()
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t elapsed_us = now_us - last_sample_us;
+    float load[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+        // The run time counter ticks in microseconds; unsigned math handles wrap-around.
+        uint32_t idle = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+        uint32_t idle_us = idle - last_idle[core];
+        last_idle[core] = idle;
+        load[core] = elapsed_us > 0 ? 1.0f - static_cast<float>(idle_us) / elapsed_us : 0.0f;
+        if (load[core] < 0.0f)
+        {
+            load[core] = 0.0f;
+        }
+    }
+    bool first = last_sample_us == 0;
+    last_sample_us = now_us;
+    if (first)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    memcpy(current.cpu_load, load, sizeof(load));
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void PowerManager::record(LatencyStat &stat, int64_t us)
+{
+    portENTER_CRITICAL(&stats_lock);
+    stat.count++;
+    stat.total_us += us;
+    if (us > stat.max_us)
+    {
+        stat.max_us = us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void PowerManager::recordIngestLatency(int64_t us)
+{
+    record(current.ingest, us);
+}
+
+void PowerManager::recordHttpLatency(int64_t us)
+{
+    record(current.http, us);
+}
+
+PowerStats PowerManager::stats()
+{
+    portENTER_CRITICAL(&stats_lock);
+    PowerStats copy = current;
+    portEXIT_CRITICAL(&stats_lock);
+    return copy;
+}
@@ -0,0 +1,50 @@
+#include "web/QueryString.hpp"
+#include <cstdlib>
+
+QueryString::QueryString(httpd_req_t *req, Arena &arena)
+{
+    size_t len = httpd_req_get_url_query_len(req);
+    if (len == 0)
+    {
+        return;
+    }
+    m_query = static_cast<char *>(arena.allocate(len + 1, 1));
+    if (!m_query || httpd_req_get_url_query_str(req, m_query, len + 1) != ESP_OK)
+    {
+        m_query = nullptr;
+        m_valid = false;
+    }
+}
+
+bool QueryString::has(const char *key) const
+{
+    char value[2];
+    if (!m_query)
+    {
+        return false;
+    }
+    esp_err_t err = httpd_query_key_value(m_query, key, value, sizeof(value));
+    return err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+bool QueryString::get(const char *key, char *out, size_t size) const
+{
+    return m_query && httpd_query_key_value(m_query, key, out, size) == ESP_OK;
+}
+
+bool QueryString::getInt(const char *key, int64_t &out) const
+{
+    char value[24];
+    if (!get(key, value, sizeof(value)))
+    {
+        return false;
+    }
+    char *end = nullptr;
+    long long parsed = strtoll(value, &end, 10);
+    if (end == value || *end != '\0')
+    {
+        return false;
+    }
+    out = parsed;
+    return true;
+}
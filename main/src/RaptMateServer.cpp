@@ -1,13 +1,63 @@
 #include "web/RaptMateServer.hpp"
 #include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <climits>
+#include <new>
+#include "esp_timer.h"
 static const char *SERVER_TAG = "RaptMateServer";
 
-void RaptMateServer::init()
-{
-    // We start the HTTP server immediately. In this example,
-    // mDNS is (re)initialized once an IP is acquired.
-    init_http_server();
+// Arena of the HTTP server task; async workers bring their own.
+static StaticArena<REQUEST_ARENA_SIZE> server_task_arena;
+
+#if !CONFIG_RAPTMATE_EMBED_WEB_ASSETS
+// Only touched by the static file handler, which always runs on the server task.
+static MissCache<WEB_MISS_CACHE_SIZE> web_miss_cache;
+#endif
+
+RaptMateServer *RaptMateServer::instance_ = nullptr;
 
+// Every endpoint is registered explicitly; the trailing wildcard serves the web app.
+// httpd matches on the path only, so query strings do not affect dispatch, and a
+// known path with the wrong method gets a 405 from httpd itself.
+const RaptMateServer::Route RaptMateServer::routes[] = {
+    {"/data", HTTP_GET, &RaptMateServer::data_get_handler, true},
+    {"/api/v1/readings", HTTP_GET, &RaptMateServer::readings_get_handler, true},
+    {"/api/v1/time", HTTP_GET, &RaptMateServer::time_get_handler, false},
+    {"/api/v1/time", HTTP_POST, &RaptMateServer::time_post_handler, false},
+    {"/api/v1/network", HTTP_GET, &RaptMateServer::network_get_handler, false},
+    {"/reset", HTTP_GET, &RaptMateServer::reset_get_handler, false},
+    {"/backup", HTTP_GET, &RaptMateServer::backup_get_handler, true},
+    {"/restore", HTTP_POST, &RaptMateServer::restore_post_handler, true},
+    {"/settings", HTTP_POST, &RaptMateServer::settings_post_handler, false},
+    {"/api/v1/settings", HTTP_GET, &RaptMateServer::settings_get_handler, false},
+    {"/api/v1/settings", HTTP_PATCH, &RaptMateServer::settings_patch_handler, false},
+    {"/api/v1/power", HTTP_GET, &RaptMateServer::power_get_handler, false},
+    {"/api/v1/storage", HTTP_GET, &RaptMateServer::storage_get_handler, false},
+    {"/health", HTTP_GET, &RaptMateServer::health_get_handler, false},
+    {"/api/v1/uplink", HTTP_GET, &RaptMateServer::uplink_get_handler, false},
+    {"/api/v1/history/delta", HTTP_GET, &RaptMateServer::history_delta_get_handler, true},
+    {"/api/v1/history/export", HTTP_GET, &RaptMateServer::history_export_get_handler, true},
+    {"/api/v1/fleet", HTTP_GET, &RaptMateServer::fleet_get_handler, false},
+    {"/api/v1/fleet/readings", HTTP_GET, &RaptMateServer::fleet_readings_get_handler, true},
+    {"/api/v1/rules", HTTP_GET, &RaptMateServer::rules_get_handler, true},
+    {"/api/v1/rules", HTTP_PUT, &RaptMateServer::rules_put_handler, true},
+    {"/api/v1/alerts", HTTP_GET, &RaptMateServer::alerts_get_handler, true},
+    {"/api/v1/alerts/stream", HTTP_GET, &RaptMateServer::alerts_stream_get_handler, false},
+    {"/api/v1/forecast", HTTP_GET, &RaptMateServer::forecast_get_handler, true},
+    {"/api/v1/ingest/ispindel", HTTP_POST, &RaptMateServer::ispindel_post_handler, true},
+    {"/api/v1/devices*", HTTP_GET, &RaptMateServer::devices_get_handler, true},
+    {"/*", HTTP_GET, &RaptMateServer::static_file_get_handler, false},
+};
+const size_t RaptMateServer::route_count = sizeof(RaptMateServer::routes) / sizeof(RaptMateServer::routes[0]);
+
+esp_err_t RaptMateServer::mountWeb()
+{
+#if CONFIG_RAPTMATE_EMBED_WEB_ASSETS
+    ESP_LOGI(SERVER_TAG, "Serving %u embedded web assets", static_cast<unsigned>(WebAssets::count));
+    return ESP_OK;
+#else
     // Initialize SPIFFS for react app
     esp_vfs_spiffs_conf_t conf = {
         .base_path = "/web",
@@ -25,6 +75,8 @@ void RaptMateServer::init()
     {
         ESP_LOGI(SERVER_TAG, "SPIFFS mounted");
     }
+    return ret;
+#endif
 }
 
 RaptMateServer::~RaptMateServer()
@@ -33,37 +85,73 @@ RaptMateServer::~RaptMateServer()
 
 }
 
-void RaptMateServer::init_http_server()
+esp_err_t RaptMateServer::start()
 {
+    // mDNS is (re)initialized once an IP is acquired.
     ESP_LOGI(SERVER_TAG, "Starting HTTP Server");
+    Arena::installJsonHooks();
+    AsyncWorkers::start(server_task_arena);
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
-    if (httpd_start(&server, &config) == ESP_OK)
-    {
-        // Register the root URI handler that serves the HTML page.
-
-        httpd_uri_t index_uri = {};
-        index_uri.uri = "/*";
-        index_uri.method = HTTP_GET;
-        index_uri.handler = RaptMateServer::index_get_handler;
-        index_uri.user_ctx = this->ble;
-        
-        httpd_register_uri_handler(server, &index_uri);
-
-        httpd_uri_t post_uri = {
-            .uri       = "/settings",  // Your endpoint
-            .method    = HTTP_POST,
-            .handler   = RaptMateServer::settings_post_handler,
-            .user_ctx  = this->wm
-        };
-        httpd_register_uri_handler(server, &post_uri);
+    config.max_open_sockets = server_profile.max_open_sockets;
+    config.max_uri_handlers = server_profile.max_uri_handlers;
+    config.recv_wait_timeout = server_profile.recv_wait_timeout_s;
+    config.send_wait_timeout = server_profile.send_wait_timeout_s;
+    config.lru_purge_enable = server_profile.lru_purge;
+    config.keep_alive_enable = server_profile.keep_alive;
+    config.keep_alive_idle = server_profile.keep_alive_idle_s;
+    config.keep_alive_interval = server_profile.keep_alive_interval_s;
+    config.keep_alive_count = server_profile.keep_alive_count;
+    config.stack_size = server_profile.stack_size;
+    esp_err_t err = httpd_start(&server, &config);
+    if (err == ESP_OK)
+    {
+        for (size_t i = 0; i < route_count; ++i)
+        {
+            httpd_uri_t uri = {
+                .uri = routes[i].uri,
+                .method = routes[i].method,
+                .handler = RaptMateServer::route_handler,
+                .user_ctx = const_cast<Route *>(&routes[i]),
+            };
+            if (httpd_register_uri_handler(server, &uri) != ESP_OK)
+            {
+                ESP_LOGE(SERVER_TAG, "Failed to register %s", routes[i].uri);
+            }
+        }
 
+        // Streams keep their socket, so the other clients and the async workers still need some.
+        static_assert(ALERT_STREAM_MAX_CLIENTS + ASYNC_WORKER_COUNT < server_profile.max_open_sockets,
+                      "alert streams would take every socket");
+        if (AlertStream::instance().start() != ESP_OK)
+        {
+            ESP_LOGE(SERVER_TAG, "Failed to start alert streams");
+        }
         ESP_LOGI(SERVER_TAG, "HTTP Server started");
     }
     else
     {
         ESP_LOGE(SERVER_TAG, "Error starting HTTP Server!");
     }
+    return err;
+}
+
+esp_err_t RaptMateServer::route_handler(httpd_req_t *req)
+{
+    const Route *route = static_cast<const Route *>(req->user_ctx);
+    if (route->async)
+    {
+        esp_err_t err = AsyncWorkers::submit(req, route->handler);
+        Startup::reach(StartupMilestone::FirstResponse);
+        return err;
+    }
+    // Interactive routes only; exports run long by design and would drown the figure.
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = route->handler(req);
+    PowerManager::recordHttpLatency(esp_timer_get_time() - start_us);
+    Startup::reach(StartupMilestone::FirstResponse);
+    return err;
 }
 
 char *RaptMateServer::get_content_type(const char *filepath)
@@ -96,26 +184,77 @@ char *RaptMateServer::get_content_type(const char *filepath)
     return "text/plain";
 }
 
+#if CONFIG_RAPTMATE_EMBED_WEB_ASSETS
+esp_err_t RaptMateServer::static_file_get_handler(httpd_req_t *req)
+{
+    // req->uri still carries the query string, only the path names an asset.
+    size_t path_len = strcspn(req->uri, "?#");
+    const WebAsset *asset = path_len == 1 ? WebAssets::find("/index.html", strlen("/index.html"))
+                                          : WebAssets::find(req->uri, path_len);
+    if (!asset)
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    // The build puts a content hash in every file name under /static/.
+    bool hashed = strncmp(asset->path, "/static/", strlen("/static/")) == 0;
+    httpd_resp_set_hdr(req, "Cache-Control", hashed ? "public, max-age=31536000, immutable" : "no-cache");
+
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset->etag) != nullptr)
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    httpd_resp_set_type(req, asset->content_type);
+    if (asset->gzip)
+    {
+        // Every browser accepts gzip; the device has no way to inflate.
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    // Straight from memory-mapped flash.
+    return httpd_resp_send(req, reinterpret_cast<const char *>(asset->data), asset->length);
+}
+#else
 esp_err_t RaptMateServer::static_file_get_handler(httpd_req_t *req)
 {
-    char filepath[600];
-    if (strcmp(req->uri, "/") == 0)
+    // req->uri still carries the query string, only the path names a file.
+    size_t path_len = strcspn(req->uri, "?#");
+    if (path_len >= WEB_PATH_MAX || strstr(req->uri, "..") != nullptr)
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_OK;
+    }
+
+    char filepath[WEB_PATH_MAX + 16];
+    if (path_len == 1)
     {
         snprintf(filepath, sizeof(filepath), "/web/index.html");
     }
     else
     {
-        snprintf(filepath, sizeof(filepath), "/web%s", req->uri);
+        snprintf(filepath, sizeof(filepath), "/web%.*s", static_cast<int>(path_len), req->uri);
+    }
+
+    if (web_miss_cache.contains(filepath))
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_OK;
     }
 
-    ESP_LOGI(SERVER_TAG, "File path: %s", filepath);
+    ESP_LOGD(SERVER_TAG, "File path: %s", filepath);
     // Open the file for reading
     FILE *file = fopen(filepath, "r");
     if (!file)
     {
-        ESP_LOGE(SERVER_TAG, "Failed to open file: %s", filepath);
+        ESP_LOGW(SERVER_TAG, "Not found, caching miss: %s", filepath);
+        web_miss_cache.insert(filepath);
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
-        return ESP_FAIL;
+        return ESP_OK;
     }
 
     // Send file content in chunks
@@ -131,133 +270,2146 @@ esp_err_t RaptMateServer::static_file_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-esp_err_t RaptMateServer::settings_post_handler(httpd_req_t *req)
-{
-    // First check if it's a POST request
-    if (req->method != HTTP_POST) {
-        httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Method not allowed");
-        return ESP_FAIL;
-    }
+#endif
 
-    // Get content length
-    int content_length = req->content_len;
-    if (content_length > 1024) { // Set your max content length
+char *RaptMateServer::receive_body(httpd_req_t *req, Arena &arena, size_t max_length)
+{
+    size_t content_length = req->content_len;
+    if (content_length > max_length)
+    {
         httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Content too long");
-        return ESP_FAIL;
+        return nullptr;
     }
 
-    // Read the content
-    char *content = static_cast<char *>(malloc(content_length + 1));
-    if (!content) {
+    char *content = static_cast<char *>(arena.allocate(content_length + 1, 1));
+    if (!content)
+    {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+        return nullptr;
     }
 
-    int ret = httpd_req_recv(req, content, content_length);
-    if (ret <= 0) {  // Returns 0 if connection closed, <0 if error
-        free(content);
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+    size_t received = 0;
+    while (received < content_length)
+    {
+        int ret = httpd_req_recv(req, content + received, content_length - received);
+        if (ret <= 0) // Returns 0 if connection closed, <0 if error
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+            }
+            return nullptr;
         }
+        received += ret;
+    }
+    content[received] = '\0';
+    return content;
+}
+
+esp_err_t RaptMateServer::settings_post_handler(httpd_req_t *req)
+{
+    // Read the content; the body and the parsed JSON tree both live in the request arena.
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *content = receive_body(req, arena, SETTINGS_BODY_MAX);
+    if (!content)
+    {
         return ESP_FAIL;
     }
-    content[ret] = '\0'; // Null-terminate the received data
 
-    // Process the received data (example: print it)
-    ESP_LOGI(SERVER_TAG, "Received POST content: %s", content);
     cJSON *json = cJSON_Parse(content);
     if (json == NULL) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        free(content);
         return ESP_FAIL;
     }
 
     cJSON *ssid = cJSON_GetObjectItem(json, "ssid");
     cJSON *password = cJSON_GetObjectItem(json, "password");
-    
-    if (cJSON_IsString(ssid) && cJSON_IsString(password)) {
-        ESP_LOGI(SERVER_TAG, "SSID: %s", ssid->valuestring);
-        ESP_LOGI(SERVER_TAG, "Password: %s", password->valuestring);
-        WiFiManager *wifi_manager = static_cast<WiFiManager *>(req->user_ctx);
-
-        // Set credentials in WiFiManager
-        wifi_manager->setCredentials(ssid->valuestring, password->valuestring);
-    } else {
+    if (!cJSON_IsString(ssid) || !cJSON_IsString(password) ||
+        strlen(ssid->valuestring) == 0 || strlen(ssid->valuestring) >= sizeof(Settings::wifi_ssid) ||
+        strlen(password->valuestring) >= sizeof(Settings::wifi_password))
+    {
         cJSON_Delete(json);
-        free(content);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON format");
         return ESP_FAIL;
     }
+    ESP_LOGI(SERVER_TAG, "SSID: %s", ssid->valuestring);
 
+    // The Wi-Fi manager picks the change up as a settings listener.
+    Settings settings = SettingsStore::get();
+    // Lengths were checked above, so the copies are terminated.
+    strncpy(settings.wifi_ssid, ssid->valuestring, sizeof(settings.wifi_ssid));
+    strncpy(settings.wifi_password, password->valuestring, sizeof(settings.wifi_password));
     cJSON_Delete(json);
+    if (SettingsStore::update(settings) != ESP_OK)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, SettingsStore::lastError());
+        return ESP_FAIL;
+    }
+
     // Send response
     const char *resp_str = "{\"status\":\"success\",\"received\":\"your data\"}";
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp_str, strlen(resp_str));
 
-    free(content);
     return ESP_OK;
 }
 
-esp_err_t RaptMateServer::index_get_handler(httpd_req_t *req)
+esp_err_t RaptMateServer::send_settings(httpd_req_t *req, const Settings &settings)
 {
-    if (strcmp(req->uri, "/data") == 0)
+    Arena &arena = AsyncWorkers::requestArena();
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
     {
-        return data_get_handler(req);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
     }
-    else if (strcmp(req->uri, "/reset") == 0)
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("wifi_ssid");
+    json.value(settings.wifi_ssid);
+    // The password is write-only.
+    json.key("wifi_password_set");
+    json.value(settings.wifi_password[0] != '\0');
+    json.key("scan_interval_ms");
+    json.value(settings.scan_interval * BLE_SCAN_UNIT_MS, 3);
+    json.key("scan_window_ms");
+    json.value(settings.scan_window * BLE_SCAN_UNIT_MS, 3);
+    json.key("history_max_records");
+    json.value(static_cast<int64_t>(settings.history_max_records));
+    json.key("power_profile");
+    json.value(PowerManager::config(settings.power_profile).name);
+    json.key("deadband");
+    json.beginObject();
+    json.key("gravity_velocity");
+    json.value(settings.deadband_gravity_velocity / 100.0f, 2);
+    json.key("temperature");
+    json.value(settings.deadband_temperature / 100.0f, 2);
+    json.key("specific_gravity");
+    json.value(settings.deadband_specific_gravity / 10000.0f, 4);
+    json.key("accel");
+    json.value(settings.deadband_accel / 100.0f, 2);
+    json.key("battery");
+    json.value(settings.deadband_battery / 100.0f, 2);
+    json.endObject();
+    json.key("history_heartbeat_s");
+    json.value(static_cast<int64_t>(settings.history_heartbeat_s));
+    json.key("uplink");
+    json.beginObject();
+    json.key("mode");
+    json.value(Uplink::modeName(static_cast<UplinkMode>(settings.uplink_mode)));
+    json.key("url");
+    json.value(settings.uplink_url);
+    json.key("topic");
+    json.value(settings.uplink_topic);
+    json.endObject();
+    json.key("collector");
+    json.beginObject();
+    json.key("enabled");
+    json.value(settings.collector_enabled != 0);
+    json.key("peers");
+    json.value(settings.collector_peers);
+    json.endObject();
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::settings_get_handler(httpd_req_t *req)
+{
+    ArenaScope scope(AsyncWorkers::requestArena());
+    return send_settings(req, SettingsStore::get());
+}
+
+esp_err_t RaptMateServer::settings_patch_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *content = receive_body(req, arena, SETTINGS_BODY_MAX);
+    if (!content)
     {
-        RaptPillBLE *ble = static_cast<RaptPillBLE *>(req->user_ctx);
-        ble->resetData();
-        httpd_resp_sendstr(req, "Data reset successfully");
-        return ESP_OK;
+        return ESP_FAIL;
     }
-    else
+    cJSON *json = cJSON_Parse(content);
+    if (!cJSON_IsObject(json))
+    {
+        cJSON_Delete(json);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // Only keys present in the body change; everything else keeps its current value.
+    Settings settings = SettingsStore::get();
+    const char *error = nullptr;
+    auto copyString = [&](const char *key, char *dest, size_t size)
+    {
+        cJSON *item = cJSON_GetObjectItem(json, key);
+        if (!item)
+        {
+            return;
+        }
+        if (!cJSON_IsString(item) || strlen(item->valuestring) >= size)
+        {
+            error = "String setting has the wrong type or is too long";
+            return;
+        }
+        strncpy(dest, item->valuestring, size);
+    };
+    auto readNumber = [&](const char *key, double min, double max, double &out)
+    {
+        cJSON *item = cJSON_GetObjectItem(json, key);
+        if (!item)
+        {
+            return false;
+        }
+        if (!cJSON_IsNumber(item) || item->valuedouble < min || item->valuedouble > max)
+        {
+            error = "Numeric setting out of range";
+            return false;
+        }
+        out = item->valuedouble;
+        return true;
+    };
+
+    copyString("wifi_ssid", settings.wifi_ssid, sizeof(settings.wifi_ssid));
+    copyString("wifi_password", settings.wifi_password, sizeof(settings.wifi_password));
+    double number;
+    if (readNumber("scan_interval_ms", 0, 10240, number))
+    {
+        settings.scan_interval = static_cast<uint16_t>(number / BLE_SCAN_UNIT_MS + 0.5);
+    }
+    if (readNumber("scan_window_ms", 0, 10240, number))
+    {
+        settings.scan_window = static_cast<uint16_t>(number / BLE_SCAN_UNIT_MS + 0.5);
+    }
+    if (readNumber("history_max_records", 0, UINT32_MAX, number))
+    {
+        settings.history_max_records = static_cast<uint32_t>(number);
+    }
+    cJSON *deadband = cJSON_GetObjectItem(json, "deadband");
+    if (deadband && !cJSON_IsObject(deadband))
+    {
+        error = "deadband must be an object";
+    }
+    else if (deadband)
+    {
+        struct DeadbandField
+        {
+            const char *key;
+            float scale;
+            uint16_t Settings::*member;
+        };
+        const DeadbandField fields[] = {
+            {"gravity_velocity", 100.0f, &Settings::deadband_gravity_velocity},
+            {"temperature", 100.0f, &Settings::deadband_temperature},
+            {"specific_gravity", 10000.0f, &Settings::deadband_specific_gravity},
+            {"accel", 100.0f, &Settings::deadband_accel},
+            {"battery", 100.0f, &Settings::deadband_battery},
+        };
+        for (const DeadbandField &field : fields)
+        {
+            cJSON *item = cJSON_GetObjectItem(deadband, field.key);
+            if (!item)
+            {
+                continue;
+            }
+            double scaled = cJSON_IsNumber(item) ? item->valuedouble * field.scale + 0.5 : -1.0;
+            if (scaled < 0 || scaled > UINT16_MAX)
+            {
+                error = "Deadband out of range";
+                break;
+            }
+            settings.*field.member = static_cast<uint16_t>(scaled);
+        }
+    }
+    if (readNumber("history_heartbeat_s", 0, 7 * 24 * 3600, number))
+    {
+        settings.history_heartbeat_s = static_cast<uint32_t>(number);
+    }
+    cJSON *uplink = cJSON_GetObjectItem(json, "uplink");
+    if (uplink && !cJSON_IsObject(uplink))
+    {
+        error = "uplink must be an object";
+    }
+    else if (uplink)
+    {
+        cJSON *mode = cJSON_GetObjectItem(uplink, "mode");
+        if (mode && (!cJSON_IsString(mode) || !Uplink::parseMode(mode->valuestring, settings.uplink_mode)))
+        {
+            error = "uplink mode must be off, mqtt or http";
+        }
+        struct UplinkField
+        {
+            const char *key;
+            char *dest;
+            size_t size;
+        };
+        const UplinkField fields[] = {
+            {"url", settings.uplink_url, sizeof(settings.uplink_url)},
+            {"topic", settings.uplink_topic, sizeof(settings.uplink_topic)},
+        };
+        for (const UplinkField &field : fields)
+        {
+            cJSON *item = cJSON_GetObjectItem(uplink, field.key);
+            if (!item)
+            {
+                continue;
+            }
+            if (!cJSON_IsString(item) || strlen(item->valuestring) >= field.size)
+            {
+                error = "String setting has the wrong type or is too long";
+                break;
+            }
+            strncpy(field.dest, item->valuestring, field.size);
+        }
+    }
+    cJSON *collector = cJSON_GetObjectItem(json, "collector");
+    if (collector && !cJSON_IsObject(collector))
+    {
+        error = "collector must be an object";
+    }
+    else if (collector)
+    {
+        cJSON *enabled = cJSON_GetObjectItem(collector, "enabled");
+        if (enabled && !cJSON_IsBool(enabled))
+        {
+            error = "collector enabled must be true or false";
+        }
+        else if (enabled)
+        {
+            settings.collector_enabled = cJSON_IsTrue(enabled) ? 1 : 0;
+        }
+        cJSON *peers = cJSON_GetObjectItem(collector, "peers");
+        if (peers && (!cJSON_IsString(peers) || strlen(peers->valuestring) >= sizeof(settings.collector_peers)))
+        {
+            error = "String setting has the wrong type or is too long";
+        }
+        else if (peers)
+        {
+            strncpy(settings.collector_peers, peers->valuestring, sizeof(settings.collector_peers));
+        }
+    }
+    cJSON *profile = cJSON_GetObjectItem(json, "power_profile");
+    if (profile && (!cJSON_IsString(profile) || !PowerManager::parseProfile(profile->valuestring, settings.power_profile)))
+    {
+        error = "power_profile must be performance, balanced or low_power";
+    }
+    cJSON_Delete(json);
+
+    if (error)
     {
-        return static_file_get_handler(req);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+        return ESP_FAIL;
+    }
+    esp_err_t err = SettingsStore::update(settings);
+    if (err == ESP_ERR_INVALID_ARG)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, SettingsStore::lastError());
+        return ESP_FAIL;
     }
+    if (err != ESP_OK)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store settings");
+        return ESP_FAIL;
+    }
+    return send_settings(req, SettingsStore::get());
 }
 
-std::string RaptMateServer::formatRaptPillData(const RaptPillData &data)
+static void writeLatency(JsonWriter &json, const char *name, const LatencyStat &stat)
 {
-    char json_response[512]; // Buffer for JSON response
-    snprintf(json_response, sizeof(json_response),
-             "{\"timestamp\": \"%lld\", \"gravity_velocity\": %f, \"temperature_celsius\": %f, \"specific_gravity\": %f, \"accel_x\": %f, \"accel_y\": %f, \"accel_z\": %f, \"battery\": %f}",
-             data.timestamp, data.gravity_velocity, data.temperature_celsius, data.specific_gravity,
-             data.accel_x, data.accel_y, data.accel_z, data.battery);
-    return std::string(json_response);
+    json.key(name);
+    json.beginObject();
+    json.key("count");
+    json.value(static_cast<int64_t>(stat.count));
+    json.key("avg_us");
+    json.value(stat.count ? stat.total_us / stat.count : static_cast<int64_t>(0));
+    json.key("max_us");
+    json.value(stat.max_us);
+    json.endObject();
 }
 
-esp_err_t RaptMateServer::data_get_handler(httpd_req_t *req)
+esp_err_t RaptMateServer::power_get_handler(httpd_req_t *req)
 {
-    RaptPillBLE *ble = static_cast<RaptPillBLE *>(req->user_ctx);
-    std::vector<RaptPillData> data = ble->getAllData();
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    PowerStats stats = PowerManager::stats();
+    const PowerProfileConfig &cfg = PowerManager::config(static_cast<uint8_t>(stats.profile));
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("profile");
+    json.value(cfg.name);
+    json.key("pm_enabled");
+    json.value(stats.pm_enabled);
+    json.key("cpu_mhz_min");
+    json.value(static_cast<int64_t>(cfg.min_freq_mhz));
+    json.key("cpu_mhz_max");
+    json.value(static_cast<int64_t>(cfg.max_freq_mhz));
+    json.key("light_sleep");
+    json.value(cfg.light_sleep);
+    json.key("scan_duty_percent");
+    json.value(static_cast<int64_t>(cfg.scan_duty_percent));
+    json.key("cpu_load");
+    json.beginArray();
+    for (float load : stats.cpu_load)
+    {
+        json.value(load, 3);
+    }
+    json.endArray();
+    json.key("light_sleep_wakes");
+    json.value(static_cast<int64_t>(stats.light_sleep_wakes));
+    json.key("light_sleep_ms");
+    json.value(stats.light_sleep_us / 1000);
+    json.key("profile_uptime_s");
+    json.value((esp_timer_get_time() - stats.profile_since_us) / 1000000);
+    writeLatency(json, "ingest_latency", stats.ingest);
+    writeLatency(json, "http_latency", stats.http);
+    DecoderStats decoders = DecoderRegistry::instance().stats();
+    json.key("adverts");
+    json.value(static_cast<int64_t>(decoders.adverts));
+    json.key("rejected_adverts");
+    json.value(static_cast<int64_t>(decoders.rejected));
+    json.key("decoders");
+    json.beginObject();
+    for (size_t i = 0; i < decoders.count; ++i)
+    {
+        json.key(decoders.names[i]);
+        json.beginObject();
+        json.key("matched");
+        json.value(static_cast<int64_t>(decoders.decoders[i].matched));
+        json.key("decoded");
+        json.value(static_cast<int64_t>(decoders.decoders[i].decoded));
+        json.key("failed");
+        json.value(static_cast<int64_t>(decoders.decoders[i].failed));
+        json.endObject();
+    }
+    json.endObject();
+    json.endObject();
+    return out.finish();
+}
 
-    // Prepare CSV header
-    std::string csv_response = "timestamp,gravity_velocity,temperature_celsius,specific_gravity,accel_x,accel_y,accel_z,battery\n";
+// Milliseconds since boot, or null for a milestone not reached (-1).
+static void writeBootMillis(JsonWriter &json, const char *name, int64_t us)
+{
+    json.key(name);
+    if (us >= 0)
+    {
+        json.value(us / 1000);
+    }
+    else
+    {
+        json.null();
+    }
+}
 
-    // Append data rows
-    for (const auto &entry : data)
+esp_err_t RaptMateServer::health_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
     {
-        csv_response += std::to_string(entry.timestamp) + "," +
-                        std::to_string(entry.gravity_velocity) + "," +
-                        std::to_string(entry.temperature_celsius) + "," +
-                        std::to_string(entry.specific_gravity) + "," +
-                        std::to_string(entry.accel_x) + "," +
-                        std::to_string(entry.accel_y) + "," +
-                        std::to_string(entry.accel_z) + "," +
-                        std::to_string(entry.battery) + "\n";
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
     }
 
-    httpd_resp_set_type(req, "text/csv");
+    // 503 until every stage is ready, so probes can tell a booting device from a healthy one.
+    bool ready = Startup::complete();
+    if (!ready)
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("ready");
+    json.value(ready);
+    json.key("uptime_ms");
+    json.value(esp_timer_get_time() / 1000);
+    json.key("stages");
+    json.beginArray();
+    for (size_t i = 0; i < STARTUP_STAGE_COUNT; ++i)
+    {
+        StageReport stage = Startup::report(static_cast<StartupStage>(i));
+        if (!stage.name)
+        {
+            continue;
+        }
+        json.beginObject();
+        json.key("name");
+        json.value(stage.name);
+        json.key("state");
+        json.value(Startup::stateName(stage.state));
+        writeBootMillis(json, "started_ms", stage.start_us);
+        writeBootMillis(json, "ready_ms", stage.state == StageState::Ready ? stage.end_us : -1);
+        json.key("duration_ms");
+        if (stage.start_us >= 0 && stage.end_us >= 0)
+        {
+            json.value((stage.end_us - stage.start_us) / 1000);
+        }
+        else
+        {
+            json.null();
+        }
+        if (stage.state == StageState::Failed || stage.state == StageState::Skipped)
+        {
+            json.key("error");
+            json.value(esp_err_to_name(stage.err));
+        }
+        json.endObject();
+    }
+    json.endArray();
+    writeBootMillis(json, "first_sample_ms", Startup::milestone(StartupMilestone::FirstSample));
+    writeBootMillis(json, "first_response_ms", Startup::milestone(StartupMilestone::FirstResponse));
+    json.key("history_loaded");
+    json.value(HistoryStore::instance().loaded());
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::uplink_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    UplinkStats stats = Uplink::instance().stats();
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("mode");
+    json.value(Uplink::modeName(stats.mode));
+    json.key("state");
+    json.value(Uplink::stateName(stats.state));
+    json.key("cursor");
+    if (stats.cursor_valid)
+    {
+        json.beginObject();
+        json.key("boot_id");
+        json.value(static_cast<int64_t>(stats.cursor_boot_id));
+        json.key("timestamp");
+        json.value(stats.cursor_timestamp);
+        json.endObject();
+    }
+    else
+    {
+        json.null();
+    }
+    json.key("backlog");
+    json.value(static_cast<int64_t>(stats.backlog));
+    json.key("sent_samples");
+    json.value(static_cast<int64_t>(stats.sent_samples));
+    json.key("sent_batches");
+    json.value(static_cast<int64_t>(stats.sent_batches));
+    json.key("sent_bytes");
+    json.value(static_cast<int64_t>(stats.sent_bytes));
+    json.key("bytes_per_sample");
+    json.value(stats.sent_samples ? static_cast<float>(stats.sent_bytes) / stats.sent_samples : 0.0f, 2);
+    json.key("dropped_samples");
+    json.value(static_cast<int64_t>(stats.dropped_samples));
+    json.key("failures");
+    json.value(static_cast<int64_t>(stats.failures));
+    json.key("last_error");
+    if (stats.failures)
+    {
+        json.value(esp_err_to_name(stats.last_error));
+    }
+    else
+    {
+        json.null();
+    }
+    json.key("backoff_ms");
+    json.value(static_cast<int64_t>(stats.backoff_ms));
+    json.key("catchup_samples_per_s");
+    json.value(stats.catchup_us ? stats.catchup_samples * 1000000.0f / stats.catchup_us : 0.0f, 1);
+    writeBootMillis(json, "last_success_ms", stats.last_success_us);
+    json.endObject();
+    return out.finish();
+}
 
-    esp_err_t send_result = httpd_resp_send(req, csv_response.c_str(), csv_response.length());
-    if (send_result != ESP_OK)
+esp_err_t RaptMateServer::storage_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
     {
-        ESP_LOGE(SERVER_TAG, "Error sending response: %d", send_result);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send response");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
 
+    StorageStats stats = StorageBackend::configured().stats();
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("backend");
+    json.value(stats.backend);
+    json.key("capacity_bytes");
+    json.value(static_cast<int64_t>(stats.capacity_bytes));
+    json.key("used_bytes");
+    json.value(static_cast<int64_t>(stats.used_bytes));
+    json.key("payload_bytes");
+    json.value(static_cast<int64_t>(stats.payload_bytes));
+    json.key("fill");
+    json.value(stats.capacity_bytes ? static_cast<float>(stats.used_bytes) / stats.capacity_bytes : 0.0f, 3);
+    json.key("space_efficiency");
+    json.value(stats.used_bytes ? static_cast<float>(stats.payload_bytes) / stats.used_bytes : 0.0f, 3);
+    json.key("appends");
+    json.value(static_cast<int64_t>(stats.appends));
+    json.key("append_errors");
+    json.value(static_cast<int64_t>(stats.append_errors));
+    json.key("rotations");
+    json.value(static_cast<int64_t>(stats.rotations));
+    // Bucket i counts appends faster than its bound; the last bucket is open-ended.
+    json.key("append_latency_us");
+    json.beginArray();
+    for (int i = 0; i < STORAGE_LATENCY_BUCKETS; ++i)
+    {
+        json.beginArray();
+        if (i < STORAGE_LATENCY_BUCKETS - 1)
+        {
+            json.value(static_cast<int64_t>(STORAGE_LATENCY_BASE_US) << i);
+        }
+        else
+        {
+            json.null();
+        }
+        json.value(static_cast<int64_t>(stats.append_latency[i]));
+        json.endArray();
+    }
+    json.endArray();
+    json.key("append_max_us");
+    json.value(stats.append_max_us);
+    json.key("read_bytes_per_s");
+    json.value(stats.read_us > 0 ? static_cast<int64_t>(stats.bytes_read * 1000000 / stats.read_us) : static_cast<int64_t>(0));
+
+    HistoryStats history = HistoryStore::instance().stats();
+    json.key("history");
+    json.beginObject();
+    json.key("samples");
+    json.value(static_cast<int64_t>(history.samples));
+    json.key("sealed_blocks");
+    json.value(static_cast<int64_t>(history.sealed_blocks));
+    json.key("open_samples");
+    json.value(static_cast<int64_t>(history.open_samples));
+    json.key("legacy_rows");
+    json.value(static_cast<int64_t>(history.legacy_rows));
+    // Samples received against samples the deadband let through.
+    json.key("offered_samples");
+    json.value(static_cast<int64_t>(history.offered_samples));
+    json.key("stored_samples");
+    json.value(static_cast<int64_t>(history.stored_samples));
+    json.key("bytes_per_sample");
+    json.value(history.bytes_per_sample, 2);
+    // Samples served by range queries per second, storage reads included.
+    json.key("decode_samples_per_s");
+    json.value(history.decode_us > 0 ? static_cast<int64_t>(history.decoded_samples * 1000000 / history.decode_us) : static_cast<int64_t>(0));
+    json.endObject();
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::reset_get_handler(httpd_req_t *req)
+{
+    instance_->ble->resetData();
+    httpd_resp_sendstr(req, "Data reset successfully");
     return ESP_OK;
 }
+
+esp_err_t RaptMateServer::backup_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    void *memory = arena.allocate(sizeof(HistoryBackup), alignof(HistoryBackup));
+    char *disposition = arena.format("attachment; filename=\"raptmate-%s.rmbk\"", WiFiManager::deviceId());
+    if (!chunk || !memory || !disposition)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, HISTORY_ARCHIVE_CONTENT_TYPE);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    HistoryBackup *backup = new (memory) HistoryBackup();
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = backup->write([](const void *data, size_t length, void *ctx)
+    {
+        ChunkedResponse *out = static_cast<ChunkedResponse *>(ctx);
+        out->write(static_cast<const char *>(data), length);
+        return out->ok();
+    }, &out);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(SERVER_TAG, "Backup aborted after %lu samples", static_cast<unsigned long>(backup->samples()));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(SERVER_TAG, "Backup of %lu samples in %lu blocks took %lld ms", static_cast<unsigned long>(backup->samples()),
+             static_cast<unsigned long>(backup->blocks()), (esp_timer_get_time() - start_us) / 1000);
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::restore_post_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    if (req->content_len == 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Upload a backup archive or data.csv");
+        return ESP_FAIL;
+    }
+    uint8_t *buffer = static_cast<uint8_t *>(arena.allocate(RESTORE_RECV_CHUNK, 1));
+    void *memory = arena.allocate(sizeof(HistoryRestore), alignof(HistoryRestore));
+    if (!buffer || !memory)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    // Each piece is stored as soon as it arrives, so memory stays constant whatever the upload size.
+    HistoryRestore *restore = new (memory) HistoryRestore();
+    int64_t start_us = esp_timer_get_time();
+    size_t remaining = req->content_len;
+    esp_err_t err = ESP_OK;
+    while (remaining > 0 && err == ESP_OK)
+    {
+        int ret = httpd_req_recv(req, reinterpret_cast<char *>(buffer), remaining < RESTORE_RECV_CHUNK ? remaining : RESTORE_RECV_CHUNK);
+        if (ret <= 0)
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+            }
+            ESP_LOGW(SERVER_TAG, "Restore upload ended after %lu samples",
+                     static_cast<unsigned long>(restore->stats().samples));
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+        err = restore->feed(buffer, ret);
+    }
+    if (err == ESP_OK)
+    {
+        err = restore->finish();
+    }
+    if (err != ESP_OK)
+    {
+        httpd_resp_send_err(req, err == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                            restore->error());
+        return ESP_FAIL;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    const HistoryRestoreStats &stats = restore->stats();
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("format");
+    json.value(stats.archive ? "archive" : "csv");
+    json.key("samples");
+    json.value(static_cast<int64_t>(stats.samples));
+    json.key("blocks");
+    json.value(static_cast<int64_t>(stats.blocks));
+    json.key("skipped_rows");
+    json.value(static_cast<int64_t>(stats.skipped_rows));
+    json.key("settings");
+    json.value(stats.settings);
+    json.key("bytes");
+    json.value(static_cast<int64_t>(req->content_len));
+    json.key("duration_ms");
+    json.value(elapsed_us / 1000);
+    json.key("samples_per_s");
+    json.value(elapsed_us > 0 ? static_cast<float>(stats.samples) * 1e6f / elapsed_us : 0.0f, 0);
+    json.endObject();
+    return out.finish();
+}
+
+const char *RaptMateServer::formatRaptPillData(const RaptPillData &data, Arena &arena)
+{
+    return arena.format("{\"timestamp\": \"%lld\", \"gravity_velocity\": %f, \"temperature_celsius\": %f, \"specific_gravity\": %f, \"accel_x\": %f, \"accel_y\": %f, \"accel_z\": %f, \"battery\": %f}",
+                        data.timestamp, data.gravity_velocity, data.temperature_celsius, data.specific_gravity,
+                        data.accel_x, data.accel_y, data.accel_z, data.battery);
+}
+
+bool RaptMateServer::history_not_modified(httpd_req_t *req, char *etag)
+{
+    // The boot id keeps versions from a previous boot from matching.
+    snprintf(etag, HISTORY_ETAG_SIZE, "\"%lx-%lx-%lx\"",
+             static_cast<unsigned long>(TimeBase::bootId()),
+             static_cast<unsigned long>(HistoryStore::instance().version()),
+             static_cast<unsigned long>(TimeBase::generation()));
+    httpd_resp_set_hdr(req, "ETag", etag);
+    // Cacheable, but revalidated on every poll.
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char if_none_match[HISTORY_ETAG_SIZE * 2];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK ||
+        (strstr(if_none_match, etag) == nullptr && strcmp(if_none_match, "*") != 0))
+    {
+        return false;
+    }
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_send(req, nullptr, 0);
+    return true;
+}
+
+esp_err_t RaptMateServer::data_get_handler(httpd_req_t *req)
+{
+    HistoryStore &history = HistoryStore::instance();
+    char etag[HISTORY_ETAG_SIZE];
+    if (history_not_modified(req, etag))
+    {
+        return ESP_OK;
+    }
+
+    // Stream the history in chunks instead of building the whole CSV in one heap string.
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    constexpr size_t batch_size = 16;
+    RaptPillData *batch = static_cast<RaptPillData *>(arena.allocate(batch_size * sizeof(RaptPillData)));
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!batch || !chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "text/csv");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    out.write("timestamp,gravity_velocity,temperature_celsius,specific_gravity,accel_x,accel_y,accel_z,battery\n");
+
+    // Sealed blocks come from the format cache when possible; only the rest is decoded and formatted.
+    FormatCache &cache = FormatCache::instance();
+    uint32_t generation = TimeBase::generation();
+    TimeResolver resolver;
+    size_t oldest_id = SIZE_MAX;
+    size_t offset = 0;
+    HistoryBlock block;
+    while (out.ok() && history.block(offset, block))
+    {
+        bool cacheable = block.immutable && block.offset == offset;
+        if (cacheable)
+        {
+            oldest_id = oldest_id == SIZE_MAX ? block.id : oldest_id;
+            const FormatCache::Entry *entry = cache.acquire(block.id, generation, resolver);
+            if (entry)
+            {
+                out.write(entry->text, entry->length);
+                resolver = entry->after;
+                cache.release(entry);
+                offset += block.samples;
+                continue;
+            }
+        }
+
+        FormatCache::Reservation text = cacheable ? cache.reserve(block.id, block.samples, oldest_id, generation)
+                                                  : FormatCache::Reservation{};
+        TimeResolver before = resolver;
+        size_t end = block.offset + block.samples;
+        size_t count;
+        while (out.ok() && offset < end &&
+               (count = history.copy(offset, batch, end - offset < batch_size ? end - offset : batch_size)) > 0)
+        {
+            offset += count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                char row[128];
+                int len = RaptPillBLE::formatExportRow(batch[i], resolver.resolve(batch[i]), row, sizeof(row));
+                if (len <= 0)
+                {
+                    continue;
+                }
+                out.write(row, len);
+                cache.append(text, row, len);
+            }
+        }
+        if (offset == end)
+        {
+            cache.insert(text, generation, before, resolver);
+        }
+        else
+        {
+            cache.discard(text);
+        }
+        if (offset < end)
+        {
+            // The history changed under us; what was sent is all there is.
+            break;
+        }
+    }
+    return out.finish();
+}
+
+namespace
+{
+    struct ReadingField
+    {
+        const char *name;
+        int precision;
+        float RaptPillData::*member;
+    };
+
+    // Columns selectable through ?fields=; the timestamp is always the first column.
+    const ReadingField reading_fields[] = {
+        {"gv", 2, &RaptPillData::gravity_velocity},
+        {"temp", 2, &RaptPillData::temperature_celsius},
+        {"sg", 4, &RaptPillData::specific_gravity},
+        {"accel_x", 2, &RaptPillData::accel_x},
+        {"accel_y", 2, &RaptPillData::accel_y},
+        {"accel_z", 2, &RaptPillData::accel_z},
+        {"battery", 2, &RaptPillData::battery},
+    };
+    constexpr size_t reading_field_count = sizeof(reading_fields) / sizeof(reading_fields[0]);
+
+    // Parses a comma separated field list into a bitmask over reading_fields. Returns 0 on unknown names.
+    uint32_t parseFieldMask(const char *list)
+    {
+        uint32_t mask = 0;
+        while (*list)
+        {
+            const char *end = strchr(list, ',');
+            size_t len = end ? static_cast<size_t>(end - list) : strlen(list);
+            bool found = false;
+            for (size_t i = 0; i < reading_field_count; ++i)
+            {
+                if (strlen(reading_fields[i].name) == len && strncmp(reading_fields[i].name, list, len) == 0)
+                {
+                    mask |= 1u << i;
+                    found = true;
+                }
+            }
+            if (!found && len > 0)
+            {
+                return 0;
+            }
+            list += len + (end ? 1 : 0);
+        }
+        return mask;
+    }
+
+    // Cursor of /api/v1/readings: the offset of the next row and the resolver's state before it, as
+    // offset:boot:wall:mono. A bare offset, as earlier firmware returned, resumes with a fresh resolver.
+    bool parseReadingsCursor(const char *text, size_t &offset, TimeResolver &resolver)
+    {
+        char *end;
+        long long value = strtoll(text, &end, 10);
+        if (end == text || value < 0)
+        {
+            return false;
+        }
+        offset = static_cast<size_t>(value);
+        if (*end == '\0')
+        {
+            return true;
+        }
+        TimeResolver::Checkpoint checkpoint;
+        const char *p = end;
+        unsigned long long boot_id = strtoull(p + 1, &end, 10);
+        if (*p != ':' || end == p + 1 || boot_id > UINT32_MAX)
+        {
+            return false;
+        }
+        checkpoint.boot_id = static_cast<uint32_t>(boot_id);
+        p = end;
+        checkpoint.last_wall = strtoll(p + 1, &end, 10);
+        if (*p != ':' || end == p + 1)
+        {
+            return false;
+        }
+        p = end;
+        checkpoint.last_mono = strtoll(p + 1, &end, 10);
+        if (*p != ':' || end == p + 1 || *end != '\0')
+        {
+            return false;
+        }
+        resolver = TimeResolver::resume(checkpoint);
+        return true;
+    }
+}
+
+esp_err_t RaptMateServer::readings_get_handler(httpd_req_t *req)
+{
+    RaptPillBLE *ble = instance_->ble;
+    char etag[HISTORY_ETAG_SIZE];
+    if (history_not_modified(req, etag))
+    {
+        return ESP_OK;
+    }
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+
+    QueryString query(req, arena);
+    if (!query.valid())
+    {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_FAIL;
+    }
+
+    uint32_t mask = (1u << reading_field_count) - 1;
+    char fields[96];
+    if (query.get("fields", fields, sizeof(fields)))
+    {
+        mask = parseFieldMask(fields);
+        if (mask == 0)
+        {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown field");
+            return ESP_FAIL;
+        }
+    }
+
+    int64_t from = INT64_MIN, to = INT64_MAX, limit = READINGS_DEFAULT_LIMIT;
+    query.getInt("from", from);
+    query.getInt("to", to);
+    query.getInt("limit", limit);
+    // Resolution depends on the rows before, so a page resumes the resolver where the last one stopped.
+    TimeResolver resolver;
+    size_t offset = 0;
+    char cursor[80];
+    bool has_cursor = query.get("cursor", cursor, sizeof(cursor));
+    if ((has_cursor && !parseReadingsCursor(cursor, offset, resolver)) || limit <= 0 || limit > READINGS_MAX_LIMIT || from > to)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid range or paging parameters");
+        return ESP_FAIL;
+    }
+
+    constexpr size_t batch_size = 16;
+    RaptPillData *batch = static_cast<RaptPillData *>(arena.allocate(batch_size * sizeof(RaptPillData)));
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!batch || !chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("fields");
+    json.beginArray();
+    json.value("timestamp");
+    for (size_t f = 0; f < reading_field_count; ++f)
+    {
+        if (mask & (1u << f))
+        {
+            json.value(reading_fields[f].name);
+        }
+    }
+    json.endArray();
+
+    // Rows are arrays in the column order above, which keeps keys out of every row.
+    json.key("readings");
+    json.beginArray();
+    int64_t emitted = 0;
+    bool more = false;
+    bool past_range = false;
+    size_t count;
+    while (out.ok() && !more && !past_range && (count = ble->copyData(offset, batch, batch_size)) > 0)
+    {
+        size_t i = 0;
+        for (; i < count; ++i)
+        {
+            const RaptPillData &entry = batch[i];
+            TimeResolver before = resolver;
+            int64_t timestamp = resolver.resolve(entry);
+            if (timestamp > to)
+            {
+                // Resolved time never steps back, so no later row is in range.
+                past_range = true;
+                break;
+            }
+            if (timestamp < from)
+            {
+                continue;
+            }
+            if (emitted == limit)
+            {
+                // The next page starts at this row, resolving it again from the same state.
+                resolver = before;
+                more = true;
+                break;
+            }
+            json.beginArray();
+            json.value(timestamp);
+            for (size_t f = 0; f < reading_field_count; ++f)
+            {
+                if (mask & (1u << f))
+                {
+                    json.value(entry.*reading_fields[f].member, reading_fields[f].precision);
+                }
+            }
+            json.endArray();
+            emitted++;
+        }
+        offset += i;
+    }
+    json.endArray();
+
+    json.key("next_cursor");
+    TimeResolver::Checkpoint checkpoint = resolver.checkpoint();
+    char *next = more ? arena.format("%zu:%lu:%lld:%lld", offset, static_cast<unsigned long>(checkpoint.boot_id),
+                                     static_cast<long long>(checkpoint.last_wall), static_cast<long long>(checkpoint.last_mono))
+                      : nullptr;
+    if (next)
+    {
+        json.value(next);
+    }
+    else
+    {
+        json.null();
+    }
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::history_delta_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+
+    QueryString query(req, arena);
+    if (!query.valid())
+    {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_FAIL;
+    }
+    int64_t boot_id = -1, timestamp = 0, tail = -1;
+    bool has_cursor = query.getInt("boot", boot_id) && query.getInt("ts", timestamp);
+    query.getInt("tail", tail);
+    if (has_cursor ? (boot_id < 0 || boot_id > UINT32_MAX) : tail < 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Pass a boot and ts cursor, or tail");
+        return ESP_FAIL;
+    }
+
+    HistoryStore &history = HistoryStore::instance();
+    HistoryRange range = history.storedRange();
+    size_t start = range.first;
+    if (has_cursor)
+    {
+        start = history.seekAfter(static_cast<uint32_t>(boot_id), timestamp);
+    }
+    else if (static_cast<uint64_t>(tail) < range.end - range.first)
+    {
+        start = range.end - static_cast<size_t>(tail);
+    }
+
+    uint8_t *buffer = static_cast<uint8_t *>(arena.allocate(GORILLA_BLOCK_BYTES, 1));
+    void *memory = arena.allocate(sizeof(HistoryBatch), alignof(HistoryBatch));
+    if (!buffer || !memory)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    HistoryBatch *batch = new (memory) HistoryBatch(buffer, GORILLA_BLOCK_BYTES);
+    size_t samples = batch->build(start, range.end);
+    size_t remaining = range.end > start + samples ? range.end - start - samples : 0;
+
+    const RaptPillData &last = batch->last();
+    char *remaining_text = arena.format("%u", static_cast<unsigned>(remaining));
+    char *cursor_text = arena.format("%lu:%lld", static_cast<unsigned long>(last.boot_id), last.timestamp);
+    if (!remaining_text || !cursor_text)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_hdr(req, "X-RaptMate-Device", WiFiManager::deviceId());
+    httpd_resp_set_hdr(req, "X-RaptMate-Remaining", remaining_text);
+    if (samples == 0)
+    {
+        // Nothing new, or only samples of this boot while its wall time is unknown.
+        httpd_resp_set_status(req, "204 No Content");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+    httpd_resp_set_hdr(req, "X-RaptMate-Cursor", cursor_text);
+    httpd_resp_set_type(req, HISTORY_BATCH_CONTENT_TYPE);
+    return httpd_resp_send(req, reinterpret_cast<const char *>(batch->data()), batch->size());
+}
+
+namespace
+{
+    enum class ByteRange : uint8_t
+    {
+        None,
+        Valid,
+        Unsatisfiable,
+    };
+
+    // Parse "bytes=first-last", "bytes=first-" or "bytes=-suffix" against a body of length bytes.
+    // Several ranges or another unit come back as None and get the whole body, which HTTP allows.
+    ByteRange parseByteRange(const char *header, size_t length, size_t &first, size_t &last)
+    {
+        if (strncmp(header, "bytes=", 6) != 0 || strchr(header, ',') != nullptr)
+        {
+            return ByteRange::None;
+        }
+        const char *spec = header + 6;
+        char *end;
+        if (*spec == '-')
+        {
+            if (!isdigit(static_cast<unsigned char>(spec[1])))
+            {
+                return ByteRange::None;
+            }
+            unsigned long long suffix = strtoull(spec + 1, &end, 10);
+            if (*end != '\0')
+            {
+                return ByteRange::None;
+            }
+            if (suffix == 0 || length == 0)
+            {
+                return ByteRange::Unsatisfiable;
+            }
+            first = suffix < length ? length - suffix : 0;
+            last = length - 1;
+            return ByteRange::Valid;
+        }
+
+        if (!isdigit(static_cast<unsigned char>(*spec)))
+        {
+            return ByteRange::None;
+        }
+        unsigned long long start = strtoull(spec, &end, 10);
+        if (*end != '-')
+        {
+            return ByteRange::None;
+        }
+        unsigned long long stop = ULLONG_MAX;
+        if (end[1] != '\0')
+        {
+            const char *stop_text = end + 1;
+            if (!isdigit(static_cast<unsigned char>(*stop_text)))
+            {
+                return ByteRange::None;
+            }
+            stop = strtoull(stop_text, &end, 10);
+            if (*end != '\0' || stop < start)
+            {
+                return ByteRange::None;
+            }
+        }
+        if (start >= length)
+        {
+            return ByteRange::Unsatisfiable;
+        }
+        first = static_cast<size_t>(start);
+        last = stop < length ? static_cast<size_t>(stop) : length - 1;
+        return ByteRange::Valid;
+    }
+
+    // Whether a request header lists etag, as If-None-Match and If-Range compare it.
+    bool headerMatches(httpd_req_t *req, const char *field, const char *etag)
+    {
+        char value[EXPORT_ETAG_SIZE * 2];
+        return httpd_req_get_hdr_value_str(req, field, value, sizeof(value)) == ESP_OK && strstr(value, etag) != nullptr;
+    }
+}
+
+esp_err_t RaptMateServer::history_export_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+
+    QueryString query(req, arena);
+    if (!query.valid())
+    {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_FAIL;
+    }
+    char format[8] = "csv";
+    query.get("format", format, sizeof(format));
+    bool csv = strcmp(format, "csv") == 0;
+    if (!csv && strcmp(format, "blocks") != 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown format");
+        return ESP_FAIL;
+    }
+    int64_t from = 0, count = -1;
+    query.getInt("from", from);
+    query.getInt("count", count);
+    if (from < 0 || count < -1)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid record range");
+        return ESP_FAIL;
+    }
+
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    void *memory = arena.allocate(sizeof(HistoryExport), alignof(HistoryExport));
+    if (!chunk || !memory)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    HistoryExport *exporter = new (memory) HistoryExport(csv ? HistoryExportFormat::Csv : HistoryExportFormat::Blocks,
+                                                         static_cast<size_t>(from), count < 0 ? SIZE_MAX : static_cast<size_t>(count));
+    const HistoryRange &range = exporter->range();
+    size_t length = exporter->length();
+
+    // The selected samples only change by rotating out, so the validator holds while new samples arrive.
+    // Resolved CSV timestamps also change with the boot offsets.
+    char *etag = arena.format("\"%c%lx-%lx-%x-%x-%lx\"", csv ? 'c' : 'b', static_cast<unsigned long>(TimeBase::bootId()),
+                              static_cast<unsigned long>(range.epoch), static_cast<unsigned>(range.first),
+                              static_cast<unsigned>(range.end), static_cast<unsigned long>(csv ? TimeBase::generation() : 0));
+    char *records = arena.format("%u-%u", static_cast<unsigned>(range.first), static_cast<unsigned>(range.end));
+    char *disposition = arena.format("attachment; filename=\"raptmate-%s-%u.%s\"", WiFiManager::deviceId(),
+                                     static_cast<unsigned>(range.first), csv ? "csv" : "bin");
+    char *range_header = static_cast<char *>(arena.allocate(EXPORT_RANGE_HEADER_MAX, 1));
+    if (!etag || !records || !disposition || !range_header)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    // Absolute sample numbers of the export; pass them as from and count to pin a resumed download.
+    httpd_resp_set_hdr(req, "X-RaptMate-Records", records);
+    if (headerMatches(req, "If-None-Match", etag))
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    // A Range only applies while the client's copy is still current; otherwise the whole body follows.
+    size_t first = 0;
+    size_t last = length > 0 ? length - 1 : 0;
+    bool partial = false;
+    if (httpd_req_get_hdr_value_str(req, "Range", range_header, EXPORT_RANGE_HEADER_MAX) == ESP_OK &&
+        (httpd_req_get_hdr_value_len(req, "If-Range") == 0 || headerMatches(req, "If-Range", etag)))
+    {
+        ByteRange result = parseByteRange(range_header, length, first, last);
+        if (result == ByteRange::Unsatisfiable)
+        {
+            char *content_range = arena.format("bytes */%u", static_cast<unsigned>(length));
+            if (content_range)
+            {
+                httpd_resp_set_hdr(req, "Content-Range", content_range);
+            }
+            httpd_resp_set_status(req, "416 Range Not Satisfiable");
+            return httpd_resp_send(req, nullptr, 0);
+        }
+        partial = result == ByteRange::Valid;
+    }
+    if (partial)
+    {
+        char *content_range = arena.format("bytes %u-%u/%u", static_cast<unsigned>(first), static_cast<unsigned>(last),
+                                           static_cast<unsigned>(length));
+        if (!content_range)
+        {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+            return ESP_FAIL;
+        }
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+        httpd_resp_set_status(req, "206 Partial Content");
+    }
+
+    httpd_resp_set_type(req, csv ? HISTORY_EXPORT_CSV_CONTENT_TYPE : HISTORY_EXPORT_BLOCKS_CONTENT_TYPE);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    esp_err_t err = exporter->write(first, last, [](const void *data, size_t size, void *ctx)
+    {
+        ChunkedResponse *out = static_cast<ChunkedResponse *>(ctx);
+        out->write(static_cast<const char *>(data), size);
+        return out->ok();
+    }, &out);
+    if (err != ESP_OK)
+    {
+        // Dropping the connection tells the client the body is incomplete; a terminated one would look whole.
+        ESP_LOGW(SERVER_TAG, "Export of samples %s stopped: %s", records, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return out.finish();
+}
+
+// A device's latest reading with the /api/v1/readings field names; the timestamp is null when unresolved.
+static void writeFleetLatest(JsonWriter &json, const RaptPillData &data, bool resolved)
+{
+    json.key("latest");
+    json.beginObject();
+    json.key("timestamp");
+    if (resolved)
+    {
+        json.value(data.timestamp);
+    }
+    else
+    {
+        json.null();
+    }
+    for (size_t f = 0; f < reading_field_count; ++f)
+    {
+        json.key(reading_fields[f].name);
+        json.value(data.*reading_fields[f].member, reading_fields[f].precision);
+    }
+    json.endObject();
+}
+
+esp_err_t RaptMateServer::fleet_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    Collector &collector = Collector::instance();
+    CollectorStats stats = collector.stats();
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("collector");
+    json.value(stats.enabled);
+    json.key("discovery_runs");
+    json.value(static_cast<int64_t>(stats.discovery_runs));
+    writeBootMillis(json, "last_discovery_ms", stats.last_discovery_us);
+    json.key("active_pulls");
+    json.value(static_cast<int64_t>(stats.active_pulls));
+    json.key("peak_active_pulls");
+    json.value(static_cast<int64_t>(stats.peak_active_pulls));
+
+    json.key("devices");
+    json.beginArray();
+    HistoryStore &history = HistoryStore::instance();
+    json.beginObject();
+    json.key("id");
+    json.value(WiFiManager::deviceId());
+    json.key("local");
+    json.value(true);
+    json.key("samples");
+    json.value(static_cast<int64_t>(history.size()));
+    RaptPillData latest;
+    if (history.latest(latest))
+    {
+        TimeResolver resolver;
+        latest.timestamp = resolver.resolve(latest);
+        writeFleetLatest(json, latest, true);
+    }
+    json.endObject();
+
+    PeerStats peer;
+    for (size_t i = 0; i < COLLECTOR_MAX_PEERS && out.ok(); ++i)
+    {
+        if (!collector.peer(i, peer))
+        {
+            continue;
+        }
+        json.beginObject();
+        json.key("id");
+        if (peer.id[0] != '\0')
+        {
+            json.value(peer.id);
+        }
+        else
+        {
+            json.null();
+        }
+        json.key("local");
+        json.value(false);
+        json.key("host");
+        json.value(peer.address.host);
+        json.key("port");
+        json.value(static_cast<int64_t>(peer.address.port));
+        json.key("source");
+        json.value(Collector::sourceName(peer.source));
+        json.key("state");
+        json.value(Collector::stateName(peer.state));
+        json.key("samples");
+        json.value(static_cast<int64_t>(peer.held_samples));
+        json.key("pulled_samples");
+        json.value(static_cast<int64_t>(peer.pulled_samples));
+        json.key("bytes_per_sample");
+        json.value(peer.pulled_samples ? static_cast<float>(peer.pulled_bytes) / peer.pulled_samples : 0.0f, 2);
+        json.key("pulls");
+        json.value(static_cast<int64_t>(peer.pulls));
+        json.key("failures");
+        json.value(static_cast<int64_t>(peer.failures));
+        json.key("last_error");
+        if (peer.failures)
+        {
+            json.value(esp_err_to_name(peer.last_error));
+        }
+        else
+        {
+            json.null();
+        }
+        json.key("backoff_ms");
+        json.value(static_cast<int64_t>(peer.backoff_ms));
+        writeBootMillis(json, "last_pull_ms", peer.last_pull_us);
+        json.key("pull_duration_ms");
+        json.value(static_cast<int64_t>(peer.last_pull_ms));
+        if (peer.has_latest)
+        {
+            writeFleetLatest(json, peer.latest, peer.latest.boot_id == 0);
+        }
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::fleet_readings_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+
+    QueryString query(req, arena);
+    if (!query.valid())
+    {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Query too long");
+        return ESP_FAIL;
+    }
+    uint32_t mask = (1u << reading_field_count) - 1;
+    char fields[96];
+    if (query.get("fields", fields, sizeof(fields)))
+    {
+        mask = parseFieldMask(fields);
+        if (mask == 0)
+        {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown field");
+            return ESP_FAIL;
+        }
+    }
+    char device[sizeof(PeerStats::id)] = {};
+    bool has_device = query.get("device", device, sizeof(device));
+    int64_t limit = FLEET_READINGS_DEFAULT_LIMIT;
+    query.getInt("limit", limit);
+    if (limit <= 0 || limit > FLEET_READINGS_MAX_LIMIT)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid limit");
+        return ESP_FAIL;
+    }
+
+    constexpr size_t batch_size = 8;
+    RaptPillData *batch = static_cast<RaptPillData *>(arena.allocate(batch_size * sizeof(RaptPillData)));
+    uint8_t *blocks = static_cast<uint8_t *>(arena.allocate(COLLECTOR_PEER_BLOCKS * GORILLA_BLOCK_BYTES, 1));
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!batch || !blocks || !chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    auto writeRow = [&](int64_t timestamp, const RaptPillData &entry)
+    {
+        json.beginArray();
+        json.value(timestamp);
+        for (size_t f = 0; f < reading_field_count; ++f)
+        {
+            if (mask & (1u << f))
+            {
+                json.value(entry.*reading_fields[f].member, reading_fields[f].precision);
+            }
+        }
+        json.endArray();
+    };
+
+    json.beginObject();
+    json.key("fields");
+    json.beginArray();
+    json.value("timestamp");
+    for (size_t f = 0; f < reading_field_count; ++f)
+    {
+        if (mask & (1u << f))
+        {
+            json.value(reading_fields[f].name);
+        }
+    }
+    json.endArray();
+
+    // One series per device, this one first, each with its most recent samples.
+    json.key("devices");
+    json.beginArray();
+    const char *self = WiFiManager::deviceId();
+    if (!has_device || strcmp(device, self) == 0)
+    {
+        json.beginObject();
+        json.key("id");
+        json.value(self);
+        json.key("readings");
+        json.beginArray();
+        RaptPillBLE *ble = instance_->ble;
+        size_t size = HistoryStore::instance().size();
+        size_t offset = size > static_cast<size_t>(limit) ? size - static_cast<size_t>(limit) : 0;
+        // Resolved per boot like the peers' series: the tail has no earlier rows to place a boot
+        // whose wall time never got known, so its samples are left out rather than guessed.
+        uint32_t boot_id = UINT32_MAX;
+        bool offset_known = false;
+        int64_t boot_offset = 0;
+        size_t count;
+        while (out.ok() && (count = ble->copyData(offset, batch, batch_size)) > 0)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (batch[i].boot_id != boot_id)
+                {
+                    boot_id = batch[i].boot_id;
+                    offset_known = TimeBase::offsetFor(boot_id, boot_offset);
+                }
+                if (offset_known)
+                {
+                    writeRow(batch[i].timestamp + boot_offset, batch[i]);
+                }
+            }
+            offset += count;
+        }
+        json.endArray();
+        json.endObject();
+    }
+
+    Collector &collector = Collector::instance();
+    PeerStats peer;
+    for (size_t p = 0; p < COLLECTOR_MAX_PEERS && out.ok(); ++p)
+    {
+        if (!collector.peer(p, peer) || peer.id[0] == '\0' || (has_device && strcmp(device, peer.id) != 0))
+        {
+            continue;
+        }
+        size_t copied = collector.copyBlocks(peer.id, blocks);
+        size_t total = 0;
+        for (size_t b = 0; b < copied; ++b)
+        {
+            total += GorillaDecoder::sealed(blocks + b * GORILLA_BLOCK_BYTES, GORILLA_BLOCK_BYTES).remaining();
+        }
+        size_t skip = total > static_cast<size_t>(limit) ? total - static_cast<size_t>(limit) : 0;
+
+        json.beginObject();
+        json.key("id");
+        json.value(peer.id);
+        json.key("readings");
+        json.beginArray();
+        for (size_t b = 0; b < copied && out.ok(); ++b)
+        {
+            GorillaDecoder decoder = GorillaDecoder::sealed(blocks + b * GORILLA_BLOCK_BYTES, GORILLA_BLOCK_BYTES);
+            RaptPillData entry;
+            while (decoder.next(entry))
+            {
+                // Peers resolve what they can; samples of a boot whose wall time never got known are left out.
+                if (skip > 0)
+                {
+                    skip--;
+                }
+                else if (entry.boot_id == 0)
+                {
+                    writeRow(entry.timestamp, entry);
+                }
+            }
+        }
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::rules_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    char *webhook = static_cast<char *>(arena.allocate(RULES_WEBHOOK_MAX, 1));
+    if (!chunk || !webhook)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    RuleEngine &engine = RuleEngine::instance();
+    RuleEngineStats stats = engine.stats();
+    engine.webhook(webhook);
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("rules");
+    json.beginArray();
+    char condition[RULES_RULE_TEXT_MAX];
+    RuleState state;
+    for (size_t i = 0; engine.rule(i, condition, state); ++i)
+    {
+        json.beginObject();
+        json.key("condition");
+        json.value(condition);
+        json.key("active");
+        json.value(state.active);
+        json.key("fired");
+        json.value(static_cast<int64_t>(state.fired));
+        json.endObject();
+    }
+    json.endArray();
+    json.key("webhook");
+    json.value(webhook);
+    writeLatency(json, "evaluation", stats.evaluation);
+    json.key("alerts");
+    json.value(static_cast<int64_t>(stats.alerts));
+    json.key("dropped_alerts");
+    json.value(static_cast<int64_t>(stats.dropped_alerts));
+    json.key("webhook_sent");
+    json.value(static_cast<int64_t>(stats.webhook_sent));
+    json.key("webhook_failures");
+    json.value(static_cast<int64_t>(stats.webhook_failures));
+    json.key("webhook_error");
+    if (stats.webhook_failures > 0)
+    {
+        json.value(esp_err_to_name(stats.webhook_error));
+    }
+    else
+    {
+        json.null();
+    }
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::rules_put_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *content = receive_body(req, arena, RULES_BODY_MAX);
+    if (!content)
+    {
+        return ESP_FAIL;
+    }
+    cJSON *json = cJSON_Parse(content);
+    cJSON *rules = cJSON_GetObjectItem(json, "rules");
+    cJSON *webhook = cJSON_GetObjectItem(json, "webhook");
+    if (!cJSON_IsObject(json) || !cJSON_IsArray(rules) || (webhook && !cJSON_IsString(webhook)))
+    {
+        cJSON_Delete(json);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected {\"rules\": [...], \"webhook\": \"...\"}");
+        return ESP_FAIL;
+    }
+
+    // The engine takes one rule per line; the current webhook stays unless one is given.
+    char *text = static_cast<char *>(arena.allocate(RULES_TEXT_MAX, 1));
+    char *current = static_cast<char *>(arena.allocate(RULES_WEBHOOK_MAX, 1));
+    if (!text || !current)
+    {
+        cJSON_Delete(json);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    size_t length = 0;
+    const char *error = nullptr;
+    cJSON *rule;
+    cJSON_ArrayForEach(rule, rules)
+    {
+        size_t rule_length = cJSON_IsString(rule) ? strlen(rule->valuestring) : 0;
+        if (!cJSON_IsString(rule) || strchr(rule->valuestring, '\n') != nullptr)
+        {
+            error = "Every rule must be a string of one line";
+            break;
+        }
+        if (length + rule_length + 1 >= RULES_TEXT_MAX)
+        {
+            error = "Rules are too long";
+            break;
+        }
+        memcpy(text + length, rule->valuestring, rule_length);
+        length += rule_length;
+        text[length++] = '\n';
+    }
+    text[length] = '\0';
+    RuleEngine &engine = RuleEngine::instance();
+    engine.webhook(current);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (!error)
+    {
+        err = engine.configure(text, webhook ? webhook->valuestring : current);
+        error = engine.error();
+    }
+    cJSON_Delete(json);
+    if (err != ESP_OK)
+    {
+        httpd_resp_send_err(req, err == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR, error);
+        return ESP_FAIL;
+    }
+    return rules_get_handler(req);
+}
+
+esp_err_t RaptMateServer::alerts_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    RuleAlert *alerts = static_cast<RuleAlert *>(arena.allocate(RULES_RECENT_ALERTS * sizeof(RuleAlert), alignof(RuleAlert)));
+    if (!chunk || !alerts)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    size_t count = RuleEngine::instance().recentAlerts(alerts, RULES_RECENT_ALERTS);
+
+    // Alerts are written as the same objects webhooks and the event stream receive, newest first.
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    out.write("{\"alerts\":[");
+    char text[RULES_ALERT_JSON_MAX];
+    for (size_t i = 0; i < count; ++i)
+    {
+        int length = RuleEngine::format(alerts[i], text, sizeof(text));
+        if (i > 0)
+        {
+            out.write(",");
+        }
+        out.write(text, length < static_cast<int>(sizeof(text)) ? length : sizeof(text) - 1);
+    }
+    out.write("]}");
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::alerts_stream_get_handler(httpd_req_t *req)
+{
+    return AlertStream::instance().open(req);
+}
+
+esp_err_t RaptMateServer::forecast_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    // Fits on this worker when the cached fit is stale, never on the server or ingest task.
+    Forecast &forecast = Forecast::instance();
+    ForecastResult result = forecast.current();
+    ForecastStats stats = forecast.stats();
+    bool fitted = result.state == ForecastState::Fermenting || result.state == ForecastState::Complete;
+
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("state");
+    json.value(Forecast::stateName(result.state));
+    const struct
+    {
+        const char *name;
+        float value;
+        int precision;
+    } values[] = {
+        {"original_gravity", result.model.original_gravity, 4},
+        {"final_gravity", result.model.final_gravity, 4},
+        {"current_gravity", result.current_gravity, 4},
+        {"rate_per_hour", result.model.rate, 4},
+        {"rmse", result.model.rmse, 5},
+    };
+    for (const auto &value : values)
+    {
+        json.key(value.name);
+        if (fitted)
+        {
+            json.value(value.value, value.precision);
+        }
+        else
+        {
+            json.null();
+        }
+    }
+    // Times are only meaningful once the wall time of the latest boot is known; the remaining time always is.
+    const struct
+    {
+        const char *name;
+        int64_t value;
+    } times[] = {
+        {"start", result.start},
+        {"midpoint", result.midpoint},
+        {"completion", result.completion},
+    };
+    for (const auto &time : times)
+    {
+        json.key(time.name);
+        if (fitted && result.resolved)
+        {
+            json.value(time.value);
+        }
+        else
+        {
+            json.null();
+        }
+    }
+    json.key("remaining_s");
+    if (fitted)
+    {
+        json.value(result.completion > result.last ? result.completion - result.last : static_cast<int64_t>(0));
+    }
+    else
+    {
+        json.null();
+    }
+    json.key("samples");
+    json.value(static_cast<int64_t>(result.samples));
+    json.key("points");
+    json.value(static_cast<int64_t>(result.points));
+    json.key("iterations");
+    json.value(static_cast<int64_t>(result.model.iterations));
+    writeLatency(json, "fit", stats.fit);
+    json.key("cached");
+    json.value(static_cast<int64_t>(stats.cached));
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::ispindel_post_handler(httpd_req_t *req)
+{
+    // iSpindel and compatible firmware post one reading per wake-up through their generic HTTP service.
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *content = receive_body(req, arena, ISPINDEL_BODY_MAX);
+    if (!content)
+    {
+        return ESP_FAIL;
+    }
+    int64_t received_us = esp_timer_get_time();
+    cJSON *json = cJSON_Parse(content);
+    RaptPillData sample;
+    bool decoded = json && DecoderRegistry::decodeISpindel(json, sample);
+    cJSON_Delete(json);
+    if (!decoded)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected iSpindel JSON with gravity and temperature");
+        return ESP_FAIL;
+    }
+    if (instance_->ble->submit(sample, received_us, pdMS_TO_TICKS(ISPINDEL_QUEUE_WAIT_MS)) != ESP_OK)
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Ingest queue full");
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"status\":\"accepted\"}");
+}
+
+static void writeLink(JsonWriter &json, const DeviceLink &link)
+{
+    const LinkStats &stats = link.stats;
+    json.beginObject();
+    json.key("id");
+    json.value(link.id);
+    json.key("decoder");
+    json.value(link.decoder);
+    json.key("rssi");
+    json.value(static_cast<int64_t>(stats.rssi));
+    json.key("rssi_avg");
+    json.value(stats.rssi_avg, 1);
+    json.key("adverts");
+    json.value(static_cast<int64_t>(stats.adverts));
+    json.key("adverts_per_sample");
+    json.value(stats.adverts_per_sample, 2);
+    json.key("samples");
+    json.value(static_cast<int64_t>(stats.samples));
+    json.key("duplicates");
+    json.value(static_cast<int64_t>(stats.duplicates));
+    json.key("decode_failures");
+    json.value(static_cast<int64_t>(stats.decode_failures));
+    json.key("queue_drops");
+    json.value(static_cast<int64_t>(stats.queue_drops));
+    json.key("cadence_s");
+    if (stats.cadence_us > 0)
+    {
+        json.value(stats.cadence_us / 1000000.0f, 1);
+    }
+    else
+    {
+        json.null();
+    }
+    json.key("expected");
+    json.value(static_cast<int64_t>(stats.expected));
+    json.key("received");
+    json.value(static_cast<int64_t>(stats.received));
+    json.key("loss_rate");
+    if (stats.expected > 0)
+    {
+        json.value(static_cast<float>(stats.expected - stats.received) / stats.expected, 3);
+    }
+    else
+    {
+        json.null();
+    }
+    json.key("gaps");
+    json.value(static_cast<int64_t>(stats.gaps));
+    json.key("longest_gap_s");
+    json.value(stats.longest_gap_us / 1000000);
+    writeBootMillis(json, "last_gap_ms", stats.gaps > 0 ? stats.last_gap_us : -1);
+    writeBootMillis(json, "last_advert_ms", stats.last_advert_us);
+    writeBootMillis(json, "last_sample_ms", stats.samples > 0 ? stats.last_sample_us : -1);
+    json.endObject();
+}
+
+esp_err_t RaptMateServer::devices_get_handler(httpd_req_t *req)
+{
+    // /api/v1/devices lists every device heard, /api/v1/devices/<id>/link reports one of them.
+    const char *path = req->uri + strlen("/api/v1/devices");
+    size_t length = strcspn(path, "?");
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    DeviceLink *links = static_cast<DeviceLink *>(arena.allocate(BLE_MAX_SOURCES * sizeof(DeviceLink), alignof(DeviceLink)));
+    if (!chunk || !links)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    constexpr size_t id_length = sizeof(links->id) - 1;
+    const char suffix[] = "/link";
+    bool single = length > 0;
+    size_t count = 0;
+    if (single)
+    {
+        char id[sizeof(links->id)] = {};
+        if (length != 1 + id_length + sizeof(suffix) - 1 || path[0] != '/' ||
+            strncmp(path + 1 + id_length, suffix, sizeof(suffix) - 1) != 0)
+        {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Expected /api/v1/devices/<id>/link");
+            return ESP_FAIL;
+        }
+        memcpy(id, path + 1, id_length);
+        if (!instance_->ble->link(id, links[0]))
+        {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Device not heard");
+            return ESP_FAIL;
+        }
+        count = 1;
+    }
+    else
+    {
+        count = instance_->ble->links(links, BLE_MAX_SOURCES);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    if (single)
+    {
+        writeLink(json, links[0]);
+        return out.finish();
+    }
+    json.beginObject();
+    json.key("devices");
+    json.beginArray();
+    for (size_t i = 0; i < count; ++i)
+    {
+        writeLink(json, links[i]);
+    }
+    json.endArray();
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::network_get_handler(httpd_req_t *req)
+{
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *chunk = static_cast<char *>(arena.allocate(RESPONSE_CHUNK_SIZE, 1));
+    if (!chunk)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    WifiMetrics metrics = instance_->wm->metrics();
+    httpd_resp_set_type(req, "application/json");
+    ChunkedResponse out(req, chunk, RESPONSE_CHUNK_SIZE);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("state");
+    json.value(WiFiManager::stateName(instance_->wm->state()));
+    // Boot-relative milestones in milliseconds, null until reached.
+    auto milliseconds = [&json](const char *key, int64_t us)
+    {
+        json.key(key);
+        if (us >= 0)
+        {
+            json.value(static_cast<int64_t>(us / 1000));
+        }
+        else
+        {
+            json.null();
+        }
+    };
+    milliseconds("time_to_ip_ms", metrics.time_to_ip_us);
+    milliseconds("time_to_synced_clock_ms", metrics.time_to_synced_clock_us);
+    milliseconds("last_connect_ms", metrics.last_connect_duration_us);
+    json.key("disconnects");
+    json.value(static_cast<int64_t>(metrics.disconnects));
+    json.key("fast_reconnects");
+    json.value(static_cast<int64_t>(metrics.fast_reconnects));
+    json.key("backoff_ms");
+    json.value(static_cast<int64_t>(metrics.backoff_ms));
+    json.endObject();
+    return out.finish();
+}
+
+esp_err_t RaptMateServer::time_get_handler(httpd_req_t *req)
+{
+    char response[160];
+    const char *source = TimeBase::source() == TimeSource::Sntp      ? "sntp"
+                         : TimeBase::source() == TimeSource::Browser ? "browser"
+                                                                     : "none";
+    snprintf(response, sizeof(response), "{\"unix\":%lld,\"source\":\"%s\",\"boot_id\":%lu,\"monotonic\":%lld}",
+             static_cast<long long>(time(nullptr)), source,
+             static_cast<unsigned long>(TimeBase::bootId()), TimeBase::monotonicSeconds());
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, response);
+}
+
+esp_err_t RaptMateServer::time_post_handler(httpd_req_t *req)
+{
+    // Lets the dashboard hand its clock to a device that has no route to an NTP server.
+    Arena &arena = AsyncWorkers::requestArena();
+    ArenaScope scope(arena);
+    char *content = receive_body(req, arena, 96);
+    if (!content)
+    {
+        return ESP_FAIL;
+    }
+    cJSON *json = cJSON_Parse(content);
+    cJSON *unix_ms = json ? cJSON_GetObjectItem(json, "unix_ms") : nullptr;
+    if (!cJSON_IsNumber(unix_ms) || unix_ms->valuedouble < 1.5e12)
+    {
+        cJSON_Delete(json);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected {\"unix_ms\": <milliseconds since epoch>}");
+        return ESP_FAIL;
+    }
+    int64_t unix_seconds = static_cast<int64_t>(unix_ms->valuedouble / 1000.0);
+    cJSON_Delete(json);
+
+    esp_err_t err = TimeBase::setWallClock(unix_seconds, TimeSource::Browser);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, err == ESP_OK ? "{\"status\":\"applied\"}" : "{\"status\":\"ignored\",\"reason\":\"clock set by SNTP\"}");
+}
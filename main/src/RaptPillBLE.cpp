@@ -1,25 +1,62 @@
 #include "drivers/RaptPillBLE.hpp"
+#include <strings.h>
+#include "drivers/PowerManager.hpp"
+#include "common/Startup.hpp"
+#include "drivers/Uplink.hpp"
+#include "drivers/RuleEngine.hpp"
 
 RaptPillBLE *RaptPillBLE::instance_ = nullptr;
 
+static_assert(sizeof(CompactSample) == 24, "CompactSample layout changed");
+
 QueueHandle_t dataQueue;
 
 void RaptPillBLE::dataReceiverTask(void *param)
 {
-    RaptPillData receivedData;
+    PendingSample pending;
     RaptPillBLE *ble = static_cast<RaptPillBLE *>(param);
+    // Discovery is started here rather than on the tasks that ask for it, so a refused start is retried
+    // without holding up the NimBLE host or HTTP tasks, and without holding up samples either.
+    int scan_attempts = 0;
     while (true)
     {
-        if (xQueueReceive(ble->dataQueue, &receivedData, portMAX_DELAY))
+        TickType_t wait = scan_attempts > 0 ? pdMS_TO_TICKS(BLE_SCAN_RETRY_MS) : portMAX_DELAY;
+        QueueSetMemberHandle_t ready = xQueueSelectFromSet(ble->m_receiver_set, wait);
+        if (ready == ble->m_scan_request)
+        {
+            xSemaphoreTake(ble->m_scan_request, 0);
+            scan_attempts = BLE_SCAN_ATTEMPTS;
+        }
+        if (ready != ble->dataQueue)
         {
-            ble->m_most_recent_data.push_back(receivedData);
-            if (receivedData.timestamp != 0)
+            if (scan_attempts > 0 && !ble->ble_app_scan())
             {
-                // ESP_LOGI(BLE_TAG, "Updating data");
-                std::string formattedData = RaptPillBLE::formatDataAsString(receivedData);
-                RaptPillBLE::writeToFile("/data/data.csv", formattedData);
-
-                ESP_LOGI(BLE_TAG, "Data received and written to file");
+                if (--scan_attempts > 0)
+                {
+                    ESP_LOGW(BLE_TAG, "Retrying discovery, %d attempts left", scan_attempts);
+                }
+                else
+                {
+                    ESP_LOGE(BLE_TAG, "Discovery did not start after %d attempts", BLE_SCAN_ATTEMPTS);
+                }
+            }
+            else
+            {
+                scan_attempts = 0;
+            }
+            continue;
+        }
+        if (xQueueReceive(ble->dataQueue, &pending, 0))
+        {
+            RaptPillData receivedData = CompactCodec::decode(pending.data, TimeBase::bootId());
+            if (receivedData.boot_id != 0 || receivedData.timestamp != 0)
+            {
+                ble->m_history->append(receivedData);
+                ESP_LOGI(BLE_TAG, "Data received and written to storage");
+                RuleEngine::instance().evaluate(nullptr, receivedData);
+                PowerManager::recordIngestLatency(static_cast<uint32_t>(esp_timer_get_time()) - pending.received_us);
+                Startup::reach(StartupMilestone::FirstSample);
+                Uplink::instance().notify();
             }
             else
             {
@@ -28,11 +65,10 @@ void RaptPillBLE::dataReceiverTask(void *param)
         }
     }
 }
-std::string RaptPillBLE::formatDataAsString(const RaptPillData &data)
+int RaptPillBLE::formatExportRow(const RaptPillData &data, int64_t timestamp, char *buffer, size_t size)
 {
-    char buffer[256];
-    snprintf(buffer, sizeof(buffer), "%lld,%.2f,%.2f,%.4f,%.2f,%.2f,%.2f,%.2f\n",
-             data.timestamp,
+    return snprintf(buffer, size, "%lld,%.2f,%.2f,%.4f,%.2f,%.2f,%.2f,%.2f\n",
+             timestamp,
              data.gravity_velocity,
              data.temperature_celsius,
              data.specific_gravity,
@@ -40,20 +76,36 @@ std::string RaptPillBLE::formatDataAsString(const RaptPillData &data)
              data.accel_y,
              data.accel_z,
              data.battery);
-    return std::string(buffer);
 }
 
-void RaptPillBLE::writeToFile(const char *filepath, const std::string &content)
+static DeadbandConfig deadbandConfig(const Settings &settings)
 {
-    FILE *file = fopen(filepath, "a");
-    if (file)
+    return {
+        .gravity_velocity = settings.deadband_gravity_velocity / 100.0f,
+        .temperature = settings.deadband_temperature / 100.0f,
+        .specific_gravity = settings.deadband_specific_gravity / 10000.0f,
+        .accel = settings.deadband_accel / 100.0f,
+        .battery = settings.deadband_battery / 100.0f,
+        .heartbeat_s = settings.history_heartbeat_s,
+    };
+}
+
+void RaptPillBLE::onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx)
+{
+    RaptPillBLE *self = static_cast<RaptPillBLE *>(ctx);
+    if (changed & SETTINGS_RETENTION)
     {
-        fputs(content.c_str(), file);
-        fclose(file);
+        self->m_history->setRetention(settings.history_max_records);
     }
-    else
+    if (changed & SETTINGS_DEADBAND)
+    {
+        self->m_history->setDeadband(deadbandConfig(settings));
+    }
+    // Before the host has synced there is no discovery to restart; the first scan picks up the settings.
+    if ((changed & (SETTINGS_SCAN | SETTINGS_POWER)) && self->m_scanning)
     {
-        ESP_LOGE(BLE_TAG, "Failed to open %s for writing", filepath);
+        ESP_LOGI(BLE_TAG, "Scan parameters changed, restarting discovery");
+        self->startScan();
     }
 }
 
@@ -62,349 +114,239 @@ RaptPillBLE::RaptPillBLE()
     instance_ = this;
 
     // Create the queue to hold RaptPillData items
-    dataQueue = xQueueCreate(10, sizeof(RaptPillData));
+    dataQueue = xQueueCreate(BLE_QUEUE_LENGTH, sizeof(PendingSample));
     if (dataQueue == nullptr)
     {
         ESP_LOGE(BLE_TAG, "Failed to create data queue");
         return;
     }
 
-    // Initialize SPIFFS for data partition
-    esp_vfs_spiffs_conf_t data_conf = {
-        .base_path = "/data",
-        .partition_label = "data",
-        .max_files = 1,
-        .format_if_mount_failed = false,
-    };
-
-    // Initialize data persistence
-    esp_err_t data_ret = esp_vfs_spiffs_register(&data_conf);
-
-    if (data_ret != ESP_OK)
-    {
-        ESP_LOGE(BLE_TAG, "Failed to mount or format data filesystem");
-    }
-    else
-    {
-        ESP_LOGI(BLE_TAG, "Data SPIFFS mounted");
-        // Check if data.csv exists, if not create it
-        createFileIfNotExist("/data/data.csv");
-        createFileIfNotExist("/data/settings.csv");
-    }
-    // Open the file in read mode
-    this->m_most_recent_data = readAllData();
-    ESP_LOGI(BLE_TAG, "Number of records loaded from CSV: %zu", this->m_most_recent_data.size());
+    m_synced = xSemaphoreCreateBinary();
+    m_scan_request = xSemaphoreCreateBinary();
+    m_receiver_set = xQueueCreateSet(BLE_QUEUE_LENGTH + 1);
+    xQueueAddToSet(dataQueue, m_receiver_set);
+    xQueueAddToSet(m_scan_request, m_receiver_set);
+    m_sources_mutex = xSemaphoreCreateMutex();
+    // The history is loaded by loadHistory(); until then appended samples are buffered.
+    m_history = &HistoryStore::instance();
+    Settings settings = SettingsStore::get();
+    m_history->setRetention(settings.history_max_records);
+    m_history->setDeadband(deadbandConfig(settings));
+    SettingsStore::subscribe(SETTINGS_SCAN | SETTINGS_RETENTION | SETTINGS_POWER | SETTINGS_DEADBAND, &RaptPillBLE::onSettingsChanged, this);
     // Create the data receiver task
     xTaskCreate(RaptPillBLE::dataReceiverTask, "DataReceiverTask", 4096, this, 5, nullptr);
 }
 
-void RaptPillBLE::createFileIfNotExist(const char *filename)
+esp_err_t RaptPillBLE::loadHistory()
 {
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    StorageBackend &storage = StorageBackend::configured();
+    esp_err_t err = storage.mount();
+    if (err != ESP_OK)
     {
-        ESP_LOGW(BLE_TAG, "File not found, creating a new one: %s", filename);
-        file = fopen(filename, "w");
-        if (file)
-        {
-            fclose(file);
-            ESP_LOGI(BLE_TAG, "File created successfully: %s", filename);
-        }
-        else
-        {
-            ESP_LOGE(BLE_TAG, "Failed to create file: %s", filename);
-        }
-    }
-    else
-    {
-        fclose(file);
-        ESP_LOGI(BLE_TAG, "File already exists: %s", filename);
+        return err;
     }
+    int64_t start_us = esp_timer_get_time();
+    err = m_history->load(storage);
+    ESP_LOGI(BLE_TAG, "Indexed %zu records in %lld ms", m_history->size(),
+             (esp_timer_get_time() - start_us) / 1000);
+    return err;
 }
 
 void RaptPillBLE::resetData()
 {
-    // Reset the data to default values
-    m_most_recent_data = {};
-    ESP_LOGI(BLE_TAG, "Data reset to default values");
-    // Delete the content of the CSV file
-    FILE *file = fopen("/data/data.csv", "w");
-    if (file)
+    if (m_history->clear() == ESP_OK)
     {
-        fclose(file);
-        ESP_LOGI(BLE_TAG, "CSV content deleted");
+        ESP_LOGI(BLE_TAG, "Stored history deleted");
     }
     else
     {
-        ESP_LOGE(BLE_TAG, "Failed to open data.csv for resetting");
+        ESP_LOGE(BLE_TAG, "Failed to delete stored history");
     }
 }
 
-RaptPillData RaptPillBLE::readLatestData()
+RaptPillBLE::~RaptPillBLE()
 {
-    RaptPillData lastData = {};
-    auto filename = "/data/data.csv";
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        ESP_LOGE(BLE_TAG, "Failed to open file: %s", filename);
-        return lastData;
-    }
-
-    if (fseek(file, -1, SEEK_END) != 0)
-    {
-        ESP_LOGE(BLE_TAG, "Failed to seek to the end of the file");
-        fclose(file);
-        return lastData;
-    }
+    // Destructor implementation
+}
 
-    long filePos = ftell(file);
-    std::string lastLine;
-    while (filePos > 0)
+esp_err_t RaptPillBLE::init()
+{
+    // Initialize NimBLE host stack.
+    esp_err_t err = nimble_port_init();
+    if (err != ESP_OK)
     {
-        char ch;
-        fseek(file, --filePos, SEEK_SET);
-        fread(&ch, 1, 1, file);
-
-        if (ch == '\n' && !lastLine.empty())
-        {
-            break;
-        }
-        lastLine.insert(lastLine.begin(), ch);
+        return err;
     }
-
-    fclose(file);
-    if (!lastLine.empty())
+    err = esp_nimble_hci_init();
+    if (err != ESP_OK)
     {
-        sscanf(lastLine.c_str(), "%lld,%f,%f,%f,%f,%f,%f,%f",
-               &lastData.timestamp,
-               &lastData.gravity_velocity,
-               &lastData.temperature_celsius,
-               &lastData.specific_gravity,
-               &lastData.accel_x,
-               &lastData.accel_y,
-               &lastData.accel_z,
-               &lastData.battery);
+        return err;
     }
-    return lastData;
-}
+    ble_hs_cfg.sync_cb = &RaptPillBLE::onHostSync;
 
-std::vector<RaptPillData> RaptPillBLE::readAllData()
-{
-    std::vector<RaptPillData> allData;
-    const char *file_path = "/data/data.csv";
-    FILE *file = fopen(file_path, "r");
-    if (!file)
-    {
-        ESP_LOGE(BLE_TAG, "Failed to open file: %s", file_path);
-        return allData;
-    }
+    // Create the FreeRTOS task
+    xTaskCreate(bleHostTask, "nimble_host_task", 4096, this, 5, NULL);
 
-    char line[256];
-    
-    // Read each line and parse the data
-    while (fgets(line, sizeof(line), file))
+    // Discovery fails until the host has synced; onHostSync() starts it, however late that is.
+    if (xSemaphoreTake(m_synced, pdMS_TO_TICKS(BLE_SYNC_TIMEOUT_MS)) != pdTRUE)
     {
-        RaptPillData data = {};
-        if (sscanf(line, "%lld,%f,%f,%f,%f,%f,%f,%f",
-                   &data.timestamp,
-                   &data.gravity_velocity,
-                   &data.temperature_celsius,
-                   &data.specific_gravity,
-                   &data.accel_x,
-                   &data.accel_y,
-                   &data.accel_z,
-                   &data.battery) == 8)
-        {
-            allData.push_back(data);
-        }
-        else
-        {
-            ESP_LOGW(BLE_TAG, "Failed to parse line: %s", line);
-        }
+        ESP_LOGE(BLE_TAG, "NimBLE host did not sync within %d ms, scanning starts once it does", BLE_SYNC_TIMEOUT_MS);
+        return ESP_ERR_TIMEOUT;
     }
-
-    fclose(file);
-    return allData;
-}
-RaptPillBLE::~RaptPillBLE()
-{
-    // Destructor implementation
+    return ESP_OK;
 }
 
-void RaptPillBLE::init()
+void RaptPillBLE::onHostSync()
 {
-    // Initialize NimBLE host stack.
-    nimble_port_init();
-    ESP_ERROR_CHECK(esp_nimble_hci_init());
-
-    // Create the FreeRTOS task
-    xTaskCreate(bleHostTask, "nimble_host_task", 4096, this, 5, NULL);
-    startScan();
+    RaptPillBLE *self = instance_;
+    ESP_LOGI(BLE_TAG, "NimBLE host synced");
+    // The first sync, one after init() gave up waiting, or a resync after a controller reset,
+    // which ends discovery: scanning has to (re)start in every case.
+    self->m_scanning = true;
+    self->startScan();
+    xSemaphoreGive(self->m_synced);
 }
 
 void RaptPillBLE::startScan()
 {
-    ble_app_scan();
+    xSemaphoreGive(m_scan_request);
 }
 
-void RaptPillBLE::ble_app_scan()
+bool RaptPillBLE::ble_app_scan()
 {
+    Settings settings = SettingsStore::get();
+    // The power profile caps how much of each interval the radio listens.
+    uint32_t max_window = static_cast<uint32_t>(settings.scan_interval) *
+                          PowerManager::config(settings.power_profile).scan_duty_percent / 100;
+    uint16_t window = settings.scan_window;
+    if (window > max_window)
+    {
+        window = max_window < BLE_MIN_SCAN_WINDOW ? BLE_MIN_SCAN_WINDOW : static_cast<uint16_t>(max_window);
+    }
     struct ble_gap_disc_params disc_params = {
-        .itvl = 10,             // Default interval
-        .window = 5,           // Default window
+        .itvl = settings.scan_interval,
+        .window = window,
         .filter_policy = 0,    // Accept all advertisements
         .limited = 0,          // General discovery mode
         .passive = 1,          // Passive scanning (no scan requests)
         .filter_duplicates = 0 // Do not filter duplicate advertisements
     };
 
-    for (int i = 0; i < 10; ++i)
+    // Restarting with new parameters needs the running discovery stopped; after a resync none is running.
+    ble_gap_disc_cancel();
+    int rc = ble_gap_disc(0, BLE_HS_FOREVER, &disc_params, bleGapEvent, this);
+    if (rc != 0)
     {
-        int rc = ble_gap_disc(0, BLE_HS_FOREVER, &disc_params, bleGapEvent, this);
-        if (rc == 0)
-        {
-            break;
-        }
-        ESP_LOGW(BLE_TAG, "Retrying discovery, attempt %d", i + 1);
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Wait for 1 second before retrying
+        ESP_LOGW(BLE_TAG, "Discovery failed to start: %d", rc);
     }
+    return rc == 0;
 }
 
-int RaptPillBLE::parseManufacturerData(const uint8_t *data, size_t length, ble_addr_t addr)
+void RaptPillBLE::onAdvert(const DecoderMatch &match, const ble_addr_t &addr, int8_t rssi)
 {
-    RaptPillData parsed_data = {};
-    time_t now;
-    time(&now);
-    struct tm timeinfo;
-    int64_t epoch_time = static_cast<int64_t>(now);
-    parsed_data.timestamp = epoch_time;
-
-    uint8_t version = data[4];
-    if (version == 0x01)
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(m_sources_mutex, portMAX_DELAY);
+    Source *source = nullptr;
+    for (size_t i = 0; i < m_source_count; ++i)
     {
-        if (last_timestamp == parsed_data.timestamp){
-            // ESP_LOGI(BLE_TAG, "Duplicate timestamp detected, ignoring data");
-            return 0;
-        }else{
-            last_timestamp = parsed_data.timestamp;
+        if (memcmp(m_sources[i].addr.val, addr.val, sizeof(addr.val)) == 0)
+        {
+            source = &m_sources[i];
+            break;
         }
-    
-        // Parse MAC address.
-        char mac_address[18];
-        snprintf(mac_address, sizeof(mac_address), "%02X:%02X:%02X:%02X:%02X:%02X",
-                 data[5], data[6], data[7], data[8], data[9], data[10]);
-
-        uint16_t temperature = (data[11] << 8) | data[12];
-        float temp_celsius = temperature / 256.0f;
-
-        // Parse specific gravity (raw value).
-        uint32_t sg_raw = (data[13] << 24) | (data[14] << 16) | (data[15] << 8) | data[16];
-        float sg = static_cast<float>(sg_raw);
-
-        // Parse raw accelerometer data.
-        int16_t raw_accel_x = (data[17] << 8) | data[18];
-        int16_t raw_accel_y = (data[19] << 8) | data[20];
-        int16_t raw_accel_z = (data[21] << 8) | data[22];
-
-        // Scale the raw accelerometer data.
-        float accel_x_scaled = raw_accel_x / 16.0f;
-        float accel_y_scaled = raw_accel_y / 16.0f;
-        float accel_z_scaled = raw_accel_z / 16.0f;
-
-        // Parse battery state-of-charge (percentage * 256).
-        uint16_t battery_raw = (data[23] << 8) | data[24];
-        float battery = battery_raw / 256.0f;
-
-        // Populate the struct with parsed data.
-        parsed_data = {
-            .timestamp = epoch_time,
-            .gravity_velocity = 0.0f, // Not available in version 0x01
-            .temperature_celsius = temp_celsius,
-            .specific_gravity = sg,
-            .accel_x = accel_x_scaled,
-            .accel_y = accel_y_scaled,
-            .accel_z = accel_z_scaled,
-            .battery = battery};
-
-        // Log parsed data.
-        ESP_LOGI(BLE_TAG, "MAC Address: %s, Specific Gravity: %.4f, Temperature: %.2f °C, Battery: %.2f%%, Accelerometer (X, Y, Z): %.2f, %.2f, %.2f",
-                 mac_address, sg, temp_celsius, battery, accel_x_scaled, accel_y_scaled, accel_z_scaled);
     }
-    else if (version == 0x02)
+    if (!source)
     {
-        if (last_timestamp == epoch_time){
-            ESP_LOGI(BLE_TAG, "Duplicate timestamp detected, ignoring data");
-            return 0;
-        }else{
-            last_timestamp = epoch_time;
+        // Take a free slot, or the one that has been silent longest.
+        if (m_source_count < BLE_MAX_SOURCES)
+        {
+            source = &m_sources[m_source_count++];
         }
-    
-        // Parse gravity velocity validity.
-        uint8_t cc = data[6];
-        float gv = 0.0f;
-        if (cc == 0x01)
+        else
         {
-            // Gravity velocity is valid; parse it.
-            uint32_t gv_raw = (data[7] << 24) | (data[8] << 16) | (data[9] << 8) | data[10];
-            memcpy(&gv, &gv_raw, sizeof(float));
+            source = &m_sources[0];
+            for (Source &candidate : m_sources)
+            {
+                source = candidate.link.stats().last_advert_us < source->link.stats().last_advert_us ? &candidate : source;
+            }
         }
+        *source = {.addr = addr, .decoder = nullptr, .last_accepted_us = INT64_MIN, .link = {}};
+    }
+    source->decoder = match.decoder->name;
+    LinkTracker &link = source->link;
+    link.advert(rssi, now_us);
 
-        // Parse temperature (Kelvin * 128).
-        uint16_t temp_raw = (data[11] << 8) | data[12];
-        float temp = temp_raw / 128.0f;
-
-        // Parse specific gravity (as a float).
-        uint32_t sg_raw = (data[13] << 24) | (data[14] << 16) | (data[15] << 8) | data[16];
-        float sg;
-        memcpy(&sg, &sg_raw, sizeof(float));
-
-        // Parse accelerometer data (x, y, z).
-        int16_t accel_x = (data[17] << 8) | data[18];
-        int16_t accel_y = (data[19] << 8) | data[20];
-        int16_t accel_z = (data[21] << 8) | data[22];
-        float accel_x_scaled = accel_x / 16.0f;
-        float accel_y_scaled = accel_y / 16.0f;
-        float accel_z_scaled = accel_z / 16.0f;
-
-        // Parse battery state-of-charge (percentage * 256).
-        uint16_t battery_raw = (data[23] << 8) | data[24];
-        float battery = battery_raw / 256.0f;
-
-        // Convert temperature to Celsius (from Kelvin).
-        float temp_celsius = temp - 273.15f;
-
-        // Populate the struct with parsed data.
-        parsed_data = {
-            .timestamp = epoch_time,
-            .gravity_velocity = gv,
-            .temperature_celsius = temp_celsius,
-            .specific_gravity = sg,
-            .accel_x = accel_x_scaled,
-            .accel_y = accel_y_scaled,
-            .accel_z = accel_z_scaled,
-            .battery = battery};
-
-        // Log the parsed data.
-        ESP_LOGI(BLE_TAG, "Timestamp: %lld,Gravity Velocity Valid: %s, Gravity Velocity: %.2f points/day, Temperature: %.2f °C, Specific Gravity: %.4f, "
-                          "Accelerometer (X, Y, Z): %.2f, %.2f, %.2f, Battery: %.2f%%",
-                 parsed_data.timestamp,
-                 cc == 0x01 ? "Yes" : "No", gv, temp_celsius, sg,
-                 accel_x_scaled, accel_y_scaled, accel_z_scaled, battery);
+    // Dedupe on monotonic time per device, the wall clock may not be set yet.
+    RaptPillData parsed_data = {};
+    bool accepted = false;
+    if (source->last_accepted_us != INT64_MIN && now_us - source->last_accepted_us < match.decoder->min_interval_us)
+    {
+        link.duplicate();
+    }
+    else if (!DecoderRegistry::instance().decode(match, parsed_data))
+    {
+        link.decodeFailure();
     }
     else
     {
-        return -1; // Unknown version.
+        source->last_accepted_us = now_us;
+        link.sample(now_us);
+        accepted = true;
     }
+    xSemaphoreGive(m_sources_mutex);
 
+    // Never block the host task on a full queue; the drop is counted against the device instead.
+    if (accepted && submit(parsed_data, now_us, pdMS_TO_TICKS(BLE_QUEUE_WAIT_MS)) != ESP_OK)
+    {
+        xSemaphoreTake(m_sources_mutex, portMAX_DELAY);
+        link.queueDrop();
+        xSemaphoreGive(m_sources_mutex);
+    }
+}
 
-    // Send the parsed data to the queue.
-    if (xQueueSend(dataQueue, &parsed_data, portMAX_DELAY) != pdPASS)
+size_t RaptPillBLE::links(DeviceLink *out, size_t max)
+{
+    xSemaphoreTake(m_sources_mutex, portMAX_DELAY);
+    size_t count = m_source_count < max ? m_source_count : max;
+    for (size_t i = 0; i < count; ++i)
     {
-        ESP_LOGE(BLE_TAG, "Failed to send data to the queue");
+        const Source &source = m_sources[i];
+        const uint8_t *val = source.addr.val;
+        snprintf(out[i].id, sizeof(out[i].id), "%02x%02x%02x%02x%02x%02x", val[5], val[4], val[3], val[2], val[1], val[0]);
+        out[i].decoder = source.decoder;
+        out[i].stats = source.link.stats();
+    }
+    xSemaphoreGive(m_sources_mutex);
+    return count;
+}
+
+bool RaptPillBLE::link(const char *id, DeviceLink &out)
+{
+    DeviceLink all[BLE_MAX_SOURCES];
+    size_t count = links(all, BLE_MAX_SOURCES);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strcasecmp(all[i].id, id) == 0)
+        {
+            out = all[i];
+            return true;
+        }
     }
+    return false;
+}
 
-    return 0;
+esp_err_t RaptPillBLE::submit(RaptPillData &sample, int64_t received_us, TickType_t wait)
+{
+    TimeBase::stamp(sample);
+
+    // Send the parsed data to the queue; stamping makes it a sample of this boot, which always fits.
+    PendingSample pending = {.data = CompactCodec::encode(sample), .received_us = static_cast<uint32_t>(received_us)};
+    if (xQueueSend(dataQueue, &pending, wait) != pdPASS)
+    {
+        ESP_LOGE(BLE_TAG, "Failed to send data to the queue");
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
 }
 
 int RaptPillBLE::bleGapEvent(struct ble_gap_event *event, void *arg)
@@ -427,17 +369,11 @@ int RaptPillBLE::handleBleGapEvent(struct ble_gap_event *event)
     {
     case BLE_GAP_EVENT_DISC:
     {
-        struct ble_hs_adv_fields fields;
-        int rc = ble_hs_adv_parse_fields(&fields, event->disc.data, event->disc.length_data);
-
-        // TODO figure out why this is failing to parse
-        // if (rc != 0) {
-        //     ESP_LOGE(BLE_TAG, "Failed to parse advertisement data");
-        //     return 0;
-        // }
-        if (fields.mfg_data != nullptr && fields.mfg_data_len == 25)
+        // Only the manufacturer data is looked at, so adverts of other devices are dropped without a full parse.
+        DecoderMatch match;
+        if (DecoderRegistry::instance().match(event->disc.data, event->disc.length_data, match))
         {
-            parseManufacturerData(fields.mfg_data, fields.mfg_data_len, event->disc.addr);
+            onAdvert(match, event->disc.addr, event->disc.rssi);
         }
         break;
     }
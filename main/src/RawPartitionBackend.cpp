@@ -0,0 +1,472 @@
+#include "storage/RawPartitionBackend.hpp"
+#include <cstdlib>
+#include <cstring>
+#include "esp_log.h"
+
+static const char *RAW_TAG = "RawPartition";
+
+#define RAW_ERASED_WORD 0xFFFFFFFF
+#define RAW_ERASED_LENGTH 0xFFFF
+
+RawPartitionBackend::RawPartitionBackend(const char *partition_label)
+    : m_partition_label(partition_label)
+{
+}
+
+size_t RawPartitionBackend::sectorsInUse() const
+{
+    return m_empty ? 0 : (m_head + m_sectors - m_tail) % m_sectors + 1;
+}
+
+size_t RawPartitionBackend::walkSector(const uint8_t *buffer, size_t &records, size_t &payload,
+                                       RecordVisitor visitor, void *ctx, size_t &skip, size_t &remaining, bool &stopped)
+{
+    size_t offset = sizeof(SectorHeader);
+    while (!stopped && offset + sizeof(StorageFrameHeader) <= RAW_SECTOR_SIZE)
+    {
+        StorageFrameHeader header;
+        memcpy(&header, buffer + offset, sizeof(header));
+        if (header.length == RAW_ERASED_LENGTH)
+        {
+            break;
+        }
+        size_t end = offset + sizeof(header) + header.length;
+        if (header.length == 0 || end > RAW_SECTOR_SIZE)
+        {
+            // Torn length: nothing after it can be located, the sector is closed.
+            return RAW_SECTOR_SIZE;
+        }
+
+        // A torn payload fails the CRC and is skipped; the frame length still holds.
+        const uint8_t *record = buffer + offset + sizeof(header);
+        if (frameCrc(record, header.length) == header.crc)
+        {
+            records++;
+            payload += header.length;
+            if (skip > 0)
+            {
+                skip--;
+            }
+            else if (remaining == 0)
+            {
+                stopped = true;
+            }
+            else
+            {
+                remaining--;
+                if (visitor && !visitor(record, header.length, ctx))
+                {
+                    stopped = true;
+                }
+            }
+        }
+        offset = end;
+    }
+    return offset;
+}
+
+esp_err_t RawPartitionBackend::doMount()
+{
+    m_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, m_partition_label);
+    if (!m_partition)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t total_sectors = m_partition->size / RAW_SECTOR_SIZE;
+    if (total_sectors < RAW_WAL_SECTORS + 2)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    m_sectors = total_sectors - RAW_WAL_SECTORS;
+
+    // Find the oldest and newest sector from the headers alone.
+    bool found = false;
+    size_t foreign = 0;
+    uint32_t oldest = 0, newest = 0;
+    for (size_t i = 0; i < m_sectors; ++i)
+    {
+        SectorHeader header;
+        esp_err_t err = esp_partition_read(m_partition, i * RAW_SECTOR_SIZE, &header, sizeof(header));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (header.magic == RAW_SECTOR_MAGIC)
+        {
+            if (!found || header.sequence < oldest)
+            {
+                oldest = header.sequence;
+                m_tail = i;
+            }
+            if (!found || header.sequence > newest)
+            {
+                newest = header.sequence;
+                m_head = i;
+            }
+            found = true;
+        }
+        else if (header.magic != RAW_ERASED_WORD)
+        {
+            foreign++;
+        }
+    }
+
+    if (!found && foreign > 0)
+    {
+        // Left behind by a filesystem backend; starting over is the only option.
+        ESP_LOGW(RAW_TAG, "Partition %s holds no record log, erasing", m_partition_label);
+        esp_err_t err = esp_partition_erase_range(m_partition, 0, m_sectors * RAW_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    m_empty = !found;
+    m_payload_bytes = 0;
+    m_records = 0;
+
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(RAW_SECTOR_SIZE));
+    if (!buffer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t wal_err = mountWal(buffer);
+    if (wal_err != ESP_OK || m_empty)
+    {
+        free(buffer);
+        return wal_err;
+    }
+    m_head_sequence = newest;
+    size_t records = 0, skip = 0, remaining = SIZE_MAX;
+    bool stopped = false;
+    for (size_t i = m_tail;; i = (i + 1) % m_sectors)
+    {
+        esp_err_t err = esp_partition_read(m_partition, i * RAW_SECTOR_SIZE, buffer, RAW_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            free(buffer);
+            return err;
+        }
+        size_t end = walkSector(buffer, records, m_payload_bytes, nullptr, nullptr, skip, remaining, stopped);
+        if (i == m_head)
+        {
+            m_head_offset = end;
+            break;
+        }
+    }
+    free(buffer);
+    m_records = records;
+    ESP_LOGI(RAW_TAG, "%u records in %u sectors", (unsigned)records, (unsigned)sectorsInUse());
+    return ESP_OK;
+}
+
+esp_err_t RawPartitionBackend::mountWal(uint8_t *buffer)
+{
+    m_wal_started = false;
+    m_wal_sector = 0;
+    m_wal_offset = 0;
+    for (size_t i = 0; i < RAW_WAL_SECTORS; ++i)
+    {
+        esp_err_t err = esp_partition_read(m_partition, walAddress(i), buffer, RAW_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        SectorHeader header;
+        memcpy(&header, buffer, sizeof(header));
+        if (header.magic == RAW_WAL_MAGIC && (i == 0 || m_wal_started))
+        {
+            size_t records = 0, payload = 0, skip = 0, remaining = SIZE_MAX;
+            bool stopped = false;
+            m_wal_started = true;
+            m_wal_sector = i;
+            m_wal_offset = walkSector(buffer, records, payload, nullptr, nullptr, skip, remaining, stopped);
+        }
+        else if (header.magic != RAW_ERASED_WORD)
+        {
+            // Not part of the tail log (left by an earlier layout or an interrupted clear).
+            err = esp_partition_erase_range(m_partition, walAddress(i), RAW_SECTOR_SIZE);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t RawPartitionBackend::startSector(size_t index, uint32_t sequence)
+{
+    esp_err_t err = esp_partition_erase_range(m_partition, index * RAW_SECTOR_SIZE, RAW_SECTOR_SIZE);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    SectorHeader header = {.magic = RAW_SECTOR_MAGIC, .sequence = sequence};
+    err = esp_partition_write(m_partition, index * RAW_SECTOR_SIZE, &header, sizeof(header));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    m_head = index;
+    m_head_offset = sizeof(header);
+    m_head_sequence = sequence;
+    return ESP_OK;
+}
+
+esp_err_t RawPartitionBackend::dropOldestSector(bool erase)
+{
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(RAW_SECTOR_SIZE));
+    if (!buffer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = esp_partition_read(m_partition, m_tail * RAW_SECTOR_SIZE, buffer, RAW_SECTOR_SIZE);
+    if (err == ESP_OK)
+    {
+        size_t records = 0, payload = 0, skip = 0, remaining = SIZE_MAX;
+        bool stopped = false;
+        walkSector(buffer, records, payload, nullptr, nullptr, skip, remaining, stopped);
+        m_payload_bytes -= payload < m_payload_bytes ? payload : m_payload_bytes;
+        m_records -= records < m_records ? records : m_records;
+    }
+    free(buffer);
+    if (err == ESP_OK && erase)
+    {
+        err = esp_partition_erase_range(m_partition, m_tail * RAW_SECTOR_SIZE, RAW_SECTOR_SIZE);
+    }
+    if (err == ESP_OK)
+    {
+        m_tail = (m_tail + 1) % m_sectors;
+    }
+    return err;
+}
+
+esp_err_t RawPartitionBackend::doAppend(const void *record, size_t length)
+{
+    if (!m_partition)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t frame_size = sizeof(StorageFrameHeader) + length;
+    if (frame_size > RAW_SECTOR_SIZE - sizeof(SectorHeader))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (m_empty)
+    {
+        err = startSector(0, 1);
+        m_tail = 0;
+        m_empty = err != ESP_OK;
+    }
+    else if (m_head_offset + frame_size > RAW_SECTOR_SIZE)
+    {
+        size_t next = (m_head + 1) % m_sectors;
+        if (next == m_tail)
+        {
+            // Ring full: the oldest sector is reused, startSector erases it.
+            err = dropOldestSector(false);
+            noteRotation();
+        }
+        if (err == ESP_OK)
+        {
+            err = startSector(next, m_head_sequence + 1);
+        }
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // Header first: if power fails mid-payload the length still locates the next frame.
+    StorageFrameHeader header = {.length = static_cast<uint16_t>(length), .crc = frameCrc(record, length)};
+    size_t address = m_head * RAW_SECTOR_SIZE + m_head_offset;
+    m_head_offset += frame_size;
+    err = esp_partition_write(m_partition, address, &header, sizeof(header));
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(m_partition, address + sizeof(header), record, length);
+    }
+    if (err == ESP_OK)
+    {
+        m_payload_bytes += length;
+        m_records++;
+    }
+    return err;
+}
+
+esp_err_t RawPartitionBackend::doRead(size_t first, size_t count, RecordVisitor visitor, void *ctx, size_t &bytes_read)
+{
+    if (m_empty)
+    {
+        return ESP_OK;
+    }
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(RAW_SECTOR_SIZE));
+    if (!buffer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t records = 0, payload = 0, skip = first, remaining = count;
+    bool stopped = false;
+    esp_err_t err = ESP_OK;
+    for (size_t i = m_tail; !stopped; i = (i + 1) % m_sectors)
+    {
+        // Only the written part of the head sector is worth reading.
+        size_t length = i == m_head ? m_head_offset : RAW_SECTOR_SIZE;
+        err = esp_partition_read(m_partition, i * RAW_SECTOR_SIZE, buffer, length);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+        if (length < RAW_SECTOR_SIZE)
+        {
+            memset(buffer + length, 0xFF, RAW_SECTOR_SIZE - length);
+        }
+        bytes_read += length;
+        walkSector(buffer, records, payload, visitor, ctx, skip, remaining, stopped);
+        if (i == m_head)
+        {
+            break;
+        }
+    }
+    free(buffer);
+    return err;
+}
+
+esp_err_t RawPartitionBackend::doTruncate()
+{
+    if (!m_partition)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (size_t n = sectorsInUse(), i = m_tail; n > 0; --n, i = (i + 1) % m_sectors)
+    {
+        esp_err_t err = esp_partition_erase_range(m_partition, i * RAW_SECTOR_SIZE, RAW_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    m_empty = true;
+    m_payload_bytes = 0;
+    m_records = 0;
+    return ESP_OK;
+}
+
+esp_err_t RawPartitionBackend::doRotate()
+{
+    if (m_empty)
+    {
+        return ESP_OK;
+    }
+    if (m_tail == m_head)
+    {
+        return doTruncate();
+    }
+    return dropOldestSector(true);
+}
+
+esp_err_t RawPartitionBackend::doSync()
+{
+    // Every append is already a flash write.
+    return ESP_OK;
+}
+
+size_t RawPartitionBackend::doRecords()
+{
+    return m_records;
+}
+
+esp_err_t RawPartitionBackend::doAppendTail(const void *record, size_t length)
+{
+    if (!m_partition)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t frame_size = sizeof(StorageFrameHeader) + length;
+    if (frame_size > RAW_SECTOR_SIZE - sizeof(SectorHeader))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!m_wal_started || m_wal_offset + frame_size > RAW_SECTOR_SIZE)
+    {
+        size_t next = m_wal_started ? m_wal_sector + 1 : 0;
+        if (next >= RAW_WAL_SECTORS)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        // Sectors past the current one are erased by doClearTail() or on mount.
+        SectorHeader header = {.magic = RAW_WAL_MAGIC, .sequence = 0};
+        esp_err_t err = esp_partition_write(m_partition, walAddress(next), &header, sizeof(header));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        m_wal_started = true;
+        m_wal_sector = next;
+        m_wal_offset = sizeof(header);
+    }
+
+    StorageFrameHeader header = {.length = static_cast<uint16_t>(length), .crc = frameCrc(record, length)};
+    size_t address = walAddress(m_wal_sector) + m_wal_offset;
+    m_wal_offset += frame_size;
+    esp_err_t err = esp_partition_write(m_partition, address, &header, sizeof(header));
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(m_partition, address + sizeof(header), record, length);
+    }
+    return err;
+}
+
+esp_err_t RawPartitionBackend::doReadTail(RecordVisitor visitor, void *ctx)
+{
+    if (!m_wal_started)
+    {
+        return ESP_OK;
+    }
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(RAW_SECTOR_SIZE));
+    if (!buffer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t records = 0, payload = 0, skip = 0, remaining = SIZE_MAX;
+    bool stopped = false;
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i <= m_wal_sector && !stopped; ++i)
+    {
+        err = esp_partition_read(m_partition, walAddress(i), buffer, RAW_SECTOR_SIZE);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+        walkSector(buffer, records, payload, visitor, ctx, skip, remaining, stopped);
+    }
+    free(buffer);
+    return err;
+}
+
+esp_err_t RawPartitionBackend::doClearTail()
+{
+    if (!m_wal_started)
+    {
+        return ESP_OK;
+    }
+    esp_err_t err = esp_partition_erase_range(m_partition, walAddress(0), (m_wal_sector + 1) * RAW_SECTOR_SIZE);
+    if (err == ESP_OK)
+    {
+        m_wal_started = false;
+        m_wal_sector = 0;
+        m_wal_offset = 0;
+    }
+    return err;
+}
+
+void RawPartitionBackend::spaceStats(StorageStats &stats)
+{
+    stats.capacity_bytes = m_sectors * RAW_SECTOR_SIZE;
+    stats.used_bytes = sectorsInUse() * RAW_SECTOR_SIZE;
+    stats.payload_bytes = m_payload_bytes;
+}
@@ -0,0 +1,737 @@
+#include "drivers/RuleEngine.hpp"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/task.h"
+#include "common/TimeBase.hpp"
+#include "drivers/WifiManager.hpp"
+
+static const char *RULES_TAG = "Rules";
+
+// Tokens in the longest rule: device, ':', channel, kind, operator, value, 'for', duration.
+#define RULES_MAX_TOKENS 8
+
+namespace
+{
+    struct RuleChannel
+    {
+        const char *name;
+        float RaptPillData::*member;
+    };
+
+    const RuleChannel rule_channels[] = {
+        {"sg", &RaptPillData::specific_gravity},
+        {"temp", &RaptPillData::temperature_celsius},
+        {"battery", &RaptPillData::battery},
+    };
+    constexpr size_t rule_channel_count = sizeof(rule_channels) / sizeof(rule_channels[0]);
+
+    struct Token
+    {
+        const char *start;
+        size_t length;
+
+        bool is(const char *word) const { return strlen(word) == length && strncmp(start, word, length) == 0; }
+    };
+
+    bool isOperator(char c)
+    {
+        return c == '<' || c == '>' || c == ':';
+    }
+
+    // Split a rule into words, with '<', '>' and ':' as tokens of their own. Returns -1 on a stray character.
+    int tokenize(const char *start, const char *end, Token *tokens, size_t max)
+    {
+        size_t count = 0;
+        const char *p = start;
+        while (p < end)
+        {
+            if (*p == ' ' || *p == '\t')
+            {
+                p++;
+                continue;
+            }
+            if (!isalnum(static_cast<unsigned char>(*p)) && !isOperator(*p) && *p != '.' && *p != '-' && *p != '+')
+            {
+                return -1;
+            }
+            if (count == max)
+            {
+                return static_cast<int>(max) + 1;
+            }
+            const char *word = p++;
+            if (!isOperator(*word))
+            {
+                while (p < end && (isalnum(static_cast<unsigned char>(*p)) || *p == '.' || *p == '-' || *p == '+'))
+                {
+                    p++;
+                }
+            }
+            tokens[count++] = {word, static_cast<size_t>(p - word)};
+        }
+        return static_cast<int>(count);
+    }
+
+    bool parseNumber(const Token &token, float &out)
+    {
+        char text[24];
+        if (token.length >= sizeof(text))
+        {
+            return false;
+        }
+        memcpy(text, token.start, token.length);
+        text[token.length] = '\0';
+        char *end;
+        out = strtof(text, &end);
+        return end != text && *end == '\0' && std::isfinite(out);
+    }
+
+    // A number of seconds, or of minutes, hours or days with an m, h or d suffix.
+    bool parseDuration(const Token &token, uint32_t &out)
+    {
+        static const struct
+        {
+            char suffix;
+            uint32_t seconds;
+        } units[] = {{'s', 1}, {'m', 60}, {'h', 3600}, {'d', 86400}};
+        Token number = token;
+        uint32_t scale = 1;
+        for (const auto &unit : units)
+        {
+            if (token.length > 1 && token.start[token.length - 1] == unit.suffix)
+            {
+                number.length--;
+                scale = unit.seconds;
+            }
+        }
+        float value;
+        if (!parseNumber(number, value) || value < 0 || value * scale > UINT32_MAX)
+        {
+            return false;
+        }
+        out = static_cast<uint32_t>(value * scale);
+        return true;
+    }
+
+    // Slot of a device in the table, adding it if needed; -1 if the id is malformed or the table is full.
+    int deviceSlot(const Token &token, RuleSet &set)
+    {
+        if (token.is("local"))
+        {
+            return 0;
+        }
+        char id[13];
+        if (token.length != sizeof(id) - 1)
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < token.length; ++i)
+        {
+            if (!isxdigit(static_cast<unsigned char>(token.start[i])))
+            {
+                return -1;
+            }
+            id[i] = static_cast<char>(tolower(static_cast<unsigned char>(token.start[i])));
+        }
+        id[token.length] = '\0';
+        if (strcmp(id, WiFiManager::deviceId()) == 0)
+        {
+            return 0;
+        }
+        for (size_t slot = 1; slot < set.device_count; ++slot)
+        {
+            if (strcmp(set.devices[slot], id) == 0)
+            {
+                return static_cast<int>(slot);
+            }
+        }
+        if (set.device_count == RULES_MAX_DEVICES)
+        {
+            return -1;
+        }
+        memcpy(set.devices[set.device_count], id, sizeof(id));
+        return static_cast<int>(set.device_count++);
+    }
+
+    // Compile one rule; returns the reason it does not, or nullptr.
+    const char *compileRule(const Token *tokens, int count, RuleSet &set, Rule &rule)
+    {
+        rule = {};
+        int next = 0;
+        if (count >= 2 && tokens[1].is(":"))
+        {
+            int slot = deviceSlot(tokens[0], set);
+            if (slot < 0)
+            {
+                return "unknown device id or too many devices";
+            }
+            rule.device = static_cast<uint8_t>(slot);
+            next = 2;
+        }
+
+        if (next == count)
+        {
+            return "missing channel";
+        }
+        size_t channel = 0;
+        while (channel < rule_channel_count && !tokens[next].is(rule_channels[channel].name))
+        {
+            channel++;
+        }
+        if (channel == rule_channel_count)
+        {
+            return "unknown channel; use sg, temp or battery";
+        }
+        rule.channel = static_cast<uint8_t>(channel);
+        next++;
+
+        rule.kind = RuleKind::Threshold;
+        if (next < count && tokens[next].is("rate"))
+        {
+            rule.kind = RuleKind::Rate;
+            rule.duration_s = RULES_DEFAULT_RATE_WINDOW_S;
+            next++;
+        }
+        else if (next < count && tokens[next].is("stable"))
+        {
+            rule.kind = RuleKind::Stable;
+            next++;
+        }
+
+        if (rule.kind != RuleKind::Stable)
+        {
+            if (next == count || !(tokens[next].is(">") || tokens[next].is("<")))
+            {
+                return "expected > or <";
+            }
+            rule.above = tokens[next].is(">");
+            next++;
+        }
+        if (next == count || !parseNumber(tokens[next], rule.value))
+        {
+            return "expected a number";
+        }
+        if (rule.kind == RuleKind::Stable && rule.value <= 0)
+        {
+            return "the band of a stable rule must be positive";
+        }
+        next++;
+
+        if (next < count && tokens[next].is("for"))
+        {
+            if (next + 1 == count || !parseDuration(tokens[next + 1], rule.duration_s))
+            {
+                return "expected a duration such as 30m or 24h";
+            }
+            next += 2;
+        }
+        else if (rule.kind == RuleKind::Stable)
+        {
+            return "a stable rule needs 'for' and a duration";
+        }
+        if (rule.kind == RuleKind::Rate && rule.duration_s == 0)
+        {
+            return "the window of a rate rule must be positive";
+        }
+        return next == count ? nullptr : "unexpected text after the rule";
+    }
+}
+
+RuleEngine &RuleEngine::instance()
+{
+    static RuleEngine engine;
+    return engine;
+}
+
+RuleEngine::RuleEngine()
+{
+    m_mutex = xSemaphoreCreateMutex();
+    m_config_mutex = xSemaphoreCreateMutex();
+    m_set.device_count = 1;
+}
+
+esp_err_t RuleEngine::compile(const char *text, RuleSet &out, char *error, size_t error_size)
+{
+    out.count = 0;
+    out.device_count = 1;
+    memset(out.devices[0], 0, sizeof(out.devices[0]));
+    size_t length = strlen(text);
+    if (length >= RULES_TEXT_MAX)
+    {
+        snprintf(error, error_size, "Rules are longer than %d bytes", RULES_TEXT_MAX - 1);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    unsigned line = 0;
+    for (const char *start = text; start < text + length;)
+    {
+        const char *end = strchr(start, '\n');
+        end = end ? end : text + length;
+        line++;
+        // Trim, so the stored condition is what is shown.
+        const char *first = start;
+        const char *last = end;
+        while (first < last && isspace(static_cast<unsigned char>(*first)))
+        {
+            first++;
+        }
+        while (last > first && isspace(static_cast<unsigned char>(last[-1])))
+        {
+            last--;
+        }
+        start = end + 1;
+        if (first == last)
+        {
+            continue;
+        }
+
+        Token tokens[RULES_MAX_TOKENS];
+        int count = tokenize(first, last, tokens, RULES_MAX_TOKENS);
+        const char *reason = nullptr;
+        if (out.count == RULES_MAX)
+        {
+            reason = "too many rules";
+        }
+        else if (last - first >= RULES_RULE_TEXT_MAX)
+        {
+            reason = "rule is too long";
+        }
+        else if (count < 0)
+        {
+            reason = "unexpected character";
+        }
+        else if (count > RULES_MAX_TOKENS)
+        {
+            reason = "unexpected text after the rule";
+        }
+        else
+        {
+            reason = compileRule(tokens, count, out, out.rules[out.count]);
+        }
+        if (reason)
+        {
+            snprintf(error, error_size, "Line %u: %s", line, reason);
+            return ESP_ERR_INVALID_ARG;
+        }
+        out.spans[out.count][0] = static_cast<uint16_t>(first - text);
+        out.spans[out.count][1] = static_cast<uint16_t>(last - first);
+        out.count++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t RuleEngine::start()
+{
+    m_alerts = xQueueCreate(RULES_ALERT_QUEUE, sizeof(RuleAlert));
+    if (!m_alerts)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    char *text = static_cast<char *>(calloc(1, RULES_TEXT_MAX));
+    char webhook[RULES_WEBHOOK_MAX] = {};
+    if (!text)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    nvs_handle_t handle;
+    if (nvs_open(RULES_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        size_t size = RULES_TEXT_MAX;
+        if (nvs_get_str(handle, RULES_NVS_TEXT_KEY, text, &size) != ESP_OK)
+        {
+            text[0] = '\0';
+        }
+        size = sizeof(webhook);
+        if (nvs_get_str(handle, RULES_NVS_WEBHOOK_KEY, webhook, &size) != ESP_OK)
+        {
+            webhook[0] = '\0';
+        }
+        nvs_close(handle);
+    }
+
+    xSemaphoreTake(m_config_mutex, portMAX_DELAY);
+    char error[64];
+    esp_err_t err = compile(text, m_staging, error, sizeof(error));
+    if (err == ESP_OK)
+    {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        m_set = m_staging;
+        memcpy(m_text, text, RULES_TEXT_MAX);
+        memcpy(m_webhook, webhook, sizeof(m_webhook));
+        m_stats.rules = m_set.count;
+        xSemaphoreGive(m_mutex);
+        ESP_LOGI(RULES_TAG, "%u rules loaded", static_cast<unsigned>(m_set.count));
+    }
+    else
+    {
+        // Written by configure(), which only stores rules that compile; firmware may have changed since.
+        ESP_LOGE(RULES_TAG, "Stored rules do not compile: %s", error);
+    }
+    xSemaphoreGive(m_config_mutex);
+    free(text);
+
+    if (xTaskCreate(&RuleEngine::task, "rules", RULES_TASK_STACK, this, RULES_TASK_PRIORITY, nullptr) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t RuleEngine::configure(const char *text, const char *webhook)
+{
+    if (strlen(webhook) >= RULES_WEBHOOK_MAX ||
+        (webhook[0] && strncmp(webhook, "http://", 7) != 0 && strncmp(webhook, "https://", 8) != 0))
+    {
+        snprintf(m_error, sizeof(m_error), "The webhook must be an http:// or https:// URL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(m_config_mutex, portMAX_DELAY);
+    esp_err_t err = compile(text, m_staging, m_error, sizeof(m_error));
+    if (err != ESP_OK)
+    {
+        xSemaphoreGive(m_config_mutex);
+        return err;
+    }
+
+    nvs_handle_t handle;
+    err = nvs_open(RULES_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_str(handle, RULES_NVS_TEXT_KEY, text);
+        if (err == ESP_OK)
+        {
+            err = nvs_set_str(handle, RULES_NVS_WEBHOOK_KEY, webhook);
+        }
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        snprintf(m_error, sizeof(m_error), "Failed to store the rules");
+        xSemaphoreGive(m_config_mutex);
+        return err;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_set = m_staging;
+    memset(m_states, 0, sizeof(m_states));
+    strncpy(m_text, text, sizeof(m_text));
+    strncpy(m_webhook, webhook, sizeof(m_webhook));
+    m_stats.rules = m_set.count;
+    m_stats.evaluation = {};
+    xSemaphoreGive(m_mutex);
+    xSemaphoreGive(m_config_mutex);
+    ESP_LOGI(RULES_TAG, "%u rules configured", static_cast<unsigned>(m_set.count));
+    return ESP_OK;
+}
+
+void RuleEngine::evaluate(const char *device, const RaptPillData &sample)
+{
+    int64_t start_us = esp_timer_get_time();
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    if (m_set.count == 0)
+    {
+        xSemaphoreGive(m_mutex);
+        return;
+    }
+    size_t slot = 0;
+    if (device && device[0])
+    {
+        slot = 1;
+        while (slot < m_set.device_count && strcmp(m_set.devices[slot], device) != 0)
+        {
+            slot++;
+        }
+    }
+    if (slot < m_set.device_count)
+    {
+        for (size_t i = 0; i < m_set.count; ++i)
+        {
+            const Rule &rule = m_set.rules[i];
+            if (rule.device != slot)
+            {
+                continue;
+            }
+            RuleState &state = m_states[i];
+            float reported;
+            bool active = step(rule, state, sample, reported);
+            if (active != state.active)
+            {
+                state.active = active;
+                state.fired += active ? 1 : 0;
+                raise(i, active, reported, device, sample);
+            }
+        }
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    LatencyStat &stat = m_stats.evaluation;
+    stat.count++;
+    stat.total_us += elapsed_us;
+    stat.max_us = elapsed_us > stat.max_us ? elapsed_us : stat.max_us;
+    xSemaphoreGive(m_mutex);
+}
+
+bool RuleEngine::step(const Rule &rule, RuleState &state, const RaptPillData &sample, float &reported)
+{
+    float value = sample.*rule_channels[rule.channel].member;
+    reported = value;
+    if (std::isnan(value))
+    {
+        return state.active;
+    }
+
+    // Durations are measured on sample time, which starts over with every boot.
+    if (!state.primed || sample.boot_id != state.boot_id || sample.timestamp < state.last_timestamp)
+    {
+        state.primed = true;
+        state.boot_id = sample.boot_id;
+        state.last_timestamp = sample.timestamp;
+        state.last_value = value;
+        state.rate = 0.0f;
+        state.low = value;
+        state.high = value;
+        state.holding = false;
+        state.since_timestamp = sample.timestamp;
+    }
+
+    int64_t elapsed = sample.timestamp - state.last_timestamp;
+    bool condition = state.active;
+    switch (rule.kind)
+    {
+    case RuleKind::Threshold:
+        condition = rule.above ? value > rule.value : value < rule.value;
+        if (condition && !state.holding)
+        {
+            state.since_timestamp = sample.timestamp;
+        }
+        state.holding = condition;
+        condition = condition && sample.timestamp - state.since_timestamp >= rule.duration_s;
+        break;
+    case RuleKind::Rate:
+        // An exponential average over the window needs one value per sample; holding marks it as seeded.
+        if (elapsed > 0)
+        {
+            float per_hour = (value - state.last_value) * 3600.0f / elapsed;
+            float weight = static_cast<float>(elapsed) / (rule.duration_s + elapsed);
+            state.rate = state.holding ? state.rate + weight * (per_hour - state.rate) : per_hour;
+            state.holding = true;
+        }
+        reported = state.rate;
+        if (state.holding)
+        {
+            condition = rule.above ? state.rate > rule.value : state.rate < rule.value;
+        }
+        break;
+    case RuleKind::Stable:
+        state.low = value < state.low ? value : state.low;
+        state.high = value > state.high ? value : state.high;
+        if (state.high - state.low > rule.value)
+        {
+            // Left the band; a new one starts around this sample.
+            state.low = value;
+            state.high = value;
+            state.since_timestamp = sample.timestamp;
+        }
+        condition = sample.timestamp - state.since_timestamp >= rule.duration_s;
+        break;
+    }
+    state.last_timestamp = sample.timestamp;
+    state.last_value = value;
+    return condition;
+}
+
+void RuleEngine::raise(size_t index, bool active, float value, const char *device, const RaptPillData &sample)
+{
+    RuleAlert alert = {};
+    alert.sequence = ++m_sequence;
+    alert.rule = static_cast<uint8_t>(index);
+    alert.active = active;
+    snprintf(alert.device, sizeof(alert.device), "%s", device ? device : "");
+    snprintf(alert.condition, sizeof(alert.condition), "%.*s", m_set.spans[index][1], m_text + m_set.spans[index][0]);
+    alert.value = value;
+    alert.boot_id = sample.boot_id;
+    alert.timestamp = sample.timestamp;
+    m_stats.alerts++;
+    // Ingest never waits for the alert task; a burst beyond the queue is counted instead.
+    if (!m_alerts || xQueueSend(m_alerts, &alert, 0) != pdTRUE)
+    {
+        m_stats.dropped_alerts++;
+    }
+}
+
+void RuleEngine::task(void *param)
+{
+    RuleEngine *self = static_cast<RuleEngine *>(param);
+    RuleAlert alert;
+    while (true)
+    {
+        if (xQueueReceive(self->m_alerts, &alert, portMAX_DELAY) == pdTRUE)
+        {
+            self->deliver(alert);
+        }
+    }
+}
+
+void RuleEngine::deliver(RuleAlert &alert)
+{
+    int64_t offset;
+    if (alert.boot_id == 0)
+    {
+        alert.resolved = true;
+    }
+    else if (TimeBase::offsetFor(alert.boot_id, offset))
+    {
+        alert.timestamp += offset;
+        alert.resolved = true;
+    }
+    ESP_LOGI(RULES_TAG, "%s %s%s%s", alert.active ? "Fired" : "Cleared", alert.condition, alert.device[0] ? " on " : "",
+             alert.device);
+
+    char webhook[RULES_WEBHOOK_MAX];
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_recent[m_recent_head] = alert;
+    m_recent_head = (m_recent_head + 1) % RULES_RECENT_ALERTS;
+    m_recent_count += m_recent_count < RULES_RECENT_ALERTS ? 1 : 0;
+    memcpy(webhook, m_webhook, sizeof(webhook));
+    Subscriber listeners[RULES_MAX_LISTENERS];
+    memcpy(listeners, m_listeners, sizeof(listeners));
+    xSemaphoreGive(m_mutex);
+
+    for (const Subscriber &subscriber : listeners)
+    {
+        if (subscriber.listener)
+        {
+            subscriber.listener(alert, subscriber.ctx);
+        }
+    }
+    if (webhook[0])
+    {
+        esp_err_t err = post(alert, webhook);
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        if (err == ESP_OK)
+        {
+            m_stats.webhook_sent++;
+        }
+        else
+        {
+            m_stats.webhook_failures++;
+            m_stats.webhook_error = err;
+        }
+        xSemaphoreGive(m_mutex);
+    }
+}
+
+int RuleEngine::format(const RuleAlert &alert, char *out, size_t size)
+{
+    // Conditions only hold characters the rule tokenizer accepts, so they need no escaping.
+    char timestamp[24];
+    snprintf(timestamp, sizeof(timestamp), alert.resolved ? "%lld" : "null", static_cast<long long>(alert.timestamp));
+    return snprintf(out, size,
+                    "{\"sequence\":%lu,\"rule\":%u,\"condition\":\"%s\",\"event\":\"%s\",\"device\":\"%s\","
+                    "\"value\":%.4f,\"timestamp\":%s}",
+                    static_cast<unsigned long>(alert.sequence), alert.rule, alert.condition,
+                    alert.active ? "fired" : "cleared", alert.device[0] ? alert.device : WiFiManager::deviceId(),
+                    alert.value, timestamp);
+}
+
+esp_err_t RuleEngine::post(const RuleAlert &alert, const char *url)
+{
+    char body[RULES_ALERT_JSON_MAX];
+    int length = format(alert, body, sizeof(body));
+    esp_http_client_config_t config = {};
+    config.url = url;
+    config.method = HTTP_METHOD_POST;
+    config.timeout_ms = RULES_WEBHOOK_TIMEOUT_MS;
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+    esp_http_client_set_header(client, "X-RaptMate-Device", WiFiManager::deviceId());
+    esp_http_client_set_post_field(client, body, length);
+    esp_err_t err = esp_http_client_perform(client);
+    if (err == ESP_OK)
+    {
+        int status = esp_http_client_get_status_code(client);
+        if (status < 200 || status >= 300)
+        {
+            ESP_LOGW(RULES_TAG, "Webhook answered %d", status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    else
+    {
+        ESP_LOGW(RULES_TAG, "Webhook failed: %s", esp_err_to_name(err));
+    }
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+bool RuleEngine::rule(size_t index, char *condition, RuleState &state)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool found = index < m_set.count;
+    if (found)
+    {
+        snprintf(condition, RULES_RULE_TEXT_MAX, "%.*s", m_set.spans[index][1], m_text + m_set.spans[index][0]);
+        state = m_states[index];
+    }
+    xSemaphoreGive(m_mutex);
+    return found;
+}
+
+void RuleEngine::webhook(char *out)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    memcpy(out, m_webhook, RULES_WEBHOOK_MAX);
+    xSemaphoreGive(m_mutex);
+}
+
+size_t RuleEngine::recentAlerts(RuleAlert *out, size_t max)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t count = m_recent_count < max ? m_recent_count : max;
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = m_recent[(m_recent_head + RULES_RECENT_ALERTS - 1 - i) % RULES_RECENT_ALERTS];
+    }
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+RuleEngineStats RuleEngine::stats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    RuleEngineStats stats = m_stats;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
+
+esp_err_t RuleEngine::subscribe(Listener listener, void *ctx)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    for (Subscriber &slot : m_listeners)
+    {
+        if (slot.listener == nullptr)
+        {
+            slot = {listener, ctx};
+            xSemaphoreGive(m_mutex);
+            return ESP_OK;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    ESP_LOGE(RULES_TAG, "Too many alert listeners");
+    return ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,263 @@
+#include "common/Settings.hpp"
+#include "drivers/PowerManager.hpp"
+#include "drivers/Uplink.hpp"
+#include "drivers/Collector.hpp"
+#include <atomic>
+#include <cstring>
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *SETTINGS_TAG = "Settings";
+
+namespace
+{
+    struct ListenerSlot
+    {
+        uint32_t groups;
+        SettingsStore::Listener listener;
+        void *ctx;
+    };
+
+    Settings cached = {};
+    // Odd while a write is in progress (seqlock).
+    std::atomic<uint32_t> sequence{0};
+    SemaphoreHandle_t write_mutex = nullptr;
+    ListenerSlot listeners[SETTINGS_MAX_LISTENERS] = {};
+    const char *last_error = "";
+
+    void publish(const Settings &next)
+    {
+        sequence.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_release);
+        cached = next;
+        std::atomic_thread_fence(std::memory_order_release);
+        sequence.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+Settings SettingsStore::defaults()
+{
+    Settings settings = {};
+    settings.version = SETTINGS_VERSION;
+    settings.scan_interval = 10;
+    settings.scan_window = 5;
+    settings.history_max_records = 0;
+    settings.power_profile = static_cast<uint8_t>(PowerProfile::Balanced);
+    // Below the pill's own resolution jitter, so flat stretches collapse to their end points.
+    settings.deadband_gravity_velocity = 50;
+    settings.deadband_temperature = 10;
+    settings.deadband_specific_gravity = 2;
+    settings.deadband_accel = 50;
+    settings.deadband_battery = 100;
+    settings.history_heartbeat_s = 15 * 60;
+    settings.uplink_mode = static_cast<uint8_t>(UplinkMode::Off);
+    strcpy(settings.uplink_topic, "raptmate/history");
+    return settings;
+}
+
+void SettingsStore::init()
+{
+    write_mutex = xSemaphoreCreateMutex();
+    Settings loaded = defaults();
+
+    nvs_handle_t handle;
+    if (nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        Settings stored = defaults();
+        size_t size = sizeof(stored);
+        if (nvs_get_blob(handle, SETTINGS_NVS_KEY, &stored, &size) == ESP_OK &&
+            size >= SETTINGS_MIN_BLOB_SIZE && stored.version == SETTINGS_VERSION && validate(stored))
+        {
+            loaded = stored;
+        }
+        else
+        {
+            ESP_LOGW(SETTINGS_TAG, "No valid stored settings, using defaults");
+        }
+        nvs_close(handle);
+    }
+    publish(loaded);
+}
+
+Settings SettingsStore::get()
+{
+    Settings snapshot;
+    uint32_t before, after;
+    do
+    {
+        before = sequence.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        snapshot = cached;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_acquire);
+    } while ((before & 1) || before != after);
+    return snapshot;
+}
+
+uint32_t SettingsStore::diff(const Settings &a, const Settings &b)
+{
+    uint32_t changed = 0;
+    if (strcmp(a.wifi_ssid, b.wifi_ssid) != 0 || strcmp(a.wifi_password, b.wifi_password) != 0)
+    {
+        changed |= SETTINGS_WIFI;
+    }
+    if (a.scan_interval != b.scan_interval || a.scan_window != b.scan_window)
+    {
+        changed |= SETTINGS_SCAN;
+    }
+    if (a.history_max_records != b.history_max_records)
+    {
+        changed |= SETTINGS_RETENTION;
+    }
+    if (a.power_profile != b.power_profile)
+    {
+        changed |= SETTINGS_POWER;
+    }
+    if (a.deadband_gravity_velocity != b.deadband_gravity_velocity || a.deadband_temperature != b.deadband_temperature ||
+        a.deadband_specific_gravity != b.deadband_specific_gravity || a.deadband_accel != b.deadband_accel ||
+        a.deadband_battery != b.deadband_battery || a.history_heartbeat_s != b.history_heartbeat_s)
+    {
+        changed |= SETTINGS_DEADBAND;
+    }
+    if (a.uplink_mode != b.uplink_mode || strcmp(a.uplink_url, b.uplink_url) != 0 ||
+        strcmp(a.uplink_topic, b.uplink_topic) != 0)
+    {
+        changed |= SETTINGS_UPLINK;
+    }
+    if (a.collector_enabled != b.collector_enabled || strcmp(a.collector_peers, b.collector_peers) != 0)
+    {
+        changed |= SETTINGS_COLLECTOR;
+    }
+    return changed;
+}
+
+bool SettingsStore::validate(const Settings &settings)
+{
+    size_t ssid_len = strnlen(settings.wifi_ssid, sizeof(settings.wifi_ssid));
+    size_t password_len = strnlen(settings.wifi_password, sizeof(settings.wifi_password));
+    if (ssid_len == sizeof(settings.wifi_ssid) || password_len == sizeof(settings.wifi_password))
+    {
+        last_error = "SSID or password not terminated";
+        return false;
+    }
+    if (password_len != 0 && password_len < 8)
+    {
+        last_error = "Password too short (min 8 chars)";
+        return false;
+    }
+    // BLE allows 2.5 ms to 10.24 s, and the window must fit in the interval.
+    if (settings.scan_interval < 4 || settings.scan_interval > 16384 ||
+        settings.scan_window < 4 || settings.scan_window > settings.scan_interval)
+    {
+        last_error = "Scan window must be within 2.5 ms and the scan interval";
+        return false;
+    }
+    if (settings.power_profile >= POWER_PROFILE_COUNT)
+    {
+        last_error = "Unknown power profile";
+        return false;
+    }
+    if (settings.uplink_mode >= UPLINK_MODE_COUNT)
+    {
+        last_error = "Unknown uplink mode";
+        return false;
+    }
+    if (strnlen(settings.uplink_url, sizeof(settings.uplink_url)) == sizeof(settings.uplink_url) ||
+        strnlen(settings.uplink_topic, sizeof(settings.uplink_topic)) == sizeof(settings.uplink_topic))
+    {
+        last_error = "Uplink URL or topic not terminated";
+        return false;
+    }
+    if (!Uplink::validUrl(static_cast<UplinkMode>(settings.uplink_mode), settings.uplink_url))
+    {
+        last_error = "Uplink URL must be mqtt:// or mqtts:// for MQTT, http:// or https:// for a webhook";
+        return false;
+    }
+    if (settings.uplink_mode == static_cast<uint8_t>(UplinkMode::Mqtt) && settings.uplink_topic[0] == '\0')
+    {
+        last_error = "MQTT uplink needs a topic";
+        return false;
+    }
+    if (strnlen(settings.collector_peers, sizeof(settings.collector_peers)) == sizeof(settings.collector_peers) ||
+        Collector::parsePeers(settings.collector_peers, nullptr, COLLECTOR_MAX_STATIC_PEERS) < 0)
+    {
+        last_error = "Collector peers must be a comma separated list of host[:port], at most 8";
+        return false;
+    }
+    return true;
+}
+
+esp_err_t SettingsStore::update(const Settings &requested)
+{
+    Settings next = requested;
+    next.version = SETTINGS_VERSION;
+    if (!validate(next))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(write_mutex, portMAX_DELAY);
+    uint32_t changed = diff(get(), next);
+    if (changed == 0)
+    {
+        xSemaphoreGive(write_mutex);
+        return ESP_OK;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, SETTINGS_NVS_KEY, &next, sizeof(next));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        xSemaphoreGive(write_mutex);
+        ESP_LOGE(SETTINGS_TAG, "Failed to persist settings: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    publish(next);
+    ListenerSlot to_notify[SETTINGS_MAX_LISTENERS];
+    memcpy(to_notify, listeners, sizeof(listeners));
+    xSemaphoreGive(write_mutex);
+
+    ESP_LOGI(SETTINGS_TAG, "Settings updated (changed groups 0x%lx)", static_cast<unsigned long>(changed));
+    for (const ListenerSlot &slot : to_notify)
+    {
+        if (slot.listener && (slot.groups & changed))
+        {
+            slot.listener(next, changed, slot.ctx);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t SettingsStore::subscribe(uint32_t groups, Listener listener, void *ctx)
+{
+    xSemaphoreTake(write_mutex, portMAX_DELAY);
+    for (ListenerSlot &slot : listeners)
+    {
+        if (slot.listener == nullptr)
+        {
+            slot = {groups, listener, ctx};
+            xSemaphoreGive(write_mutex);
+            return ESP_OK;
+        }
+    }
+    xSemaphoreGive(write_mutex);
+    ESP_LOGE(SETTINGS_TAG, "Too many settings listeners");
+    return ESP_ERR_NO_MEM;
+}
+
+const char *SettingsStore::lastError()
+{
+    return last_error;
+}
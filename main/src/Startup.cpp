@@ -0,0 +1,193 @@
+#include "common/Startup.hpp"
+#include <atomic>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+static const char *STARTUP_TAG = "Startup";
+
+// Event bits: a stage's ready bit is set on success, its done bit once it finished either way.
+#define STARTUP_DONE_SHIFT 12
+static_assert(STARTUP_STAGE_COUNT <= STARTUP_DONE_SHIFT, "Ready bits would overlap the done bits");
+static_assert(STARTUP_DONE_SHIFT + STARTUP_STAGE_COUNT <= 24, "Event groups hold 24 bits");
+
+namespace
+{
+    struct Stage
+    {
+        const char *name;
+        uint32_t depends;
+        uint32_t after;
+        Startup::StageFn fn;
+        void *ctx;
+        bool defined;
+        StageReport report;
+    };
+
+    portMUX_TYPE stage_lock = portMUX_INITIALIZER_UNLOCKED;
+    Stage stages[STARTUP_STAGE_COUNT] = {};
+    EventGroupHandle_t events = nullptr;
+    uint32_t defined_mask = 0;
+
+    std::atomic<int64_t> milestones[STARTUP_MILESTONE_COUNT] = {{-1}, {-1}};
+
+    void finish(size_t index, StageState state, esp_err_t err)
+    {
+        portENTER_CRITICAL(&stage_lock);
+        stages[index].report.state = state;
+        stages[index].report.err = err;
+        stages[index].report.end_us = esp_timer_get_time();
+        portEXIT_CRITICAL(&stage_lock);
+        EventBits_t bits = 1u << (index + STARTUP_DONE_SHIFT);
+        if (state == StageState::Ready)
+        {
+            bits |= 1u << index;
+        }
+        xEventGroupSetBits(events, bits);
+    }
+}
+
+void Startup::define(StartupStage stage, const char *name, uint32_t depends, StageFn fn, void *ctx,
+                     uint32_t after)
+{
+    size_t index = static_cast<size_t>(stage);
+    stages[index] = {
+        .name = name,
+        .depends = depends,
+        .after = after,
+        .fn = fn,
+        .ctx = ctx,
+        .defined = true,
+        .report = {.name = name, .state = StageState::Pending, .start_us = -1, .end_us = -1, .err = ESP_OK},
+    };
+    defined_mask |= bit(stage);
+}
+
+void Startup::run()
+{
+    events = xEventGroupCreate();
+    for (size_t i = 0; i < STARTUP_STAGE_COUNT; ++i)
+    {
+        if (!stages[i].defined)
+        {
+            continue;
+        }
+        if ((stages[i].depends | stages[i].after) & ~defined_mask)
+        {
+            ESP_LOGE(STARTUP_TAG, "Stage %s depends on a stage that is not defined", stages[i].name);
+            finish(i, StageState::Skipped, ESP_ERR_INVALID_STATE);
+            continue;
+        }
+        if (xTaskCreate(&Startup::stageTask, stages[i].name, STARTUP_STAGE_STACK, &stages[i],
+                        STARTUP_STAGE_PRIORITY, nullptr) != pdPASS)
+        {
+            ESP_LOGE(STARTUP_TAG, "Failed to start stage %s", stages[i].name);
+            finish(i, StageState::Failed, ESP_ERR_NO_MEM);
+        }
+    }
+}
+
+void Startup::stageTask(void *param)
+{
+    Stage &stage = *static_cast<Stage *>(param);
+    size_t index = &stage - stages;
+    uint32_t waits = stage.depends | stage.after;
+    if (waits)
+    {
+        xEventGroupWaitBits(events, waits << STARTUP_DONE_SHIFT, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    if (!ready(stage.depends))
+    {
+        ESP_LOGW(STARTUP_TAG, "Skipping %s, a dependency failed", stage.name);
+        finish(index, StageState::Skipped, ESP_ERR_INVALID_STATE);
+        vTaskDelete(nullptr);
+        return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stage_lock);
+    stage.report.state = StageState::Running;
+    stage.report.start_us = start_us;
+    portEXIT_CRITICAL(&stage_lock);
+
+    esp_err_t err = stage.fn(stage.ctx);
+    int64_t end_us = esp_timer_get_time();
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(STARTUP_TAG, "%s ready after %lld ms (took %lld ms)", stage.name, end_us / 1000,
+                 (end_us - start_us) / 1000);
+    }
+    else
+    {
+        ESP_LOGE(STARTUP_TAG, "%s failed: %s", stage.name, esp_err_to_name(err));
+    }
+    finish(index, err == ESP_OK ? StageState::Ready : StageState::Failed, err);
+
+    if (complete())
+    {
+        ESP_LOGI(STARTUP_TAG, "Startup complete after %lld ms", end_us / 1000);
+    }
+    vTaskDelete(nullptr);
+}
+
+bool Startup::ready(uint32_t mask)
+{
+    if (mask == 0)
+    {
+        return true;
+    }
+    if (!events)
+    {
+        return false;
+    }
+    return (xEventGroupGetBits(events) & mask) == mask;
+}
+
+bool Startup::complete()
+{
+    return ready(defined_mask);
+}
+
+StageReport Startup::report(StartupStage stage)
+{
+    portENTER_CRITICAL(&stage_lock);
+    StageReport report = stages[static_cast<size_t>(stage)].report;
+    portEXIT_CRITICAL(&stage_lock);
+    return report;
+}
+
+const char *Startup::stateName(StageState state)
+{
+    switch (state)
+    {
+    case StageState::Pending:
+        return "pending";
+    case StageState::Running:
+        return "running";
+    case StageState::Ready:
+        return "ready";
+    case StageState::Failed:
+        return "failed";
+    case StageState::Skipped:
+        return "skipped";
+    }
+    return "unknown";
+}
+
+void Startup::reach(StartupMilestone milestone)
+{
+    int64_t unset = -1;
+    int64_t now = esp_timer_get_time();
+    if (milestones[static_cast<size_t>(milestone)].compare_exchange_strong(unset, now, std::memory_order_relaxed))
+    {
+        ESP_LOGI(STARTUP_TAG, "%s after %lld ms",
+                 milestone == StartupMilestone::FirstSample ? "First sample" : "First HTTP response", now / 1000);
+    }
+}
+
+int64_t Startup::milestone(StartupMilestone milestone)
+{
+    return milestones[static_cast<size_t>(milestone)].load(std::memory_order_relaxed);
+}
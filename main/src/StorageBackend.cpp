@@ -0,0 +1,174 @@
+#include "storage/StorageBackend.hpp"
+#include "storage/FileBackend.hpp"
+#include "storage/RawPartitionBackend.hpp"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *STORAGE_TAG = "Storage";
+
+// Partition and mount point shared by all backends.
+#define STORAGE_PARTITION_LABEL "data"
+#define STORAGE_BASE_PATH "/data"
+
+StorageBackend::StorageBackend()
+{
+    m_mutex = xSemaphoreCreateMutex();
+}
+
+StorageBackend &StorageBackend::configured()
+{
+#if CONFIG_RAPTMATE_STORAGE_LITTLEFS
+    static LittleFsBackend backend(STORAGE_BASE_PATH, STORAGE_PARTITION_LABEL);
+#elif CONFIG_RAPTMATE_STORAGE_RAW
+    static RawPartitionBackend backend(STORAGE_PARTITION_LABEL);
+#else
+    static SpiffsBackend backend(STORAGE_BASE_PATH, STORAGE_PARTITION_LABEL);
+#endif
+    return backend;
+}
+
+uint16_t StorageBackend::frameCrc(const void *data, size_t length)
+{
+    return esp_rom_crc16_le(0, static_cast<const uint8_t *>(data), length);
+}
+
+esp_err_t StorageBackend::mount()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doMount();
+    xSemaphoreGive(m_mutex);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(STORAGE_TAG, "Failed to mount %s storage: %s", name(), esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(STORAGE_TAG, "History stored on %s", name());
+    return ESP_OK;
+}
+
+esp_err_t StorageBackend::append(const void *record, size_t length)
+{
+    if (length == 0 || length > STORAGE_MAX_RECORD)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = doAppend(record, length);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    if (err == ESP_OK)
+    {
+        m_stats.appends++;
+        size_t bucket = 0;
+        while (bucket < STORAGE_LATENCY_BUCKETS - 1 && elapsed_us >= (static_cast<int64_t>(STORAGE_LATENCY_BASE_US) << bucket))
+        {
+            bucket++;
+        }
+        m_stats.append_latency[bucket]++;
+        if (elapsed_us > m_stats.append_max_us)
+        {
+            m_stats.append_max_us = elapsed_us;
+        }
+    }
+    else
+    {
+        m_stats.append_errors++;
+    }
+    xSemaphoreGive(m_mutex);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(STORAGE_TAG, "Append to %s failed: %s", name(), esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t StorageBackend::read(size_t first, size_t count, RecordVisitor visitor, void *ctx)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    size_t bytes_read = 0;
+    esp_err_t err = doRead(first, count, visitor, ctx, bytes_read);
+    m_stats.read_us += esp_timer_get_time() - start_us;
+    m_stats.bytes_read += bytes_read;
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t StorageBackend::truncate()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doTruncate();
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t StorageBackend::rotate()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doRotate();
+    if (err == ESP_OK)
+    {
+        noteRotation();
+    }
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t StorageBackend::sync()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doSync();
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+size_t StorageBackend::records()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    size_t count = doRecords();
+    xSemaphoreGive(m_mutex);
+    return count;
+}
+
+esp_err_t StorageBackend::appendTail(const void *record, size_t length)
+{
+    if (length == 0 || length > STORAGE_MAX_RECORD)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doAppendTail(record, length);
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t StorageBackend::readTail(RecordVisitor visitor, void *ctx)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doReadTail(visitor, ctx);
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+esp_err_t StorageBackend::clearTail()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    esp_err_t err = doClearTail();
+    xSemaphoreGive(m_mutex);
+    return err;
+}
+
+StorageStats StorageBackend::stats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    StorageStats copy = m_stats;
+    copy.backend = name();
+    spaceStats(copy);
+    xSemaphoreGive(m_mutex);
+    return copy;
+}
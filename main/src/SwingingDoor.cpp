@@ -0,0 +1,133 @@
+#include "common/SwingingDoor.hpp"
+#include <cfloat>
+
+namespace
+{
+    struct Channel
+    {
+        float RaptPillData::*value;
+        float DeadbandConfig::*deadband;
+    };
+
+    const Channel channels[SWINGING_DOOR_CHANNELS] = {
+        {&RaptPillData::gravity_velocity, &DeadbandConfig::gravity_velocity},
+        {&RaptPillData::temperature_celsius, &DeadbandConfig::temperature},
+        {&RaptPillData::specific_gravity, &DeadbandConfig::specific_gravity},
+        {&RaptPillData::accel_x, &DeadbandConfig::accel},
+        {&RaptPillData::accel_y, &DeadbandConfig::accel},
+        {&RaptPillData::accel_z, &DeadbandConfig::accel},
+        {&RaptPillData::battery, &DeadbandConfig::battery},
+    };
+}
+
+void SwingingDoor::reset()
+{
+    m_has_origin = false;
+    m_has_held = false;
+}
+
+void SwingingDoor::restart(const RaptPillData &stored)
+{
+    open(stored);
+}
+
+void SwingingDoor::open(const RaptPillData &origin)
+{
+    m_origin = origin;
+    m_has_origin = true;
+    m_has_held = false;
+    for (int c = 0; c < SWINGING_DOOR_CHANNELS; ++c)
+    {
+        m_upper[c] = FLT_MAX;
+        m_lower[c] = -FLT_MAX;
+    }
+}
+
+bool SwingingDoor::fits(const RaptPillData &sample) const
+{
+    float dt = static_cast<float>(sample.timestamp - m_origin.timestamp);
+    for (int c = 0; c < SWINGING_DOOR_CHANNELS; ++c)
+    {
+        float slope = (sample.*channels[c].value - m_origin.*channels[c].value) / dt;
+        // Written so that a NaN reading does not fit either.
+        if (!(slope >= m_lower[c] && slope <= m_upper[c]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SwingingDoor::narrow(const RaptPillData &sample)
+{
+    float dt = static_cast<float>(sample.timestamp - m_origin.timestamp);
+    for (int c = 0; c < SWINGING_DOOR_CHANNELS; ++c)
+    {
+        float deadband = m_config.*channels[c].deadband;
+        float rise = sample.*channels[c].value - m_origin.*channels[c].value;
+        float upper = (rise + deadband) / dt;
+        float lower = (rise - deadband) / dt;
+        if (upper < m_upper[c])
+        {
+            m_upper[c] = upper;
+        }
+        if (lower > m_lower[c])
+        {
+            m_lower[c] = lower;
+        }
+    }
+}
+
+bool SwingingDoor::pending(RaptPillData &sample) const
+{
+    if (m_has_held)
+    {
+        sample = m_held;
+    }
+    return m_has_held;
+}
+
+size_t SwingingDoor::offer(const RaptPillData &sample, RaptPillData out[2])
+{
+    size_t count = 0;
+    // Slopes mean nothing across a reboot or when time does not move forward.
+    if (!m_has_origin || sample.boot_id != m_origin.boot_id || sample.timestamp <= m_origin.timestamp ||
+        (m_has_held && sample.timestamp <= m_held.timestamp))
+    {
+        if (m_has_held)
+        {
+            out[count++] = m_held;
+        }
+        out[count++] = sample;
+        open(sample);
+        return count;
+    }
+
+    if (!fits(sample))
+    {
+        // The held sample is the last one that could end the line; store it and start a new one.
+        if (m_has_held)
+        {
+            out[count++] = m_held;
+            open(m_held);
+        }
+        if (!fits(sample))
+        {
+            out[count++] = sample;
+            open(sample);
+            return count;
+        }
+    }
+    narrow(sample);
+
+    if (m_config.heartbeat_s > 0 && sample.timestamp - m_origin.timestamp >= static_cast<int64_t>(m_config.heartbeat_s))
+    {
+        out[count++] = sample;
+        open(sample);
+        return count;
+    }
+
+    m_held = sample;
+    m_has_held = true;
+    return count;
+}
@@ -0,0 +1,240 @@
+#include "common/TimeBase.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TIME_TAG = "TimeBase";
+
+namespace
+{
+    struct BootOffset
+    {
+        uint32_t boot_id;
+        int64_t offset; // unix seconds - monotonic seconds
+    };
+
+    std::atomic<uint32_t> current_boot_id{0};
+    TimeSource current_source = TimeSource::None;
+    BootOffset offsets[TIMEBASE_MAX_BOOTS] = {};
+    SemaphoreHandle_t offsets_mutex = nullptr;
+    std::atomic<uint32_t> offsets_generation{0};
+    TimeBase::OffsetArchive offset_archive = nullptr;
+    void *offset_archive_ctx = nullptr;
+
+    void persistOffsets()
+    {
+        nvs_handle_t handle;
+        if (nvs_open(TIMEBASE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        {
+            ESP_LOGE(TIME_TAG, "Failed to open NVS for offsets");
+            return;
+        }
+        nvs_set_blob(handle, "offsets", offsets, sizeof(offsets));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+void TimeBase::init()
+{
+    offsets_mutex = xSemaphoreCreateMutex();
+
+    nvs_handle_t handle;
+    if (nvs_open(TIMEBASE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        ESP_LOGE(TIME_TAG, "Failed to open NVS, samples of this boot cannot be rebased later");
+        current_boot_id = 1;
+        return;
+    }
+    uint32_t last_boot = 0;
+    nvs_get_u32(handle, "boot_id", &last_boot);
+    current_boot_id = last_boot + 1;
+    if (current_boot_id == 0)
+    {
+        current_boot_id = 1; // 0 is reserved for unix-stamped history.
+    }
+    nvs_set_u32(handle, "boot_id", current_boot_id);
+
+    size_t size = sizeof(offsets);
+    if (nvs_get_blob(handle, "offsets", offsets, &size) != ESP_OK || size != sizeof(offsets))
+    {
+        memset(offsets, 0, sizeof(offsets));
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+    ESP_LOGI(TIME_TAG, "Boot id %u", (unsigned)current_boot_id);
+}
+
+void TimeBase::setArchive(OffsetArchive archive, void *ctx)
+{
+    offset_archive_ctx = ctx;
+    offset_archive = archive;
+}
+
+void TimeBase::archiveChanged()
+{
+    offsets_generation.fetch_add(1, std::memory_order_release);
+}
+
+void TimeBase::raiseBootId(uint32_t at_least)
+{
+    xSemaphoreTake(offsets_mutex, portMAX_DELAY);
+    uint32_t old_id = current_boot_id;
+    if (at_least <= old_id)
+    {
+        xSemaphoreGive(offsets_mutex);
+        return;
+    }
+    current_boot_id = at_least;
+
+    // Keep an offset learned before the id moved.
+    BootOffset &old_slot = offsets[old_id % TIMEBASE_MAX_BOOTS];
+    if (old_slot.boot_id == old_id)
+    {
+        BootOffset moved = {.boot_id = at_least, .offset = old_slot.offset};
+        old_slot = {};
+        offsets[at_least % TIMEBASE_MAX_BOOTS] = moved;
+        persistOffsets();
+        offsets_generation.fetch_add(1, std::memory_order_release);
+    }
+    nvs_handle_t handle;
+    if (nvs_open(TIMEBASE_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK)
+    {
+        nvs_set_u32(handle, "boot_id", at_least);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    xSemaphoreGive(offsets_mutex);
+    ESP_LOGW(TIME_TAG, "History holds boots up to %u, boot id %u moved to %u",
+             (unsigned)(at_least - 1), (unsigned)old_id, (unsigned)at_least);
+}
+
+uint32_t TimeBase::bootId()
+{
+    return current_boot_id;
+}
+
+int64_t TimeBase::monotonicSeconds()
+{
+    return esp_timer_get_time() / 1000000;
+}
+
+void TimeBase::stamp(RaptPillData &data)
+{
+    data.boot_id = current_boot_id;
+    data.timestamp = monotonicSeconds();
+}
+
+esp_err_t TimeBase::setWallClock(int64_t unix_seconds, TimeSource source)
+{
+    if (source == TimeSource::Browser && current_source == TimeSource::Sntp)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (source == TimeSource::Browser)
+    {
+        struct timeval tv = {.tv_sec = static_cast<time_t>(unix_seconds), .tv_usec = 0};
+        settimeofday(&tv, nullptr);
+    }
+
+    int64_t offset = unix_seconds - monotonicSeconds();
+    xSemaphoreTake(offsets_mutex, portMAX_DELAY);
+    // Slot by boot id, so the table keeps the most recent TIMEBASE_MAX_BOOTS boots.
+    BootOffset &slot = offsets[current_boot_id % TIMEBASE_MAX_BOOTS];
+    bool changed = slot.boot_id != current_boot_id || llabs(slot.offset - offset) > 1;
+    slot.boot_id = current_boot_id;
+    slot.offset = offset;
+    current_source = source;
+    if (changed)
+    {
+        persistOffsets();
+        offsets_generation.fetch_add(1, std::memory_order_release);
+    }
+    xSemaphoreGive(offsets_mutex);
+
+    ESP_LOGI(TIME_TAG, "Wall clock known from %s, boot %u offset %lld s",
+             source == TimeSource::Sntp ? "SNTP" : "browser", (unsigned)current_boot_id, offset);
+    return ESP_OK;
+}
+
+TimeSource TimeBase::source()
+{
+    return current_source;
+}
+
+uint32_t TimeBase::generation()
+{
+    return offsets_generation.load(std::memory_order_acquire);
+}
+
+bool TimeBase::offsetFor(uint32_t boot_id, int64_t &offset)
+{
+    if (boot_id == 0)
+    {
+        offset = 0;
+        return true;
+    }
+    xSemaphoreTake(offsets_mutex, portMAX_DELAY);
+    const BootOffset &slot = offsets[boot_id % TIMEBASE_MAX_BOOTS];
+    bool known = slot.boot_id == boot_id;
+    if (known)
+    {
+        offset = slot.offset;
+    }
+    xSemaphoreGive(offsets_mutex);
+    // The archive has its own lock; it is never taken while holding ours.
+    return known || (offset_archive && offset_archive(boot_id, offset, offset_archive_ctx));
+}
+
+TimeResolver TimeResolver::resume(const Checkpoint &checkpoint)
+{
+    TimeResolver resolver;
+    resolver.m_boot_id = checkpoint.boot_id;
+    resolver.m_offset_known = checkpoint.boot_id != UINT32_MAX && TimeBase::offsetFor(checkpoint.boot_id, resolver.m_offset);
+    resolver.m_last_wall = checkpoint.last_wall;
+    resolver.m_last_mono = checkpoint.last_mono;
+    return resolver;
+}
+
+int64_t TimeResolver::resolve(const RaptPillData &data)
+{
+    bool new_boot = data.boot_id != m_boot_id;
+    if (new_boot)
+    {
+        m_boot_id = data.boot_id;
+        m_offset_known = TimeBase::offsetFor(data.boot_id, m_offset);
+    }
+
+    int64_t wall;
+    if (m_offset_known)
+    {
+        wall = data.timestamp + m_offset;
+    }
+    else if (m_last_wall == INT64_MIN)
+    {
+        wall = data.timestamp; // Nothing to anchor to; best effort.
+    }
+    else if (new_boot)
+    {
+        wall = m_last_wall + 1;
+    }
+    else
+    {
+        wall = m_last_wall + (data.timestamp - m_last_mono);
+    }
+
+    // Never step backwards, even if a clock was set wrong and corrected later.
+    if (m_last_wall != INT64_MIN && wall < m_last_wall)
+    {
+        wall = m_last_wall;
+    }
+    m_last_wall = wall;
+    m_last_mono = data.timestamp;
+    return wall;
+}
@@ -0,0 +1,488 @@
+#include "drivers/Uplink.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/task.h"
+#include "common/HistoryStore.hpp"
+#include "drivers/WifiManager.hpp"
+
+static const char *UPLINK_TAG = "Uplink";
+
+// Event bits of the publisher task.
+#define UPLINK_WAKE (1u << 0)
+#define UPLINK_RECONFIGURE (1u << 1)
+#define UPLINK_NETWORK_UP (1u << 2)
+#define UPLINK_MQTT_CONNECTED (1u << 3)
+#define UPLINK_MQTT_ACKED (1u << 4)
+// How often to check whether this boot's wall time is known yet.
+#define UPLINK_CLOCK_POLL_MS 5000
+
+namespace
+{
+    // Persisted position: the last acknowledged sample.
+    struct UplinkCursor
+    {
+        uint32_t boot_id;
+        int64_t timestamp;
+    };
+
+    // Written by the MQTT task, which may see the PUBACK before publish() returns the id.
+    std::atomic<int> mqtt_acked_id{-1};
+}
+
+Uplink &Uplink::instance()
+{
+    static Uplink uplink;
+    return uplink;
+}
+
+Uplink::Uplink()
+    : m_batch(m_buffer, sizeof(m_buffer))
+{
+    m_mutex = xSemaphoreCreateMutex();
+    m_stats.last_success_us = -1;
+}
+
+const char *Uplink::modeName(UplinkMode mode)
+{
+    switch (mode)
+    {
+    case UplinkMode::Off:
+        return "off";
+    case UplinkMode::Mqtt:
+        return "mqtt";
+    case UplinkMode::Http:
+        return "http";
+    }
+    return "unknown";
+}
+
+bool Uplink::parseMode(const char *name, uint8_t &mode)
+{
+    for (uint8_t i = 0; i < UPLINK_MODE_COUNT; ++i)
+    {
+        if (strcmp(name, modeName(static_cast<UplinkMode>(i))) == 0)
+        {
+            mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Uplink::stateName(UplinkState state)
+{
+    switch (state)
+    {
+    case UplinkState::Off:
+        return "off";
+    case UplinkState::Idle:
+        return "idle";
+    case UplinkState::Sending:
+        return "sending";
+    case UplinkState::Backoff:
+        return "backoff";
+    case UplinkState::WaitingForClock:
+        return "waiting_for_clock";
+    }
+    return "unknown";
+}
+
+bool Uplink::validUrl(UplinkMode mode, const char *url)
+{
+    switch (mode)
+    {
+    case UplinkMode::Off:
+        return true;
+    case UplinkMode::Mqtt:
+        return strncmp(url, "mqtt://", 7) == 0 || strncmp(url, "mqtts://", 8) == 0;
+    case UplinkMode::Http:
+        return strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0;
+    }
+    return false;
+}
+
+esp_err_t Uplink::start()
+{
+    m_events = xEventGroupCreate();
+    if (!m_events)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(UPLINK_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        UplinkCursor cursor = {};
+        size_t size = sizeof(cursor);
+        if (nvs_get_blob(handle, UPLINK_NVS_CURSOR_KEY, &cursor, &size) == ESP_OK && size == sizeof(cursor))
+        {
+            m_stats.cursor_valid = true;
+            m_stats.cursor_boot_id = cursor.boot_id;
+            m_stats.cursor_timestamp = cursor.timestamp;
+        }
+        nvs_close(handle);
+    }
+
+    m_stats.mode = static_cast<UplinkMode>(SettingsStore::get().uplink_mode);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &Uplink::onGotIp, this, nullptr);
+    SettingsStore::subscribe(SETTINGS_UPLINK, &Uplink::onSettingsChanged, this);
+    if (xTaskCreate(&Uplink::task, "uplink", UPLINK_TASK_STACK, this, UPLINK_TASK_PRIORITY, nullptr) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (m_stats.cursor_valid)
+    {
+        ESP_LOGI(UPLINK_TAG, "Resuming after boot %lu, t=%lld", static_cast<unsigned long>(m_stats.cursor_boot_id),
+                 m_stats.cursor_timestamp);
+    }
+    notify();
+    return ESP_OK;
+}
+
+void Uplink::notify()
+{
+    if (m_events)
+    {
+        xEventGroupSetBits(m_events, UPLINK_WAKE);
+    }
+}
+
+UplinkStats Uplink::stats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    UplinkStats stats = m_stats;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
+
+void Uplink::onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx)
+{
+    Uplink *self = static_cast<Uplink *>(ctx);
+    xEventGroupSetBits(self->m_events, UPLINK_RECONFIGURE | UPLINK_WAKE);
+}
+
+void Uplink::onGotIp(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    // Retry right away instead of sitting out the backoff, then drain the backlog.
+    Uplink *self = static_cast<Uplink *>(arg);
+    xEventGroupSetBits(self->m_events, UPLINK_NETWORK_UP | UPLINK_WAKE);
+}
+
+void Uplink::onMqttEvent(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    Uplink *self = static_cast<Uplink *>(arg);
+    esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(data);
+    switch (static_cast<esp_mqtt_event_id_t>(id))
+    {
+    case MQTT_EVENT_CONNECTED:
+        xEventGroupSetBits(self->m_events, UPLINK_MQTT_CONNECTED);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        xEventGroupClearBits(self->m_events, UPLINK_MQTT_CONNECTED);
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        mqtt_acked_id.store(event->msg_id);
+        xEventGroupSetBits(self->m_events, UPLINK_MQTT_ACKED);
+        break;
+    default:
+        break;
+    }
+}
+
+void Uplink::task(void *param)
+{
+    static_cast<Uplink *>(param)->run();
+}
+
+void Uplink::setState(UplinkState state)
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_stats.state = state;
+    xSemaphoreGive(m_mutex);
+}
+
+void Uplink::run()
+{
+    HistoryStore &history = HistoryStore::instance();
+    TickType_t wait = portMAX_DELAY;
+    while (true)
+    {
+        EventBits_t bits = xEventGroupWaitBits(m_events, UPLINK_WAKE | UPLINK_RECONFIGURE | UPLINK_NETWORK_UP,
+                                               pdTRUE, pdFALSE, wait);
+        Settings settings = SettingsStore::get();
+        UplinkMode mode = static_cast<UplinkMode>(settings.uplink_mode);
+        int64_t now = esp_timer_get_time();
+        if (bits & UPLINK_RECONFIGURE)
+        {
+            disconnect();
+            xSemaphoreTake(m_mutex, portMAX_DELAY);
+            m_stats.mode = mode;
+            m_stats.backoff_ms = 0;
+            xSemaphoreGive(m_mutex);
+            m_retry_at_us = 0;
+        }
+        if (bits & UPLINK_NETWORK_UP)
+        {
+            m_retry_at_us = 0;
+        }
+        if (mode == UplinkMode::Off)
+        {
+            disconnect();
+            commitCursor();
+            setState(UplinkState::Off);
+            wait = portMAX_DELAY;
+            continue;
+        }
+        if (now < m_retry_at_us)
+        {
+            wait = pdMS_TO_TICKS((m_retry_at_us - now) / 1000 + 1);
+            continue;
+        }
+
+        // A load restarts the history's numbering; find the cursor again.
+        HistoryRange range = history.storedRange();
+        if (!m_positioned || range.epoch != m_epoch)
+        {
+            m_next = m_stats.cursor_valid ? history.seekAfter(m_stats.cursor_boot_id, m_stats.cursor_timestamp)
+                                          : range.first;
+            m_epoch = range.epoch;
+            m_positioned = true;
+        }
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        if (m_next < range.first)
+        {
+            m_stats.dropped_samples += range.first - m_next;
+            ESP_LOGW(UPLINK_TAG, "%u samples rotated out before they were sent",
+                     static_cast<unsigned>(range.first - m_next));
+            m_next = range.first;
+        }
+        size_t backlog = range.end > m_next ? range.end - m_next : 0;
+        m_stats.backlog = backlog;
+        xSemaphoreGive(m_mutex);
+
+        if (backlog == 0)
+        {
+            commitCursor();
+            setState(UplinkState::Idle);
+            wait = portMAX_DELAY;
+            continue;
+        }
+        int64_t since_send_us = now - m_last_send_us;
+        if (backlog < UPLINK_MIN_BATCH && since_send_us < UPLINK_MAX_DELAY_S * 1000000LL)
+        {
+            setState(UplinkState::Idle);
+            wait = pdMS_TO_TICKS((UPLINK_MAX_DELAY_S * 1000000LL - since_send_us) / 1000 + 1);
+            continue;
+        }
+
+        size_t samples = m_batch.build(m_next, range.end);
+        if (samples == 0)
+        {
+            setState(UplinkState::WaitingForClock);
+            wait = pdMS_TO_TICKS(UPLINK_CLOCK_POLL_MS);
+            continue;
+        }
+
+        setState(UplinkState::Sending);
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = send(settings, samples);
+        int64_t end_us = esp_timer_get_time();
+        m_last_send_us = end_us;
+
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        if (err == ESP_OK)
+        {
+            m_next += samples;
+            m_stats.cursor_valid = true;
+            m_stats.cursor_boot_id = m_batch.last().boot_id;
+            m_stats.cursor_timestamp = m_batch.last().timestamp;
+            m_stats.backlog = backlog - samples;
+            m_stats.sent_samples += samples;
+            m_stats.sent_batches++;
+            m_stats.sent_bytes += m_batch.size();
+            m_stats.backoff_ms = 0;
+            m_stats.last_success_us = end_us;
+            if (backlog > samples)
+            {
+                m_stats.catchup_samples += samples;
+                m_stats.catchup_us += end_us - start_us;
+            }
+            m_stats.state = UplinkState::Idle;
+            m_cursor_dirty = true;
+            wait = 0;
+        }
+        else
+        {
+            m_stats.failures++;
+            m_stats.last_error = err;
+            m_stats.backoff_ms = m_stats.backoff_ms ? m_stats.backoff_ms * 2 : UPLINK_BACKOFF_BASE_MS;
+            if (m_stats.backoff_ms > UPLINK_BACKOFF_MAX_MS)
+            {
+                m_stats.backoff_ms = UPLINK_BACKOFF_MAX_MS;
+            }
+            m_stats.state = UplinkState::Backoff;
+            m_retry_at_us = end_us + m_stats.backoff_ms * 1000LL;
+            wait = pdMS_TO_TICKS(m_stats.backoff_ms);
+            ESP_LOGW(UPLINK_TAG, "Upload of %u samples failed (%s), retrying in %lu ms", static_cast<unsigned>(samples),
+                     esp_err_to_name(err), static_cast<unsigned long>(m_stats.backoff_ms));
+        }
+        xSemaphoreGive(m_mutex);
+
+        if (err == ESP_OK && (backlog == samples || end_us - m_cursor_committed_us >= UPLINK_CURSOR_COMMIT_S * 1000000LL))
+        {
+            commitCursor();
+        }
+    }
+}
+
+esp_err_t Uplink::send(const Settings &settings, size_t samples)
+{
+    switch (static_cast<UplinkMode>(settings.uplink_mode))
+    {
+    case UplinkMode::Mqtt:
+        return sendMqtt(settings);
+    case UplinkMode::Http:
+        return sendHttp(settings, samples);
+    default:
+        return ESP_ERR_INVALID_STATE;
+    }
+}
+
+esp_err_t Uplink::sendMqtt(const Settings &settings)
+{
+    if (!m_mqtt)
+    {
+        esp_mqtt_client_config_t config = {};
+        config.broker.address.uri = settings.uplink_url;
+        config.network.timeout_ms = UPLINK_ACK_TIMEOUT_MS;
+        m_mqtt = esp_mqtt_client_init(&config);
+        if (!m_mqtt)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_mqtt_client_register_event(m_mqtt, MQTT_EVENT_ANY, &Uplink::onMqttEvent, this);
+        esp_err_t err = esp_mqtt_client_start(m_mqtt);
+        if (err != ESP_OK)
+        {
+            disconnect();
+            return err;
+        }
+    }
+    // The client reconnects on its own; a batch only goes out on a live session.
+    if (!(xEventGroupWaitBits(m_events, UPLINK_MQTT_CONNECTED, pdFALSE, pdTRUE, pdMS_TO_TICKS(UPLINK_ACK_TIMEOUT_MS)) &
+          UPLINK_MQTT_CONNECTED))
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    xEventGroupClearBits(m_events, UPLINK_MQTT_ACKED);
+    int msg_id = esp_mqtt_client_publish(m_mqtt, settings.uplink_topic, reinterpret_cast<const char *>(m_batch.data()),
+                                         m_batch.size(), 1, 0);
+    if (msg_id < 0)
+    {
+        return ESP_FAIL;
+    }
+    int64_t deadline_us = esp_timer_get_time() + UPLINK_ACK_TIMEOUT_MS * 1000LL;
+    while (mqtt_acked_id.load() != msg_id)
+    {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0 ||
+            !(xEventGroupWaitBits(m_events, UPLINK_MQTT_ACKED, pdTRUE, pdTRUE, pdMS_TO_TICKS(left_us / 1000 + 1)) &
+              UPLINK_MQTT_ACKED))
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Uplink::sendHttp(const Settings &settings, size_t samples)
+{
+    if (!m_http)
+    {
+        esp_http_client_config_t config = {};
+        config.url = settings.uplink_url;
+        config.method = HTTP_METHOD_POST;
+        config.timeout_ms = UPLINK_ACK_TIMEOUT_MS;
+        // Reuse the connection while catching up.
+        config.keep_alive_enable = true;
+        m_http = esp_http_client_init(&config);
+        if (!m_http)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    char count[12];
+    snprintf(count, sizeof(count), "%u", static_cast<unsigned>(samples));
+    esp_http_client_set_header(m_http, "Content-Type", HISTORY_BATCH_CONTENT_TYPE);
+    esp_http_client_set_header(m_http, "X-RaptMate-Device", WiFiManager::deviceId());
+    esp_http_client_set_header(m_http, "X-RaptMate-Samples", count);
+    esp_http_client_set_post_field(m_http, reinterpret_cast<const char *>(m_batch.data()), m_batch.size());
+    esp_err_t err = esp_http_client_perform(m_http);
+    if (err == ESP_OK)
+    {
+        int status = esp_http_client_get_status_code(m_http);
+        if (status < 200 || status >= 300)
+        {
+            ESP_LOGW(UPLINK_TAG, "Webhook answered %d", status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    if (err != ESP_OK)
+    {
+        // Start over with a fresh connection on the next attempt.
+        disconnect();
+    }
+    return err;
+}
+
+void Uplink::disconnect()
+{
+    if (m_mqtt)
+    {
+        esp_mqtt_client_stop(m_mqtt);
+        esp_mqtt_client_destroy(m_mqtt);
+        m_mqtt = nullptr;
+        xEventGroupClearBits(m_events, UPLINK_MQTT_CONNECTED | UPLINK_MQTT_ACKED);
+    }
+    if (m_http)
+    {
+        esp_http_client_cleanup(m_http);
+        m_http = nullptr;
+    }
+}
+
+void Uplink::commitCursor()
+{
+    if (!m_cursor_dirty)
+    {
+        return;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    UplinkCursor cursor = {.boot_id = m_stats.cursor_boot_id, .timestamp = m_stats.cursor_timestamp};
+    xSemaphoreGive(m_mutex);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(UPLINK_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, UPLINK_NVS_CURSOR_KEY, &cursor, sizeof(cursor));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(UPLINK_TAG, "Failed to persist the cursor: %s", esp_err_to_name(err));
+        return;
+    }
+    m_cursor_dirty = false;
+    m_cursor_committed_us = esp_timer_get_time();
+}
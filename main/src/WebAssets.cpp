@@ -0,0 +1,31 @@
+#include "web/WebAssets.hpp"
+#include <cstring>
+
+const WebAsset *WebAssets::find(const char *path, size_t length)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        const char *candidate = table[mid].path;
+        int order = strncmp(candidate, path, length);
+        if (order == 0 && candidate[length] != '\0')
+        {
+            order = 1; // The candidate continues past path, so it sorts after it.
+        }
+        if (order == 0)
+        {
+            return &table[mid];
+        }
+        if (order < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,485 @@
+#include "drivers/WifiManager.hpp"
+#include "esp_random.h"
+#include "common/TimeBase.hpp"
+#include <time.h>
+
+WiFiManager *WiFiManager::instance_ = nullptr;
+
+void WiFiManager::wifi_init_softap()
+{
+    instance_ = this;
+    esp_netif_init();
+    esp_event_loop_create_default();
+    esp_netif_create_default_wifi_ap();
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT(); // always start with this
+
+    esp_wifi_init(&cfg);
+    // The modem sleep level belongs to the power profile, see PowerManager.
+
+    esp_timer_create_args_t timer_args = {
+        .callback = &WiFiManager::onReconnectTimer,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi_reconnect",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &m_reconnect_timer));
+    m_have_last_ap = loadLastAp(m_last_ap);
+
+    registerEventHandlers();
+    SettingsStore::subscribe(SETTINGS_WIFI, &WiFiManager::onSettingsChanged, this);
+
+    // Boot straight into APSTA when station credentials are stored.
+    Settings settings = SettingsStore::get();
+    bool has_sta = settings.wifi_ssid[0] != '\0';
+    esp_wifi_set_mode(has_sta ? WIFI_MODE_APSTA : WIFI_MODE_AP);
+    configureAP();
+    if (has_sta && !configureSTA(settings.wifi_ssid, settings.wifi_password))
+    {
+        esp_wifi_set_mode(WIFI_MODE_AP);
+    }
+
+    // In STA modes the connection is started from WIFI_EVENT_STA_START.
+    esp_err_t err = esp_wifi_start();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("WiFiManager", "Failed to start Wi-Fi: %s", esp_err_to_name(err));
+        return;
+    }
+}
+
+void WiFiManager::setCredentials(const char *ssid, const char *password)
+{
+    // Stop Wi-Fi if it's already running
+    esp_timer_stop(m_reconnect_timer);
+    esp_wifi_stop();
+    m_state = WifiState::Idle;
+    m_attempts = 0;
+    // The cached BSSID belongs to the previous network.
+    m_have_last_ap = false;
+
+    // Change mode to APSTA
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+
+    // Reapply the original AP configuration
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config_ap));
+    if (!configureSTA(ssid, password))
+    {
+        return;
+    }
+    esp_err_t err = esp_wifi_start();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("WiFiManager", "Failed to start Wi-Fi: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI("WiFiManager", "STA configuration updated, connecting to: %s", ssid);
+}
+
+void WiFiManager::onSettingsChanged(const Settings &settings, uint32_t changed, void *ctx)
+{
+    WiFiManager *self = static_cast<WiFiManager *>(ctx);
+    if (settings.wifi_ssid[0] != '\0')
+    {
+        self->setCredentials(settings.wifi_ssid, settings.wifi_password);
+        return;
+    }
+    // Credentials were cleared: fall back to soft-AP only.
+    esp_timer_stop(self->m_reconnect_timer);
+    esp_wifi_stop();
+    self->m_state = WifiState::Idle;
+    esp_wifi_set_mode(WIFI_MODE_AP);
+    esp_wifi_set_config(WIFI_IF_AP, &self->wifi_config_ap);
+    esp_wifi_start();
+    ESP_LOGI("WiFiManager", "Station credentials cleared, running as soft-AP only");
+}
+
+const char *WiFiManager::stateName(WifiState state)
+{
+    switch (state)
+    {
+    case WifiState::Idle:
+        return "idle";
+    case WifiState::Connecting:
+        return "connecting";
+    case WifiState::Associated:
+        return "associated";
+    case WifiState::Online:
+        return "online";
+    case WifiState::Backoff:
+        return "backoff";
+    }
+    return "unknown";
+}
+
+namespace
+{
+    struct DeviceId
+    {
+        char text[13];
+    };
+
+    DeviceId readDeviceId()
+    {
+        // The MAC comes from eFuse, so this works before Wi-Fi is started.
+        uint8_t mac[6] = {};
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        DeviceId id;
+        snprintf(id.text, sizeof(id.text), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4],
+                 mac[5]);
+        return id;
+    }
+}
+
+const char *WiFiManager::deviceId()
+{
+    static const DeviceId id = readDeviceId();
+    return id.text;
+}
+
+void WiFiManager::configureAP()
+{
+    wifi_config_ap = {
+        .ap = {
+            .ssid = "RaptMate",
+            .ssid_len = strlen("RaptMate"),
+            .channel = 6,
+            .authmode = WIFI_AUTH_OPEN,
+            .max_connection = 4,
+            .beacon_interval = 500,
+            .pmf_cfg = {
+                .capable = true,
+                .required = false,
+            },
+        }};
+
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config_ap));
+}
+
+bool WiFiManager::configureSTA(const char *ssid, const char *password)
+{
+    // Validate SSID
+    if (ssid == nullptr || strlen(ssid) == 0 || strlen(ssid) > 32)
+    {
+        ESP_LOGE("WiFiManager", "Invalid SSID length (must be 1-32 chars)");
+        return false;
+    }
+
+    // Validate password if provided
+    if (password != nullptr && strlen(password) > 0)
+    {
+        if (strlen(password) < 8)
+        {
+            ESP_LOGE("WiFiManager", "Password too short (min 8 chars)");
+            return false;
+        }
+        if (strlen(password) > 64)
+        {
+            ESP_LOGE("WiFiManager", "Password too long (max 64 chars)");
+            return false;
+        }
+    }
+
+    // Prepare new configuration
+    wifi_config_t wifi_config = {};
+    strncpy(reinterpret_cast<char *>(wifi_config.sta.ssid), ssid, sizeof(wifi_config.sta.ssid) - 1);
+    wifi_config.sta.ssid[sizeof(wifi_config.sta.ssid) - 1] = '\0'; // Ensure null-termination
+
+    if (password != nullptr && strlen(password) > 0)
+    {
+        strncpy(reinterpret_cast<char *>(wifi_config.sta.password), password, sizeof(wifi_config.sta.password) - 1);
+        wifi_config.sta.password[sizeof(wifi_config.sta.password) - 1] = '\0'; // Ensure null-termination
+    }
+    else
+    {
+        wifi_config.sta.password[0] = '\0'; // Empty password for open networks
+    }
+
+    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    wifi_config.sta.pmf_cfg.capable = true;
+    wifi_config.sta.pmf_cfg.required = false;
+    // Apply configuration
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+
+    return true;
+}
+
+void WiFiManager::registerEventHandlers()
+{
+    ESP_LOGI("WiFiManager", "Registering Wi-Fi event handlers");
+    esp_event_handler_instance_t instance_got_ip;
+    esp_err_t err = esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &WiFiManager::onGotIP,
+                                                        this,
+                                                        &instance_got_ip);
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_register(WIFI_EVENT,
+                                        ESP_EVENT_ANY_ID,
+                                        &WiFiManager::wifi_event_handler,
+                                        this,
+                                        &instance_any_id);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("WiFiManager", "Failed to register event handler: %s", esp_err_to_name(err));
+    }
+}
+
+void WiFiManager::applyCachedAp(bool enable)
+{
+    wifi_config_t config = {};
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
+    {
+        return;
+    }
+    config.sta.bssid_set = enable;
+    if (enable)
+    {
+        memcpy(config.sta.bssid, m_last_ap.bssid, sizeof(config.sta.bssid));
+        config.sta.channel = m_last_ap.channel;
+        config.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        config.sta.channel = 0;
+        config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+}
+
+void WiFiManager::connect()
+{
+    // Try the AP we last associated with first; a failure falls back to a full scan.
+    m_using_cached_ap = m_have_last_ap;
+    applyCachedAp(m_using_cached_ap);
+
+    m_state = WifiState::Connecting;
+    m_connect_started_us = esp_timer_get_time();
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("WiFiManager", "Failed to initiate connection: %s", esp_err_to_name(err));
+        scheduleReconnect();
+    }
+}
+
+void WiFiManager::scheduleReconnect()
+{
+    uint32_t shift = m_attempts < 16 ? m_attempts : 16;
+    uint32_t delay_ms = WIFI_BACKOFF_BASE_MS << shift;
+    if (delay_ms > WIFI_BACKOFF_MAX_MS)
+    {
+        delay_ms = WIFI_BACKOFF_MAX_MS;
+    }
+    // +-25% jitter so several devices do not hammer a rebooting AP in lockstep.
+    delay_ms = delay_ms * 3 / 4 + esp_random() % (delay_ms / 2 + 1);
+    m_attempts++;
+    m_metrics.backoff_ms = delay_ms;
+    m_state = WifiState::Backoff;
+
+    ESP_LOGI("WiFiManager", "Reconnecting in %u ms (attempt %u)", (unsigned)delay_ms, (unsigned)m_attempts);
+    esp_timer_stop(m_reconnect_timer);
+    esp_timer_start_once(m_reconnect_timer, static_cast<uint64_t>(delay_ms) * 1000);
+}
+
+void WiFiManager::onReconnectTimer(void *arg)
+{
+    static_cast<WiFiManager *>(arg)->connect();
+}
+
+bool WiFiManager::loadLastAp(LastAp &ap)
+{
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+    size_t size = sizeof(ap);
+    esp_err_t err = nvs_get_blob(handle, WIFI_NVS_LAST_AP_KEY, &ap, &size);
+    nvs_close(handle);
+    return err == ESP_OK && size == sizeof(ap) && ap.channel != 0;
+}
+
+void WiFiManager::saveLastAp(const LastAp &ap)
+{
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        ESP_LOGW("WiFiManager", "Failed to open NVS to cache the AP");
+        return;
+    }
+    nvs_set_blob(handle, WIFI_NVS_LAST_AP_KEY, &ap, sizeof(ap));
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+void WiFiManager::wifi_event_handler(void *arg, esp_event_base_t event_base,
+                                     int32_t event_id, void *event_data)
+{
+    WiFiManager *self = static_cast<WiFiManager *>(arg);
+
+    if (event_base == WIFI_EVENT)
+    {
+        switch (event_id)
+        {
+        case WIFI_EVENT_STA_START:
+        {
+            ESP_LOGI("WiFiManager", "STA started");
+            wifi_config_t config = {};
+            if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK && config.sta.ssid[0] != '\0')
+            {
+                self->m_attempts = 0;
+                self->connect();
+            }
+            break;
+        }
+
+        case WIFI_EVENT_STA_CONNECTED:
+        {
+            auto *event = static_cast<wifi_event_sta_connected_t *>(event_data);
+            ESP_LOGI("WiFiManager", "Connected to AP on channel %d", event->channel);
+            self->m_state = WifiState::Associated;
+            if (self->m_using_cached_ap)
+            {
+                self->m_metrics.fast_reconnects++;
+            }
+            // Only write NVS when the AP actually changed.
+            if (!self->m_have_last_ap || self->m_last_ap.channel != event->channel ||
+                memcmp(self->m_last_ap.bssid, event->bssid, sizeof(event->bssid)) != 0)
+            {
+                memcpy(self->m_last_ap.bssid, event->bssid, sizeof(event->bssid));
+                self->m_last_ap.channel = event->channel;
+                saveLastAp(self->m_last_ap);
+            }
+            self->m_have_last_ap = true;
+            break;
+        }
+
+        case WIFI_EVENT_STA_DISCONNECTED:
+        {
+            auto *event = static_cast<wifi_event_sta_disconnected_t *>(event_data);
+            self->m_metrics.disconnects++;
+            ESP_LOGW("WiFiManager", "Disconnected from AP (reason %d)", event->reason);
+            if (event->reason == WIFI_REASON_ASSOC_LEAVE)
+            {
+                // We left on purpose (esp_wifi_stop / setCredentials).
+                self->m_state = WifiState::Idle;
+                break;
+            }
+            if (self->m_state == WifiState::Connecting && self->m_using_cached_ap)
+            {
+                // The cached AP moved or is gone; retry right away with a full scan.
+                ESP_LOGI("WiFiManager", "Cached AP not reachable, falling back to full scan");
+                self->m_have_last_ap = false;
+                self->connect();
+                break;
+            }
+            self->scheduleReconnect();
+            break;
+        }
+
+        case WIFI_EVENT_STA_STOP:
+            esp_timer_stop(self->m_reconnect_timer);
+            self->m_state = WifiState::Idle;
+            break;
+        }
+    }
+}
+
+void WiFiManager::onGotIP(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    WiFiManager *self = static_cast<WiFiManager *>(arg);
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+    ESP_LOGI("WiFiManager", "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+
+    int64_t now = esp_timer_get_time();
+    self->m_state = WifiState::Online;
+    self->m_attempts = 0;
+    self->m_metrics.backoff_ms = 0;
+    self->m_metrics.last_connect_duration_us = now - self->m_connect_started_us;
+    if (self->m_metrics.time_to_ip_us < 0)
+    {
+        self->m_metrics.time_to_ip_us = now;
+        ESP_LOGI("WiFiManager", "Time to IP after boot: %lld ms", now / 1000);
+    }
+    self->initMDNS();
+    self->initSNTP();
+}
+
+void WiFiManager::initMDNS()
+{
+    if (m_mdns_started)
+    {
+        return;
+    }
+    ESP_LOGI("WiFiManager", "Initializing mDNS with hostname: raptmate.local");
+    esp_err_t err = mdns_init();
+    if (err)
+    {
+        ESP_LOGE("WiFiManager", "MDNS Init failed: %d", err);
+        return;
+    }
+    mdns_hostname_set("raptmate");
+    // Several devices share the hostname (mDNS renames the later ones); the instance name tells them apart.
+    char instance[32];
+    snprintf(instance, sizeof(instance), "RaptMate %s", deviceId() + 6);
+    mdns_instance_name_set(instance);
+
+    mdns_txt_item_t txt[] = {
+        {"id", deviceId()},
+        {"api", MDNS_API_VERSION},
+        {"role", SettingsStore::get().collector_enabled ? "collector" : "node"},
+    };
+    err = mdns_service_add(nullptr, MDNS_SERVICE_TYPE, MDNS_SERVICE_PROTO, MDNS_SERVICE_PORT, txt,
+                           sizeof(txt) / sizeof(txt[0]));
+    if (err)
+    {
+        ESP_LOGW("WiFiManager", "Failed to advertise the %s service: %d", MDNS_SERVICE_TYPE, err);
+    }
+    m_mdns_started = true;
+    ESP_LOGI("WiFiManager", "mDNS initialized: device is available as raptmate.local (%s)", instance);
+}
+
+void WiFiManager::initSNTP()
+{
+    // SNTP keeps running across reconnects; completion is reported through onTimeSync
+    // so the event loop is never blocked waiting for the clock.
+    if (m_sntp_started)
+    {
+        return;
+    }
+    ESP_LOGI("WiFiManager", "Initializing SNTP");
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG("pool.ntp.org");
+    config.smooth_sync = true;
+    config.sync_cb = &WiFiManager::onTimeSync;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("WiFiManager", "SNTP init failed: %s", esp_err_to_name(err));
+        return;
+    }
+    m_sntp_started = true;
+}
+
+void WiFiManager::onTimeSync(struct timeval *tv)
+{
+    WiFiManager *self = instance_;
+    TimeBase::setWallClock(tv->tv_sec, TimeSource::Sntp);
+    struct tm timeinfo = {};
+    localtime_r(&tv->tv_sec, &timeinfo);
+    ESP_LOGI("WiFiManager", "System time set successfully: %04d-%02d-%02d %02d:%02d:%02d",
+             timeinfo.tm_year + 1900,
+             timeinfo.tm_mon + 1,
+             timeinfo.tm_mday,
+             timeinfo.tm_hour,
+             timeinfo.tm_min,
+             timeinfo.tm_sec);
+    if (self && self->m_metrics.time_to_synced_clock_us < 0)
+    {
+        self->m_metrics.time_to_synced_clock_us = esp_timer_get_time();
+        ESP_LOGI("WiFiManager", "Time to synced clock after boot: %lld ms", self->m_metrics.time_to_synced_clock_us / 1000);
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef FILE_BACKEND_HPP
+#define FILE_BACKEND_HPP
+
+#include <cstdio>
+#include "storage/StorageBackend.hpp"
+
+// Each of the two log generations may grow to this share of the filesystem,
+// leaving headroom for the filesystem's own garbage collection.
+#define FILE_BACKEND_SEGMENT_PERCENT 40
+#define FILE_BACKEND_PATH_MAX 32
+
+/**
+ * @brief Record log kept in two files on a mounted filesystem.
+ *
+ * Records are framed (length + CRC) and appended to history.log; once it
+ * reaches its share of the filesystem it becomes history.old, replacing the
+ * previous one. A torn frame at the end of the log (power cut mid-append)
+ * ends the readable part of that file, and the log is rotated on mount so
+ * later appends stay readable. The tail log is tail.log, removed when cleared.
+ */
+class FileBackend : public StorageBackend
+{
+public:
+    FileBackend(const char *base_path, const char *partition_label);
+    ~FileBackend() override;
+
+protected:
+    virtual esp_err_t mountFilesystem() = 0;
+    virtual esp_err_t filesystemInfo(size_t &total, size_t &used) = 0;
+
+    esp_err_t doMount() override;
+    esp_err_t doAppend(const void *record, size_t length) override;
+    esp_err_t doRead(size_t first, size_t count, RecordVisitor visitor, void *ctx, size_t &bytes_read) override;
+    esp_err_t doTruncate() override;
+    esp_err_t doRotate() override;
+    esp_err_t doSync() override;
+    size_t doRecords() override;
+    esp_err_t doAppendTail(const void *record, size_t length) override;
+    esp_err_t doReadTail(RecordVisitor visitor, void *ctx) override;
+    esp_err_t doClearTail() override;
+    void spaceStats(StorageStats &stats) override;
+
+    const char *m_base_path;
+    const char *m_partition_label;
+
+private:
+    struct ReadState
+    {
+        size_t skip;
+        size_t remaining;
+        RecordVisitor visitor;
+        void *ctx;
+        size_t bytes_read;
+        size_t records;
+        bool stopped;
+    };
+
+    /// Walk the frames of one file; returns the offset after the last valid frame.
+    size_t readFile(const char *path, ReadState &state);
+    esp_err_t openLog();
+    static esp_err_t writeFrame(FILE *file, const void *record, size_t length);
+    void importLegacyCsv();
+
+    char m_log_path[FILE_BACKEND_PATH_MAX];
+    char m_old_path[FILE_BACKEND_PATH_MAX];
+    char m_tail_path[FILE_BACKEND_PATH_MAX];
+    FILE *m_log = nullptr;
+    FILE *m_tail = nullptr;
+    size_t m_tail_size = 0;
+    size_t m_log_size = 0;
+    size_t m_old_size = 0;
+    size_t m_log_records = 0;
+    size_t m_old_records = 0;
+    size_t m_segment_limit = 0;
+    uint8_t m_record[STORAGE_MAX_RECORD];
+};
+
+class SpiffsBackend : public FileBackend
+{
+public:
+    using FileBackend::FileBackend;
+    const char *name() const override { return "spiffs"; }
+
+protected:
+    esp_err_t mountFilesystem() override;
+    esp_err_t filesystemInfo(size_t &total, size_t &used) override;
+};
+
+class LittleFsBackend : public FileBackend
+{
+public:
+    using FileBackend::FileBackend;
+    const char *name() const override { return "littlefs"; }
+
+protected:
+    esp_err_t mountFilesystem() override;
+    esp_err_t filesystemInfo(size_t &total, size_t &used) override;
+};
+
+#endif // FILE_BACKEND_HPP
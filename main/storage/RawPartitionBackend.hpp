@@ -0,0 +1,81 @@
+#ifndef RAW_PARTITION_BACKEND_HPP
+#define RAW_PARTITION_BACKEND_HPP
+
+#include "esp_partition.h"
+#include "storage/StorageBackend.hpp"
+
+#define RAW_SECTOR_SIZE 4096
+#define RAW_SECTOR_MAGIC 0x474C4D52 // "RMLG"
+#define RAW_WAL_MAGIC 0x4C574D52    // "RMWL"
+// Sectors at the end of the partition set aside for the tail log.
+#define RAW_WAL_SECTORS 4
+
+/**
+ * @brief Record log written straight to a data partition, without a filesystem.
+ *
+ * The partition is a ring of flash sectors. Each sector starts with a magic and
+ * a sequence number, followed by frames (length, CRC, payload) that never span
+ * sectors. Unwritten flash reads as length 0xFFFF, which ends a sector. When the
+ * ring is full the oldest sector is erased, so appends cost one flash write plus
+ * one sector erase every RAW_SECTOR_SIZE bytes, with no garbage collection.
+ * The last RAW_WAL_SECTORS sectors hold the tail log, filled front to back
+ * and erased when cleared.
+ */
+class RawPartitionBackend : public StorageBackend
+{
+public:
+    explicit RawPartitionBackend(const char *partition_label);
+    const char *name() const override { return "raw"; }
+
+protected:
+    esp_err_t doMount() override;
+    esp_err_t doAppend(const void *record, size_t length) override;
+    esp_err_t doRead(size_t first, size_t count, RecordVisitor visitor, void *ctx, size_t &bytes_read) override;
+    esp_err_t doTruncate() override;
+    esp_err_t doRotate() override;
+    esp_err_t doSync() override;
+    size_t doRecords() override;
+    esp_err_t doAppendTail(const void *record, size_t length) override;
+    esp_err_t doReadTail(RecordVisitor visitor, void *ctx) override;
+    esp_err_t doClearTail() override;
+    void spaceStats(StorageStats &stats) override;
+
+private:
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+    };
+
+    /**
+     * @brief Walk the valid frames of a sector already read into buffer.
+     * @return Offset where the next frame would be written.
+     */
+    static size_t walkSector(const uint8_t *buffer, size_t &records, size_t &payload,
+                             RecordVisitor visitor, void *ctx, size_t &skip, size_t &remaining, bool &stopped);
+    esp_err_t startSector(size_t index, uint32_t sequence);
+    /// Forget the oldest sector; erase it unless it is about to be reused anyway.
+    esp_err_t dropOldestSector(bool erase);
+    size_t sectorsInUse() const;
+    esp_err_t mountWal(uint8_t *buffer);
+    size_t walAddress(size_t sector) const { return (m_sectors + sector) * RAW_SECTOR_SIZE; }
+
+    const char *m_partition_label;
+    const esp_partition_t *m_partition = nullptr;
+    size_t m_sectors = 0;
+
+    bool m_empty = true;
+    size_t m_tail = 0; // Oldest sector.
+    size_t m_head = 0; // Sector being appended to.
+    size_t m_head_offset = 0;
+    uint32_t m_head_sequence = 0;
+    size_t m_payload_bytes = 0;
+    size_t m_records = 0;
+
+    // Tail log position; nothing is written while m_wal_started is false.
+    bool m_wal_started = false;
+    size_t m_wal_sector = 0;
+    size_t m_wal_offset = 0;
+};
+
+#endif // RAW_PARTITION_BACKEND_HPP
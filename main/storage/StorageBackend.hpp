@@ -0,0 +1,116 @@
+#ifndef STORAGE_BACKEND_HPP
+#define STORAGE_BACKEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Largest record accepted by append().
+#define STORAGE_MAX_RECORD 1024
+// Append latency histogram: bucket i counts appends under (250 us << i), the last one the rest.
+#define STORAGE_LATENCY_BUCKETS 12
+#define STORAGE_LATENCY_BASE_US 250
+
+/// Header in front of every stored record.
+struct StorageFrameHeader
+{
+    uint16_t length; // 0xFFFF marks erased flash.
+    uint16_t crc;    // CRC-16 of the payload.
+};
+
+struct StorageStats
+{
+    const char *backend;
+    size_t capacity_bytes;
+    // Space the backend has claimed, including filesystem or sector overhead.
+    size_t used_bytes;
+    // Record payload bytes; payload / used is the space efficiency.
+    size_t payload_bytes;
+
+    uint32_t appends;
+    uint32_t append_errors;
+    uint32_t rotations;
+    uint32_t append_latency[STORAGE_LATENCY_BUCKETS];
+    int64_t append_max_us;
+
+    uint64_t bytes_read;
+    int64_t read_us;
+};
+
+/**
+ * @brief Append-only record log that the history is persisted to.
+ *
+ * Records are opaque byte strings read back in the order they were written.
+ * When space runs out the oldest segment is dropped, so the log always holds
+ * the most recent history. The public calls are serialized and timed here;
+ * implementations only provide the storage-specific parts.
+ *
+ * Next to the log each backend keeps a small tail log: a write-ahead log for
+ * data that is still being assembled into a log record, cleared as a whole
+ * once that record is appended.
+ */
+class StorageBackend
+{
+public:
+    /// Called for each record; return false to stop reading.
+    using RecordVisitor = bool (*)(const uint8_t *record, size_t length, void *ctx);
+
+    virtual ~StorageBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    esp_err_t mount();
+    esp_err_t append(const void *record, size_t length);
+
+    /**
+     * @brief Visit up to count records starting at index first (0 is the oldest kept).
+     */
+    esp_err_t read(size_t first, size_t count, RecordVisitor visitor, void *ctx);
+
+    /// Drop all records.
+    esp_err_t truncate();
+    /// Drop the oldest segment of records.
+    esp_err_t rotate();
+    /// Make every appended record durable.
+    esp_err_t sync();
+
+    /// Number of records currently kept; drops when old segments rotate out.
+    size_t records();
+
+    esp_err_t appendTail(const void *record, size_t length);
+    esp_err_t readTail(RecordVisitor visitor, void *ctx);
+    esp_err_t clearTail();
+
+    StorageStats stats();
+
+    /// The backend selected in menuconfig (RaptMate > History storage backend).
+    static StorageBackend &configured();
+
+    static uint16_t frameCrc(const void *data, size_t length);
+
+protected:
+    StorageBackend();
+
+    virtual esp_err_t doMount() = 0;
+    virtual esp_err_t doAppend(const void *record, size_t length) = 0;
+    virtual esp_err_t doRead(size_t first, size_t count, RecordVisitor visitor, void *ctx, size_t &bytes_read) = 0;
+    virtual esp_err_t doTruncate() = 0;
+    virtual esp_err_t doRotate() = 0;
+    virtual esp_err_t doSync() = 0;
+    virtual size_t doRecords() = 0;
+    virtual esp_err_t doAppendTail(const void *record, size_t length) = 0;
+    virtual esp_err_t doReadTail(RecordVisitor visitor, void *ctx) = 0;
+    virtual esp_err_t doClearTail() = 0;
+    /// Fill capacity, used and payload bytes.
+    virtual void spaceStats(StorageStats &stats) = 0;
+
+    void noteRotation() { m_stats.rotations++; }
+
+private:
+    SemaphoreHandle_t m_mutex;
+    StorageStats m_stats = {};
+};
+
+#endif // STORAGE_BACKEND_HPP
@@ -0,0 +1,61 @@
+#ifndef ALERT_STREAM_HPP
+#define ALERT_STREAM_HPP
+
+#include <atomic>
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "drivers/RuleEngine.hpp"
+
+// Open /api/v1/alerts/stream connections; each holds a socket and an async request while it lasts.
+#define ALERT_STREAM_MAX_CLIENTS 3
+// Alerts and new streams waiting for the stream task; alerts beyond it are not streamed.
+#define ALERT_STREAM_QUEUE_LENGTH 8
+// Comment sent after this long without an alert, so clients that went away are noticed and their socket freed.
+#define ALERT_STREAM_HEARTBEAT_MS 30000
+#define ALERT_STREAM_TASK_STACK 3072
+#define ALERT_STREAM_TASK_PRIORITY 4
+
+/**
+ * @brief Server-sent event streams of rule alerts.
+ *
+ * The server task only detaches the request with httpd_req_async_handler_begin
+ * and hands it over. A dedicated task owns every open stream from then on: it
+ * writes the headers and each event as a chunk of the response, and completes
+ * the request once the client is gone.
+ */
+class AlertStream
+{
+public:
+    static AlertStream &instance();
+
+    /// Start the stream task and subscribe to the rule engine.
+    esp_err_t start();
+
+    /// Take over the request as a new stream; answers 503 itself when all streams are taken.
+    esp_err_t open(httpd_req_t *req);
+
+private:
+    AlertStream() = default;
+
+    // A new stream when req is set, else an alert for every open stream.
+    struct Command
+    {
+        httpd_req_t *req;
+        RuleAlert alert;
+    };
+
+    static void onAlert(const RuleAlert &alert, void *ctx);
+    static void task(void *param);
+    void run();
+    /// Send text to every open stream, completing those whose client is gone.
+    void broadcast(const char *text);
+
+    QueueHandle_t m_commands = nullptr;
+    // Only touched on the stream task.
+    httpd_req_t *m_streams[ALERT_STREAM_MAX_CLIENTS] = {};
+    // Streams opened or being opened; counted on the server task, released on the stream task.
+    std::atomic<int> m_open{0};
+};
+
+#endif // ALERT_STREAM_HPP
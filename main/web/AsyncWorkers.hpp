@@ -0,0 +1,53 @@
+#ifndef ASYNC_WORKERS_HPP
+#define ASYNC_WORKERS_HPP
+
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "common/Arena.hpp"
+
+// Scratch memory for one request; reset when the handler returns.
+#define REQUEST_ARENA_SIZE 4096
+
+#define ASYNC_WORKER_COUNT 2
+#define ASYNC_WORKER_STACK_SIZE 4096
+#define ASYNC_WORKER_PRIORITY 5
+// Requests that may wait for a worker before new ones are answered with 503.
+#define ASYNC_QUEUE_LENGTH 4
+
+/**
+ * @brief Pool of tasks that run long HTTP handlers off the server task.
+ *
+ * The server task only hands the request over with httpd_req_async_handler_begin,
+ * so one slow download does not stall asset serving for other clients.
+ */
+class AsyncWorkers
+{
+public:
+    using Handler = esp_err_t (*)(httpd_req_t *req);
+
+    static esp_err_t start(Arena &server_arena);
+
+    /**
+     * @brief Run handler on a worker, or inline when already on one.
+     * @return ESP_OK once queued; the worker sends the response.
+     */
+    static esp_err_t submit(httpd_req_t *req, Handler handler);
+
+    /// Scratch arena of the calling task: the worker's own, or the server task's.
+    static Arena &requestArena();
+
+private:
+    struct Job
+    {
+        httpd_req_t *req;
+        Handler handler;
+    };
+
+    static void workerTask(void *param);
+
+    static QueueHandle_t s_jobs;
+    static Arena *s_server_arena;
+};
+
+#endif // ASYNC_WORKERS_HPP
@@ -0,0 +1,92 @@
+#ifndef FORMAT_CACHE_HPP
+#define FORMAT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "common/TimeBase.hpp"
+#include "sdkconfig.h"
+
+#define FORMAT_CACHE_BYTES (CONFIG_RAPTMATE_FORMAT_CACHE_KB * 1024)
+#define FORMAT_CACHE_SLOTS 16
+// How much more of the pool a block being formatted claims at a time.
+#define FORMAT_CACHE_GROW_BYTES 1024
+// Shortest /data row; a block too long for the pool even at this is not cached.
+#define FORMAT_CACHE_MIN_ROW_BYTES 40
+
+/**
+ * @brief /data text of sealed history blocks, reused across requests.
+ *
+ * Sealed blocks never change, but their text also depends on how timestamps
+ * resolve. An entry therefore only matches the time offset generation and the
+ * resolver state it was formatted with, and carries the resolver state after
+ * its last row.
+ *
+ * The text lives in a static pool used as a ring: a block is formatted straight
+ * into the space after the newest entry, which grows with the text and makes
+ * room by evicting the oldest entries. Only blocks older than the one being
+ * formatted are evicted, so the cache holds the most recently sealed blocks and
+ * a /data walk from the start does not push them out. At about 55 bytes per
+ * row the default 32 KB covers the newest 590 or so stored samples. Entries for
+ * rotated-out blocks or an old generation are dropped first.
+ */
+class FormatCache
+{
+public:
+    struct Entry
+    {
+        size_t id;
+        uint32_t generation;
+        TimeResolver before;
+        TimeResolver after;
+        const char *text;
+        size_t length;
+        // Insertion order; the entry with the lowest is the oldest in the ring.
+        uint32_t seq;
+        uint16_t pins;
+    };
+
+    /// Pool space claimed for formatting one block; only one is open at a time.
+    struct Reservation
+    {
+        bool active;
+        size_t id;
+        char *text;
+        size_t length;
+        size_t capacity;
+    };
+
+    static FormatCache &instance();
+
+    /// Entry for the block, pinned until release(), or nullptr.
+    const Entry *acquire(size_t id, uint32_t generation, const TimeResolver &before);
+    void release(const Entry *entry);
+
+    /**
+     * @brief Start caching the text of a block; the reservation is inactive when it will not be cached.
+     * @param oldest_id Oldest block still in the history; older entries are dropped
+     */
+    Reservation reserve(size_t id, size_t samples, size_t oldest_id, uint32_t generation);
+    /// Add text to a reservation; once it no longer fits the reservation is released and false returned.
+    bool append(Reservation &reservation, const char *text, size_t length);
+    /// Store a fully formatted block, taking over the reservation.
+    void insert(Reservation &reservation, uint32_t generation, const TimeResolver &before, const TimeResolver &after);
+    void discard(Reservation &reservation);
+
+private:
+    FormatCache();
+    void evict(Entry &entry);
+    Entry *oldest();
+    /// Make the reservation capacity bytes long, moving it to the pool start if it would run past the end.
+    bool claim(Reservation &reservation, size_t capacity);
+
+    SemaphoreHandle_t m_mutex;
+    Entry m_entries[FORMAT_CACHE_SLOTS] = {};
+    // Pool offset where the next reservation starts.
+    size_t m_head = 0;
+    uint32_t m_seq = 0;
+    bool m_reserved = false;
+};
+
+#endif // FORMAT_CACHE_HPP
@@ -0,0 +1,75 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdarg>
+#include "esp_http_server.h"
+
+/**
+ * @brief Buffers output into a fixed buffer and sends it as HTTP chunks.
+ *
+ * Once a send fails every further write is dropped, so handlers can write
+ * unconditionally and check ok() once at the end.
+ */
+class ChunkedResponse
+{
+public:
+    ChunkedResponse(httpd_req_t *req, char *buffer, size_t size)
+        : m_req(req), m_buffer(buffer), m_size(size) {}
+
+    void write(const char *data, size_t len);
+    void write(const char *str);
+    void print(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    /// Flush the buffer and send the terminating chunk.
+    esp_err_t finish();
+
+    bool ok() const { return m_ok; }
+
+private:
+    void flush();
+
+    httpd_req_t *m_req;
+    char *m_buffer;
+    size_t m_size;
+    size_t m_used = 0;
+    bool m_ok = true;
+};
+
+/**
+ * @brief Streaming JSON serializer on top of a ChunkedResponse.
+ *
+ * Tracks only comma placement, so nesting is limited to 32 levels and keys
+ * and values are expected to be written in a valid order by the caller.
+ */
+class JsonWriter
+{
+public:
+    explicit JsonWriter(ChunkedResponse &out) : m_out(out) {}
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(const char *name);
+
+    void value(const char *str);
+    void value(int64_t number);
+    void value(float number, int precision);
+    void value(bool flag);
+    void null();
+
+private:
+    void separator();
+    void push();
+    void pop();
+
+    ChunkedResponse &m_out;
+    uint32_t m_has_items = 0; // Bit per nesting level: an item was already written.
+    uint8_t m_depth = 0;
+    bool m_after_key = false;
+};
+
+#endif // JSON_WRITER_HPP
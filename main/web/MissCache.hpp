@@ -0,0 +1,64 @@
+#ifndef MISS_CACHE_HPP
+#define MISS_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Remembers paths that were looked up and not found.
+ *
+ * Stores 32-bit FNV-1a hashes in a small ring, so probes and typos from the
+ * LAN are answered without touching flash. A hash collision can only turn an
+ * existing file into a 404 if that file never existed when first requested,
+ * which cannot happen for the read-only web partition.
+ */
+template <size_t N>
+class MissCache
+{
+public:
+    bool contains(const char *path) const
+    {
+        uint32_t h = hash(path);
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            if (m_hashes[i] == h)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(const char *path)
+    {
+        m_hashes[m_next] = hash(path);
+        m_next = (m_next + 1) % N;
+        if (m_count < N)
+        {
+            m_count++;
+        }
+    }
+
+    void clear()
+    {
+        m_count = 0;
+        m_next = 0;
+    }
+
+private:
+    static uint32_t hash(const char *path)
+    {
+        uint32_t h = 2166136261u;
+        for (; *path; ++path)
+        {
+            h = (h ^ static_cast<uint8_t>(*path)) * 16777619u;
+        }
+        return h;
+    }
+
+    uint32_t m_hashes[N] = {};
+    size_t m_count = 0;
+    size_t m_next = 0;
+};
+
+#endif // MISS_CACHE_HPP
@@ -0,0 +1,35 @@
+#ifndef QUERY_STRING_HPP
+#define QUERY_STRING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_http_server.h"
+#include "common/Arena.hpp"
+
+/**
+ * @brief Query string of a request, copied once into the request arena.
+ */
+class QueryString
+{
+public:
+    QueryString(httpd_req_t *req, Arena &arena);
+
+    /// False if the request had a query that did not fit into the arena.
+    bool valid() const { return m_valid; }
+    bool empty() const { return m_query == nullptr; }
+
+    bool has(const char *key) const;
+    bool get(const char *key, char *out, size_t size) const;
+
+    /**
+     * @brief Read a decimal integer parameter.
+     * @return false if the key is missing or not a whole number; out is left untouched.
+     */
+    bool getInt(const char *key, int64_t &out) const;
+
+private:
+    char *m_query = nullptr;
+    bool m_valid = true;
+};
+
+#endif // QUERY_STRING_HPP
@@ -25,29 +25,146 @@
 #include "time.h"
 #include "cJSON.h"
 #include "drivers/WifiManager.hpp"
+#include "common/Arena.hpp"
+#include "common/TimeBase.hpp"
+#include "common/Settings.hpp"
+#include "drivers/PowerManager.hpp"
+#include "common/Startup.hpp"
+#include "drivers/Uplink.hpp"
+#include "drivers/Collector.hpp"
+#include "drivers/RuleEngine.hpp"
+#include "common/HistoryBatch.hpp"
+#include "common/HistoryArchive.hpp"
+#include "common/Forecast.hpp"
+#include "common/HistoryExport.hpp"
+#include "web/JsonWriter.hpp"
+#include "web/AsyncWorkers.hpp"
+#include "web/QueryString.hpp"
+#include "web/MissCache.hpp"
+#include "web/FormatCache.hpp"
+#include "web/AlertStream.hpp"
+#include "web/WebAssets.hpp"
+// Size of each chunk sent by streaming handlers.
+#define RESPONSE_CHUNK_SIZE 1024
+// Longest static asset path served from /web.
+#define WEB_PATH_MAX 128
+// Missing static paths remembered to avoid repeated flash lookups.
+#define WEB_MISS_CACHE_SIZE 32
+// Largest accepted settings request body.
+#define SETTINGS_BODY_MAX 1024
+// BLE scan timing unit.
+#define BLE_SCAN_UNIT_MS 0.625f
+// Room for a quoted history ETag.
+#define HISTORY_ETAG_SIZE 40
+// Page size limits for /api/v1/readings.
+#define READINGS_DEFAULT_LIMIT 500
+#define READINGS_MAX_LIMIT 2000
+// Bytes of a /restore upload received at a time.
+#define RESTORE_RECV_CHUNK 512
+// Room for a /api/v1/history/export validator and the Range header it answers.
+#define EXPORT_ETAG_SIZE 64
+#define EXPORT_RANGE_HEADER_MAX 64
+// Largest accepted /api/v1/rules body: the rules as a JSON array, quoted, plus the webhook.
+#define RULES_BODY_MAX (RULES_TEXT_MAX + RULES_MAX * 4 + RULES_WEBHOOK_MAX + 64)
+// Largest iSpindel post, and how long it waits for room in the ingest queue.
+#define ISPINDEL_BODY_MAX 512
+#define ISPINDEL_QUEUE_WAIT_MS 100
+// Samples per device served by /api/v1/fleet/readings.
+#define FLEET_READINGS_DEFAULT_LIMIT 256
+#define FLEET_READINGS_MAX_LIMIT (COLLECTOR_PEER_BLOCKS * GORILLA_BLOCK_MAX_SAMPLES)
+
+/**
+ * @brief Connection handling settings applied on top of HTTPD_DEFAULT_CONFIG().
+ */
+struct HttpServerProfile
+{
+    uint16_t max_open_sockets; // Must stay below CONFIG_LWIP_MAX_SOCKETS - 3.
+    uint16_t max_uri_handlers;
+    uint16_t recv_wait_timeout_s;
+    uint16_t send_wait_timeout_s;
+    bool lru_purge;            // Close the least recently used socket instead of refusing new clients.
+    bool keep_alive;           // TCP keep-alive, so phones that left the AP free their slot.
+    int keep_alive_idle_s;
+    int keep_alive_interval_s;
+    int keep_alive_count;
+    size_t stack_size;
+};
 
 class RaptMateServer {
 public:
-    RaptMateServer(RaptPillBLE* ble, WiFiManager* wm) : server(NULL), ble(ble), wm(wm) {}
-    void init();
+    RaptMateServer(RaptPillBLE* ble, WiFiManager* wm) : server(NULL), ble(ble), wm(wm) { instance_ = this; }
+    /// Make the web UI files available; a no-op when they are embedded.
+    esp_err_t mountWeb();
+    /// Start the HTTP server. Call once the web UI is mounted, so early requests are not cached as misses.
+    esp_err_t start();
     ~RaptMateServer();
 
     RaptPillData get_data() { return rapt_pill_data; }
 private:
+    // Several dashboards plus a logging script on the soft-AP, with exports running on async workers.
+    static constexpr HttpServerProfile server_profile = {
+        .max_open_sockets = 10,
+        .max_uri_handlers = 28,
+        .recv_wait_timeout_s = 10,
+        .send_wait_timeout_s = 10,
+        .lru_purge = true,
+        .keep_alive = true,
+        .keep_alive_idle_s = 15,
+        .keep_alive_interval_s = 5,
+        .keep_alive_count = 3,
+        .stack_size = 6144,
+    };
+
+    struct Route
+    {
+        const char *uri;
+        httpd_method_t method;
+        esp_err_t (*handler)(httpd_req_t *req);
+        bool async; // Run on an AsyncWorkers task instead of the server task.
+    };
+    static const Route routes[];
+    static const size_t route_count;
 
     httpd_handle_t server;
     RaptPillBLE* ble;
     WiFiManager* wm;
-    void init_http_server();
+    static RaptMateServer *instance_;
+    static esp_err_t route_handler(httpd_req_t *req);
 
     // HTTP URI handlers.
-    static esp_err_t index_get_handler(httpd_req_t *req);
     static esp_err_t static_file_get_handler(httpd_req_t *req);
     static esp_err_t settings_post_handler(httpd_req_t *req);
-    static std::string formatRaptPillData(const RaptPillData &data);
+    static esp_err_t settings_get_handler(httpd_req_t *req);
+    static esp_err_t settings_patch_handler(httpd_req_t *req);
+    static esp_err_t power_get_handler(httpd_req_t *req);
+    static esp_err_t storage_get_handler(httpd_req_t *req);
+    static esp_err_t health_get_handler(httpd_req_t *req);
+    static esp_err_t uplink_get_handler(httpd_req_t *req);
+    static esp_err_t history_delta_get_handler(httpd_req_t *req);
+    static esp_err_t history_export_get_handler(httpd_req_t *req);
+    static esp_err_t fleet_get_handler(httpd_req_t *req);
+    static esp_err_t fleet_readings_get_handler(httpd_req_t *req);
+    static esp_err_t rules_get_handler(httpd_req_t *req);
+    static esp_err_t rules_put_handler(httpd_req_t *req);
+    static esp_err_t alerts_get_handler(httpd_req_t *req);
+    static esp_err_t alerts_stream_get_handler(httpd_req_t *req);
+    static esp_err_t forecast_get_handler(httpd_req_t *req);
+    static esp_err_t ispindel_post_handler(httpd_req_t *req);
+    static esp_err_t devices_get_handler(httpd_req_t *req);
+    static esp_err_t send_settings(httpd_req_t *req, const Settings &settings);
+    static char *receive_body(httpd_req_t *req, Arena &arena, size_t max_length);
+    static esp_err_t reset_get_handler(httpd_req_t *req);
+    static esp_err_t backup_get_handler(httpd_req_t *req);
+    static esp_err_t restore_post_handler(httpd_req_t *req);
+    static const char *formatRaptPillData(const RaptPillData &data, Arena &arena);
+    static bool history_not_modified(httpd_req_t *req, char *etag);
     static char* get_content_type(const char* filepath);
 
     static esp_err_t data_get_handler(httpd_req_t *req);
+    static esp_err_t readings_get_handler(httpd_req_t *req);
+    static esp_err_t network_get_handler(httpd_req_t *req);
+    static esp_err_t time_get_handler(httpd_req_t *req);
+    static esp_err_t time_post_handler(httpd_req_t *req);
     RaptPillData rapt_pill_data;
 
 };
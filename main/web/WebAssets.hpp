@@ -0,0 +1,58 @@
+#ifndef WEB_ASSETS_HPP
+#define WEB_ASSETS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/// A file of the web UI compiled into the app image.
+struct WebAsset
+{
+    const char *path;
+    const uint8_t *data;
+    size_t length;
+    const char *content_type;
+    // Quoted, ready for the ETag header.
+    const char *etag;
+    // data holds the gzip-compressed file.
+    bool gzip;
+};
+
+/**
+ * @brief Web UI embedded by tools/embed_web_assets.py (RaptMate > Embed web UI).
+ *
+ * The table is generated at build time, sorted by path, and lives in flash
+ * like the rest of .rodata, so assets are served without any file I/O.
+ */
+class WebAssets
+{
+public:
+    /// Asset at path (length characters, not necessarily terminated), or nullptr.
+    static const WebAsset *find(const char *path, size_t length);
+
+    static constexpr int compare(const char *a, const char *b)
+    {
+        while (*a && *a == *b)
+        {
+            ++a;
+            ++b;
+        }
+        return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+    }
+
+    static constexpr bool sorted(const WebAsset *assets, size_t count)
+    {
+        for (size_t i = 1; i < count; ++i)
+        {
+            if (compare(assets[i - 1].path, assets[i].path) >= 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const WebAsset *const table;
+    static const size_t count;
+};
+
+#endif // WEB_ASSETS_HPP
@@ -6,6 +6,7 @@ import {
     TableBody,
     TableCell,
     TableContainer,
+    TableHead,
     TableRow,
     AppBar,
     Toolbar,
@@ -26,12 +27,22 @@ function App() {
     const [ssid, setSsid] = useState('');
     const [password, setPassword] = useState('');
     const [tabIndex, setTabIndex] = useState(0);
+    const [fleet, setFleet] = useState(null);
     const [chartData, setChartData] = useState({
         labels: [],
         gravity: [],
         temperature: [],
         battery: []
     });
+    useEffect(() => {
+        // Hand the browser clock to the device; it is ignored once the device has synced over NTP.
+        fetch('/api/v1/time', {
+            method: 'POST',
+            headers: { 'Content-Type': 'application/json' },
+            body: JSON.stringify({ unix_ms: Date.now() }),
+        }).catch(() => {});
+    }, []);
+
     useEffect(() => {
         const fetchData = () => {
             fetch('/data', { headers: { 'Accept': 'text/csv' } })
@@ -74,6 +85,20 @@ function App() {
         return () => clearInterval(interval);
     }, []);
 
+    useEffect(() => {
+        if (tabIndex !== 1) {
+            return undefined;
+        }
+        const fetchFleet = () => {
+            fetch('/api/v1/fleet')
+                .then(response => response.json())
+                .then(setFleet)
+                .catch(() => {});
+        };
+        const interval = setInterval(fetchFleet, 10000);
+        fetchFleet();
+        return () => clearInterval(interval);
+    }, [tabIndex]);
 
     const handleTabChange = (event, newValue) => {
         setTabIndex(newValue);
@@ -97,6 +122,7 @@ function App() {
                 sx={{ mb: 3 }}
             >
                 <Tab label="Overview" />
+                <Tab label="Fleet" />
                 <Tab label="Settings" />
             </Tabs>
             <Container maxWidth="lg">
@@ -223,6 +249,54 @@ function App() {
                     </Paper>
                 )}
                 {tabIndex === 1 && (
+                    <Paper elevation={4} sx={{ p: 3, mb: 4 }}>
+                        <Typography variant="h6" gutterBottom align="left">
+                            Devices
+                        </Typography>
+                        {fleet && !fleet.collector && (
+                            <Typography variant="body2" align="left" sx={{ mb: 2 }}>
+                                Collector mode is off; only this device is shown.
+                            </Typography>
+                        )}
+                        <TableContainer component={Paper} elevation={2}>
+                            <Table size="small">
+                                <TableHead>
+                                    <TableRow>
+                                        <TableCell>Device</TableCell>
+                                        <TableCell>State</TableCell>
+                                        <TableCell align="right">Specific Gravity</TableCell>
+                                        <TableCell align="right">Temperature (°C)</TableCell>
+                                        <TableCell align="right">Battery</TableCell>
+                                        <TableCell align="right">Last Reading</TableCell>
+                                        <TableCell align="right">Samples</TableCell>
+                                    </TableRow>
+                                </TableHead>
+                                <TableBody>
+                                    {(fleet?.devices || []).map(device => (
+                                        <TableRow key={device.id || `${device.host}:${device.port}`}>
+                                            <TableCell>
+                                                {device.id || `${device.host}:${device.port}`}
+                                                {device.local && ' (this device)'}
+                                            </TableCell>
+                                            <TableCell>
+                                                {device.local ? 'local' : device.state}
+                                                {device.last_error && ` (${device.last_error})`}
+                                            </TableCell>
+                                            <TableCell align="right">{device.latest?.sg?.toFixed(4) ?? '-'}</TableCell>
+                                            <TableCell align="right">{device.latest?.temp ?? '-'}</TableCell>
+                                            <TableCell align="right">{device.latest?.battery ?? '-'}</TableCell>
+                                            <TableCell align="right">
+                                                {device.latest?.timestamp ? new Date(device.latest.timestamp * 1000).toLocaleString() : '-'}
+                                            </TableCell>
+                                            <TableCell align="right">{device.samples}</TableCell>
+                                        </TableRow>
+                                    ))}
+                                </TableBody>
+                            </Table>
+                        </TableContainer>
+                    </Paper>
+                )}
+                {tabIndex === 2 && (
                     <Box display="flex" flexDirection="column" gap={3}>
                         <Paper elevation={4} sx={{ p: 3 }}>
                             <Typography variant="h6" gutterBottom align="left">
@@ -275,7 +349,40 @@ function App() {
                             <Typography variant="h6" gutterBottom align="left">
                                 Data Management
                             </Typography>
-                            <Box display="flex" justifyContent="flex-start">
+                            <Box display="flex" justifyContent="flex-start" gap={2}>
+                                <Button
+                                    variant="contained"
+                                    color="primary"
+                                    href="/backup"
+                                    sx={{ mt: 1 }}
+                                >
+                                    Download Backup
+                                </Button>
+                                <Button
+                                    variant="outlined"
+                                    color="primary"
+                                    component="label"
+                                    sx={{ mt: 1 }}
+                                >
+                                    Restore
+                                    <input
+                                        type="file"
+                                        accept=".rmbk,.csv"
+                                        hidden
+                                        onChange={(e) => {
+                                            const file = e.target.files[0];
+                                            e.target.value = '';
+                                            if (!file || !window.confirm('Restoring replaces the stored history. Continue?')) {
+                                                return;
+                                            }
+                                            fetch('/restore', { method: 'POST', body: file })
+                                                .then(response => response.ok
+                                                    ? response.json().then(result => alert(`Restored ${result.samples} samples`))
+                                                    : response.text().then(text => alert(`Restore failed: ${text}`)))
+                                                .catch(() => alert('Error occurred while restoring'));
+                                        }}
+                                    />
+                                </Button>
                                 <Button
                                     variant="contained"
                                     color="error"
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <vector>
+#include "esp_spiffs.h"
+#include "storage/FileBackend.hpp"
+#include "storage/RawPartitionBackend.hpp"
+#include "test.hpp"
+
+// Size of the data partition in partitions.csv.
+#define BENCH_PARTITION_SIZE 0xF0000
+#define BENCH_SPIFFS_PATH "bench_spiffs"
+#define BENCH_SPIFFS_PAGE 256
+// A history record is a tag byte plus a Gorilla block of up to 1000 bytes.
+#define BENCH_RECORD_MAX 1001
+#define BENCH_RECORD_MIN 200
+
+using Clock = std::chrono::steady_clock;
+
+// RAM-backed NOR flash: erase sets bytes to 0xFF, writes can only clear bits.
+static esp_partition_t partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_ANY,
+    .address = 0x310000,
+    .size = BENCH_PARTITION_SIZE,
+    .erase_size = RAW_SECTOR_SIZE,
+    .label = "data",
+};
+static std::vector<uint8_t> flash(BENCH_PARTITION_SIZE, 0xFF);
+static size_t flash_erases;
+static size_t flash_written;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *label)
+{
+    return strcmp(label, partition.label) == 0 ? &partition : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > flash.size())
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, flash.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *, size_t offset, const void *src, size_t size)
+{
+    if (offset + size > flash.size())
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; ++i)
+    {
+        flash[offset + i] &= bytes[i];
+    }
+    flash_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t offset, size_t size)
+{
+    if (offset % RAW_SECTOR_SIZE != 0 || size % RAW_SECTOR_SIZE != 0 || offset + size > flash.size())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::fill(flash.begin() + offset, flash.begin() + offset + size, 0xFF);
+    flash_erases += size / RAW_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+// SPIFFS is a directory in the build tree; the backend's own stdio calls do the rest.
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    mkdir(conf->base_path, 0755);
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char *, size_t *total, size_t *used)
+{
+    // Files take whole pages; SPIFFS' index pages and GC reserve are not modelled,
+    // so this is the best case for the filesystem backends.
+    *total = BENCH_PARTITION_SIZE;
+    *used = 0;
+    DIR *dir = opendir(BENCH_SPIFFS_PATH);
+    for (dirent *entry = dir ? readdir(dir) : nullptr; entry; entry = readdir(dir))
+    {
+        char path[FILE_BACKEND_PATH_MAX + 256];
+        snprintf(path, sizeof(path), "%s/%s", BENCH_SPIFFS_PATH, entry->d_name);
+        struct stat st;
+        if (entry->d_name[0] != '.' && stat(path, &st) == 0)
+        {
+            *used += (st.st_size + BENCH_SPIFFS_PAGE - 1) / BENCH_SPIFFS_PAGE * BENCH_SPIFFS_PAGE;
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    return ESP_OK;
+}
+
+// Record n starts with n and is filled with a pattern derived from it.
+static size_t makeRecord(uint32_t n, uint8_t *record)
+{
+    size_t length = BENCH_RECORD_MIN + (n * 2654435761u) % (BENCH_RECORD_MAX - BENCH_RECORD_MIN + 1);
+    memcpy(record, &n, sizeof(n));
+    for (size_t i = sizeof(n); i < length; ++i)
+    {
+        record[i] = static_cast<uint8_t>(n + i);
+    }
+    return length;
+}
+
+struct ReadCheck
+{
+    uint32_t next;
+    size_t records;
+    size_t bytes;
+    bool ordered;
+};
+
+static bool checkRecord(const uint8_t *record, size_t length, void *ctx)
+{
+    ReadCheck &check = *static_cast<ReadCheck *>(ctx);
+    uint32_t n;
+    memcpy(&n, record, sizeof(n));
+    uint8_t expected[BENCH_RECORD_MAX];
+    // Rotation drops the oldest records, so the first one read may be any; the rest follow on.
+    bool ordered = (check.records == 0 || n == check.next) && makeRecord(n, expected) == length &&
+                   memcmp(expected, record, length) == 0;
+    check.ordered &= ordered;
+    check.next = n + 1;
+    check.records++;
+    check.bytes += length;
+    return true;
+}
+
+static double percentile(std::vector<int64_t> &values, double share)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0.0 : values[std::min(values.size() - 1, static_cast<size_t>(values.size() * share))] / 1000.0;
+}
+
+/**
+ * Append until level% of the capacity has been written as payload, then read
+ * everything back. Latency covers the appends since the previous level.
+ */
+static void fillTo(StorageBackend &backend, int level, uint32_t &next, size_t &payload_written)
+{
+    uint8_t record[BENCH_RECORD_MAX];
+    size_t target = backend.stats().capacity_bytes * level / 100;
+    size_t erases = flash_erases, written = flash_written;
+    std::vector<int64_t> latency_ns;
+    while (payload_written < target)
+    {
+        size_t length = makeRecord(next++, record);
+        Clock::time_point start = Clock::now();
+        CHECK(backend.append(record, length) == ESP_OK);
+        latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        payload_written += length;
+    }
+    size_t appends = latency_ns.size();
+
+    ReadCheck check = {.next = 0, .records = 0, .bytes = 0, .ordered = true};
+    Clock::time_point start = Clock::now();
+    CHECK(backend.read(0, SIZE_MAX, checkRecord, &check) == ESP_OK);
+    double read_s = std::chrono::duration<double>(Clock::now() - start).count();
+    CHECK(check.ordered);
+    CHECK(check.records == backend.records());
+    CHECK(check.records > 0 && check.next == next);
+
+    StorageStats stats = backend.stats();
+    CHECK(stats.payload_bytes == check.bytes);
+    std::printf("%-8s %3d%%  used %5.1f%%  %6zu records  append p50 %7.2f us  p99 %7.2f us  max %8.2f us  "
+                "read %7.1f MB/s  efficiency %5.1f%%",
+                backend.name(), level, 100.0 * stats.used_bytes / stats.capacity_bytes, check.records,
+                percentile(latency_ns, 0.5), percentile(latency_ns, 0.99), percentile(latency_ns, 1.0),
+                check.bytes / read_s / 1e6, stats.used_bytes ? 100.0 * stats.payload_bytes / stats.used_bytes : 0.0);
+    if (flash_erases != erases || flash_written != written)
+    {
+        // Flash work per append: what the latency is made of on the device.
+        std::printf("  %.3f erases, %.0f bytes programmed per append", double(flash_erases - erases) / appends,
+                    double(flash_written - written) / appends);
+    }
+    std::printf("\n");
+}
+
+static void bench(StorageBackend &backend)
+{
+    CHECK(backend.mount() == ESP_OK);
+    CHECK(backend.truncate() == ESP_OK);
+    uint32_t next = 0;
+    size_t payload_written = 0;
+    for (int level : {10, 50, 90})
+    {
+        fillTo(backend, level, next, payload_written);
+    }
+}
+
+int main()
+{
+    RawPartitionBackend raw("data");
+    bench(raw);
+    size_t records = raw.records();
+    // Everything appended is found again after a reboot.
+    RawPartitionBackend remounted("data");
+    CHECK(remounted.mount() == ESP_OK);
+    CHECK(remounted.records() == records);
+
+    remove(BENCH_SPIFFS_PATH "/history.log");
+    remove(BENCH_SPIFFS_PATH "/history.old");
+    SpiffsBackend spiffs(BENCH_SPIFFS_PATH, "data");
+    bench(spiffs);
+    return TEST_RESULT();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h>
+
+// The subset of cJSON the tested modules use. Objects are built by hand in the tests.
+#define cJSON_Invalid (0)
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON
+{
+    struct cJSON *next, *prev, *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef struct cJSON_Hooks
+{
+    void *(*malloc_fn)(size_t sz);
+    void (*free_fn)(void *ptr);
+} cJSON_Hooks;
+
+typedef int cJSON_bool;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *name);
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *name);
+cJSON_bool cJSON_IsNumber(const cJSON *item);
+cJSON_bool cJSON_IsString(const cJSON *item);
+double cJSON_GetNumberValue(const cJSON *item);
+char *cJSON_GetStringValue(const cJSON *item);
+
+// Test helpers: the allocator the firmware routed cJSON to, via cJSON_InitHooks.
+void *stub_cjson_malloc(size_t size);
+void stub_cjson_free(void *ptr);
@@ -0,0 +1,22 @@
+#pragma once
+#include <stddef.h>
+#include "esp_err.h"
+
+// Just enough of a request to carry a URI; the query helpers parse it like ESP-IDF.
+typedef void *httpd_handle_t;
+
+typedef struct httpd_req
+{
+    httpd_handle_t handle;
+    int method;
+    char uri[513];
+    size_t content_len;
+    void *aux;
+    void *user_ctx;
+} httpd_req_t;
+
+#define ESP_ERR_HTTPD_RESULT_TRUNC 0xb008
+
+size_t httpd_req_get_url_query_len(httpd_req_t *req);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
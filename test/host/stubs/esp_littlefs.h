@@ -0,0 +1,7 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct { const char *base_path; const char *partition_label; const void *partition; uint8_t format_if_mount_failed:1; uint8_t read_only:1; uint8_t dont_mount:1; uint8_t grow_on_mount:1; } esp_vfs_littlefs_conf_t;
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *);
+esp_err_t esp_littlefs_info(const char *, size_t *, size_t *);
@@ -0,0 +1,10 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_sntp.h"
+typedef void (*esp_sntp_time_cb_t)(struct timeval *tv);
+typedef struct { bool smooth_sync; bool server_from_dhcp; bool wait_for_sync; bool start; esp_sntp_time_cb_t sync_cb; bool renew_servers_after_new_IP; int ip_event_to_renew; size_t index_of_first_server; size_t num_of_servers; const char *servers[1]; } esp_sntp_config_t;
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) esp_sntp_config_t{ false, false, true, true, nullptr, false, 0, 0, 1, {server} }
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *);
+esp_err_t esp_netif_sntp_start(void);
+void esp_netif_sntp_deinit(void);
+esp_err_t esp_netif_sntp_sync_wait(uint32_t);
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+uint16_t esp_rom_crc16_le(uint16_t, const uint8_t *, uint32_t);
+uint32_t esp_rom_crc32_le(uint32_t, const uint8_t *, uint32_t);
@@ -0,0 +1,11 @@
+#pragma once
+#include <sys/time.h>
+typedef enum { SNTP_SYNC_MODE_IMMED, SNTP_SYNC_MODE_SMOOTH } sntp_sync_mode_t;
+typedef enum { SNTP_SYNC_STATUS_RESET, SNTP_SYNC_STATUS_COMPLETED, SNTP_SYNC_STATUS_IN_PROGRESS } sntp_sync_status_t;
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+void sntp_init(void);
+void sntp_setservername(int, const char *);
+void sntp_set_sync_mode(sntp_sync_mode_t);
+void sntp_set_sync_interval(uint32_t);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t);
+sntp_sync_status_t sntp_get_sync_status(void);
@@ -0,0 +1,30 @@
+#pragma once
+#include "esp_netif.h"
+typedef enum { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+typedef enum { WIFI_IF_STA, WIFI_IF_AP } wifi_interface_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum { WIFI_AUTH_OPEN, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK } wifi_auth_mode_t;
+typedef enum { WIFI_ALL_CHANNEL_SCAN, WIFI_FAST_SCAN } wifi_scan_method_t;
+typedef struct { bool capable; bool required; } wifi_pmf_config_t;
+typedef struct { int8_t rssi; wifi_auth_mode_t authmode; } wifi_scan_threshold_t;
+typedef struct { uint8_t ssid[32]; uint8_t password[64]; uint8_t ssid_len; uint8_t channel; wifi_auth_mode_t authmode; uint8_t ssid_hidden; uint8_t max_connection; uint16_t beacon_interval; uint8_t csa_count; uint8_t dtim_period; int pairwise_cipher; bool ftm_responder; wifi_pmf_config_t pmf_cfg; } wifi_ap_config_t;
+typedef struct { uint8_t ssid[32]; uint8_t password[64]; wifi_scan_method_t scan_method; bool bssid_set; uint8_t bssid[6]; uint8_t channel; uint16_t listen_interval; int sort_method; wifi_scan_threshold_t threshold; wifi_pmf_config_t pmf_cfg; } wifi_sta_config_t;
+typedef union { wifi_ap_config_t ap; wifi_sta_config_t sta; } wifi_config_t;
+typedef struct { int x; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() wifi_init_config_t{}
+extern esp_event_base_t WIFI_EVENT;
+enum { WIFI_EVENT_WIFI_READY, WIFI_EVENT_SCAN_DONE, WIFI_EVENT_STA_START, WIFI_EVENT_STA_STOP, WIFI_EVENT_STA_CONNECTED, WIFI_EVENT_STA_DISCONNECTED, WIFI_EVENT_AP_START, WIFI_EVENT_AP_STACONNECTED, WIFI_EVENT_AP_STADISCONNECTED };
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; wifi_auth_mode_t authmode; uint16_t aid; } wifi_event_sta_connected_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; int8_t rssi; } wifi_event_sta_disconnected_t;
+enum { WIFI_REASON_AUTH_FAIL = 202, WIFI_REASON_NO_AP_FOUND = 201, WIFI_REASON_ASSOC_LEAVE = 8, WIFI_REASON_HANDSHAKE_TIMEOUT = 204 };
+esp_err_t esp_wifi_init(const wifi_init_config_t *);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *);
+esp_err_t esp_wifi_set_mode(wifi_mode_t);
+esp_err_t esp_wifi_get_mode(wifi_mode_t *);
+esp_err_t esp_wifi_set_config(wifi_interface_t, wifi_config_t *);
+esp_err_t esp_wifi_get_config(wifi_interface_t, wifi_config_t *);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
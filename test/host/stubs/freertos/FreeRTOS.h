@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(x) ((TickType_t)(x)/10)
+#define pdTICKS_TO_MS(x) ((x)*10)
+#define configTICK_RATE_HZ 100
+typedef struct { int x; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(m) (void)(m)
+#define portEXIT_CRITICAL(m) (void)(m)
+#define tskNO_AFFINITY 0x7fffffff
+#define portNUM_PROCESSORS 2
+#define portENTER_CRITICAL_SAFE(m) (void)(m)
+#define portEXIT_CRITICAL_SAFE(m) (void)(m)
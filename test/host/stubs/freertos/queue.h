@@ -0,0 +1,13 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef struct QueueDefinition *QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t);
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t);
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t);
+BaseType_t xQueueReset(QueueHandle_t);
+typedef struct QueueDefinition *QueueSetHandle_t;
+typedef struct QueueDefinition *QueueSetMemberHandle_t;
+QueueSetHandle_t xQueueCreateSet(UBaseType_t);
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t, QueueSetHandle_t);
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t, TickType_t);
@@ -0,0 +1,16 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void (*TaskFunction_t)(void *);
+typedef struct tskTaskControlBlock *TaskHandle_t;
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, BaseType_t);
+void vTaskDelay(TickType_t);
+void vTaskDelete(TaskHandle_t);
+TickType_t xTaskGetTickCount(void);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskGetIdleRunTimeCounter(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+uint32_t ulTaskGetRunTimeCounter(TaskHandle_t);
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t);
@@ -0,0 +1,16 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_netif.h"
+typedef struct { const char *key; const char *value; } mdns_txt_item_t;
+#define ESP_IPADDR_TYPE_V4 0
+#define ESP_IPADDR_TYPE_V6 6
+typedef struct { union { esp_ip4_addr_t ip4; uint32_t ip6[4]; } u_addr; uint8_t type; } esp_ip_addr_t;
+typedef struct mdns_ip_addr_s { esp_ip_addr_t addr; struct mdns_ip_addr_s *next; } mdns_ip_addr_t;
+typedef struct mdns_result_s { struct mdns_result_s *next; esp_netif_t *esp_netif; uint32_t ttl; int ip_protocol; char *instance_name; char *service_type; char *proto; char *hostname; uint16_t port; mdns_txt_item_t *txt; uint8_t *txt_value_len; size_t txt_count; mdns_ip_addr_t *addr; } mdns_result_t;
+esp_err_t mdns_init(void);
+esp_err_t mdns_hostname_set(const char *);
+esp_err_t mdns_instance_name_set(const char *);
+esp_err_t mdns_service_add(const char *, const char *, const char *, uint16_t, mdns_txt_item_t *, size_t);
+esp_err_t mdns_service_txt_item_set(const char *, const char *, const char *, const char *);
+esp_err_t mdns_query_ptr(const char *, const char *, uint32_t, size_t, mdns_result_t **);
+void mdns_query_results_free(mdns_result_t *);
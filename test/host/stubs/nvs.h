@@ -0,0 +1,18 @@
+#pragma once
+#include "esp_err.h"
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *);
+void nvs_close(nvs_handle_t);
+esp_err_t nvs_commit(nvs_handle_t);
+esp_err_t nvs_get_blob(nvs_handle_t, const char *, void *, size_t *);
+esp_err_t nvs_set_blob(nvs_handle_t, const char *, const void *, size_t);
+esp_err_t nvs_get_u32(nvs_handle_t, const char *, uint32_t *);
+esp_err_t nvs_set_u32(nvs_handle_t, const char *, uint32_t);
+esp_err_t nvs_get_u64(nvs_handle_t, const char *, uint64_t *);
+esp_err_t nvs_set_u64(nvs_handle_t, const char *, uint64_t);
+esp_err_t nvs_get_i64(nvs_handle_t, const char *, int64_t *);
+esp_err_t nvs_set_i64(nvs_handle_t, const char *, int64_t);
+esp_err_t nvs_get_str(nvs_handle_t, const char *, char *, size_t *);
+esp_err_t nvs_set_str(nvs_handle_t, const char *, const char *);
+esp_err_t nvs_erase_key(nvs_handle_t, const char *);
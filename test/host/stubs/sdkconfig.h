@@ -0,0 +1,2 @@
+#pragma once
+// No Kconfig choices are made on the host, so the firmware defaults apply.
@@ -0,0 +1,175 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "cJSON.h"
+#include "esp_http_server.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+
+namespace
+{
+    cJSON_Hooks json_hooks = {.malloc_fn = malloc, .free_fn = free};
+}
+
+void cJSON_InitHooks(cJSON_Hooks *hooks)
+{
+    json_hooks = hooks ? *hooks : cJSON_Hooks{.malloc_fn = malloc, .free_fn = free};
+}
+
+void *stub_cjson_malloc(size_t size)
+{
+    return json_hooks.malloc_fn(size);
+}
+
+void stub_cjson_free(void *ptr)
+{
+    json_hooks.free_fn(ptr);
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *name)
+{
+    for (cJSON *item = object ? object->child : nullptr; item; item = item->next)
+    {
+        if (item->string && strcasecmp(item->string, name) == 0)
+        {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *name)
+{
+    for (cJSON *item = object ? object->child : nullptr; item; item = item->next)
+    {
+        if (item->string && strcmp(item->string, name) == 0)
+        {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item)
+{
+    return item && (item->type & 0xff) == cJSON_String;
+}
+
+double cJSON_GetNumberValue(const cJSON *item)
+{
+    return cJSON_IsNumber(item) ? item->valuedouble : 0.0;
+}
+
+char *cJSON_GetStringValue(const cJSON *item)
+{
+    return cJSON_IsString(item) ? item->valuestring : nullptr;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *req)
+{
+    const char *query = strchr(req->uri, '?');
+    return query ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len)
+{
+    const char *query = strchr(req->uri, '?');
+    if (!query)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t len = strlen(query + 1);
+    size_t copied = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query + 1, copied);
+    buf[copied] = '\0';
+    return copied < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t key_len = strlen(key);
+    for (const char *pair = qry; pair && *pair; pair = strchr(pair, '&') ? strchr(pair, '&') + 1 : nullptr)
+    {
+        if (strncmp(pair, key, key_len) != 0 || pair[key_len] != '=')
+        {
+            continue;
+        }
+        const char *value = pair + key_len + 1;
+        size_t len = strcspn(value, "&");
+        size_t copied = len < val_size - 1 ? len : val_size - 1;
+        memcpy(val, value, copied);
+        val[copied] = '\0';
+        return copied < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t *buf, uint32_t len)
+{
+    // CRC-16/CCITT, reflected, as in the ROM.
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+// The host tests are single threaded, so a mutex never blocks.
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    static int mutex;
+    return reinterpret_cast<SemaphoreHandle_t>(&mutex);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t)
+{
+    return pdTRUE;
+}
+
+// There is no NVS on the host; callers see it fail to open and keep their state in RAM.
+esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *)
+{
+    return ESP_FAIL;
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t, const char *, const void *, size_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t, const char *, uint32_t)
+{
+    return ESP_FAIL;
+}
@@ -0,0 +1,40 @@
+#ifndef HOST_TEST_HPP
+#define HOST_TEST_HPP
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal assertion helpers for the host tests: failures are reported and
+// counted, and main() returns TEST_RESULT() so ctest sees the outcome.
+
+inline int &test_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures()++;                                                   \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                          \
+    do                                                                                   \
+    {                                                                                    \
+        double actual_ = (actual), expected_ = (expected);                               \
+        if (!(std::fabs(actual_ - expected_) <= (tolerance)))                            \
+        {                                                                                \
+            std::printf("%s:%d: CHECK_NEAR(%s, %s) failed: %.9g vs %.9g\n", __FILE__,    \
+                        __LINE__, #actual, #expected, actual_, expected_);               \
+            test_failures()++;                                                           \
+        }                                                                                \
+    } while (0)
+
+#define TEST_RESULT() (test_failures() == 0 ? 0 : 1)
+
+#endif // HOST_TEST_HPP
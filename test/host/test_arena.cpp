@@ -0,0 +1,94 @@
+#include <cstdint>
+#include <cstring>
+#include "common/Arena.hpp"
+#include "cJSON.h"
+#include "test.hpp"
+
+static void testAllocateAlignsAndExhausts()
+{
+    StaticArena<128> arena;
+    void *a = arena.allocate(3, 1);
+    void *b = arena.allocate(8, 8);
+    CHECK(a != nullptr && b != nullptr);
+    CHECK(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+    CHECK(arena.used() == 16);
+    CHECK(arena.owns(a) && arena.owns(b));
+
+    CHECK(arena.allocate(113, 1) == nullptr);
+    CHECK(arena.used() == 16);
+    CHECK(arena.allocate(112, 1) != nullptr);
+    CHECK(arena.used() == arena.capacity());
+
+    arena.reset();
+    CHECK(arena.used() == 0);
+    CHECK(arena.highWater() == 128);
+}
+
+static void testFormat()
+{
+    StaticArena<16> arena;
+    char *text = arena.format("%d-%s", 42, "ab");
+    CHECK(text != nullptr && strcmp(text, "42-ab") == 0);
+    CHECK(arena.used() == 6);
+
+    // Needs 11 bytes with the terminator; only 10 are left.
+    CHECK(arena.format("%s", "0123456789") == nullptr);
+    CHECK(arena.used() == 6);
+    CHECK(arena.format("%s", "012345678") != nullptr);
+}
+
+static void testScopeBindsAndResets()
+{
+    StaticArena<64> outer;
+    StaticArena<64> inner;
+    CHECK(Arena::current() == nullptr);
+    {
+        ArenaScope outer_scope(outer);
+        CHECK(Arena::current() == &outer);
+        outer.allocate(10, 1);
+        {
+            ArenaScope inner_scope(inner);
+            CHECK(Arena::current() == &inner);
+            inner.allocate(10, 1);
+        }
+        CHECK(inner.used() == 0);
+        CHECK(Arena::current() == &outer);
+        CHECK(outer.used() == 10);
+    }
+    CHECK(outer.used() == 0);
+    CHECK(Arena::current() == nullptr);
+}
+
+static void testJsonHooksFallBackToHeap()
+{
+    Arena::installJsonHooks();
+    StaticArena<64> arena;
+
+    // Outside a scope cJSON gets the heap.
+    void *heap = stub_cjson_malloc(16);
+    CHECK(heap != nullptr && !arena.owns(heap));
+    stub_cjson_free(heap);
+
+    {
+        ArenaScope scope(arena);
+        void *small = stub_cjson_malloc(16);
+        CHECK(arena.owns(small));
+        stub_cjson_free(small);
+        CHECK(arena.used() > 0);
+
+        void *large = stub_cjson_malloc(256);
+        CHECK(large != nullptr && !arena.owns(large));
+        CHECK(arena.fallbacks() == 1);
+        stub_cjson_free(large);
+    }
+    cJSON_InitHooks(nullptr);
+}
+
+int main()
+{
+    testAllocateAlignsAndExhausts();
+    testFormat();
+    testScopeBindsAndResets();
+    testJsonHooksFallBackToHeap();
+    return TEST_RESULT();
+}
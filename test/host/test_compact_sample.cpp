@@ -0,0 +1,247 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "common/CompactSample.hpp"
+#include "drivers/DecoderRegistry.hpp"
+#include "test.hpp"
+
+#define TEST_BOOT_ID 7
+
+// Manufacturer data wrapped in the advertising structure the scanner hands over.
+static std::vector<uint8_t> advert(const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> out = {0x02, 0x01, 0x06, static_cast<uint8_t>(data.size() + 1), DECODER_AD_MANUFACTURER};
+    out.insert(out.end(), data.begin(), data.end());
+    return out;
+}
+
+static void putU16(std::vector<uint8_t> &data, size_t offset, uint16_t value)
+{
+    data[offset] = value >> 8;
+    data[offset + 1] = value & 0xFF;
+}
+
+static void putU32(std::vector<uint8_t> &data, size_t offset, uint32_t value)
+{
+    putU16(data, offset, value >> 16);
+    putU16(data, offset + 2, value & 0xFFFF);
+}
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static bool same(float a, float b)
+{
+    return floatBits(a) == floatBits(b);
+}
+
+static std::vector<uint8_t> raptV1(uint16_t temperature, uint32_t gravity, int16_t x, int16_t y, int16_t z,
+                                   uint16_t battery)
+{
+    std::vector<uint8_t> data(DECODER_RAPT_LENGTH, 0);
+    const uint8_t head[] = {0x52, 0x41, 'P', 'T', 0x01, 0x78, 0xE3, 0x6D, 0x01, 0x02, 0x03};
+    memcpy(data.data(), head, sizeof(head));
+    putU16(data, 11, temperature);
+    putU32(data, 13, gravity);
+    putU16(data, 17, static_cast<uint16_t>(x));
+    putU16(data, 19, static_cast<uint16_t>(y));
+    putU16(data, 21, static_cast<uint16_t>(z));
+    putU16(data, 23, battery);
+    return data;
+}
+
+static std::vector<uint8_t> raptV2(bool velocity_valid, float velocity, uint16_t kelvin, float gravity, int16_t x,
+                                   int16_t y, int16_t z, uint16_t battery)
+{
+    std::vector<uint8_t> data(DECODER_RAPT_LENGTH, 0);
+    const uint8_t head[] = {0x52, 0x41, 'P', 'T', 0x02, 0x00};
+    memcpy(data.data(), head, sizeof(head));
+    data[6] = velocity_valid ? 0x01 : 0x00;
+    putU32(data, 7, floatBits(velocity));
+    putU16(data, 11, kelvin);
+    putU32(data, 13, floatBits(gravity));
+    putU16(data, 17, static_cast<uint16_t>(x));
+    putU16(data, 19, static_cast<uint16_t>(y));
+    putU16(data, 21, static_cast<uint16_t>(z));
+    putU16(data, 23, battery);
+    return data;
+}
+
+static std::vector<uint8_t> tilt(uint8_t colour, uint16_t major, uint16_t minor)
+{
+    std::vector<uint8_t> data = {0x4C, 0x00, 0x02, 0x15, 0xA4, 0x95, 0xBB, colour, 0xC5, 0xB1, 0x4B, 0x44, 0xB5,
+                                 0x12, 0x13, 0x70, 0xF0, 0x2D, 0x74, 0xDE, 0, 0, 0, 0, 0xC5};
+    putU16(data, 20, major);
+    putU16(data, 22, minor);
+    return data;
+}
+
+static bool decodeAdvert(const std::vector<uint8_t> &data, const char *decoder, RaptPillData &out)
+{
+    std::vector<uint8_t> raw = advert(data);
+    DecoderMatch match;
+    if (!DecoderRegistry::instance().match(raw.data(), raw.size(), match) || strcmp(match.decoder->name, decoder) != 0)
+    {
+        return false;
+    }
+    return DecoderRegistry::instance().decode(match, out);
+}
+
+// The decoded sample as it comes back out of the ingest queue or the early ring.
+static RaptPillData roundTrip(RaptPillData sample)
+{
+    sample.timestamp = 3600;
+    sample.boot_id = TEST_BOOT_ID;
+    CHECK(CompactCodec::fits(sample, TEST_BOOT_ID));
+    return CompactCodec::decode(CompactCodec::encode(sample), TEST_BOOT_ID);
+}
+
+// Every field the decoder reported must survive bit for bit.
+static bool survives(const RaptPillData &in, const RaptPillData &out)
+{
+    return out.timestamp == 3600 && out.boot_id == TEST_BOOT_ID && same(in.gravity_velocity, out.gravity_velocity) &&
+           same(in.temperature_celsius, out.temperature_celsius) && same(in.specific_gravity, out.specific_gravity) &&
+           same(in.accel_x, out.accel_x) &&
+           same(in.accel_y, out.accel_y) && same(in.accel_z, out.accel_z) && same(in.battery, out.battery);
+}
+
+static void testShortData()
+{
+    const std::vector<uint8_t> adverts[] = {raptV1(0, 0, 0, 0, 0, 0), raptV2(false, 0, 0, 1.0f, 0, 0, 0, 0),
+                                            tilt(0x10, 68, 1050)};
+    for (const std::vector<uint8_t> &data : adverts)
+    {
+        std::vector<uint8_t> raw = advert(data);
+        DecoderMatch match;
+        RaptPillData sample;
+        CHECK(DecoderRegistry::instance().match(raw.data(), raw.size(), match));
+        // Decoders called directly check the length themselves.
+        CHECK(!match.decoder->decode(match.data, match.length - 1, sample));
+        CHECK(match.decoder->decode(match.data, match.length, sample));
+    }
+}
+
+static void testLayout()
+{
+    CHECK(sizeof(CompactSample) == 24);
+    CHECK(sizeof(CompactSample) < sizeof(RaptPillData));
+}
+
+static void testRaptV1()
+{
+    // Raw gravity far outside any SG range, which used to saturate.
+    const uint32_t gravities[] = {0, 1, 1050, 10473, 1000000, 0x3F860419, 0xFFFFFFFF};
+    for (uint32_t gravity : gravities)
+    {
+        RaptPillData sample;
+        CHECK(decodeAdvert(raptV1(0x1801, gravity, -16, 0, 16 * 63, 0x5A80), "rapt_v1", sample));
+        CHECK(sample.specific_gravity == static_cast<float>(gravity));
+        CHECK(survives(sample, roundTrip(sample)));
+    }
+
+    // Every 1/256 °C step, including the odd ones 1/128 K could not hold.
+    bool all = true;
+    for (uint32_t raw = 0; raw <= 0xFFFF; ++raw)
+    {
+        RaptPillData sample;
+        all &= decodeAdvert(raptV1(static_cast<uint16_t>(raw), 1050, INT16_MIN, INT16_MAX, -1, raw), "rapt_v1", sample);
+        all &= survives(sample, roundTrip(sample));
+    }
+    CHECK(all);
+}
+
+static void testRaptV2()
+{
+    const float gravities[] = {0.99f, 1.0f, 1.0473f, 1.08123f, 1.4f};
+    // Velocities off any 0.01 grid, and beyond what 16 bits at 0.01 would hold.
+    const float velocities[] = {-3.27f, 0.0012345f, -1234.5678f, 3.0e7f};
+    for (float gravity : gravities)
+    {
+        for (float velocity : velocities)
+        {
+            RaptPillData sample;
+            CHECK(decodeAdvert(raptV2(true, velocity, 38758, gravity, 5, -700, 1023, 25600), "rapt_v2", sample));
+            CHECK(same(sample.specific_gravity, gravity));
+            CHECK(same(sample.gravity_velocity, velocity));
+            CHECK(survives(sample, roundTrip(sample)));
+        }
+    }
+
+    bool all = true;
+    for (uint32_t kelvin = 0; kelvin <= 0xFFFF; ++kelvin)
+    {
+        RaptPillData sample;
+        all &= decodeAdvert(raptV2(false, 0.0f, static_cast<uint16_t>(kelvin), 1.05f, 0, 0, 0, 0), "rapt_v2", sample);
+        all &= survives(sample, roundTrip(sample)) && sample.gravity_velocity == 0.0f;
+    }
+    CHECK(all);
+}
+
+static void testTilt()
+{
+    RaptPillData sample;
+    CHECK(decodeAdvert(tilt(0x20, 68, 1053), "tilt", sample));
+    CHECK_NEAR(sample.specific_gravity, 1.053, 1e-6);
+    CHECK(survives(sample, roundTrip(sample)));
+
+    // Tilt Pro steps of 0.0001 SG and 0.1 °F.
+    CHECK(decodeAdvert(tilt(0x70, 681, 10537), "tilt", sample));
+    CHECK_NEAR(sample.specific_gravity, 1.0537, 1e-6);
+    CHECK_NEAR(sample.temperature_celsius, 20.05556, 1e-4);
+    CHECK(survives(sample, roundTrip(sample)));
+}
+
+static cJSON member(const char *name, int type)
+{
+    cJSON item = {};
+    item.type = type;
+    item.string = const_cast<char *>(name);
+    return item;
+}
+
+static void testISpindel()
+{
+    const struct
+    {
+        double gravity;
+        double temperature;
+        const char *units;
+        double volts;
+    } posts[] = {{1.0473, 19.875, "C", 3.87}, {12.5, 66.2, "F", 3.913}, {1.012, 293.4, "K", 4.0371}};
+    for (const auto &post : posts)
+    {
+        cJSON gravity = member("gravity", cJSON_Number);
+        gravity.valuedouble = post.gravity;
+        cJSON temperature = member("temperature", cJSON_Number);
+        temperature.valuedouble = post.temperature;
+        cJSON units = member("temp_units", cJSON_String);
+        units.valuestring = const_cast<char *>(post.units);
+        cJSON battery = member("battery", cJSON_Number);
+        battery.valuedouble = post.volts;
+        gravity.next = &temperature;
+        temperature.next = &units;
+        units.next = &battery;
+        cJSON json = member(nullptr, cJSON_Object);
+        json.child = &gravity;
+
+        RaptPillData sample;
+        CHECK(DecoderRegistry::decodeISpindel(&json, sample));
+        CHECK(sample.specific_gravity > 1.0f && sample.specific_gravity < 1.1f);
+        CHECK(survives(sample, roundTrip(sample)));
+    }
+}
+
+int main()
+{
+    testLayout();
+    testRaptV1();
+    testRaptV2();
+    testTilt();
+    testISpindel();
+    testShortData();
+    return TEST_RESULT();
+}
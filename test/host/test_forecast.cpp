@@ -0,0 +1,124 @@
+#include <cmath>
+#include <vector>
+#include "common/Forecast.hpp"
+#include "test.hpp"
+
+static float logistic(const ForecastModel &model, float hours)
+{
+    return model.final_gravity +
+           (model.original_gravity - model.final_gravity) / (1.0f + expf(model.rate * (hours - model.midpoint_h)));
+}
+
+static std::vector<ForecastPoint> curve(const ForecastModel &model, size_t count, float span_h, float noise = 0.0f)
+{
+    std::vector<ForecastPoint> points;
+    uint32_t state = 12345;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float hours = span_h * i / (count - 1);
+        // Deterministic noise in [-noise, noise].
+        state = state * 1664525u + 1013904223u;
+        float jitter = noise * ((state >> 8) / static_cast<float>(1u << 24) * 2.0f - 1.0f);
+        points.push_back({hours, logistic(model, hours) + jitter});
+    }
+    return points;
+}
+
+static const ForecastModel ale = {
+    .final_gravity = 1.010f,
+    .original_gravity = 1.050f,
+    .rate = 0.12f,
+    .midpoint_h = 40.0f,
+    .rmse = 0.0f,
+    .iterations = 0,
+};
+
+static void testExactCurve()
+{
+    std::vector<ForecastPoint> points = curve(ale, FORECAST_POINTS, 120.0f);
+    ForecastModel model = {};
+    CHECK(Forecast::fit(points.data(), points.size(), model));
+    CHECK_NEAR(model.final_gravity, ale.final_gravity, 0.0002);
+    CHECK_NEAR(model.original_gravity, ale.original_gravity, 0.0002);
+    CHECK_NEAR(model.rate, ale.rate, 0.005);
+    CHECK_NEAR(model.midpoint_h, ale.midpoint_h, 0.5);
+    CHECK(model.rmse < 0.0001f);
+    CHECK(model.iterations >= 1);
+    CHECK(model.iterations <= FORECAST_MAX_ITERATIONS);
+}
+
+static void testNoisyCurve()
+{
+    // About what a floating hydrometer scatters by within a bucket.
+    std::vector<ForecastPoint> points = curve(ale, FORECAST_POINTS, 120.0f, 0.0005f);
+    ForecastModel model = {};
+    CHECK(Forecast::fit(points.data(), points.size(), model));
+    CHECK_NEAR(model.final_gravity, ale.final_gravity, 0.001);
+    CHECK_NEAR(model.original_gravity, ale.original_gravity, 0.001);
+    CHECK_NEAR(model.midpoint_h, ale.midpoint_h, 3.0);
+    CHECK(model.rmse > 0.0001f);
+    CHECK(model.rmse < 0.0005f);
+}
+
+static void testPastMidpoint()
+{
+    // Only the first half of the drop has been seen; the curve still predicts the final gravity.
+    std::vector<ForecastPoint> points = curve(ale, 24, 60.0f);
+    ForecastModel model = {};
+    CHECK(Forecast::fit(points.data(), points.size(), model));
+    CHECK_NEAR(model.final_gravity, ale.final_gravity, 0.001);
+    CHECK_NEAR(model.midpoint_h, ale.midpoint_h, 2.0);
+    CHECK(model.final_gravity < points.back().gravity);
+}
+
+static void testLager()
+{
+    // A slow, long ferment measured in days.
+    const ForecastModel lager = {
+        .final_gravity = 1.012f,
+        .original_gravity = 1.048f,
+        .rate = 0.03f,
+        .midpoint_h = 150.0f,
+        .rmse = 0.0f,
+        .iterations = 0,
+    };
+    std::vector<ForecastPoint> points = curve(lager, FORECAST_POINTS, 21 * 24.0f, 0.0002f);
+    ForecastModel model = {};
+    CHECK(Forecast::fit(points.data(), points.size(), model));
+    CHECK_NEAR(model.final_gravity, lager.final_gravity, 0.0005);
+    CHECK_NEAR(model.rate, lager.rate, 0.003);
+    CHECK_NEAR(model.midpoint_h, lager.midpoint_h, 3.0);
+}
+
+static void testRejects()
+{
+    ForecastModel model = {};
+    std::vector<ForecastPoint> points = curve(ale, 3, 120.0f);
+    CHECK(!Forecast::fit(points.data(), points.size(), model));
+
+    // No drop to fit: the amplitude stays below FORECAST_DONE_POINTS.
+    std::vector<ForecastPoint> flat;
+    for (int i = 0; i < 32; ++i)
+    {
+        flat.push_back({i * 2.0f, 1.040f});
+    }
+    CHECK(!Forecast::fit(flat.data(), flat.size(), model));
+
+    // Rising gravity is no fermentation curve either.
+    std::vector<ForecastPoint> rising;
+    for (int i = 0; i < 32; ++i)
+    {
+        rising.push_back({i * 2.0f, 1.010f + i * 0.001f});
+    }
+    CHECK(!Forecast::fit(rising.data(), rising.size(), model));
+}
+
+int main()
+{
+    testExactCurve();
+    testNoisyCurve();
+    testPastMidpoint();
+    testLager();
+    testRejects();
+    return TEST_RESULT();
+}
@@ -0,0 +1,221 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "common/Gorilla.hpp"
+#include "test.hpp"
+
+static RaptPillData sample(uint32_t boot_id, int64_t timestamp, float sg, float temperature)
+{
+    return {
+        .timestamp = timestamp,
+        .gravity_velocity = -1.25f,
+        .temperature_celsius = temperature,
+        .specific_gravity = sg,
+        .accel_x = 0.0625f,
+        .accel_y = -12.5f,
+        .accel_z = 63.9375f,
+        .battery = 87.5f,
+        .boot_id = boot_id,
+    };
+}
+
+static bool sameBits(const RaptPillData &a, const RaptPillData &b)
+{
+    return a.timestamp == b.timestamp && a.boot_id == b.boot_id &&
+           memcmp(&a.gravity_velocity, &b.gravity_velocity, 7 * sizeof(float)) == 0;
+}
+
+// Every timestamp bucket, a boot change, and floats that defeat the XOR window.
+static std::vector<RaptPillData> mixedSamples()
+{
+    std::vector<RaptPillData> samples;
+    int64_t t = 1000;
+    const int64_t steps[] = {60, 60, 61, 120, 400, 2000, 100000, 60, 59, 60};
+    for (int64_t step : steps)
+    {
+        t += step;
+        samples.push_back(sample(3, t, 1.05f - samples.size() * 0.0007f, 20.0f + samples.size() * 0.13f));
+    }
+    samples.push_back(sample(4, 5, 1.01f, NAN));
+    samples.push_back(sample(4, 65, -0.0f, -273.15f));
+    samples.push_back(sample(4, 125, 1e-30f, 1e30f));
+    return samples;
+}
+
+static void testRoundTrip()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block));
+    std::vector<RaptPillData> samples = mixedSamples();
+    for (const RaptPillData &s : samples)
+    {
+        CHECK(encoder.append(s));
+    }
+    CHECK(encoder.count() == samples.size());
+
+    GorillaDecoder decoder = GorillaDecoder::sealed(encoder.data(), encoder.size());
+    RaptPillData decoded;
+    for (const RaptPillData &s : samples)
+    {
+        CHECK(decoder.next(decoded) && sameBits(decoded, s));
+    }
+    CHECK(!decoder.next(decoded));
+}
+
+static void testOverflowLeavesBlockIntact()
+{
+    uint8_t block[120];
+    GorillaEncoder encoder(block, sizeof(block));
+    std::vector<RaptPillData> samples = mixedSamples();
+    size_t appended = 0;
+    while (appended < samples.size() && encoder.append(samples[appended]))
+    {
+        appended++;
+    }
+    CHECK(appended > 0 && appended < samples.size());
+    size_t size = encoder.size();
+    CHECK(!encoder.append(samples[appended]));
+    CHECK(encoder.size() == size && encoder.count() == appended);
+
+    GorillaDecoder decoder = GorillaDecoder::sealed(encoder.data(), encoder.size());
+    RaptPillData decoded;
+    for (size_t i = 0; i < appended; ++i)
+    {
+        CHECK(decoder.next(decoded) && sameBits(decoded, samples[i]));
+    }
+}
+
+static void testFullAtMaxSamples()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block));
+    for (int i = 0; i < GORILLA_BLOCK_MAX_SAMPLES; ++i)
+    {
+        CHECK(encoder.append(sample(1, i * 60, 1.0f, 20.0f)));
+    }
+    CHECK(encoder.full());
+    CHECK(!encoder.append(sample(1, 99999, 1.0f, 20.0f)));
+    // Header, the raw first sample, the second with its 60 s delta in 17 bits, then 9 bits each:
+    // same boot, delta-of-delta 0 and seven unchanged channels.
+    CHECK(encoder.size() == 4 + 40 + (17 + (GORILLA_BLOCK_MAX_SAMPLES - 2) * 9 + 7) / 8);
+}
+
+static void testBootOffsetTable()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block), GORILLA_BOOT_TABLE_BYTES);
+    std::vector<RaptPillData> samples = mixedSamples();
+    for (const RaptPillData &s : samples)
+    {
+        CHECK(encoder.append(s));
+    }
+    size_t stream = encoder.size();
+    GorillaBootOffset offsets[] = {{.boot_id = 3, .offset = 1700000000}, {.boot_id = 4, .offset = -5}};
+    CHECK(encoder.appendBootOffsets(offsets, 2));
+    CHECK(encoder.size() == stream + 2 * GORILLA_BOOT_OFFSET_BYTES + 1);
+    CHECK(!encoder.append(samples[0]));
+
+    GorillaBootOffset read[GORILLA_MAX_BOOT_OFFSETS];
+    CHECK(GorillaDecoder::bootOffsets(encoder.data(), encoder.size(), read, GORILLA_MAX_BOOT_OFFSETS) == 2);
+    CHECK(read[0].boot_id == 3 && read[0].offset == 1700000000);
+    CHECK(read[1].boot_id == 4 && read[1].offset == -5);
+
+    // The table does not disturb the samples.
+    GorillaDecoder decoder = GorillaDecoder::sealed(encoder.data(), encoder.size());
+    RaptPillData decoded;
+    size_t count = 0;
+    while (decoder.next(decoded))
+    {
+        CHECK(sameBits(decoded, samples[count++]));
+    }
+    CHECK(count == samples.size());
+
+    encoder.removeBootOffsets();
+    CHECK(encoder.size() == stream);
+    CHECK(GorillaDecoder::bootOffsets(encoder.data(), encoder.size(), read, GORILLA_MAX_BOOT_OFFSETS) == 0);
+    CHECK(encoder.append(samples[0]));
+}
+
+static void testReserveKeepsRoomForTable()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block), GORILLA_BOOT_TABLE_BYTES);
+    int64_t t = 0;
+    while (encoder.append(sample(1, t, 1.0f + t * 1e-5f, 20.0f - t * 1e-3f)))
+    {
+        t += 61 + t % 7;
+    }
+    CHECK(encoder.size() <= sizeof(block) - GORILLA_BOOT_TABLE_BYTES);
+    GorillaBootOffset offsets[GORILLA_MAX_BOOT_OFFSETS] = {};
+    CHECK(encoder.appendBootOffsets(offsets, GORILLA_MAX_BOOT_OFFSETS));
+    CHECK(encoder.size() <= sizeof(block));
+}
+
+static void testDeltaReplay()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    uint8_t rebuilt[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block));
+    GorillaEncoder replica(rebuilt, sizeof(rebuilt));
+    uint8_t delta[GORILLA_DELTA_MAX_BYTES];
+    CHECK(encoder.lastDelta(delta, sizeof(delta)) == 0);
+
+    std::vector<RaptPillData> samples = mixedSamples();
+    std::vector<std::vector<uint8_t>> log;
+    for (const RaptPillData &s : samples)
+    {
+        CHECK(encoder.append(s));
+        size_t length = encoder.lastDelta(delta, sizeof(delta));
+        CHECK(length > GORILLA_DELTA_HEADER_BYTES && length <= sizeof(delta));
+        log.emplace_back(delta, delta + length);
+    }
+    // Steady samples log far less than a raw RaptPillData.
+    CHECK(log[1].size() < sizeof(RaptPillData) / 2);
+
+    // Out of order records are refused.
+    CHECK(!replica.replayDelta(log[1].data(), log[1].size()));
+    for (const std::vector<uint8_t> &record : log)
+    {
+        CHECK(replica.replayDelta(record.data(), record.size()));
+    }
+    RaptPillData last = {};
+    CHECK(replica.resume(last));
+    CHECK(sameBits(last, samples.back()));
+    CHECK(replica.count() == encoder.count() && replica.size() == encoder.size());
+    CHECK(memcmp(block, rebuilt, sizeof(block)) == 0);
+
+    // The resumed encoder carries on exactly as the original.
+    RaptPillData next = sample(4, 185, 1.0101f, 19.5f);
+    CHECK(encoder.append(next) && replica.append(next));
+    CHECK(memcmp(block, rebuilt, sizeof(block)) == 0);
+}
+
+static void testDeltaReplayRejectsCorruption()
+{
+    uint8_t block[GORILLA_BLOCK_BYTES];
+    uint8_t rebuilt[GORILLA_BLOCK_BYTES];
+    GorillaEncoder encoder(block, sizeof(block));
+    GorillaEncoder replica(rebuilt, sizeof(rebuilt));
+    uint8_t delta[GORILLA_DELTA_MAX_BYTES];
+    CHECK(encoder.append(sample(1, 10, 1.0f, 20.0f)));
+    size_t length = encoder.lastDelta(delta, sizeof(delta));
+    CHECK(!replica.replayDelta(delta, length - 1));
+    CHECK(!replica.replayDelta(delta, GORILLA_DELTA_HEADER_BYTES));
+
+    // A raw sample, as the tail log held before, does not pass for a delta.
+    RaptPillData raw = sample(1, 10, 1.0f, 20.0f);
+    CHECK(!replica.replayDelta(reinterpret_cast<const uint8_t *>(&raw), sizeof(raw)));
+    CHECK(replica.count() == 0);
+}
+
+int main()
+{
+    testRoundTrip();
+    testOverflowLeavesBlockIntact();
+    testFullAtMaxSamples();
+    testBootOffsetTable();
+    testReserveKeepsRoomForTable();
+    testDeltaReplay();
+    testDeltaReplayRejectsCorruption();
+    return TEST_RESULT();
+}
@@ -0,0 +1,84 @@
+#include <cstring>
+#include "web/QueryString.hpp"
+#include "test.hpp"
+
+static httpd_req_t request(const char *uri)
+{
+    httpd_req_t req = {};
+    strncpy(req.uri, uri, sizeof(req.uri) - 1);
+    return req;
+}
+
+static void testNoQuery()
+{
+    StaticArena<64> arena;
+    httpd_req_t req = request("/api/v1/readings");
+    QueryString query(&req, arena);
+    CHECK(query.valid());
+    CHECK(query.empty());
+    CHECK(!query.has("limit"));
+    int64_t value = 7;
+    CHECK(!query.getInt("limit", value));
+    CHECK(value == 7);
+    CHECK(arena.used() == 0);
+}
+
+static void testLookup()
+{
+    StaticArena<64> arena;
+    httpd_req_t req = request("/api/v1/readings?from=-5&fields=sg,temp&cursor=12:3:4:5&flag=");
+    QueryString query(&req, arena);
+    CHECK(query.valid());
+    CHECK(!query.empty());
+    CHECK(arena.used() == strlen("from=-5&fields=sg,temp&cursor=12:3:4:5&flag=") + 1);
+
+    int64_t from = 0;
+    CHECK(query.getInt("from", from));
+    CHECK(from == -5);
+
+    char fields[16];
+    CHECK(query.get("fields", fields, sizeof(fields)));
+    CHECK(strcmp(fields, "sg,temp") == 0);
+
+    // has() does not care that the value is longer than its probe buffer.
+    CHECK(query.has("cursor"));
+    CHECK(query.has("flag"));
+    CHECK(!query.has("to"));
+
+    char small[4];
+    CHECK(!query.get("fields", small, sizeof(small)));
+}
+
+static void testGetIntRejectsPartialNumbers()
+{
+    StaticArena<64> arena;
+    httpd_req_t req = request("/x?a=12x&b=&c=99999999999&d=+3");
+    QueryString query(&req, arena);
+    int64_t value = 1;
+    CHECK(!query.getInt("a", value));
+    CHECK(!query.getInt("b", value));
+    CHECK(value == 1);
+    CHECK(query.getInt("c", value));
+    CHECK(value == 99999999999LL);
+    CHECK(query.getInt("d", value));
+    CHECK(value == 3);
+}
+
+static void testQueryLargerThanArena()
+{
+    StaticArena<8> arena;
+    httpd_req_t req = request("/x?limit=1000000");
+    QueryString query(&req, arena);
+    CHECK(!query.valid());
+    CHECK(query.empty());
+    CHECK(!query.has("limit"));
+}
+
+int main()
+{
+    testNoQuery();
+    testLookup();
+    testGetIntRejectsPartialNumbers();
+    testQueryLargerThanArena();
+    return TEST_RESULT();
+}
@@ -0,0 +1,203 @@
+#include <cstring>
+#include <string>
+#include "drivers/RuleEngine.hpp"
+#include "drivers/WifiManager.hpp"
+#include "test.hpp"
+
+#define OWN_DEVICE_ID "0123456789ab"
+
+const char *WiFiManager::deviceId()
+{
+    return OWN_DEVICE_ID;
+}
+
+static RuleSet set;
+static char error[96];
+
+static esp_err_t compile(const char *text)
+{
+    error[0] = '\0';
+    return RuleEngine::compile(text, set, error, sizeof(error));
+}
+
+static std::string condition(const char *text, size_t index)
+{
+    return std::string(text + set.spans[index][0], set.spans[index][1]);
+}
+
+static void testEmpty()
+{
+    CHECK(compile("") == ESP_OK);
+    CHECK(set.count == 0);
+    CHECK(compile("\n  \n\t\n") == ESP_OK);
+    CHECK(set.count == 0);
+    CHECK(set.device_count == 1);
+}
+
+static void testThreshold()
+{
+    const char *text = "sg < 1.012\n  temp > 24 for 15m  \nbattery<20";
+    CHECK(compile(text) == ESP_OK);
+    CHECK(set.count == 3);
+
+    const Rule &sg = set.rules[0];
+    CHECK(sg.kind == RuleKind::Threshold);
+    CHECK(sg.channel == 0);
+    CHECK(!sg.above);
+    CHECK(sg.device == 0);
+    CHECK_NEAR(sg.value, 1.012, 1e-6);
+    CHECK(sg.duration_s == 0);
+    CHECK(condition(text, 0) == "sg < 1.012");
+
+    const Rule &temp = set.rules[1];
+    CHECK(temp.channel == 1);
+    CHECK(temp.above);
+    CHECK_NEAR(temp.value, 24.0, 0.0);
+    CHECK(temp.duration_s == 15 * 60);
+    // Conditions are stored trimmed.
+    CHECK(condition(text, 1) == "temp > 24 for 15m");
+
+    const Rule &battery = set.rules[2];
+    CHECK(battery.channel == 2);
+    CHECK(!battery.above);
+    CHECK_NEAR(battery.value, 20.0, 0.0);
+}
+
+static void testDurations()
+{
+    CHECK(compile("temp > 1 for 45\ntemp > 1 for 30s\ntemp > 1 for 1.5h\ntemp > 1 for 2d") == ESP_OK);
+    CHECK(set.count == 4);
+    CHECK(set.rules[0].duration_s == 45);
+    CHECK(set.rules[1].duration_s == 30);
+    CHECK(set.rules[2].duration_s == 5400);
+    CHECK(set.rules[3].duration_s == 2 * 86400);
+}
+
+static void testRateAndStable()
+{
+    CHECK(compile("sg rate > -0.0005\nsg rate < -0.002 for 6h\nsg stable 0.001 for 2d") == ESP_OK);
+    CHECK(set.count == 3);
+
+    CHECK(set.rules[0].kind == RuleKind::Rate);
+    CHECK(set.rules[0].above);
+    CHECK_NEAR(set.rules[0].value, -0.0005, 1e-9);
+    CHECK(set.rules[0].duration_s == RULES_DEFAULT_RATE_WINDOW_S);
+
+    CHECK(set.rules[1].kind == RuleKind::Rate);
+    CHECK(!set.rules[1].above);
+    CHECK(set.rules[1].duration_s == 6 * 3600);
+
+    CHECK(set.rules[2].kind == RuleKind::Stable);
+    CHECK_NEAR(set.rules[2].value, 0.001, 1e-9);
+    CHECK(set.rules[2].duration_s == 2 * 86400);
+}
+
+static void testDevices()
+{
+    const char *text = "a0b1c2d3e4f5: temp > 22\n"
+                       "A0B1C2D3E4F5 : sg < 1.01\n"
+                       "local: sg < 1.0\n" OWN_DEVICE_ID ": battery < 10\n"
+                       "ffffffffffff: sg < 1.0";
+    CHECK(compile(text) == ESP_OK);
+    CHECK(set.count == 5);
+    // Ids are matched case insensitively and stored lower case.
+    CHECK(set.rules[0].device == 1);
+    CHECK(set.rules[1].device == 1);
+    CHECK(set.rules[2].device == 0);
+    CHECK(set.rules[3].device == 0);
+    CHECK(set.rules[4].device == 2);
+    CHECK(set.device_count == 3);
+    CHECK(strcmp(set.devices[1], "a0b1c2d3e4f5") == 0);
+    CHECK(strcmp(set.devices[2], "ffffffffffff") == 0);
+
+    // A new compile starts with an empty device table.
+    CHECK(compile("sg < 1.0") == ESP_OK);
+    CHECK(set.device_count == 1);
+}
+
+static void testDeviceTableFull()
+{
+    std::string text;
+    for (int i = 1; i < RULES_MAX_DEVICES; ++i)
+    {
+        char line[32];
+        snprintf(line, sizeof(line), "%012x: sg < 1.0\n", i);
+        text += line;
+    }
+    CHECK(compile(text.c_str()) == ESP_OK);
+    CHECK(set.device_count == RULES_MAX_DEVICES);
+
+    // Known devices still resolve once the table is full.
+    CHECK(compile((text + "000000000001: temp > 30").c_str()) == ESP_OK);
+    CHECK(compile((text + "00000000ffff: temp > 30").c_str()) == ESP_ERR_INVALID_ARG);
+    CHECK(strcmp(error, "Line 8: unknown device id or too many devices") == 0);
+}
+
+static void testErrors()
+{
+    const struct
+    {
+        const char *text;
+        const char *error;
+    } cases[] = {
+        {"sg < 1.0\nph > 4", "Line 2: unknown channel; use sg, temp or battery"},
+        {"sg 1.0", "Line 1: expected > or <"},
+        {"sg <", "Line 1: expected a number"},
+        {"sg < abc", "Line 1: expected a number"},
+        {"sg < 1.0 for", "Line 1: expected a duration such as 30m or 24h"},
+        {"sg < 1.0 for 10x", "Line 1: expected a duration such as 30m or 24h"},
+        {"sg < 1.0 for -5m", "Line 1: expected a duration such as 30m or 24h"},
+        {"sg < 1.0 or so", "Line 1: unexpected text after the rule"},
+        {"sg < 1.0;", "Line 1: unexpected character"},
+        {"sg stable 0.001", "Line 1: a stable rule needs 'for' and a duration"},
+        {"sg stable 0 for 1d", "Line 1: the band of a stable rule must be positive"},
+        {"sg rate > 0.1 for 0s", "Line 1: the window of a rate rule must be positive"},
+        {"123: sg < 1.0", "Line 1: unknown device id or too many devices"},
+        {"a0b1c2d3e4fg: sg < 1.0", "Line 1: unknown device id or too many devices"},
+        {": sg < 1.0", "Line 1: unknown channel; use sg, temp or battery"},
+        {"a0b1c2d3e4f5:", "Line 1: missing channel"},
+        {"\n\nsg < 1.0 for 1h for 2h", "Line 3: unexpected text after the rule"},
+        {"temp > 1 for 1d for 1d for 1d", "Line 1: unexpected text after the rule"},
+        {"temp > 1.000000000000000000000000000000000000000001", "Line 1: rule is too long"},
+    };
+    for (const auto &c : cases)
+    {
+        CHECK(compile(c.text) == ESP_ERR_INVALID_ARG);
+        if (strcmp(error, c.error) != 0)
+        {
+            std::printf("\"%s\": got \"%s\", expected \"%s\"\n", c.text, error, c.error);
+            test_failures()++;
+        }
+    }
+}
+
+static void testLimits()
+{
+    std::string text;
+    for (int i = 0; i < RULES_MAX; ++i)
+    {
+        text += "sg < 1.0\n";
+    }
+    CHECK(compile(text.c_str()) == ESP_OK);
+    CHECK(set.count == RULES_MAX);
+    CHECK(compile((text + "sg < 1.0").c_str()) == ESP_ERR_INVALID_ARG);
+    CHECK(strcmp(error, "Line 49: too many rules") == 0);
+
+    std::string long_text(RULES_TEXT_MAX, '\n');
+    CHECK(compile(long_text.c_str()) == ESP_ERR_INVALID_ARG);
+    long_text.pop_back();
+    CHECK(compile(long_text.c_str()) == ESP_OK);
+}
+
+int main()
+{
+    testEmpty();
+    testThreshold();
+    testDurations();
+    testRateAndStable();
+    testDevices();
+    testDeviceTableFull();
+    testErrors();
+    testLimits();
+    return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+#include <cmath>
+#include <vector>
+#include "common/SwingingDoor.hpp"
+#include "test.hpp"
+
+static const DeadbandConfig deadband = {
+    .gravity_velocity = 0.5f,
+    .temperature = 0.1f,
+    .specific_gravity = 0.0002f,
+    .accel = 0.5f,
+    .battery = 1.0f,
+    .heartbeat_s = 0,
+};
+
+static RaptPillData sample(int64_t timestamp, float sg, float temperature, uint32_t boot_id = 1)
+{
+    return {
+        .timestamp = timestamp,
+        .gravity_velocity = 0.0f,
+        .temperature_celsius = temperature,
+        .specific_gravity = sg,
+        .accel_x = 1.0f,
+        .accel_y = 2.0f,
+        .accel_z = 3.0f,
+        .battery = 90.0f,
+        .boot_id = boot_id,
+    };
+}
+
+static std::vector<RaptPillData> offerAll(SwingingDoor &door, const std::vector<RaptPillData> &samples)
+{
+    std::vector<RaptPillData> stored;
+    RaptPillData out[2];
+    for (const RaptPillData &s : samples)
+    {
+        size_t count = door.offer(s, out);
+        CHECK(count <= 2);
+        stored.insert(stored.end(), out, out + count);
+    }
+    RaptPillData held;
+    if (door.pending(held))
+    {
+        stored.push_back(held);
+    }
+    return stored;
+}
+
+static float interpolate(const std::vector<RaptPillData> &stored, int64_t t, float RaptPillData::*field)
+{
+    for (size_t i = 1; i < stored.size(); ++i)
+    {
+        if (stored[i].timestamp >= t)
+        {
+            const RaptPillData &a = stored[i - 1];
+            const RaptPillData &b = stored[i];
+            float f = static_cast<float>(t - a.timestamp) / static_cast<float>(b.timestamp - a.timestamp);
+            return a.*field + (b.*field - a.*field) * f;
+        }
+    }
+    return stored.back().*field;
+}
+
+static void testStraightLineKeepsEndPoints()
+{
+    SwingingDoor door;
+    door.configure(deadband);
+    std::vector<RaptPillData> samples;
+    for (int i = 0; i < 50; ++i)
+    {
+        samples.push_back(sample(i * 60, 1.050f - i * 0.0001f, 20.0f));
+    }
+    std::vector<RaptPillData> stored = offerAll(door, samples);
+    CHECK(stored.size() == 2);
+    CHECK(stored.front().timestamp == 0 && stored.back().timestamp == 49 * 60);
+}
+
+static void testInterpolationStaysWithinDeadband()
+{
+    SwingingDoor door;
+    door.configure(deadband);
+    std::vector<RaptPillData> samples;
+    // A fermentation curve with sensor noise and a temperature swing.
+    for (int i = 0; i < 2000; ++i)
+    {
+        float hours = i / 4.0f;
+        float sg = 1.010f + 0.040f / (1.0f + std::exp((hours - 60.0f) / 12.0f)) + 0.00015f * std::sin(i * 1.7f);
+        float temperature = 19.0f + 1.5f * std::sin(hours / 5.0f) + 0.05f * std::cos(i * 2.3f);
+        samples.push_back(sample(i * 900, sg, temperature));
+    }
+    std::vector<RaptPillData> stored = offerAll(door, samples);
+    CHECK(stored.size() < samples.size() / 2);
+    for (const RaptPillData &s : samples)
+    {
+        CHECK_NEAR(interpolate(stored, s.timestamp, &RaptPillData::specific_gravity), s.specific_gravity,
+                   deadband.specific_gravity * 1.001);
+        CHECK_NEAR(interpolate(stored, s.timestamp, &RaptPillData::temperature_celsius), s.temperature_celsius,
+                   deadband.temperature * 1.001);
+    }
+}
+
+static void testBootChangeStoresBothSides()
+{
+    SwingingDoor door;
+    door.configure(deadband);
+    RaptPillData out[2];
+    CHECK(door.offer(sample(0, 1.05f, 20.0f), out) == 1);
+    CHECK(door.offer(sample(60, 1.05f, 20.0f), out) == 0);
+    CHECK(door.offer(sample(5, 1.05f, 20.0f, 2), out) == 2);
+    CHECK(out[0].boot_id == 1 && out[0].timestamp == 60);
+    CHECK(out[1].boot_id == 2 && out[1].timestamp == 5);
+    RaptPillData held;
+    CHECK(!door.pending(held));
+}
+
+static void testHeartbeatAndStaleSamples()
+{
+    DeadbandConfig config = deadband;
+    config.heartbeat_s = 600;
+    SwingingDoor door;
+    door.configure(config);
+    RaptPillData out[2];
+    CHECK(door.offer(sample(0, 1.05f, 20.0f), out) == 1);
+    for (int t = 60; t < 600; t += 60)
+    {
+        CHECK(door.offer(sample(t, 1.05f, 20.0f), out) == 0);
+    }
+    CHECK(door.offer(sample(600, 1.05f, 20.0f), out) == 1);
+    CHECK(out[0].timestamp == 600);
+
+    // Time that does not move forward flushes the held sample and stores the new one.
+    CHECK(door.offer(sample(660, 1.05f, 20.0f), out) == 0);
+    CHECK(door.offer(sample(660, 1.05f, 20.0f), out) == 2);
+}
+
+static void testNanIsStored()
+{
+    SwingingDoor door;
+    door.configure(deadband);
+    RaptPillData out[2];
+    door.offer(sample(0, 1.05f, 20.0f), out);
+    door.offer(sample(60, 1.05f, 20.0f), out);
+    CHECK(door.offer(sample(120, 1.05f, NAN), out) == 2);
+    CHECK(out[0].timestamp == 60 && std::isnan(out[1].temperature_celsius));
+}
+
+static void testRestartContinuesFromStored()
+{
+    SwingingDoor door;
+    door.configure(deadband);
+    door.restart(sample(0, 1.05f, 20.0f));
+    RaptPillData out[2];
+    CHECK(door.offer(sample(60, 1.05f, 20.0f), out) == 0);
+    door.reset();
+    CHECK(door.offer(sample(120, 1.05f, 20.0f), out) == 1);
+}
+
+int main()
+{
+    testStraightLineKeepsEndPoints();
+    testInterpolationStaysWithinDeadband();
+    testBootChangeStoresBothSides();
+    testHeartbeatAndStaleSamples();
+    testNanIsStored();
+    testRestartContinuesFromStored();
+    return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Generate a C++ source embedding the built web UI into the firmware image.
+
+Every file under the build directory is gzip-compressed (when that makes it
+smaller) and emitted as a byte array in flash, together with a table sorted by
+URL path that maps path -> data, length, content type and ETag. The output is
+only rewritten when it changes, so an unchanged UI does not trigger a rebuild.
+
+Usage: embed_web_assets.py <web build dir> <output .cpp>
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+CONTENT_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.map': 'application/json',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.jpeg': 'image/jpeg',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+    '.txt': 'text/plain',
+    '.woff': 'font/woff',
+    '.woff2': 'font/woff2',
+}
+
+# Source maps are only useful with a debugger attached and would double the image size.
+SKIPPED_SUFFIXES = ('.map',)
+
+
+def collect(root):
+    assets = []
+    for directory, _, files in os.walk(root):
+        for name in files:
+            if name.endswith(SKIPPED_SUFFIXES):
+                continue
+            path = os.path.join(directory, name)
+            url = '/' + os.path.relpath(path, root).replace(os.sep, '/')
+            with open(path, 'rb') as f:
+                data = f.read()
+            # mtime=0 keeps the output identical across builds of the same UI.
+            compressed = gzip.compress(data, compresslevel=9, mtime=0)
+            gzipped = len(compressed) < len(data)
+            body = compressed if gzipped else data
+            content_type = CONTENT_TYPES.get(os.path.splitext(name)[1].lower(), 'application/octet-stream')
+            etag = '"%s"' % hashlib.sha256(data).hexdigest()[:16]
+            assets.append((url, body, content_type, etag, gzipped))
+    # The firmware binary-searches the table with strcmp, i.e. by bytes.
+    assets.sort(key=lambda asset: asset[0].encode())
+    return assets
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def render(assets):
+    lines = [
+        '// Generated by tools/embed_web_assets.py; do not edit.',
+        '#include "web/WebAssets.hpp"',
+        '',
+        'namespace',
+        '{',
+    ]
+    for index, (_, body, _, _, _) in enumerate(assets):
+        lines.append('    constexpr uint8_t asset_%d[] = {' % index)
+        for offset in range(0, len(body), 20):
+            chunk = body[offset:offset + 20]
+            lines.append('        ' + ','.join('0x%02x' % byte for byte in chunk) + ',')
+        lines.append('    };')
+    lines.append('')
+    lines.append('    constexpr WebAsset assets[] = {')
+    for index, (url, body, content_type, etag, gzipped) in enumerate(assets):
+        lines.append('        {%s, asset_%d, %d, %s, %s, %s},' % (
+            c_string(url), index, len(body), c_string(content_type), c_string(etag),
+            'true' if gzipped else 'false'))
+    if not assets:
+        lines.append('        {"", nullptr, 0, "", "", false},')
+    lines.append('    };')
+    lines.append('}')
+    lines.append('')
+    lines.append('static_assert(WebAssets::sorted(assets, sizeof(assets) / sizeof(assets[0])), "web assets must be sorted by path");')
+    lines.append('')
+    lines.append('const WebAsset *const WebAssets::table = assets;')
+    lines.append('const size_t WebAssets::count = %d;' % len(assets))
+    lines.append('')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    root, output = sys.argv[1], sys.argv[2]
+    if not os.path.isdir(root):
+        sys.exit('%s does not exist; build the web UI first (npm run build)' % root)
+
+    assets = collect(root)
+    source = render(assets)
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == source:
+                return
+    with open(output, 'w') as f:
+        f.write(source)
+    total = sum(len(asset[1]) for asset in assets)
+    print('Embedded %d web assets, %d bytes' % (len(assets), total))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Run simulated RaptMate nodes for testing collector mode without hardware.
+
+Each node listens on its own port and serves /api/v1/history/delta the way the
+firmware does: one Gorilla block per request after a boot:ts cursor, or the
+most recent `tail` samples, with the X-RaptMate-Device, X-RaptMate-Cursor and
+X-RaptMate-Remaining headers and 204 when there is nothing new. Nodes record a
+synthetic fermentation with a known wall clock, so every sample has boot id 0.
+
+Usage:
+  fake_peers.py [--count 4] [--base-port 8081] [--interval 5] [--backlog 600]
+                [--fail-every N] [--mdns]
+
+Point a collector at them with the printed settings patch, or pass --mdns to
+advertise every node as _raptmate._tcp (needs the zeroconf package).
+"""
+
+import argparse
+import math
+import random
+import socket
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+from gorilla_block import encode_block
+
+CONTENT_TYPE = 'application/vnd.raptmate.gorilla'
+
+
+class Node:
+    def __init__(self, index, port, interval, backlog):
+        self.device_id = '02fa4e%06x' % index
+        self.port = port
+        self.interval = interval
+        self.lock = threading.Lock()
+        self.samples = []
+        self.requests = 0
+        self.original_gravity = random.uniform(1.040, 1.070)
+        self.final_gravity = random.uniform(1.006, 1.014)
+        self.start = int(time.time()) - backlog * interval
+        for step in range(backlog):
+            self.record(self.start + step * interval)
+
+    def record(self, timestamp):
+        hours = (timestamp - self.start) / 3600.0
+        progress = 1.0 / (1.0 + math.exp(-(hours - 36.0) / 8.0))
+        gravity = self.original_gravity - (self.original_gravity - self.final_gravity) * progress
+        sample = {
+            'boot_id': 0,
+            'timestamp': timestamp,
+            'gravity_velocity': round(-(self.original_gravity - self.final_gravity) * progress * (1 - progress) / 8.0 * 24000, 1),
+            'temperature': round((19.0 + random.gauss(0, 0.1)) / 0.0625) * 0.0625,
+            'specific_gravity': round(gravity + random.gauss(0, 0.0002), 4),
+            'accel_x': random.randint(-40, 40),
+            'accel_y': random.randint(-40, 40),
+            'accel_z': 3900 + random.randint(-20, 20),
+            'battery': round(max(0.0, 100.0 - hours * 0.05), 1),
+        }
+        with self.lock:
+            self.samples.append(sample)
+
+    def delta(self, boot_id, timestamp, tail):
+        with self.lock:
+            if tail is not None:
+                start = max(0, len(self.samples) - tail)
+            else:
+                start = len(self.samples)
+                for i, sample in enumerate(self.samples):
+                    if (sample['boot_id'], sample['timestamp']) > (boot_id, timestamp):
+                        start = i
+                        break
+            pending = self.samples[start:]
+        block, count = encode_block(pending)
+        return block, count, pending[count - 1] if count else None, len(pending) - count
+
+
+def make_handler(node, fail_every):
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            url = urlparse(self.path)
+            if url.path != '/api/v1/history/delta':
+                self.send_error(404)
+                return
+            node.requests += 1
+            if fail_every and node.requests % fail_every == 0:
+                self.send_error(503)
+                return
+            query = {k: v[0] for k, v in parse_qs(url.query).items()}
+            try:
+                if 'boot' in query and 'ts' in query:
+                    block, count, last, remaining = node.delta(int(query['boot']), int(query['ts']), None)
+                else:
+                    block, count, last, remaining = node.delta(0, 0, int(query['tail']))
+            except (KeyError, ValueError):
+                self.send_error(400, 'Pass a boot and ts cursor, or tail')
+                return
+            self.send_response(200 if count else 204)
+            self.send_header('X-RaptMate-Device', node.device_id)
+            self.send_header('X-RaptMate-Remaining', str(remaining))
+            if count:
+                self.send_header('X-RaptMate-Cursor', '%d:%d' % (last['boot_id'], last['timestamp']))
+                self.send_header('Content-Type', CONTENT_TYPE)
+            self.send_header('Content-Length', str(len(block) if count else 0))
+            self.end_headers()
+            if count:
+                self.wfile.write(block)
+            print('%s: %d samples, %d remaining' % (node.device_id, count, remaining))
+
+        def log_message(self, *unused):
+            pass
+
+    # The collector keeps its connection open across the batches of a pull.
+    Handler.protocol_version = 'HTTP/1.1'
+    return Handler
+
+
+def advertise(nodes):
+    try:
+        from zeroconf import ServiceInfo, Zeroconf
+    except ImportError:
+        sys.exit('zeroconf is required for --mdns: pip install zeroconf')
+    address = socket.inet_aton(socket.gethostbyname(socket.gethostname()))
+    zeroconf = Zeroconf()
+    for node in nodes:
+        name = 'RaptMate %s' % node.device_id[-6:]
+        zeroconf.register_service(ServiceInfo(
+            '_raptmate._tcp.local.', '%s._raptmate._tcp.local.' % name,
+            addresses=[address], port=node.port,
+            properties={'id': node.device_id, 'api': '1', 'role': 'node'},
+            server='raptmate-%s.local.' % node.device_id[-6:]))
+    return zeroconf
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--count', type=int, default=4)
+    parser.add_argument('--base-port', type=int, default=8081)
+    parser.add_argument('--interval', type=int, default=5, help='seconds between samples')
+    parser.add_argument('--backlog', type=int, default=600, help='samples recorded before start')
+    parser.add_argument('--fail-every', type=int, default=0, help='answer every Nth request with 503')
+    parser.add_argument('--mdns', action='store_true', help='advertise the nodes as _raptmate._tcp')
+    args = parser.parse_args()
+
+    nodes = [Node(i, args.base_port + i, args.interval, args.backlog) for i in range(args.count)]
+    for node in nodes:
+        server = ThreadingHTTPServer(('', node.port), make_handler(node, args.fail_every))
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+    if args.mdns:
+        advertise(nodes)
+
+    host = socket.gethostbyname(socket.gethostname())
+    peers = ','.join('%s:%d' % (host, node.port) for node in nodes)
+    print('Serving %d nodes; enable collector mode with:' % len(nodes))
+    print('  curl -X PATCH http://<collector>/api/v1/settings -d \'{"collector": {"enabled": true, "peers": "%s"}}\''
+          % peers)
+
+    next_sample = time.time()
+    while True:
+        next_sample += args.interval
+        time.sleep(max(0.0, next_sample - time.time()))
+        for node in nodes:
+            node.record(int(next_sample))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,169 @@
+"""Gorilla block format shared by the RaptMate history, uplink and peer API.
+
+See main/common/Gorilla.hpp for the layout. Samples are dicts with boot_id,
+timestamp and one key per channel.
+"""
+
+import struct
+
+BLOCK_BYTES = 1000
+BLOCK_MAX_SAMPLES = 256
+BLOCK_VERSION = 1
+CHANNELS = ('gravity_velocity', 'temperature', 'specific_gravity', 'accel_x', 'accel_y', 'accel_z', 'battery')
+
+
+class BitReader:
+    def __init__(self, data, bit_pos):
+        self.data = data
+        self.pos = bit_pos
+
+    def read(self, bits):
+        value = 0
+        for _ in range(bits):
+            if self.pos >= len(self.data) * 8:
+                raise ValueError('truncated block')
+            value = (value << 1) | ((self.data[self.pos // 8] >> (7 - self.pos % 8)) & 1)
+            self.pos += 1
+        return value
+
+
+def signed64(value):
+    return value - (1 << 64) if value & (1 << 63) else value
+
+
+def decode_block(data):
+    """Return the samples of a block as dicts with boot_id, timestamp and the channels."""
+    if len(data) < 4 or data[0] != BLOCK_VERSION:
+        raise ValueError('not a Gorilla block')
+    count = struct.unpack_from('<H', data, 2)[0]
+    reader = BitReader(data, 32)
+    values = [0] * len(CHANNELS)
+    leading = [0] * len(CHANNELS)
+    trailing = [0] * len(CHANNELS)
+    boot_id = timestamp = delta = 0
+    samples = []
+    for index in range(count):
+        if index == 0 or reader.read(1):
+            boot_id = reader.read(32)
+            timestamp = signed64(reader.read(64))
+            delta = 0
+            if index == 0:
+                values = [reader.read(32) for _ in CHANNELS]
+        else:
+            if not reader.read(1):
+                dod = 0
+            elif not reader.read(1):
+                dod = reader.read(7) - 63
+            elif not reader.read(1):
+                dod = reader.read(9) - 255
+            elif not reader.read(1):
+                dod = reader.read(12) - 2047
+            else:
+                dod = signed64(reader.read(64))
+            delta += dod
+            timestamp += delta
+        if index > 0:
+            for c in range(len(CHANNELS)):
+                if reader.read(1):
+                    if reader.read(1):
+                        leading[c] = reader.read(5)
+                        meaningful = reader.read(5) + 1
+                        trailing[c] = 32 - leading[c] - meaningful
+                    else:
+                        meaningful = 32 - leading[c] - trailing[c]
+                    values[c] ^= reader.read(meaningful) << trailing[c]
+        sample = {'boot_id': boot_id, 'timestamp': timestamp}
+        for c, name in enumerate(CHANNELS):
+            sample[name] = struct.unpack('<f', struct.pack('<I', values[c]))[0]
+        samples.append(sample)
+    return samples
+
+
+class BitWriter:
+    def __init__(self, capacity):
+        self.data = bytearray(capacity)
+        self.pos = 32
+
+    def write(self, value, bits):
+        if self.pos + bits > len(self.data) * 8:
+            raise OverflowError
+        for i in range(bits - 1, -1, -1):
+            if (value >> i) & 1:
+                self.data[self.pos // 8] |= 0x80 >> (self.pos % 8)
+            self.pos += 1
+
+
+def float_bits(value):
+    return struct.unpack('<I', struct.pack('<f', value))[0]
+
+
+def encode_block(samples, capacity=BLOCK_BYTES):
+    """Encode as many leading samples as fit in one block; return (block bytes, samples encoded)."""
+    writer = BitWriter(capacity)
+    values = [0] * len(CHANNELS)
+    leading = [None] * len(CHANNELS)
+    trailing = [0] * len(CHANNELS)
+    boot_id = timestamp = delta = 0
+    count = 0
+    for sample in samples[:BLOCK_MAX_SAMPLES]:
+        saved = (bytearray(writer.data), writer.pos, values[:], leading[:], trailing[:], boot_id, timestamp, delta)
+        try:
+            if count == 0 or sample['boot_id'] != boot_id:
+                if count:
+                    writer.write(1, 1)
+                boot_id = sample['boot_id']
+                timestamp = sample['timestamp']
+                delta = 0
+                writer.write(boot_id, 32)
+                writer.write(timestamp & (1 << 64) - 1, 64)
+            else:
+                writer.write(0, 1)
+                new_delta = sample['timestamp'] - timestamp
+                dod = new_delta - delta
+                if dod == 0:
+                    writer.write(0, 1)
+                elif -63 <= dod <= 64:
+                    writer.write(0b10, 2)
+                    writer.write(dod + 63, 7)
+                elif -255 <= dod <= 256:
+                    writer.write(0b110, 3)
+                    writer.write(dod + 255, 9)
+                elif -2047 <= dod <= 2048:
+                    writer.write(0b1110, 4)
+                    writer.write(dod + 2047, 12)
+                else:
+                    writer.write(0b1111, 4)
+                    writer.write(dod & (1 << 64) - 1, 64)
+                delta = new_delta
+                timestamp = sample['timestamp']
+            for c, name in enumerate(CHANNELS):
+                bits = float_bits(sample[name])
+                if count == 0:
+                    values[c] = bits
+                    writer.write(bits, 32)
+                    continue
+                x = bits ^ values[c]
+                values[c] = bits
+                if x == 0:
+                    writer.write(0, 1)
+                    continue
+                lead = min(32 - x.bit_length(), 31)
+                trail = (x & -x).bit_length() - 1
+                if leading[c] is not None and lead >= leading[c] and trail >= trailing[c]:
+                    writer.write(0b10, 2)
+                    writer.write(x >> trailing[c], 32 - leading[c] - trailing[c])
+                    continue
+                meaningful = 32 - lead - trail
+                writer.write(0b11, 2)
+                writer.write(lead, 5)
+                writer.write(meaningful - 1, 5)
+                writer.write(x >> trail, meaningful)
+                leading[c] = lead
+                trailing[c] = trail
+        except OverflowError:
+            writer.data, writer.pos, values, leading, trailing, boot_id, timestamp, delta = saved
+            break
+        count += 1
+    writer.data[0] = BLOCK_VERSION
+    struct.pack_into('<H', writer.data, 2, count)
+    return bytes(writer.data[:(writer.pos + 7) // 8]), count
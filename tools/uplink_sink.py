@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Receive and decode RaptMate uplink batches, for testing the publisher locally.
+
+Each batch is one Gorilla block as described in main/common/Gorilla.hpp.
+Samples with boot id 0 carry unix seconds; any other boot id means seconds
+since that boot, for boots whose wall time the device never learned.
+
+Usage:
+  uplink_sink.py http [--port 8080] [--csv out.csv] [--fail-every N]
+      Stub webhook: point the device at http://<host>:8080/ (mode "http").
+  uplink_sink.py mqtt <broker host> [--port 1883] [--topic raptmate/history] [--csv out.csv]
+      Subscribe to a broker such as a local mosquitto (needs paho-mqtt).
+  uplink_sink.py decode <file>...
+      Decode saved batches, e.g. from `mosquitto_sub -t raptmate/history -C 1 > batch.bin`.
+
+Every batch is reported with its size. A batch arriving within a second of the
+previous one counts towards the catch-up rate in samples per second.
+"""
+
+import argparse
+import csv
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+from gorilla_block import CHANNELS, decode_block
+
+class Sink:
+    def __init__(self, csv_path):
+        self.writer = None
+        if csv_path:
+            self.csv_file = open(csv_path, 'a', newline='')
+            self.writer = csv.writer(self.csv_file)
+        self.seen = set()
+        self.total = 0
+        self.duplicates = 0
+        self.last_arrival = None
+        self.burst_samples = 0
+        self.burst_seconds = 0.0
+
+    def batch(self, data, source=''):
+        arrival = time.monotonic()
+        samples = decode_block(data)
+        duplicates = 0
+        for sample in samples:
+            key = (sample['boot_id'], sample['timestamp'])
+            if key in self.seen:
+                duplicates += 1
+                continue
+            self.seen.add(key)
+            if self.writer:
+                self.writer.writerow([sample['boot_id'], sample['timestamp']] + [sample[n] for n in CHANNELS])
+        if self.writer:
+            self.csv_file.flush()
+        self.total += len(samples) - duplicates
+        self.duplicates += duplicates
+
+        rate = ''
+        if self.last_arrival is not None and arrival - self.last_arrival < 1.0:
+            self.burst_samples += len(samples)
+            self.burst_seconds += arrival - self.last_arrival
+            if self.burst_seconds > 0:
+                rate = ', catch-up %.0f samples/s' % (self.burst_samples / self.burst_seconds)
+        self.last_arrival = arrival
+
+        span = ''
+        if samples:
+            span = ' %d/%d..%d/%d' % (samples[0]['boot_id'], samples[0]['timestamp'],
+                                      samples[-1]['boot_id'], samples[-1]['timestamp'])
+        print('%s%d samples in %d bytes (%.2f bytes/sample)%s, %d duplicates, %d total%s' % (
+            source, len(samples), len(data), len(data) / max(len(samples), 1), span, duplicates, self.total, rate))
+        sys.stdout.flush()
+
+
+def serve_http(args, sink):
+    fail = {'count': 0}
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+            fail['count'] += 1
+            if args.fail_every and fail['count'] % args.fail_every == 0:
+                # Exercise the device's backoff and retry.
+                self.send_response(503)
+                self.send_header('Content-Length', '0')
+                self.end_headers()
+                print('Rejected a batch on purpose')
+                return
+            try:
+                sink.batch(body, '[%s] ' % self.headers.get('X-RaptMate-Device', '?'))
+            except ValueError as e:
+                self.send_response(400)
+                self.send_header('Content-Length', '0')
+                self.end_headers()
+                print('Bad batch: %s' % e)
+                return
+            self.send_response(204)
+            self.end_headers()
+
+        def log_message(self, *unused):
+            pass
+
+    # HTTP/1.1 keeps the device's connection open across a catch-up.
+    Handler.protocol_version = 'HTTP/1.1'
+    print('Listening on port %d' % args.port)
+    HTTPServer(('', args.port), Handler).serve_forever()
+
+
+def serve_mqtt(args, sink):
+    try:
+        import paho.mqtt.client as mqtt
+    except ImportError:
+        sys.exit('paho-mqtt is required: pip install paho-mqtt')
+
+    def on_message(client, userdata, message):
+        sink.batch(message.payload, '[%s] ' % message.topic)
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(args.topic, qos=1)
+    print('Subscribed to %s on %s:%d' % (args.topic, args.host, args.port))
+    client.loop_forever()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+    http = commands.add_parser('http')
+    http.add_argument('--port', type=int, default=8080)
+    http.add_argument('--csv')
+    http.add_argument('--fail-every', type=int, default=0, help='answer every Nth batch with 503')
+    broker = commands.add_parser('mqtt')
+    broker.add_argument('host')
+    broker.add_argument('--port', type=int, default=1883)
+    broker.add_argument('--topic', default='raptmate/history')
+    broker.add_argument('--csv')
+    decode = commands.add_parser('decode')
+    decode.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    if args.command == 'decode':
+        for path in args.files:
+            with open(path, 'rb') as f:
+                data = f.read()
+            for sample in decode_block(data):
+                print('%d,%d,%s' % (sample['boot_id'], sample['timestamp'],
+                                    ','.join('%.4f' % sample[n] for n in CHANNELS)))
+        return
+    sink = Sink(args.csv)
+    if args.command == 'http':
+        serve_http(args, sink)
+    else:
+        serve_mqtt(args, sink)
+
+
+if __name__ == '__main__':
+    main()